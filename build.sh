@@ -91,6 +91,7 @@ build_project() {
     echo "  - bin/server         (Server application)"
     echo "  - bin/admin_client   (Admin client)"
     echo "  - bin/client         (Regular client)"
+    echo "  - bin/bench          (Load generator)"
     echo "  - bin/client.py      (Python client)"
     
     cd "$SOURCE_DIR"
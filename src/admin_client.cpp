@@ -13,13 +13,15 @@
  * course.
  */
 
-#include <arpa/inet.h>
-#include <cstring>
+#include <cctype>
+#include <cstdint>
 #include <iostream>
+#include <poll.h>
 #include <string>
-#include <sys/socket.h>
 #include <unistd.h>
 
+#include "cce_client.h"
+
 /** @def SERVER_IP
  * @brief Default server IP address
  */
@@ -28,12 +30,7 @@
 /** @def ADMIN_PORT
  * @brief Admin server port (must match server configuration)
  */
-#define ADMIN_PORT 8081
-
-/** @def BUFFER_SIZE
- * @brief Maximum buffer size for network communications
- */
-#define BUFFER_SIZE 4096
+#define ADMIN_PORT CCE_ADMIN_PORT
 
 /**
  * @class AdminClient
@@ -46,32 +43,89 @@
 
 class AdminClient {
 private:
-  int sock;                     /**< Socket file descriptor */
-  struct sockaddr_in serv_addr; /**< Server address structure */
+  cce::Connection conn; /**< Connection to the admin port */
+  uint32_t next_job_id; /**< Identifier of the next command */
 
-public:
   /**
-   * @brief Default constructor
+   * @brief Send one frame
    *
-   * Initializes the AdminClient with invalid socket descriptor.
+   * @param type frame_type_t
+   * @param payload Payload bytes
+   * @return true on success
    */
-  AdminClient() : sock(-1) {}
+  bool send_frame(uint8_t type, const std::string &payload) {
+    return conn.send_frame(type, 0, next_job_id++, payload);
+  }
 
-  bool connect_to_server() {
-    if ((sock = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
-      std::cerr << "Socket creation error" << std::endl;
-      return false;
+  /**
+   * @brief Check whether a LOGS command asks to follow the log
+   *
+   * @param command Command text
+   * @return true if one of its words is FOLLOW
+   */
+  static bool is_follow(const std::string &command) {
+    std::string upper(command);
+    for (size_t i = 0; i < upper.size(); i++) {
+      upper[i] = static_cast<char>(
+          std::toupper(static_cast<unsigned char>(upper[i])));
     }
+    size_t grep = upper.find(" GREP ");
+    size_t found = upper.find(" FOLLOW");
+    return found != std::string::npos && found < grep &&
+           (found + 7 == upper.size() || upper[found + 7] == ' ');
+  }
 
-    serv_addr.sin_family = AF_INET;
-    serv_addr.sin_port = htons(ADMIN_PORT);
+  /**
+   * @brief Print log lines as the server sends them
+   *
+   * Called after a LOGS ... FOLLOW command was sent. Pressing Enter sends
+   * "LOGS STOP"; the server answers with the frame that ends the stream.
+   */
+  void follow_log() {
+    bool stopping = false;
+    std::cout << "Following the log, press Enter to stop" << std::endl;
 
-    if (inet_pton(AF_INET, SERVER_IP, &serv_addr.sin_addr) <= 0) {
-      std::cerr << "Invalid address/ Address not supported" << std::endl;
-      return false;
+    while (true) {
+      struct pollfd fds[2] = {{conn.fd(), POLLIN, 0},
+                              {STDIN_FILENO, POLLIN, 0}};
+      if (poll(fds, stopping ? 1 : 2, -1) < 0) {
+        std::cerr << "poll failed" << std::endl;
+        return;
+      }
+      if (!stopping && (fds[1].revents & (POLLIN | POLLHUP))) {
+        std::string line;
+        std::getline(std::cin, line);
+        if (!send_frame(FRAME_COMMAND, "LOGS STOP")) {
+          std::cerr << "Send failed" << std::endl;
+          return;
+        }
+        stopping = true;
+      }
+      if (fds[0].revents) {
+        frame_header_t header;
+        std::string payload;
+        if (!conn.recv_frame(header, payload)) {
+          std::cerr << "Connection to server lost" << std::endl;
+          return;
+        }
+        std::cout << payload << std::flush;
+        if (header.type != FRAME_REPLY || !(header.flags & FRAME_FLAG_MORE)) {
+          return;
+        }
+      }
     }
+  }
 
-    if (connect(sock, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) < 0) {
+public:
+  /**
+   * @brief Default constructor
+   *
+   * Initializes the AdminClient without a connection.
+   */
+  AdminClient() : next_job_id(1) {}
+
+  bool connect_to_server() {
+    if (!conn.open(SERVER_IP, ADMIN_PORT)) {
       std::cerr << "Connection Failed" << std::endl;
       return false;
     }
@@ -90,22 +144,44 @@ public:
    *
    * @details Supported commands:
    * - "STATUS": Get server statistics
-   * - "LOGS": View server logs
-   * - "SHUTDOWN": Shutdown server
+   * - "LOGS [offset]": View server logs (negative offset: the last bytes)
+   * - "LOGS [TAIL n] [LEVEL l] [SINCE t] [UNTIL t] [FOLLOW] [GREP text]":
+   *   View matching log lines; with FOLLOW new lines are printed as they
+   *   are written until Enter is pressed
+   * - "CLASSES": View priority classes and tenant weights
+   * - "CLASS <name> <queue> <running>": Adjust a priority class
+   * - "WEIGHT <address> <weight>": Set a client's fair share
+   * - "SHUTDOWN [seconds|NOW]": Drain and stop the server
    * - "QUIT": Disconnect from server
    */
   void send_command(const std::string &command) {
-    if (send(sock, command.c_str(), command.length(), 0) < 0) {
+    if (command == "QUIT") {
+      send_frame(FRAME_QUIT, "");
+      return;
+    }
+    if (!send_frame(FRAME_COMMAND, command)) {
       std::cerr << "Send failed" << std::endl;
       return;
     }
 
-    char buffer[BUFFER_SIZE] = {0};
-    int bytes_received = recv(sock, buffer, BUFFER_SIZE - 1, 0);
-
-    if (bytes_received > 0) {
-      std::cout << "Server response:\n" << buffer << std::endl;
+    if (command.compare(0, 5, "LOGS ") == 0 && is_follow(command)) {
+      follow_log();
+      return;
     }
+
+    // Collect REPLY frames until one without FRAME_FLAG_MORE
+    std::string response;
+    frame_header_t header;
+    do {
+      std::string payload;
+      if (!conn.recv_frame(header, payload)) {
+        std::cerr << "Connection to server lost" << std::endl;
+        return;
+      }
+      response += payload;
+    } while (header.type == FRAME_REPLY && (header.flags & FRAME_FLAG_MORE));
+
+    std::cout << "Server response:\n" << response << std::endl;
   }
 
   /**
@@ -130,8 +206,25 @@ public:
     std::string command;
     std::cout << "\nAdmin Client - Available commands:" << std::endl;
     std::cout << "STATUS  - Get server statistics" << std::endl;
-    std::cout << "LOGS    - View server logs" << std::endl;
-    std::cout << "SHUTDOWN- Shutdown the server" << std::endl;
+    std::cout << "LOGS [offset]" << std::endl
+              << "        - View server logs, from a byte offset or, if it "
+                 "is negative, the end" << std::endl;
+    std::cout << "LOGS [TAIL n] [LEVEL info|warn|error] [SINCE t] [UNTIL t] "
+                 "[FOLLOW] [GREP text]" << std::endl
+              << "        - View matching log lines; t is seconds, -15m, "
+                 "HH:MM or" << std::endl
+              << "          YYYY-MM-DDTHH:MM. FOLLOW prints new lines until "
+                 "Enter" << std::endl;
+    std::cout << "CLASSES - View priority classes and tenant weights"
+              << std::endl;
+    std::cout << "CLASS <interactive|batch> <queue> <running>" << std::endl
+              << "        - Adjust a priority class" << std::endl;
+    std::cout << "WEIGHT <address> <weight>" << std::endl
+              << "        - Set a client's fair share (1 is the default)"
+              << std::endl;
+    std::cout << "SHUTDOWN [seconds|NOW]" << std::endl
+              << "        - Stop the server once its jobs finish or the "
+                 "deadline passes" << std::endl;
     std::cout << "QUIT    - Disconnect from server" << std::endl;
     std::cout << "exit    - Exit this client" << std::endl;
 
@@ -148,10 +241,16 @@ public:
         break;
       }
 
-      if (command == "STATUS" || command == "LOGS" || command == "SHUTDOWN") {
+      bool shutdown = command == "SHUTDOWN" ||
+                      command.compare(0, 9, "SHUTDOWN ") == 0;
+
+      if (command == "STATUS" || command == "LOGS" || shutdown ||
+          command.compare(0, 5, "LOGS ") == 0 ||
+          command == "CLASSES" || command.compare(0, 6, "CLASS ") == 0 ||
+          command.compare(0, 7, "WEIGHT ") == 0) {
         send_command(command);
 
-        if (command == "SHUTDOWN") {
+        if (shutdown) {
           std::cout << "Server shutdown initiated." << std::endl;
           break;
         }
@@ -159,25 +258,15 @@ public:
         continue;
       } else {
         std::cout
-            << "Unknown command. Available: STATUS, LOGS, SHUTDOWN, QUIT, exit"
+            << "Unknown command. Available: STATUS, LOGS, CLASSES, CLASS, "
+               "WEIGHT, SHUTDOWN, QUIT, exit"
             << std::endl;
       }
     }
 
-    close(sock);
+    conn.close();
     std::cout << "Disconnected from server." << std::endl;
   }
-
-  /**
-   * @brief Destructor
-   *
-   * Ensures socket is properly closed when object is destroyed.
-   */
-  ~AdminClient() {
-    if (sock >= 0) {
-      close(sock);
-    }
-  }
 };
 
 /**
@@ -0,0 +1,802 @@
+/**
+ * @file bench.cpp
+ * @brief Load generator and benchmark for Code Compiler & Executor Server
+ * @author Rares-Nicholas Popa & Adrian-Petru Enache
+ * @version 1.0.0
+ *
+ * @details Opens several connections to the regular port and replays a
+ * corpus of C programs over them, either closed-loop (every connection
+ * keeps a fixed number of submissions in flight) or open-loop at a target
+ * rate. At the end it reports throughput, latency percentiles and how
+ * many requests failed, were refused with BUSY or hit a protocol or
+ * connection error.
+ *
+ * In open-loop mode the latency of a request is measured from the moment
+ * it was due, not from when it could be sent, so a server that falls
+ * behind shows up in the percentiles instead of silently lowering the
+ * offered load.
+ *
+ * @copyright This project is for educational purposes as part of the PCD
+ * course.
+ */
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sstream>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "protocol.h"
+
+/** @def SERVER_IP
+ * @brief Default server address
+ */
+#define SERVER_IP "127.0.0.1"
+
+/** @def PORT
+ * @brief Default regular client port (must match server configuration)
+ */
+#define PORT 8080
+
+/** @def DEFAULT_CONNECTIONS
+ * @brief Default number of concurrent connections
+ */
+#define DEFAULT_CONNECTIONS 8
+
+/** @def DEFAULT_REQUESTS
+ * @brief Default number of submissions when no duration is given
+ */
+#define DEFAULT_REQUESTS 200
+
+/** @def SOURCE_SUFFIX
+ * @brief Extension of the corpus files taken from a directory
+ */
+#define SOURCE_SUFFIX ".c"
+
+/** @def SAMPLE_PROGRAM
+ * @brief Program replayed when no corpus is given
+ */
+#define SAMPLE_PROGRAM                                                         \
+  "#include <stdio.h>\n"                                                       \
+  "int main(void) {\n"                                                         \
+  "  long sum = 0;\n"                                                          \
+  "  for (int i = 1; i <= 1000; i++) sum += i;\n"                              \
+  "  printf(\"%ld\\n\", sum);\n"                                               \
+  "  return 0;\n"                                                              \
+  "}\n"
+
+/** @brief Clock used for every measurement */
+typedef std::chrono::steady_clock Clock;
+
+/**
+ * @struct Program
+ * @brief One corpus entry
+ */
+struct Program {
+  std::string name;   /**< File name shown in errors */
+  std::string source; /**< C source code */
+};
+
+/**
+ * @struct BenchOptions
+ * @brief What to run and how hard
+ */
+struct BenchOptions {
+  std::string host;         /**< Server address */
+  unsigned port;            /**< Regular client port */
+  unsigned connections;     /**< Concurrent connections */
+  unsigned depth;           /**< Submissions in flight per connection */
+  uint64_t requests;        /**< Submissions to send, 0 for no limit */
+  double duration_s;        /**< Run time limit, 0 for none */
+  double rate;              /**< Open-loop submissions per second, 0 for
+                                 closed loop */
+  bool nocache;             /**< Set FRAME_FLAG_NOCACHE */
+  bool unique;              /**< Make every source distinct */
+  std::string profile;      /**< Compiler profile, "" for the default */
+  std::vector<Program> corpus; /**< Programs replayed round-robin */
+};
+
+/**
+ * @struct Tally
+ * @brief Outcomes counted by one connection
+ */
+struct Tally {
+  uint64_t passed;                /**< RESULT with exit code 0 */
+  uint64_t failed;                /**< RESULT of a program that failed */
+  uint64_t busy;                  /**< Refused with BUSY */
+  uint64_t errors;                /**< ERROR frames and lost requests */
+  bool connect_failed;            /**< The connection never opened */
+  std::vector<uint64_t> latency_us; /**< Latency of every reply */
+  Tally() : passed(0), failed(0), busy(0), errors(0), connect_failed(false) {}
+};
+
+/**
+ * @brief Submissions handed out to the connections, in order
+ *
+ * Each ticket is one submission: it selects the corpus entry and, in
+ * open-loop mode, the time it is due.
+ */
+class Schedule {
+  const BenchOptions &options; /**< Limits and rate */
+  Clock::time_point start;     /**< Time of ticket 0 */
+  std::atomic<uint64_t> next;  /**< Next ticket to hand out */
+
+public:
+  /**
+   * @brief Start the schedule now
+   *
+   * @param options Limits and rate
+   */
+  explicit Schedule(const BenchOptions &options)
+      : options(options), start(Clock::now()), next(0) {}
+
+  /**
+   * @brief Take the next ticket
+   *
+   * @param ticket Receives the ticket
+   * @return false once the request count or the duration is used up
+   */
+  bool take(uint64_t &ticket) {
+    ticket = next.fetch_add(1);
+    if (options.requests > 0 && ticket >= options.requests) {
+      return false;
+    }
+    if (options.duration_s <= 0) {
+      return true;
+    }
+    // Open loop: the offered load ends with the last ticket due in time
+    return options.rate > 0 ? ticket / options.rate < options.duration_s
+                            : seconds_since_start() < options.duration_s;
+  }
+
+  /**
+   * @brief When a ticket should be sent
+   *
+   * @param ticket Ticket from take()
+   * @return Due time (the start for closed-loop runs)
+   */
+  Clock::time_point due(uint64_t ticket) const {
+    if (options.rate <= 0) {
+      return start;
+    }
+    return start + std::chrono::duration_cast<Clock::duration>(
+                       std::chrono::duration<double>(ticket / options.rate));
+  }
+
+  /**
+   * @brief Time elapsed since the schedule started
+   *
+   * @return Seconds
+   */
+  double seconds_since_start() const {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+  }
+};
+
+/**
+ * @class BenchConnection
+ * @brief One connection replaying tickets from the shared schedule
+ */
+class BenchConnection {
+  const BenchOptions &options; /**< Run parameters */
+  Schedule &schedule;          /**< Shared ticket source */
+  Tally &tally;                /**< Receives the outcomes */
+  int sock;                    /**< Socket descriptor */
+  uint32_t next_job_id;        /**< Identifier of the next submission */
+  std::map<uint32_t, Clock::time_point> in_flight; /**< Job id -> start */
+
+  /**
+   * @brief Write a whole buffer to the socket
+   *
+   * @param data Bytes to send
+   * @param len Number of bytes
+   * @return true on success, false if the connection failed
+   */
+  bool send_all(const void *data, size_t len) {
+    const char *bytes = static_cast<const char *>(data);
+    while (len > 0) {
+      ssize_t n = send(sock, bytes, len, MSG_NOSIGNAL);
+      if (n <= 0) {
+        return false;
+      }
+      bytes += n;
+      len -= static_cast<size_t>(n);
+    }
+    return true;
+  }
+
+  /**
+   * @brief Read exactly len bytes from the socket
+   *
+   * @param data Destination buffer
+   * @param len Number of bytes
+   * @return true on success, false if the connection closed or failed
+   */
+  bool recv_all(void *data, size_t len) {
+    char *bytes = static_cast<char *>(data);
+    while (len > 0) {
+      ssize_t n = recv(sock, bytes, len, 0);
+      if (n <= 0) {
+        return false;
+      }
+      bytes += n;
+      len -= static_cast<size_t>(n);
+    }
+    return true;
+  }
+
+  /**
+   * @brief Send one frame
+   *
+   * @param type frame_type_t
+   * @param flags FRAME_FLAG_*
+   * @param job_id Request identifier
+   * @param payload Payload bytes
+   * @return true on success
+   */
+  bool send_frame(uint8_t type, uint16_t flags, uint32_t job_id,
+                  const std::string &payload) {
+    uint8_t header[FRAME_HEADER_SIZE];
+    frame_encode_header(header, type, flags, job_id,
+                        static_cast<uint32_t>(payload.size()));
+    // One write per frame, so the measurement never waits on Nagle
+    std::string frame(reinterpret_cast<char *>(header), sizeof(header));
+    frame += payload;
+    return send_all(frame.data(), frame.size());
+  }
+
+  /**
+   * @brief Append one field to a SUBMIT payload, sending full frames
+   *
+   * @param payload Frame being filled, updated
+   * @param flags FRAME_FLAG_* of every frame
+   * @param job_id Request identifier
+   * @param tag field_tag_t
+   * @param value Field value (split over frames if needed)
+   * @return true on success
+   */
+  bool add_field(std::string &payload, uint16_t flags, uint32_t job_id,
+                 uint16_t tag, const std::string &value) {
+    size_t offset = 0;
+    do {
+      if (payload.size() + FIELD_HEADER_SIZE >= FRAME_MAX_PAYLOAD) {
+        if (!send_frame(FRAME_SUBMIT, flags | FRAME_FLAG_MORE, job_id,
+                        payload)) {
+          return false;
+        }
+        payload.clear();
+      }
+      size_t room = FRAME_MAX_PAYLOAD - FIELD_HEADER_SIZE - payload.size();
+      size_t chunk = std::min(value.size() - offset, room);
+      uint8_t header[FIELD_HEADER_SIZE];
+      field_encode_header(header, tag, static_cast<uint32_t>(chunk));
+      payload.append(reinterpret_cast<char *>(header), sizeof(header));
+      payload.append(value, offset, chunk);
+      offset += chunk;
+    } while (offset < value.size());
+    return true;
+  }
+
+  /**
+   * @brief Submit the corpus entry of a ticket
+   *
+   * @param ticket Ticket from the schedule
+   * @return true on success
+   */
+  bool submit(uint64_t ticket) {
+    const Program &program = options.corpus[ticket % options.corpus.size()];
+    uint16_t flags = options.nocache ? FRAME_FLAG_NOCACHE : 0;
+    uint32_t job_id = next_job_id++;
+    std::string payload;
+    bool sent;
+
+    if (options.unique) {
+      // A trailing comment changes the compile cache key, not the program
+      std::ostringstream source;
+      source << program.source << "\n/* bench " << ticket << " */\n";
+      sent = add_field(payload, flags, job_id, FIELD_SOURCE, source.str());
+    } else {
+      sent = add_field(payload, flags, job_id, FIELD_SOURCE, program.source);
+    }
+    if (sent && !options.profile.empty()) {
+      sent = add_field(payload, flags, job_id, FIELD_PROFILE, options.profile);
+    }
+    if (!sent || !send_frame(FRAME_SUBMIT, flags, job_id, payload)) {
+      return false;
+    }
+    in_flight[job_id] = options.rate > 0 ? schedule.due(ticket) : Clock::now();
+    return true;
+  }
+
+  /**
+   * @brief Read one reply frame and count it if it ends a job
+   *
+   * @return false if the connection failed or the server reported an
+   *         ERROR (it closes the connection after one)
+   */
+  bool receive() {
+    uint8_t raw[FRAME_HEADER_SIZE];
+    frame_header_t header;
+    std::vector<uint8_t> payload;
+
+    if (!recv_all(raw, sizeof(raw)) || frame_decode_header(raw, &header) != 0) {
+      return false;
+    }
+    payload.resize(header.length);
+    if (header.length > 0 && !recv_all(payload.data(), header.length)) {
+      return false;
+    }
+    if (header.type == FRAME_OUTPUT || header.type == FRAME_CASE) {
+      return true;
+    }
+
+    std::map<uint32_t, Clock::time_point>::iterator job =
+        in_flight.find(header.job_id);
+    if (job == in_flight.end()) {
+      return header.type != FRAME_ERROR;
+    }
+    tally.latency_us.push_back(static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() -
+                                                              job->second)
+            .count()));
+    in_flight.erase(job);
+
+    if (header.type == FRAME_BUSY) {
+      tally.busy++;
+    } else if (header.type == FRAME_RESULT) {
+      result_payload_t result;
+      result_decode(payload.data(), payload.size(), &result);
+      if (result.exit_code == 0 && !(result.flags & RESULT_FAILED)) {
+        tally.passed++;
+      } else {
+        tally.failed++;
+      }
+    } else {
+      tally.errors++;
+      return false;
+    }
+    return true;
+  }
+
+public:
+  /**
+   * @brief Prepare a connection
+   *
+   * @param options Run parameters
+   * @param schedule Shared ticket source
+   * @param tally Receives the outcomes
+   */
+  BenchConnection(const BenchOptions &options, Schedule &schedule,
+                  Tally &tally)
+      : options(options), schedule(schedule), tally(tally), sock(-1),
+        next_job_id(1) {}
+
+  /**
+   * @brief Close the socket
+   */
+  ~BenchConnection() {
+    if (sock >= 0) {
+      close(sock);
+    }
+  }
+
+  /**
+   * @brief Connect to the server
+   *
+   * @return true on success
+   */
+  bool open() {
+    struct addrinfo hints, *address;
+    std::ostringstream port;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    port << options.port;
+    if (getaddrinfo(options.host.c_str(), port.str().c_str(), &hints,
+                    &address) != 0) {
+      return false;
+    }
+    sock = socket(address->ai_family, address->ai_socktype,
+                  address->ai_protocol);
+    if (sock >= 0 && connect(sock, address->ai_addr, address->ai_addrlen) < 0) {
+      close(sock);
+      sock = -1;
+    }
+    if (sock >= 0) {
+      int one = 1;
+      setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+    freeaddrinfo(address);
+    return sock >= 0;
+  }
+
+  /**
+   * @brief Replay tickets until the schedule is used up
+   *
+   * Keeps up to options.depth submissions in flight and sends each
+   * open-loop ticket no earlier than it is due. Requests still
+   * unanswered when the connection fails are counted as errors.
+   */
+  void run() {
+    uint64_t ticket = 0;
+    bool have_ticket = false, done = false;
+
+    while (true) {
+      int timeout = -1;
+
+      // Fill the window with the tickets that are due
+      while (!done && in_flight.size() < options.depth) {
+        if (!have_ticket && !(have_ticket = schedule.take(ticket))) {
+          done = true;
+          break;
+        }
+        Clock::time_point due = schedule.due(ticket);
+        if (due > Clock::now()) {
+          timeout = static_cast<int>(
+              std::chrono::duration_cast<std::chrono::milliseconds>(
+                  due - Clock::now())
+                  .count() +
+              1);
+          break;
+        }
+        have_ticket = false;
+        if (!submit(ticket)) {
+          tally.errors += in_flight.size() + 1;
+          return;
+        }
+      }
+      if (done && in_flight.empty()) {
+        break;
+      }
+
+      struct pollfd ready;
+      ready.fd = sock;
+      ready.events = POLLIN;
+      ready.revents = 0;
+      if (poll(&ready, 1, timeout) > 0 &&
+          !receive()) {
+        tally.errors += in_flight.size();
+        return;
+      }
+    }
+    send_frame(FRAME_QUIT, 0, 0, "");
+  }
+};
+
+/**
+ * @brief Read a whole file
+ *
+ * @param path File to read
+ * @param contents Receives the bytes
+ * @return true on success
+ */
+static bool read_file(const std::string &path, std::string &contents) {
+  std::ifstream file(path.c_str(), std::ios::binary);
+  if (!file.is_open()) {
+    return false;
+  }
+  std::stringstream buffer;
+  buffer << file.rdbuf();
+  contents = buffer.str();
+  return true;
+}
+
+/**
+ * @brief Add a file, or every *.c file of a directory, to the corpus
+ *
+ * @param path File or directory
+ * @param corpus Programs, extended in name order
+ * @return true on success
+ */
+static bool load_corpus(const std::string &path,
+                        std::vector<Program> &corpus) {
+  DIR *dir = opendir(path.c_str());
+  std::vector<std::string> names;
+  const std::string suffix = SOURCE_SUFFIX;
+
+  if (!dir) {
+    Program program;
+    program.name = path;
+    if (!read_file(path, program.source)) {
+      return false;
+    }
+    corpus.push_back(program);
+    return true;
+  }
+  while (struct dirent *entry = readdir(dir)) {
+    std::string name = entry->d_name;
+    if (name.size() > suffix.size() &&
+        name.compare(name.size() - suffix.size(), suffix.size(), suffix) ==
+            0) {
+      names.push_back(name);
+    }
+  }
+  closedir(dir);
+  std::sort(names.begin(), names.end());
+  for (size_t i = 0; i < names.size(); i++) {
+    Program program;
+    program.name = path + "/" + names[i];
+    if (!read_file(program.name, program.source)) {
+      return false;
+    }
+    corpus.push_back(program);
+  }
+  return true;
+}
+
+/**
+ * @brief Latency at a percentile
+ *
+ * @param sorted Latencies in ascending order (not empty)
+ * @param percentile Between 0 and 100
+ * @return Latency in milliseconds
+ */
+static double percentile_ms(const std::vector<uint64_t> &sorted,
+                            double percentile) {
+  size_t rank = static_cast<size_t>(percentile / 100.0 * sorted.size());
+  if (rank >= sorted.size()) {
+    rank = sorted.size() - 1;
+  }
+  return sorted[rank] / 1000.0;
+}
+
+/**
+ * @brief Print the command line help
+ *
+ * @param prog Program name
+ */
+static void print_usage(const char *prog) {
+  std::cout
+      << "Usage: " << prog
+      << " [-s host] [-P port] [-c connections] [-d depth] [-n requests]\n"
+         "       [-t seconds] [-r rate] [-o profile] [-N] [-u] "
+         "[file.c|directory]...\n"
+      << "  -s host         Server address (default: " << SERVER_IP << ")\n"
+      << "  -P port         Regular client port (default: " << PORT << ")\n"
+      << "  -c connections  Concurrent connections (default: "
+      << DEFAULT_CONNECTIONS << ")\n"
+      << "  -d depth        Submissions in flight per connection "
+         "(default: 1)\n"
+      << "  -n requests     Submissions to send, 0 for no limit (default: "
+      << DEFAULT_REQUESTS << ", or none with -t)\n"
+      << "  -t seconds      Stop sending after this long\n"
+      << "  -r rate         Open loop: submissions per second over all\n"
+         "                  connections (default: closed loop)\n"
+      << "  -o profile      Compiler profile to request\n"
+      << "  -N              Bypass the server's result cache\n"
+      << "  -u              Make every source unique (cold compile cache)\n"
+      << "Without files a built-in sample program is replayed; a directory\n"
+         "contributes every *.c file in it.\n";
+}
+
+/**
+ * @brief Parse the command line
+ *
+ * @param argc Argument count
+ * @param argv Argument vector
+ * @param options Receives the configuration
+ * @return true on success
+ */
+static bool parse_options(int argc, char **argv, BenchOptions &options) {
+  bool have_requests = false;
+  int opt;
+
+  options.host = SERVER_IP;
+  options.port = PORT;
+  options.connections = DEFAULT_CONNECTIONS;
+  options.depth = 1;
+  options.requests = DEFAULT_REQUESTS;
+  options.duration_s = 0;
+  options.rate = 0;
+  options.nocache = false;
+  options.unique = false;
+
+  while ((opt = getopt(argc, argv, "s:P:c:d:n:t:r:o:Nuh")) != -1) {
+    switch (opt) {
+    case 's':
+      options.host = optarg;
+      break;
+    case 'P':
+      options.port = static_cast<unsigned>(strtoul(optarg, NULL, 10));
+      break;
+    case 'c':
+      options.connections = static_cast<unsigned>(strtoul(optarg, NULL, 10));
+      break;
+    case 'd':
+      options.depth = static_cast<unsigned>(strtoul(optarg, NULL, 10));
+      break;
+    case 'n':
+      options.requests = strtoull(optarg, NULL, 10);
+      have_requests = true;
+      break;
+    case 't':
+      options.duration_s = strtod(optarg, NULL);
+      break;
+    case 'r':
+      options.rate = strtod(optarg, NULL);
+      break;
+    case 'o':
+      options.profile = optarg;
+      break;
+    case 'N':
+      options.nocache = true;
+      break;
+    case 'u':
+      options.unique = true;
+      break;
+    case 'h':
+      print_usage(argv[0]);
+      exit(EXIT_SUCCESS);
+    default:
+      return false;
+    }
+  }
+  if (options.duration_s > 0 && !have_requests) {
+    options.requests = 0;
+  }
+  if (options.connections == 0 || options.depth == 0) {
+    std::cerr << "Connections and depth must be at least 1" << std::endl;
+    return false;
+  }
+  if (options.requests == 0 && options.duration_s <= 0) {
+    std::cerr << "Give a request count or a duration" << std::endl;
+    return false;
+  }
+
+  for (int i = optind; i < argc; i++) {
+    if (!load_corpus(argv[i], options.corpus)) {
+      std::cerr << "Error: Cannot read " << argv[i] << std::endl;
+      return false;
+    }
+  }
+  if (options.corpus.empty()) {
+    if (optind < argc) {
+      std::cerr << "Error: No *.c files in the corpus" << std::endl;
+      return false;
+    }
+    Program sample;
+    sample.name = "sample";
+    sample.source = SAMPLE_PROGRAM;
+    options.corpus.push_back(sample);
+  }
+  return true;
+}
+
+/**
+ * @brief Print the summary of a run
+ *
+ * @param options Run parameters
+ * @param tallies Outcomes of every connection
+ * @param elapsed_s Wall time of the run
+ */
+static void print_report(const BenchOptions &options,
+                         const std::vector<Tally> &tallies, double elapsed_s) {
+  Tally total;
+  size_t connect_failures = 0;
+
+  for (size_t i = 0; i < tallies.size(); i++) {
+    total.passed += tallies[i].passed;
+    total.failed += tallies[i].failed;
+    total.busy += tallies[i].busy;
+    total.errors += tallies[i].errors;
+    connect_failures += tallies[i].connect_failed;
+    total.latency_us.insert(total.latency_us.end(),
+                            tallies[i].latency_us.begin(),
+                            tallies[i].latency_us.end());
+  }
+  std::sort(total.latency_us.begin(), total.latency_us.end());
+  uint64_t replies = total.passed + total.failed + total.busy;
+  uint64_t sent = replies + total.errors;
+
+  std::cout << std::fixed << std::setprecision(2);
+  std::cout << "Corpus: " << options.corpus.size() << " programs, "
+            << options.connections << " connections x " << options.depth
+            << " in flight, ";
+  if (options.rate > 0) {
+    std::cout << "open loop at " << options.rate << "/s" << std::endl;
+  } else {
+    std::cout << "closed loop" << std::endl;
+  }
+  std::cout << "Requests: " << sent << " in " << elapsed_s << " s ("
+            << (elapsed_s > 0 ? replies / elapsed_s : 0) << " replies/s)"
+            << std::endl;
+  std::cout << "Outcomes: " << total.passed << " passed, " << total.failed
+            << " failed, " << total.busy << " busy, " << total.errors
+            << " errors";
+  if (sent > 0) {
+    std::cout << " (" << 100.0 * (total.failed + total.busy + total.errors) /
+                             sent
+              << "% not passed)";
+  }
+  std::cout << std::endl;
+  if (connect_failures > 0) {
+    std::cout << "Connections that could not be opened: " << connect_failures
+              << std::endl;
+  }
+  if (total.latency_us.empty()) {
+    return;
+  }
+
+  uint64_t sum = 0;
+  for (size_t i = 0; i < total.latency_us.size(); i++) {
+    sum += total.latency_us[i];
+  }
+  std::cout << "Latency (ms): mean " << sum / 1000.0 / total.latency_us.size()
+            << ", p50 " << percentile_ms(total.latency_us, 50) << ", p90 "
+            << percentile_ms(total.latency_us, 90) << ", p99 "
+            << percentile_ms(total.latency_us, 99) << ", p99.9 "
+            << percentile_ms(total.latency_us, 99.9) << ", max "
+            << total.latency_us.back() / 1000.0 << std::endl;
+}
+
+/**
+ * @brief Run the benchmark connection of one thread
+ *
+ * @param options Run parameters
+ * @param schedule Shared ticket source
+ * @param tally Receives the outcomes
+ */
+static void run_connection(const BenchOptions *options, Schedule *schedule,
+                           Tally *tally) {
+  BenchConnection connection(*options, *schedule, *tally);
+  if (!connection.open()) {
+    tally->connect_failed = true;
+    return;
+  }
+  connection.run();
+}
+
+/**
+ * @brief Main function
+ *
+ * @param argc Argument count
+ * @param argv Argument vector
+ * @return 0 if every request got a reply, 1 otherwise
+ */
+int main(int argc, char **argv) {
+  BenchOptions options;
+
+  if (!parse_options(argc, argv, options)) {
+    print_usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  std::vector<Tally> tallies(options.connections);
+  std::vector<std::thread> threads;
+  Schedule schedule(options);
+
+  for (unsigned i = 0; i < options.connections; i++) {
+    threads.push_back(
+        std::thread(run_connection, &options, &schedule, &tallies[i]));
+  }
+  for (size_t i = 0; i < threads.size(); i++) {
+    threads[i].join();
+  }
+  double elapsed_s = schedule.seconds_since_start();
+
+  print_report(options, tallies, elapsed_s);
+  for (size_t i = 0; i < tallies.size(); i++) {
+    if (tallies[i].errors > 0 || tallies[i].connect_failed) {
+      return EXIT_FAILURE;
+    }
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,544 @@
+/**
+ * @file cce_client.cpp
+ * @brief Client library for the Code Compiler & Executor Server
+ * @author Rares-Nicholas Popa & Adrian-Petru Enache
+ * @version 1.0.0
+ *
+ * @details A Client runs one reader thread per connection and one sender
+ * thread. The sender takes jobs from the queue in order, admitting new
+ * ones only while fewer than max_in_flight are unanswered, so that the
+ * server's queue is not flooded into BUSY replies. A reader that loses its
+ * connection hands the jobs in flight back to the queue with a delay; the
+ * connection is reopened by the next send. Lock order: a slot's
+ * write_lock, then its lock, then queue_lock; callbacks run with no lock
+ * held.
+ *
+ * @copyright This project is for educational purposes as part of the PCD
+ * course.
+ */
+
+#include "cce_client.h"
+
+#include <algorithm>
+#include <cstring>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sstream>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace cce {
+
+Result::Result() : job_id(0), type(0), result(), retry_ms(0) {
+  result.exit_code = -1;
+}
+
+Connection &Connection::operator=(Connection &&other) {
+  if (this != &other) {
+    close();
+    sock = other.sock;
+    other.sock = -1;
+  }
+  return *this;
+}
+
+bool Connection::open(const std::string &host, uint16_t port) {
+  struct addrinfo hints, *addresses;
+  std::ostringstream service;
+
+  close();
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  service << port;
+  if (getaddrinfo(host.c_str(), service.str().c_str(), &hints, &addresses) !=
+      0) {
+    return false;
+  }
+  for (struct addrinfo *address = addresses; address && sock < 0;
+       address = address->ai_next) {
+    sock = socket(address->ai_family, address->ai_socktype | SOCK_CLOEXEC,
+                  address->ai_protocol);
+    if (sock >= 0 &&
+        connect(sock, address->ai_addr, address->ai_addrlen) < 0) {
+      ::close(sock);
+      sock = -1;
+    }
+  }
+  freeaddrinfo(addresses);
+  if (sock >= 0) {
+    int one = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  }
+  return sock >= 0;
+}
+
+void Connection::close() {
+  if (sock >= 0) {
+    ::close(sock);
+    sock = -1;
+  }
+}
+
+void Connection::hangup() {
+  if (sock >= 0) {
+    shutdown(sock, SHUT_RDWR);
+  }
+}
+
+/**
+ * @brief Write a whole buffer to the socket
+ *
+ * @param data Bytes to send
+ * @param len Number of bytes
+ * @return true on success, false if the connection failed
+ */
+bool Connection::send_all(const void *data, size_t len) {
+  const char *bytes = static_cast<const char *>(data);
+  while (len > 0) {
+    ssize_t n = send(sock, bytes, len, MSG_NOSIGNAL);
+    if (n <= 0) {
+      return false;
+    }
+    bytes += n;
+    len -= static_cast<size_t>(n);
+  }
+  return true;
+}
+
+/**
+ * @brief Read exactly len bytes from the socket
+ *
+ * @param data Destination buffer
+ * @param len Number of bytes
+ * @return true on success, false if the connection closed or failed
+ */
+bool Connection::recv_all(void *data, size_t len) {
+  char *bytes = static_cast<char *>(data);
+  while (len > 0) {
+    ssize_t n = recv(sock, bytes, len, 0);
+    if (n <= 0) {
+      return false;
+    }
+    bytes += n;
+    len -= static_cast<size_t>(n);
+  }
+  return true;
+}
+
+bool Connection::send_frame(uint8_t type, uint16_t flags, uint32_t job_id,
+                            const std::string &payload) {
+  uint8_t header[FRAME_HEADER_SIZE];
+  frame_encode_header(header, type, flags, job_id,
+                      static_cast<uint32_t>(payload.size()));
+  return send_all(header, sizeof(header)) &&
+         send_all(payload.data(), payload.size());
+}
+
+bool Connection::send_submission(uint32_t job_id,
+                                 const Submission &submission) {
+  uint16_t flags = submission.flags;
+  std::string payload;
+
+  payload.reserve(FRAME_MAX_PAYLOAD);
+  for (const Field &field : submission.fields) {
+    size_t offset = 0;
+    do {
+      if (payload.size() + FIELD_HEADER_SIZE >= FRAME_MAX_PAYLOAD) {
+        if (!send_frame(FRAME_SUBMIT, flags | FRAME_FLAG_MORE, job_id,
+                        payload)) {
+          return false;
+        }
+        payload.clear();
+      }
+      size_t room = FRAME_MAX_PAYLOAD - FIELD_HEADER_SIZE - payload.size();
+      size_t chunk = std::min(field.second.size() - offset, room);
+      uint8_t header[FIELD_HEADER_SIZE];
+      field_encode_header(header, field.first, static_cast<uint32_t>(chunk));
+      payload.append(reinterpret_cast<char *>(header), sizeof(header));
+      payload.append(field.second, offset, chunk);
+      offset += chunk;
+    } while (offset < field.second.size());
+  }
+  return send_frame(FRAME_SUBMIT, flags, job_id, payload);
+}
+
+bool Connection::recv_frame(frame_header_t &header, std::string &payload) {
+  uint8_t raw[FRAME_HEADER_SIZE];
+  if (!recv_all(raw, sizeof(raw)) || frame_decode_header(raw, &header) != 0) {
+    return false;
+  }
+  payload.resize(header.length);
+  return header.length == 0 || recv_all(&payload[0], header.length);
+}
+
+bool ReplyAssembler::feed(const frame_header_t &header, std::string &payload,
+                          Result &done) {
+  switch (header.type) {
+  case FRAME_OUTPUT:
+  case FRAME_CASE:
+  case FRAME_TRACE:
+  case FRAME_RESULT:
+  case FRAME_BUSY:
+  case FRAME_ERROR:
+    break;
+  default:
+    return false;
+  }
+
+  Result &reply = partial[header.job_id];
+  if (header.type == FRAME_OUTPUT) {
+    if (reply.output.empty()) {
+      reply.output.swap(payload);
+    } else {
+      reply.output += payload;
+    }
+    return false;
+  }
+  if (header.type == FRAME_CASE) {
+    CaseResult finished;
+    long start = case_decode_header(
+        reinterpret_cast<const uint8_t *>(payload.data()), payload.size(),
+        &finished.index, &finished.result);
+    if (start < 0) {
+      return false;
+    }
+    std::pair<uint32_t, uint32_t> key(header.job_id, finished.index);
+    std::string &output = case_output[key];
+    output.append(payload, static_cast<size_t>(start), std::string::npos);
+    if (header.flags & FRAME_FLAG_MORE) {
+      return false;
+    }
+    finished.output.swap(output);
+    case_output.erase(key);
+    reply.cases.push_back(std::move(finished));
+    return false;
+  }
+  if (header.type == FRAME_TRACE) {
+    reply.trace += payload;
+    return false;
+  }
+
+  reply.job_id = header.job_id;
+  reply.type = header.type;
+  if (header.type == FRAME_RESULT) {
+    result_decode(reinterpret_cast<const uint8_t *>(payload.data()),
+                  payload.size(), &reply.result);
+  } else if (header.type == FRAME_BUSY) {
+    reply.retry_ms =
+        payload.size() >= 4
+            ? protocol_get_u32(reinterpret_cast<const uint8_t *>(
+                  payload.data()))
+            : 0;
+  } else {
+    reply.output.swap(payload);
+  }
+  done = std::move(reply);
+  partial.erase(header.job_id);
+  return true;
+}
+
+void ReplyAssembler::clear() {
+  partial.clear();
+  case_output.clear();
+}
+
+Client::Client(const std::string &host, uint16_t port,
+               const ClientOptions &options)
+    : host(host), port(port), options(options), next_job_id(1), active(0),
+      stopping(false) {
+  if (this->options.connections == 0) {
+    this->options.connections = 1;
+  }
+  if (this->options.max_in_flight == 0) {
+    this->options.max_in_flight =
+        this->options.connections * CCE_PIPELINE_DEPTH;
+  }
+  for (unsigned i = 0; i < this->options.connections; i++) {
+    slots.push_back(std::unique_ptr<Slot>(new Slot()));
+  }
+  for (const std::unique_ptr<Slot> &slot : slots) {
+    slot->reader = std::thread(&Client::read_replies, this, slot.get());
+  }
+  sender = std::thread(&Client::dispatch, this);
+}
+
+Client::~Client() { close(); }
+
+void Client::submit(Submission submission, Callback done) {
+  Job job;
+
+  job.submission = std::move(submission);
+  job.done = std::move(done);
+  {
+    std::lock_guard<std::mutex> guard(queue_lock);
+    if (!stopping) {
+      ready.push_back(std::move(job));
+      wakeup.notify_one();
+      return;
+    }
+  }
+  Result closed;
+  closed.output = "Client closed";
+  finish(job, std::move(closed));
+}
+
+std::future<Result> Client::submit(Submission submission) {
+  std::shared_ptr<std::promise<Result>> reply =
+      std::make_shared<std::promise<Result>>();
+  std::future<Result> future = reply->get_future();
+
+  submit(std::move(submission),
+         [reply](Result &&result) { reply->set_value(std::move(result)); });
+  return future;
+}
+
+void Client::close() {
+  {
+    std::lock_guard<std::mutex> guard(queue_lock);
+    stopping = true;
+  }
+  wakeup.notify_all();
+  if (sender.joinable()) {
+    sender.join();
+  }
+  for (const std::unique_ptr<Slot> &slot : slots) {
+    {
+      std::lock_guard<std::mutex> guard(slot->lock);
+      slot->closing = true;
+      slot->conn.hangup();
+    }
+    slot->opened.notify_all();
+  }
+  for (const std::unique_ptr<Slot> &slot : slots) {
+    if (slot->reader.joinable()) {
+      slot->reader.join();
+    }
+  }
+}
+
+/**
+ * @brief Send the queued jobs (sender thread)
+ *
+ * Runs until close(); the jobs still queued then are finished as failed.
+ */
+void Client::dispatch() {
+  std::unique_lock<std::mutex> guard(queue_lock);
+
+  while (!stopping) {
+    std::chrono::steady_clock::time_point now =
+        std::chrono::steady_clock::now();
+    while (!delayed.empty() && delayed.begin()->first <= now) {
+      ready.push_front(std::move(delayed.begin()->second));
+      delayed.erase(delayed.begin());
+    }
+    if (!ready.empty() &&
+        (ready.front().admitted || active < options.max_in_flight)) {
+      Job job = std::move(ready.front());
+      ready.pop_front();
+      if (!job.admitted) {
+        job.admitted = true;
+        active++;
+      }
+      guard.unlock();
+      send_job(std::move(job));
+      guard.lock();
+    } else if (delayed.empty()) {
+      wakeup.wait(guard);
+    } else {
+      wakeup.wait_until(guard, delayed.begin()->first);
+    }
+  }
+
+  std::deque<Job> left;
+  left.swap(ready);
+  for (std::pair<const std::chrono::steady_clock::time_point, Job> &entry :
+       delayed) {
+    left.push_back(std::move(entry.second));
+  }
+  delayed.clear();
+  guard.unlock();
+  for (Job &job : left) {
+    Result closed;
+    closed.output = "Client closed";
+    finish(job, std::move(closed));
+  }
+}
+
+/**
+ * @brief Send a job on the connection with the fewest in flight
+ *
+ * Opens the connection if it is not open. If the send fails, the
+ * connection is shut down and its reader resubmits what was in flight.
+ *
+ * @param job Admitted job
+ */
+void Client::send_job(Job job) {
+  Slot *slot = NULL;
+  size_t least = 0;
+
+  for (const std::unique_ptr<Slot> &candidate : slots) {
+    std::lock_guard<std::mutex> guard(candidate->lock);
+    if (!slot || candidate->pending.size() < least) {
+      slot = candidate.get();
+      least = candidate->pending.size();
+    }
+  }
+
+  std::lock_guard<std::mutex> write_guard(slot->write_lock);
+  bool open;
+  {
+    std::lock_guard<std::mutex> guard(slot->lock);
+    open = slot->fd_open;
+  }
+  if (!open) {
+    if (!slot->conn.open(host, port)) {
+      lost(std::move(job), "Cannot connect to the server");
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> guard(slot->lock);
+      slot->fd_open = true;
+    }
+    slot->opened.notify_all();
+  }
+
+  uint32_t job_id = next_job_id++;
+  if (job_id == 0) {
+    job_id = next_job_id++;
+  }
+  const Submission *submission;
+  {
+    std::lock_guard<std::mutex> guard(slot->lock);
+    // Map nodes stay put; the reader only takes jobs whose reply came, and
+    // takes them all on loss only under write_lock
+    submission = &slot->pending.insert(std::make_pair(job_id, std::move(job)))
+                      .first->second.submission;
+  }
+  if (!slot->conn.send_submission(job_id, *submission)) {
+    slot->conn.hangup();
+  }
+}
+
+/**
+ * @brief Deliver the replies of one connection (reader thread)
+ *
+ * Waits for the connection to be opened, reads until it is lost, then
+ * closes it and hands the jobs that were in flight to lost().
+ *
+ * @param slot Connection to serve
+ */
+void Client::read_replies(Slot *slot) {
+  ReplyAssembler assembler;
+  frame_header_t header;
+  std::string payload;
+
+  while (true) {
+    {
+      std::unique_lock<std::mutex> guard(slot->lock);
+      slot->opened.wait(guard,
+                        [slot] { return slot->fd_open || slot->closing; });
+      if (slot->closing && !slot->fd_open) {
+        return;
+      }
+    }
+
+    Result done;
+    while (slot->conn.recv_frame(header, payload)) {
+      if (!assembler.feed(header, payload, done)) {
+        continue;
+      }
+      Job job;
+      {
+        std::lock_guard<std::mutex> guard(slot->lock);
+        std::map<uint32_t, Job>::iterator entry =
+            slot->pending.find(done.job_id);
+        if (entry == slot->pending.end()) {
+          continue;
+        }
+        job = std::move(entry->second);
+        slot->pending.erase(entry);
+      }
+      if (done.busy() && job.busy < options.busy_retries) {
+        job.busy++;
+        retry_later(std::move(job), std::max(done.retry_ms, 10u));
+      } else {
+        finish(job, std::move(done));
+      }
+    }
+
+    std::map<uint32_t, Job> orphans;
+    assembler.clear();
+    {
+      std::lock_guard<std::mutex> write_guard(slot->write_lock);
+      std::lock_guard<std::mutex> guard(slot->lock);
+      slot->conn.close();
+      slot->fd_open = false;
+      orphans.swap(slot->pending);
+    }
+    for (std::pair<const uint32_t, Job> &orphan : orphans) {
+      lost(std::move(orphan.second), "Connection to server lost");
+    }
+  }
+}
+
+/**
+ * @brief Resubmit a job whose connection was lost, with a growing delay,
+ * or fail it once its retries are used up
+ *
+ * @param job Job
+ * @param reason Output of the failed Result
+ */
+void Client::lost(Job job, const char *reason) {
+  if (job.lost >= options.retries) {
+    Result failed;
+    failed.output = reason;
+    finish(job, std::move(failed));
+    return;
+  }
+  unsigned delay_ms = options.retry_delay_ms << std::min(job.lost, 16u);
+  job.lost++;
+  retry_later(std::move(job), delay_ms);
+}
+
+/**
+ * @brief Queue an admitted job to be sent again after a delay
+ *
+ * @param job Job
+ * @param delay_ms Delay in milliseconds
+ */
+void Client::retry_later(Job job, unsigned delay_ms) {
+  {
+    std::lock_guard<std::mutex> guard(queue_lock);
+    if (!stopping) {
+      delayed.insert(std::make_pair(std::chrono::steady_clock::now() +
+                                        std::chrono::milliseconds(delay_ms),
+                                    std::move(job)));
+      wakeup.notify_one();
+      return;
+    }
+  }
+  Result closed;
+  closed.output = "Client closed";
+  finish(job, std::move(closed));
+}
+
+/**
+ * @brief Release a job's admission and call its callback
+ *
+ * @param job Job
+ * @param result Its reply
+ */
+void Client::finish(Job &job, Result &&result) {
+  if (job.admitted) {
+    std::lock_guard<std::mutex> guard(queue_lock);
+    active--;
+  }
+  wakeup.notify_one();
+  if (job.done) {
+    job.done(std::move(result));
+  }
+}
+
+} // namespace cce
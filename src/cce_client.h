@@ -0,0 +1,437 @@
+/**
+ * @file cce_client.h
+ * @brief Client library for the Code Compiler & Executor Server
+ * @author Rares-Nicholas Popa & Adrian-Petru Enache
+ * @version 1.0.0
+ *
+ * @details The framing protocol of protocol.h as C++ objects, for the
+ * bundled clients and for services that submit programs themselves:
+ *
+ * - Connection: one blocking socket that sends submissions and commands
+ *   and receives frames, for interactive tools that print frames as they
+ *   arrive
+ * - ReplyAssembler: rebuilds whole replies from the frames of interleaved
+ *   jobs
+ * - Client: asynchronous submissions over a few kept-alive connections:
+ *   submit() returns at once with a future, or calls a callback, when the
+ *   reply is in. Jobs whose connection is lost are sent again on a new one
+ *   and BUSY replies are retried after the server's hint.
+ *
+ * Replies are move-only Result objects: payloads are received straight
+ * into their strings and handed over without copies.
+ *
+ * @code
+ * cce::Client client(CCE_DEFAULT_HOST, CCE_DEFAULT_PORT);
+ * std::future<cce::Result> reply = client.submit(cce::Submission(code));
+ * cce::Result result = reply.get();
+ * @endcode
+ *
+ * @copyright This project is for educational purposes as part of the PCD
+ * course.
+ */
+
+#ifndef CCE_CLIENT_H
+#define CCE_CLIENT_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "protocol.h"
+
+/** @def CCE_DEFAULT_HOST
+ * @brief Default server address
+ */
+#define CCE_DEFAULT_HOST "127.0.0.1"
+
+/** @def CCE_DEFAULT_PORT
+ * @brief Regular client port of the server
+ */
+#define CCE_DEFAULT_PORT 8080
+
+/** @def CCE_ADMIN_PORT
+ * @brief Admin port of the server
+ */
+#define CCE_ADMIN_PORT 8081
+
+/** @def CCE_PIPELINE_DEPTH
+ * @brief Submissions the server reads ahead per connection
+ */
+#define CCE_PIPELINE_DEPTH 8
+
+namespace cce {
+
+/** @brief One SUBMIT field: tag and value */
+typedef std::pair<uint16_t, std::string> Field;
+
+/**
+ * @class Submission
+ * @brief Fields and flags of one job
+ *
+ * The setters return the submission so that they can be chained; values
+ * are taken by value so that callers can move large sources in.
+ */
+class Submission {
+public:
+  std::vector<Field> fields; /**< Fields, in the order they are sent */
+  uint16_t flags;            /**< FRAME_FLAG_* of every SUBMIT frame */
+
+  Submission() : flags(0) {}
+
+  /**
+   * @brief Submission of a single program
+   *
+   * @param code C source code
+   * @param flags FRAME_FLAG_*
+   */
+  explicit Submission(std::string code, uint16_t flags = 0) : flags(flags) {
+    add(FIELD_SOURCE, std::move(code));
+  }
+
+  /**
+   * @brief Append a field
+   *
+   * @param tag field_tag_t
+   * @param value Field value
+   * @return This submission
+   */
+  Submission &add(uint16_t tag, std::string value) {
+    fields.push_back(Field(tag, std::move(value)));
+    return *this;
+  }
+
+  /** @brief Append the program's (or the current test case's) stdin */
+  Submission &input(std::string data) {
+    return add(FIELD_INPUT, std::move(data));
+  }
+
+  /** @brief Start a test case of a batch with its stdin */
+  Submission &test_case(std::string data) {
+    add(FIELD_CASE, std::string());
+    return input(std::move(data));
+  }
+
+  /** @brief Set the expected output of the current test case */
+  Submission &expect(std::string output) {
+    return add(FIELD_EXPECTED, std::move(output));
+  }
+
+  /** @brief Append a file of a multi-file project */
+  Submission &file(std::string name, std::string text) {
+    add(FIELD_FILE, std::move(name));
+    return add(FIELD_SOURCE, std::move(text));
+  }
+
+  /** @brief Select a compiler profile; "" keeps the server default */
+  Submission &profile(std::string name) {
+    return name.empty() ? *this : add(FIELD_PROFILE, std::move(name));
+  }
+};
+
+/**
+ * @struct CaseResult
+ * @brief Outcome of one test case of a batch
+ */
+struct CaseResult {
+  uint32_t index;          /**< Case number, in submission order */
+  result_payload_t result; /**< Exit code, flags and resources */
+  std::string output;      /**< Output of the case */
+
+  /** @brief Whether it exited with 0 and its output matched */
+  bool passed() const {
+    return result.exit_code == 0 && !(result.flags & RESULT_WRONG_OUTPUT);
+  }
+};
+
+/**
+ * @class Result
+ * @brief Reply to one submission (move-only)
+ */
+class Result {
+public:
+  uint32_t job_id;               /**< Job id it answered */
+  uint8_t type;                  /**< FRAME_RESULT, FRAME_BUSY, FRAME_ERROR,
+                                      or 0 if no reply came */
+  result_payload_t result;       /**< Decoded RESULT (type FRAME_RESULT) */
+  std::string output;            /**< Program or compiler output, the ERROR
+                                      text, or why no reply came */
+  std::vector<CaseResult> cases; /**< Cases of a batch, in finish order */
+  std::string trace;             /**< Server timeline, if one was asked for */
+  uint32_t retry_ms;             /**< Retry hint (type FRAME_BUSY) */
+
+  Result();
+  Result(Result &&other) = default;
+  Result &operator=(Result &&other) = default;
+  Result(const Result &) = delete;
+  Result &operator=(const Result &) = delete;
+
+  /** @brief Whether the server answered (type is not 0) */
+  bool answered() const { return type != 0; }
+
+  /** @brief Whether the server's queue was full */
+  bool busy() const { return type == FRAME_BUSY; }
+
+  /** @brief Whether it compiled, ran and exited with 0 */
+  bool ok() const {
+    return type == FRAME_RESULT && result.exit_code == 0 &&
+           !(result.flags & (RESULT_COMPILE_ERROR | RESULT_FAILED));
+  }
+};
+
+/**
+ * @class Connection
+ * @brief Blocking connection to one of the server's ports (move-only)
+ *
+ * Not thread-safe; Client serializes its own use.
+ */
+class Connection {
+public:
+  Connection() : sock(-1) {}
+  Connection(Connection &&other) : sock(other.sock) { other.sock = -1; }
+  Connection &operator=(Connection &&other);
+  Connection(const Connection &) = delete;
+  Connection &operator=(const Connection &) = delete;
+  ~Connection() { close(); }
+
+  /**
+   * @brief Connect, closing any previous socket first
+   *
+   * @param host Server name or address
+   * @param port Server port
+   * @return true on success
+   */
+  bool open(const std::string &host, uint16_t port);
+
+  /** @brief Close the socket */
+  void close();
+
+  /**
+   * @brief Shut the socket down without closing it, so that a thread
+   * blocked reading it returns
+   */
+  void hangup();
+
+  /** @brief Whether the socket is open */
+  bool is_open() const { return sock >= 0; }
+
+  /** @brief Socket descriptor, -1 if closed, for poll(2) */
+  int fd() const { return sock; }
+
+  /**
+   * @brief Send one frame
+   *
+   * @param type frame_type_t
+   * @param flags FRAME_FLAG_*
+   * @param job_id Request identifier
+   * @param payload Payload bytes
+   * @return true on success
+   */
+  bool send_frame(uint8_t type, uint16_t flags, uint32_t job_id,
+                  const std::string &payload);
+
+  /**
+   * @brief Send a SUBMIT sequence
+   *
+   * Packs the fields into SUBMIT frames of at most FRAME_MAX_PAYLOAD
+   * bytes, splitting long values into several fields of the same tag
+   * (the server concatenates them). All but the last frame carry
+   * FRAME_FLAG_MORE.
+   *
+   * @param job_id Request identifier
+   * @param submission Fields and flags
+   * @return true on success
+   */
+  bool send_submission(uint32_t job_id, const Submission &submission);
+
+  /**
+   * @brief Receive one frame
+   *
+   * @param header Receives the decoded header
+   * @param payload Receives the payload (its storage is reused)
+   * @return true on success, false on disconnect or a malformed frame
+   */
+  bool recv_frame(frame_header_t &header, std::string &payload);
+
+private:
+  int sock; /**< Socket file descriptor, -1 if closed */
+
+  bool send_all(const void *data, size_t len);
+  bool recv_all(void *data, size_t len);
+};
+
+/**
+ * @class ReplyAssembler
+ * @brief Rebuilds the replies of interleaved jobs from their frames
+ *
+ * OUTPUT, CASE and TRACE frames are kept per job id until the job's
+ * RESULT, BUSY or ERROR frame completes it.
+ */
+class ReplyAssembler {
+public:
+  /**
+   * @brief Add one frame
+   *
+   * @param header Frame header
+   * @param payload Frame payload; may be moved from
+   * @param done Receives the reply the frame completed
+   * @return true if a reply was completed
+   */
+  bool feed(const frame_header_t &header, std::string &payload,
+            Result &done);
+
+  /** @brief Forget every partial reply (the connection was lost) */
+  void clear();
+
+private:
+  std::map<uint32_t, Result> partial; /**< Replies being assembled */
+  std::map<std::pair<uint32_t, uint32_t>, std::string>
+      case_output; /**< Output of unfinished cases, by job and case */
+};
+
+/**
+ * @struct ClientOptions
+ * @brief Tuning of a Client
+ */
+struct ClientOptions {
+  unsigned connections;    /**< Connections opened at most */
+  unsigned max_in_flight;  /**< Jobs sent and not yet answered at most;
+                                later ones wait in the client (0: the
+                                pipeline depth of every connection) */
+  unsigned retries;        /**< Resubmissions after a lost connection */
+  unsigned busy_retries;   /**< Resubmissions after BUSY replies */
+  unsigned retry_delay_ms; /**< Delay before the first resubmission after a
+                                lost connection; doubled for each further */
+
+  ClientOptions()
+      : connections(1), max_in_flight(0), retries(3), busy_retries(50),
+        retry_delay_ms(100) {}
+};
+
+/**
+ * @class Client
+ * @brief Asynchronous submissions over kept-alive connections
+ *
+ * Each connection has a thread that reads its replies, and one more thread
+ * sends the jobs in order; submit() only queues. Jobs go to the connection
+ * with the fewest in flight, which is opened the first time it is needed
+ * and again after it is lost. Callbacks run on the library's threads: they
+ * may call submit() but must not wait for another reply.
+ */
+class Client {
+public:
+  /** @brief Called with the reply of a job */
+  typedef std::function<void(Result &&)> Callback;
+
+  /**
+   * @brief Start the client; no connection is opened yet
+   *
+   * @param host Server name or address
+   * @param port Regular client port
+   * @param options Tuning
+   */
+  Client(const std::string &host = CCE_DEFAULT_HOST,
+         uint16_t port = CCE_DEFAULT_PORT,
+         const ClientOptions &options = ClientOptions());
+
+  /** @brief Calls close() */
+  ~Client();
+
+  Client(const Client &) = delete;
+  Client &operator=(const Client &) = delete;
+
+  /**
+   * @brief Queue a job; the callback receives its reply
+   *
+   * @param submission Job
+   * @param done Callback, given a Result of type 0 if the job could not be
+   *        delivered within the retries or the client was closed
+   */
+  void submit(Submission submission, Callback done);
+
+  /**
+   * @brief Queue a job
+   *
+   * @param submission Job
+   * @return Future of its reply
+   */
+  std::future<Result> submit(Submission submission);
+
+  /**
+   * @brief Submit a job and wait for its reply
+   *
+   * @param submission Job
+   * @return The reply
+   */
+  Result run(Submission submission) {
+    return submit(std::move(submission)).get();
+  }
+
+  /**
+   * @brief Close the connections and stop the threads; jobs not yet
+   * answered get a Result of type 0
+   */
+  void close();
+
+private:
+  /** @brief Job between submit() and its callback */
+  struct Job {
+    Submission submission; /**< Fields and flags */
+    Callback done;         /**< Receives the reply */
+    unsigned lost;         /**< Connections lost with it in flight */
+    unsigned busy;         /**< BUSY replies received */
+    bool admitted;         /**< Counted in active */
+
+    Job() : lost(0), busy(0), admitted(false) {}
+  };
+
+  /** @brief One connection and the jobs in flight on it */
+  struct Slot {
+    std::mutex write_lock;           /**< Serializes sends and (re)opens */
+    std::mutex lock;                 /**< Guards the flags and pending */
+    std::condition_variable opened;  /**< Signalled when it is (re)opened */
+    Connection conn;                 /**< Socket */
+    bool fd_open;                    /**< Whether conn may be read */
+    bool closing;                    /**< close() was called */
+    std::map<uint32_t, Job> pending; /**< Jobs sent, by job id */
+    std::thread reader;              /**< Runs read_replies() */
+
+    Slot() : fd_open(false), closing(false) {}
+  };
+
+  void send_job(Job job);
+  void read_replies(Slot *slot);
+  void lost(Job job, const char *reason);
+  void finish(Job &job, Result &&result);
+  void retry_later(Job job, unsigned delay_ms);
+  void dispatch();
+
+  std::string host;      /**< Server name or address */
+  uint16_t port;         /**< Regular client port */
+  ClientOptions options; /**< Tuning */
+  std::vector<std::unique_ptr<Slot>> slots; /**< Connections */
+  std::atomic<uint32_t> next_job_id;        /**< Next job id */
+
+  std::mutex queue_lock;          /**< Guards everything below */
+  std::condition_variable wakeup; /**< Signalled when the queue changes */
+  std::deque<Job> ready;          /**< Jobs to send, retries first */
+  std::multimap<std::chrono::steady_clock::time_point, Job>
+      delayed;           /**< Retries by due time */
+  unsigned active;    /**< Admitted jobs not yet finished */
+  bool stopping;      /**< close() was called */
+  std::thread sender; /**< Runs dispatch() */
+};
+
+} // namespace cce
+
+#endif /* CCE_CLIENT_H */
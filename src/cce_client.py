@@ -0,0 +1,816 @@
+#!/usr/bin/env python3
+"""
+@file cce_client.py
+@brief Client library for the Code Compiler & Executor Server
+@author Rares-Nicholas Popa & Adrian-Petru Enache
+@version 1.0.0
+
+@details Submissions and replies of the framing protocol (src/protocol.h)
+as Python objects, for harnesses that drive many jobs:
+
+- Connection: one blocking socket on which any number of submissions may
+  be in flight; replies are reassembled from their frames and matched to
+  their job ids
+- ConnectionPool: thread-safe pool of kept-alive connections with
+  reconnect and BUSY retries, for threaded harnesses
+- AsyncClient: asyncio client whose submit() returns a future; jobs are
+  spread over a few connections, resubmitted on a new connection if
+  theirs is lost (a draining server closes idle ones), and retried after
+  the server's hint when it answers BUSY
+
+Example:
+    async with AsyncClient(connections=4) as client:
+        futures = [client.submit(code, stdin=data) for data in inputs]
+        for result in await asyncio.gather(*futures):
+            print(result.exit_code, result.output)
+
+Run as a script, it runs the given source files concurrently.
+
+@copyright This project is for educational purposes as part of the PCD course.
+"""
+
+import asyncio
+import itertools
+import queue
+import socket
+import struct
+import sys
+import threading
+import time
+
+# Server configuration constants
+SERVER_IP = "127.0.0.1"    #: Default server IP address
+PORT = 8080                #: Regular client server port
+
+# Framing protocol (must match src/protocol.h)
+FRAME_MAGIC = 0x43434531   #: "CCE1"
+PROTOCOL_VERSION = 1       #: Protocol revision
+FRAME_HEADER = struct.Struct("!IBBHII")  #: magic, version, type, flags, job id, length
+FIELD_HEADER = struct.Struct("!HI")      #: SUBMIT field tag and length
+FRAME_MAX_PAYLOAD = 64 * 1024            #: Largest payload of one frame
+SOURCE_CHUNK = FRAME_MAX_PAYLOAD - FIELD_HEADER.size  #: Source bytes per SUBMIT frame
+
+FRAME_SUBMIT, FRAME_OUTPUT, FRAME_RESULT, FRAME_BUSY, FRAME_ERROR = 1, 2, 3, 4, 5
+FRAME_COMMAND, FRAME_REPLY, FRAME_QUIT, FRAME_CASE = 6, 7, 8, 9
+FRAME_TRACE = 10
+FRAME_FLAG_MORE = 0x0001     #: More frames of the same sequence follow
+FRAME_FLAG_NOCACHE = 0x0002  #: Bypass the server's result cache
+FRAME_FLAG_STREAM = 0x0004   #: Stream output while the program runs
+FRAME_FLAG_BULK = 0x0008     #: Queue in the batch priority class
+FRAME_FLAG_TRACE = 0x0010    #: Send the job's timeline before its result
+FIELD_SOURCE = 1             #: SUBMIT field carrying source code
+FIELD_INPUT = 2              #: SUBMIT field carrying the program's stdin
+FIELD_EXPECTED = 3           #: SUBMIT field carrying the expected output
+FIELD_CASE = 4               #: Empty SUBMIT field starting a test case
+FIELD_PROFILE = 5            #: SUBMIT field naming a compiler profile
+FIELD_FILE = 6               #: SUBMIT field naming a project file
+RESULT = struct.Struct("!iIIII")  #: exit code, flags, cpu us, wall us, peak KiB
+CASE_HEADER = struct.Struct("!I")  #: case number, followed by a RESULT
+
+RESULT_COMPILE_ERROR = 0x0001
+RESULT_TIMED_OUT = 0x0002
+RESULT_TRUNCATED = 0x0004
+RESULT_CACHED = 0x0008
+RESULT_MEMORY_LIMIT = 0x0020
+RESULT_PROCESS_LIMIT = 0x0040
+RESULT_PASSED = 0x0080
+RESULT_WRONG_OUTPUT = 0x0100
+
+DEFAULT_RETRIES = 3          #: Resubmissions after a lost connection
+RETRY_DELAY = 0.1            #: Seconds before the first resubmission
+PIPELINE_DEPTH = 8           #: Jobs the server reads ahead per connection
+
+def decode_result(payload):
+    """
+    Decode a RESULT payload.
+
+    Only the known prefix is decoded; newer servers may append fields.
+
+    Returns:
+        tuple: (exit_code, flags, cpu_us, wall_us, peak_kb)
+    """
+    return RESULT.unpack(payload[:RESULT.size].ljust(RESULT.size, b"\0"))
+
+def encode_frame(frame_type, flags, job_id, payload=b""):
+    """
+    Encode one frame.
+
+    Args:
+        frame_type (int): FRAME_* type
+        flags (int): FRAME_FLAG_* bits
+        job_id (int): Request identifier
+        payload (bytes): Frame payload
+
+    Returns:
+        bytes: Header and payload
+    """
+    return FRAME_HEADER.pack(FRAME_MAGIC, PROTOCOL_VERSION, frame_type, flags,
+                             job_id, len(payload)) + payload
+
+def encode_submission(job_id, flags, fields):
+    """
+    Encode a SUBMIT sequence.
+
+    The fields are packed into SUBMIT frames of at most FRAME_MAX_PAYLOAD
+    bytes; long values are split into several fields of the same tag,
+    which the server concatenates. All but the last frame carry
+    FRAME_FLAG_MORE.
+
+    Args:
+        job_id (int): Request identifier
+        flags (int): FRAME_FLAG_* bits of every frame
+        fields (list): (tag, bytes) pairs in order
+
+    Returns:
+        bytes: Every frame of the submission
+    """
+    frames = bytearray()
+    payload = bytearray()
+    for tag, value in fields:
+        offset = 0
+        while True:
+            if len(payload) + FIELD_HEADER.size >= FRAME_MAX_PAYLOAD:
+                frames += encode_frame(FRAME_SUBMIT, flags | FRAME_FLAG_MORE,
+                                       job_id, bytes(payload))
+                payload.clear()
+            room = FRAME_MAX_PAYLOAD - FIELD_HEADER.size - len(payload)
+            chunk = value[offset:offset + room]
+            payload += FIELD_HEADER.pack(tag, len(chunk)) + chunk
+            offset += len(chunk)
+            if offset >= len(value):
+                break
+    frames += encode_frame(FRAME_SUBMIT, flags, job_id, bytes(payload))
+    return bytes(frames)
+
+class Job:
+    """
+    A submission, kept so that it can be sent again.
+
+    Args:
+        code (str or bytes): C source; None for a project
+        stdin (bytes): Standard input of the program, or None
+        cases (list): (stdin bytes, expected bytes or None) pairs of a
+            batch, or None for a single run
+        files (list): (name, text) pairs of a multi-file project, or None
+        profile (str): Compiler profile, or None for the server default
+        nocache (bool): Run the program even if its result is cached
+        bulk (bool): Queue in the batch priority class
+        trace (bool): Ask for the server's timeline of the job
+    """
+
+    def __init__(self, code=None, stdin=None, cases=None, files=None,
+                 profile=None, nocache=False, bulk=False, trace=False):
+        fields = []
+        for name, text in files or []:
+            fields.append((FIELD_FILE, _to_bytes(name)))
+            fields.append((FIELD_SOURCE, _to_bytes(text)))
+        if code is not None:
+            fields.append((FIELD_SOURCE, _to_bytes(code)))
+        if stdin is not None:
+            fields.append((FIELD_INPUT, _to_bytes(stdin)))
+        for case_stdin, expected in cases or []:
+            fields.append((FIELD_CASE, b""))
+            fields.append((FIELD_INPUT, _to_bytes(case_stdin)))
+            if expected is not None:
+                fields.append((FIELD_EXPECTED, _to_bytes(expected)))
+        if profile:
+            fields.append((FIELD_PROFILE, _to_bytes(profile)))
+        self.fields = fields
+        self.flags = ((FRAME_FLAG_NOCACHE if nocache else 0)
+                      | (FRAME_FLAG_BULK if bulk else 0)
+                      | (FRAME_FLAG_TRACE if trace else 0))
+
+    def encode(self, job_id):
+        """
+        Encode the submission under a job id.
+
+        Returns:
+            bytes: Its SUBMIT frames
+        """
+        return encode_submission(job_id, self.flags, self.fields)
+
+def _to_bytes(value):
+    """Encode text as UTF-8; bytes pass through."""
+    return value.encode('utf-8') if isinstance(value, str) else bytes(value)
+
+class CaseResult:
+    """
+    Outcome of one test case of a batch.
+
+    Attributes:
+        index (int): Case number, in submission order
+        exit_code (int): Exit status, negative if killed by a signal
+        flags (int): RESULT_* bits
+        cpu_us, wall_us, peak_kb (int): Resources used
+        output (bytes): Output of the case
+    """
+
+    __slots__ = ("index", "exit_code", "flags", "cpu_us", "wall_us",
+                 "peak_kb", "output")
+
+    def __init__(self, index, result, output):
+        self.index = index
+        (self.exit_code, self.flags, self.cpu_us, self.wall_us,
+         self.peak_kb) = result
+        self.output = output
+
+    @property
+    def passed(self):
+        """bool: Exited with 0 and, if expected output was given, matched"""
+        return self.exit_code == 0 and not self.flags & RESULT_WRONG_OUTPUT
+
+class Result:
+    """
+    Reply to one submission.
+
+    Attributes:
+        job_id (int): Job id it answered
+        kind (int): FRAME_RESULT, FRAME_BUSY or FRAME_ERROR
+        exit_code (int): Exit status (or, for a batch, the failed cases);
+            None unless kind is FRAME_RESULT
+        flags (int): RESULT_* bits
+        cpu_us, wall_us, peak_kb (int): Resources used
+        output (bytes): Program output, or the compiler diagnostics
+        cases (list): CaseResult of each case of a batch, in finish order
+        trace (str): Server timeline if one was asked for, else None
+        retry_ms (int): Back-off hint of a BUSY reply
+        error (str): Text of an ERROR reply
+    """
+
+    __slots__ = ("job_id", "kind", "exit_code", "flags", "cpu_us",
+                 "wall_us", "peak_kb", "output", "cases", "trace",
+                 "retry_ms", "error")
+
+    def __init__(self, job_id):
+        self.job_id = job_id
+        self.kind = None
+        self.exit_code = None
+        self.flags = 0
+        self.cpu_us = self.wall_us = self.peak_kb = 0
+        self.output = b""
+        self.cases = []
+        self.trace = None
+        self.retry_ms = 0
+        self.error = None
+
+    @property
+    def busy(self):
+        """bool: Rejected because the server's queue was full"""
+        return self.kind == FRAME_BUSY
+
+    @property
+    def compile_error(self):
+        """bool: The program did not compile; output holds why"""
+        return self.kind == FRAME_RESULT and bool(
+            self.flags & RESULT_COMPILE_ERROR)
+
+    @property
+    def ok(self):
+        """bool: Compiled, ran and exited with 0 (every case passed)"""
+        return (self.kind == FRAME_RESULT and self.exit_code == 0
+                and not self.flags & RESULT_COMPILE_ERROR)
+
+    def __repr__(self):
+        if self.kind == FRAME_RESULT:
+            return (f"Result(job {self.job_id}, exit {self.exit_code}, "
+                    f"flags {self.flags:#x}, {len(self.output)} bytes)")
+        if self.kind == FRAME_BUSY:
+            return f"Result(job {self.job_id}, busy {self.retry_ms} ms)"
+        return f"Result(job {self.job_id}, error {self.error!r})"
+
+class ReplyCollector:
+    """
+    Reassembles the replies of interleaved jobs from their frames.
+
+    OUTPUT, CASE and TRACE frames are kept per job id until its RESULT,
+    BUSY or ERROR frame completes it.
+    """
+
+    def __init__(self):
+        self.partial = {}  # job id -> Result being assembled
+        self.cases = {}    # (job id, case) -> output of a case in pieces
+
+    def feed(self, frame_type, flags, job_id, payload):
+        """
+        Add one frame.
+
+        Returns:
+            Result: The job it completed, or None
+        """
+        if frame_type not in (FRAME_OUTPUT, FRAME_CASE, FRAME_TRACE,
+                              FRAME_RESULT, FRAME_BUSY, FRAME_ERROR):
+            return None
+        result = self.partial.setdefault(job_id, Result(job_id))
+        if frame_type == FRAME_OUTPUT:
+            result.output += payload
+            return None
+        if frame_type == FRAME_CASE:
+            if len(payload) < CASE_HEADER.size + RESULT.size:
+                return None
+            index, = CASE_HEADER.unpack(payload[:CASE_HEADER.size])
+            key = (job_id, index)
+            output = (self.cases.pop(key, b"")
+                      + payload[CASE_HEADER.size + RESULT.size:])
+            if flags & FRAME_FLAG_MORE:
+                self.cases[key] = output
+            else:
+                result.cases.append(CaseResult(
+                    index, decode_result(payload[CASE_HEADER.size:]), output))
+            return None
+        if frame_type == FRAME_TRACE:
+            result.trace = payload.decode('utf-8', errors='replace')
+            return None
+
+        del self.partial[job_id]
+        result.kind = frame_type
+        if frame_type == FRAME_RESULT:
+            (result.exit_code, result.flags, result.cpu_us, result.wall_us,
+             result.peak_kb) = decode_result(payload)
+        elif frame_type == FRAME_BUSY:
+            result.retry_ms, = struct.unpack("!I", payload[:4].ljust(4, b"\0"))
+        else:
+            result.error = payload.decode('utf-8', errors='replace')
+        return result
+
+    def clear(self):
+        """Forget every partial reply (the connection was lost)."""
+        self.partial.clear()
+        self.cases.clear()
+
+class Connection:
+    """
+    Blocking connection on which submissions may be pipelined.
+
+    Not thread-safe; use a ConnectionPool to share connections between
+    threads.
+
+    Args:
+        host (str): Server address
+        port (int): Regular client port
+        timeout (float): Socket timeout in seconds, or None to block
+    """
+
+    def __init__(self, host=SERVER_IP, port=PORT, timeout=None):
+        self.host = host
+        self.port = port
+        self.timeout = timeout
+        self.sock = None
+        self.next_job_id = 1
+        self.collector = ReplyCollector()
+        self.done = {}  # job id -> Result read while waiting for another
+
+    def connect(self):
+        """
+        Open the socket if it is not open.
+
+        Raises:
+            OSError: If the server cannot be reached
+        """
+        if self.sock is None:
+            self.sock = socket.create_connection((self.host, self.port),
+                                                 self.timeout)
+            self.sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+
+    def close(self):
+        """Close the socket; replies not yet read are lost."""
+        if self.sock is not None:
+            try:
+                self.sock.close()
+            finally:
+                self.sock = None
+                self.collector.clear()
+                self.done.clear()
+
+    def send(self, data):
+        """
+        Send encoded frames, connecting first if needed.
+
+        Raises:
+            OSError: If the connection was lost (it is closed)
+        """
+        self.connect()
+        try:
+            self.sock.sendall(data)
+        except OSError:
+            self.close()
+            raise
+
+    def recv_exact(self, size):
+        """
+        Read exactly size bytes from the socket.
+
+        Raises:
+            ConnectionError: If the server closed the connection
+        """
+        data = bytearray()
+        while len(data) < size:
+            chunk = self.sock.recv(size - len(data))
+            if not chunk:
+                raise ConnectionError("connection closed by server")
+            data.extend(chunk)
+        return bytes(data)
+
+    def recv_frame(self):
+        """
+        Receive one frame.
+
+        Returns:
+            tuple: (type, flags, job_id, payload)
+
+        Raises:
+            ConnectionError: On disconnect or a malformed header (the
+                connection is closed)
+        """
+        try:
+            magic, version, frame_type, flags, job_id, length = \
+                FRAME_HEADER.unpack(self.recv_exact(FRAME_HEADER.size))
+            if magic != FRAME_MAGIC or version != PROTOCOL_VERSION:
+                raise ConnectionError("malformed frame from server")
+            return frame_type, flags, job_id, self.recv_exact(length)
+        except OSError:
+            self.close()
+            raise
+
+    def submit(self, job):
+        """
+        Send a job without waiting for its reply.
+
+        Args:
+            job (Job): Submission
+
+        Returns:
+            int: Its job id, to pass to wait()
+        """
+        job_id = self.next_job_id
+        self.next_job_id = self.next_job_id % 0xFFFFFFFF + 1
+        self.send(job.encode(job_id))
+        return job_id
+
+    def wait(self, job_id=None):
+        """
+        Wait for a reply.
+
+        Args:
+            job_id (int): Job to wait for, or None for whichever finishes
+                first
+
+        Returns:
+            Result: The reply
+
+        Raises:
+            ConnectionError: If the connection was lost
+        """
+        if job_id is None and self.done:
+            return self.done.pop(next(iter(self.done)))
+        if job_id in self.done:
+            return self.done.pop(job_id)
+        while True:
+            result = self.collector.feed(*self.recv_frame())
+            if result is None:
+                continue
+            if job_id is None or result.job_id == job_id:
+                return result
+            self.done[result.job_id] = result
+
+    def run(self, job):
+        """
+        Submit a job and wait for its reply.
+
+        Returns:
+            Result: The reply
+        """
+        return self.wait(self.submit(job))
+
+class ConnectionPool:
+    """
+    Thread-safe pool of kept-alive connections.
+
+    Each run() borrows a connection, so up to size jobs run at once; a
+    lost connection is replaced and the job sent again, and a BUSY reply
+    is retried after the server's hint.
+
+    Args:
+        host (str): Server address
+        port (int): Regular client port
+        size (int): Most connections open at once
+        retries (int): Resubmissions of a job after a lost connection
+        retry_busy (bool): Retry BUSY replies instead of returning them
+        timeout (float): Socket timeout in seconds, or None to block
+    """
+
+    def __init__(self, host=SERVER_IP, port=PORT, size=8,
+                 retries=DEFAULT_RETRIES, retry_busy=True, timeout=None):
+        self.host = host
+        self.port = port
+        self.retries = retries
+        self.retry_busy = retry_busy
+        self.timeout = timeout
+        self.idle = queue.LifoQueue()
+        self.slots = threading.BoundedSemaphore(size)
+
+    def run(self, job):
+        """
+        Run a job on a pooled connection.
+
+        Args:
+            job (Job): Submission
+
+        Returns:
+            Result: The reply
+
+        Raises:
+            OSError: If the server stayed unreachable through every retry
+        """
+        with self.slots:
+            try:
+                conn = self.idle.get_nowait()
+            except queue.Empty:
+                conn = Connection(self.host, self.port, self.timeout)
+            failures = 0
+            try:
+                while True:
+                    try:
+                        result = conn.run(job)
+                    except OSError:
+                        conn.close()
+                        failures += 1
+                        if failures > self.retries:
+                            raise
+                        time.sleep(RETRY_DELAY * 2 ** (failures - 1))
+                        continue
+                    if not (result.busy and self.retry_busy):
+                        return result
+                    time.sleep(result.retry_ms / 1000)
+            finally:
+                self.idle.put(conn)
+
+    def close(self):
+        """Close the idle connections."""
+        while True:
+            try:
+                self.idle.get_nowait().close()
+            except queue.Empty:
+                return
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc):
+        self.close()
+
+class _AsyncConnection:
+    """
+    One connection of an AsyncClient and the jobs in flight on it.
+    """
+
+    def __init__(self, reader, writer):
+        self.reader = reader
+        self.writer = writer
+        self.collector = ReplyCollector()
+        self.pending = {}  # job id -> future of its Result
+        self.alive = True
+        self.task = asyncio.ensure_future(self.read_replies())
+
+    async def read_replies(self):
+        """Resolve the futures of the replies until the connection drops."""
+        error = ConnectionError("connection closed by server")
+        try:
+            while True:
+                header = await self.reader.readexactly(FRAME_HEADER.size)
+                magic, version, frame_type, flags, job_id, length = \
+                    FRAME_HEADER.unpack(header)
+                if magic != FRAME_MAGIC or version != PROTOCOL_VERSION:
+                    error = ConnectionError("malformed frame from server")
+                    break
+                payload = await self.reader.readexactly(length)
+                result = self.collector.feed(frame_type, flags, job_id,
+                                             payload)
+                future = self.pending.pop(job_id, None) if result else None
+                if future and not future.done():
+                    future.set_result(result)
+        except (OSError, asyncio.IncompleteReadError) as e:
+            if isinstance(e, OSError):
+                error = e
+        finally:
+            self.fail(error)
+
+    def fail(self, error):
+        """Close the connection and fail the jobs still in flight."""
+        self.alive = False
+        self.writer.close()
+        pending, self.pending = self.pending, {}
+        for future in pending.values():
+            if not future.done():
+                future.set_exception(error)
+
+    async def submit(self, job_id, job):
+        """
+        Send a job.
+
+        Returns:
+            asyncio.Future: Resolved with its Result
+        """
+        future = asyncio.get_running_loop().create_future()
+        self.pending[job_id] = future
+        self.writer.write(job.encode(job_id))
+        try:
+            await self.writer.drain()
+        except OSError as e:
+            self.fail(e)
+        return future
+
+class AsyncClient:
+    """
+    asyncio client that runs many jobs over a few connections.
+
+    Jobs go to the open connection with the fewest in flight; new
+    connections are opened up to the limit. At most max_in_flight jobs are
+    sent at once, the rest wait in submit(), which keeps the server's
+    queue from answering BUSY; a BUSY reply is still retried after the
+    server's hint. A job whose connection is lost is sent again on a new
+    one up to retries times.
+
+    Args:
+        host (str): Server address
+        port (int): Regular client port
+        connections (int): Most connections open at once
+        max_in_flight (int): Most jobs sent and not yet answered (default:
+            PIPELINE_DEPTH per connection)
+        retries (int): Resubmissions of a job after a lost connection
+        retry_busy (bool): Retry BUSY replies instead of returning them
+    """
+
+    def __init__(self, host=SERVER_IP, port=PORT, connections=4,
+                 max_in_flight=None, retries=DEFAULT_RETRIES,
+                 retry_busy=True):
+        self.host = host
+        self.port = port
+        self.limit = connections
+        self.retries = retries
+        self.retry_busy = retry_busy
+        self.max_in_flight = max_in_flight or connections * PIPELINE_DEPTH
+        self.conns = []
+        self.job_ids = itertools.count(1)
+        self.slots = None
+        self.opening = None
+
+    async def connection(self):
+        """
+        Pick the connection for the next job, opening one if allowed.
+
+        Returns:
+            _AsyncConnection: An open connection
+
+        Raises:
+            OSError: If the server cannot be reached
+        """
+        if self.opening is None:
+            self.opening = asyncio.Lock()
+        async with self.opening:
+            self.conns = [conn for conn in self.conns if conn.alive]
+            least = min(self.conns, key=lambda conn: len(conn.pending),
+                        default=None)
+            if least is not None and (not least.pending
+                                      or len(self.conns) >= self.limit):
+                return least
+            reader, writer = await asyncio.open_connection(self.host,
+                                                           self.port)
+            sock = writer.get_extra_info('socket')
+            if sock is not None:
+                sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+            conn = _AsyncConnection(reader, writer)
+            self.conns.append(conn)
+            return conn
+
+    async def run_job(self, job):
+        """
+        Run a job to its reply, resubmitting it as needed.
+
+        Args:
+            job (Job): Submission
+
+        Returns:
+            Result: The reply
+        """
+        if self.slots is None:
+            self.slots = asyncio.Semaphore(self.max_in_flight)
+        failures = 0
+        async with self.slots:
+            while True:
+                try:
+                    conn = await self.connection()
+                    result = await (await conn.submit(next(self.job_ids),
+                                                      job))
+                except OSError:
+                    failures += 1
+                    if failures > self.retries:
+                        raise
+                    await asyncio.sleep(RETRY_DELAY * 2 ** (failures - 1))
+                    continue
+                if not (result.busy and self.retry_busy):
+                    return result
+                await asyncio.sleep(result.retry_ms / 1000)
+
+    def submit(self, code=None, **options):
+        """
+        Submit a job; must be called with the event loop running.
+
+        Args:
+            code (str or bytes): C source, or None for a project
+            **options: Other Job arguments (stdin, cases, files, profile,
+                nocache, bulk, trace)
+
+        Returns:
+            asyncio.Future: Resolved with the Result, or with the OSError
+            that outlasted every retry
+        """
+        return asyncio.ensure_future(self.run_job(Job(code, **options)))
+
+    async def run(self, code=None, **options):
+        """
+        Submit a job and wait for its reply.
+
+        Returns:
+            Result: The reply
+        """
+        return await self.submit(code, **options)
+
+    async def close(self):
+        """Close every connection; jobs in flight fail."""
+        conns, self.conns = self.conns, []
+        for conn in conns:
+            conn.task.cancel()
+            conn.fail(ConnectionError("client closed"))
+        for conn in conns:
+            try:
+                await conn.task
+            except asyncio.CancelledError:
+                pass
+
+    async def __aenter__(self):
+        return self
+
+    async def __aexit__(self, *exc):
+        await self.close()
+
+async def run_files(filenames, host=SERVER_IP, port=PORT, connections=4):
+    """
+    Run source files concurrently and print each result as it arrives.
+
+    Args:
+        filenames (list): C source files
+        host (str): Server address
+        port (int): Regular client port
+        connections (int): Connections to spread the jobs over
+
+    Returns:
+        int: Number of programs that did not compile or exit with 0
+    """
+    async def run_file(client, filename):
+        try:
+            with open(filename, 'rb') as file:
+                code = file.read()
+            return filename, await client.run(code)
+        except OSError as e:
+            return filename, e
+
+    failed = 0
+    started = time.monotonic()
+    async with AsyncClient(host, port, connections) as client:
+        for done in asyncio.as_completed([run_file(client, filename)
+                                          for filename in filenames]):
+            filename, result = await done
+            if isinstance(result, OSError):
+                print(f"{filename}: error: {result}")
+                failed += 1
+                continue
+            if result.compile_error:
+                status = "compile error"
+            elif result.kind == FRAME_RESULT:
+                status = f"exit {result.exit_code}"
+            else:
+                status = repr(result)
+            print(f"{filename}: {status}, {len(result.output)} bytes of output")
+            failed += not result.ok
+    print(f"{len(filenames)} programs in "
+          f"{time.monotonic() - started:.2f} s, {failed} failed")
+    return failed
+
+def main():
+    """
+    Run the source files named on the command line concurrently.
+
+    Usage: cce_client.py [-c connections] file.c...
+    """
+    args = sys.argv[1:]
+    connections = 4
+    if len(args) >= 2 and args[0] == "-c":
+        connections = int(args[1])
+        args = args[2:]
+    if not args:
+        print("Usage: cce_client.py [-c connections] file.c...")
+        return 2
+    return 1 if asyncio.run(run_files(args, connections=connections)) else 0
+
+if __name__ == "__main__":
+    sys.exit(main())
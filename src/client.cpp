@@ -6,20 +6,36 @@
  *
  * @details This application allows users to submit C source code to the
  * Code Compiler & Executor Server for compilation and execution.
- * It supports both interactive code entry and file loading.
+ * It supports interactive code entry, file loading, programs with
+ * standard input and batches of test cases. Given source files on the
+ * command line it runs non-interactively instead: every file is
+ * submitted over several pipelined connections and its output is
+ * written to a file of its own (see BulkRun).
  *
  * @copyright This project is for educational purposes as part of the PCD
  * course.
  */
 
-#include <arpa/inet.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
 #include <cstring>
+#include <dirent.h>
 #include <fstream>
+#include <getopt.h>
+#include <glob.h>
+#include <iomanip>
 #include <iostream>
+#include <map>
+#include <mutex>
 #include <sstream>
 #include <string>
-#include <sys/socket.h>
-#include <unistd.h>
+#include <sys/stat.h>
+#include <vector>
+
+#include "cce_client.h"
 
 /** @def SERVER_IP
  * @brief Default server IP address
@@ -29,12 +45,297 @@
 /** @def PORT
  * @brief Regular client server port (must match server configuration)
  */
-#define PORT 8080
+#define PORT CCE_DEFAULT_PORT
+
+/** @def TEST_INPUT_SUFFIX
+ * @brief Extension of test case input files
+ */
+#define TEST_INPUT_SUFFIX ".in"
+
+/** @def TEST_OUTPUT_SUFFIX
+ * @brief Extension of expected output files
+ */
+#define TEST_OUTPUT_SUFFIX ".out"
+
+/** @def SOURCE_SUFFIX
+ * @brief Extension of the source files taken from a directory in bulk mode
+ */
+#define SOURCE_SUFFIX ".c"
+
+/** @def DEFAULT_CONCURRENCY
+ * @brief Default number of connections in bulk mode
+ */
+#define DEFAULT_CONCURRENCY 4
+
+/** @def BULK_DEPTH
+ * @brief Submissions each bulk connection keeps in flight (the server's
+ * default pipeline depth)
+ */
+#define BULK_DEPTH 8
+
+/** @def BULK_MAX_RETRIES
+ * @brief Times a submission refused with BUSY is sent again
+ */
+#define BULK_MAX_RETRIES 50
+
+/** @def DEFAULT_OUTPUT_DIR
+ * @brief Directory receiving the bulk mode output files
+ */
+#define DEFAULT_OUTPUT_DIR "results"
+
+/** @def SUMMARY_FILE
+ * @brief Bulk mode summary, one tab-separated line per source file
+ */
+#define SUMMARY_FILE "summary.tsv"
+
+/**
+ * @struct TestCase
+ * @brief One test case of a batch submission
+ */
+struct TestCase {
+  std::string name;     /**< Name shown in the report */
+  std::string input;    /**< Standard input of the program */
+  std::string expected; /**< Expected output */
+  bool has_expected;    /**< Whether the output is checked */
+};
+
+/**
+ * @brief Read a whole file
+ *
+ * @param path File to read
+ * @param contents Receives the file contents
+ * @return true on success
+ */
+static bool read_file(const std::string &path, std::string &contents) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file.is_open()) {
+    return false;
+  }
+  std::stringstream buffer;
+  buffer << file.rdbuf();
+  contents = buffer.str();
+  return true;
+}
+
+/**
+ * @brief Load the test cases of a directory
+ *
+ * Every NAME.in file is a case; NAME.out, if present, is its expected
+ * output. Cases are sorted by name.
+ *
+ * @param dir Directory to scan
+ * @param cases Receives the cases
+ * @return true if the directory could be read
+ */
+static bool load_tests(const std::string &dir, std::vector<TestCase> &cases) {
+  const std::string suffix = TEST_INPUT_SUFFIX;
+  DIR *handle = opendir(dir.c_str());
+  struct dirent *entry;
+
+  if (!handle) {
+    return false;
+  }
+  while ((entry = readdir(handle)) != NULL) {
+    std::string file = entry->d_name;
+    if (file.size() <= suffix.size() ||
+        file.compare(file.size() - suffix.size(), suffix.size(), suffix) != 0) {
+      continue;
+    }
+    TestCase test;
+    test.name = file.substr(0, file.size() - suffix.size());
+    if (!read_file(dir + "/" + file, test.input)) {
+      continue;
+    }
+    test.has_expected = read_file(dir + "/" + test.name + TEST_OUTPUT_SUFFIX,
+                                  test.expected);
+    cases.push_back(test);
+  }
+  closedir(handle);
+  std::sort(cases.begin(), cases.end(),
+            [](const TestCase &a, const TestCase &b) {
+              return a.name < b.name;
+            });
+  return true;
+}
+
+/**
+ * @brief Load a multi-file project
+ *
+ * Every *.c and *.h file directly in the directory becomes a FIELD_FILE
+ * with its name followed by a FIELD_SOURCE with its text, in name order.
+ *
+ * @param dir Project directory
+ * @param project Extended with the project's fields
+ * @return Number of files loaded, 0 if the directory has none
+ */
+static size_t load_project(const std::string &dir, cce::Submission &project) {
+  std::vector<std::string> names;
+  DIR *handle = opendir(dir.c_str());
+  struct dirent *entry;
+
+  if (!handle) {
+    return 0;
+  }
+  while ((entry = readdir(handle)) != NULL) {
+    std::string file = entry->d_name;
+    if (file.size() > 2 && file[0] != '.' && file[file.size() - 2] == '.' &&
+        (file[file.size() - 1] == 'c' || file[file.size() - 1] == 'h')) {
+      names.push_back(file);
+    }
+  }
+  closedir(handle);
+  std::sort(names.begin(), names.end());
 
-/** @def BUFFER_SIZE
- * @brief Maximum buffer size for network communications
+  size_t loaded = 0;
+  for (const std::string &name : names) {
+    std::string text;
+    if (read_file(dir + "/" + name, text)) {
+      project.file(name, std::move(text));
+      loaded++;
+    }
+  }
+  return loaded;
+}
+
+/**
+ * @brief Add the source files a command line argument names
+ *
+ * A directory contributes every *.c file in it, a pattern with wildcards
+ * is expanded with glob(3) (for lists too long for the shell), anything
+ * else is taken as a file name.
+ *
+ * @param argument Directory, pattern or file
+ * @param files Extended in name order
+ * @return false if a directory or pattern matched nothing
  */
-#define BUFFER_SIZE 4096
+static bool expand_sources(const std::string &argument,
+                           std::vector<std::string> &files) {
+  const std::string suffix = SOURCE_SUFFIX;
+  std::vector<std::string> found;
+  DIR *handle = opendir(argument.c_str());
+
+  if (handle) {
+    struct dirent *entry;
+    while ((entry = readdir(handle)) != NULL) {
+      std::string file = entry->d_name;
+      if (file.size() > suffix.size() &&
+          file.compare(file.size() - suffix.size(), suffix.size(), suffix) ==
+              0) {
+        found.push_back(argument + "/" + file);
+      }
+    }
+    closedir(handle);
+  } else if (argument.find_first_of("*?[") != std::string::npos) {
+    glob_t matches;
+    if (glob(argument.c_str(), 0, NULL, &matches) == 0) {
+      for (size_t i = 0; i < matches.gl_pathc; i++) {
+        found.push_back(matches.gl_pathv[i]);
+      }
+    }
+    globfree(&matches);
+  } else {
+    files.push_back(argument);
+    return true;
+  }
+  std::sort(found.begin(), found.end());
+  files.insert(files.end(), found.begin(), found.end());
+  return !found.empty();
+}
+
+/**
+ * @struct BulkRun
+ * @brief Files of a non-interactive run, shared by its connections
+ *
+ * Files are taken in order and submitted through a cce::Client; as each
+ * reply arrives it is recorded and the next file is submitted. The output
+ * goes to a file named after the source (directories flattened, e.g.
+ * tests/a.c -> results/tests_a.c.out) and a line with the verdict, exit
+ * code and times goes to SUMMARY_FILE.
+ */
+struct BulkRun {
+  std::vector<std::string> files; /**< Sources to run */
+  std::string output_dir;         /**< Where the output files go */
+  std::string profile;            /**< Compiler profile, "" for default */
+  bool nocache;                   /**< Bypass the server's result cache */
+  std::atomic<size_t> next;       /**< Index of the next file to take */
+  std::mutex lock;                /**< Serializes everything below */
+  std::condition_variable done;   /**< Signalled when every file is in */
+  std::ofstream summary;          /**< SUMMARY_FILE */
+  size_t finished;                /**< Files recorded */
+  size_t passed;                  /**< Programs that compiled and exited 0 */
+
+  BulkRun() : nocache(false), next(0), finished(0), passed(0) {}
+
+  /**
+   * @brief Take the next file
+   *
+   * @param index Receives its index in files
+   * @return false once every file was taken
+   */
+  bool take(size_t &index) {
+    index = next.fetch_add(1);
+    return index < files.size();
+  }
+
+  /**
+   * @brief Path of the output file of a source
+   *
+   * @param source Source file as given
+   * @return Path inside output_dir
+   */
+  std::string output_path(const std::string &source) const {
+    std::string name = source;
+    while (name.compare(0, 2, "./") == 0) {
+      name.erase(0, 2);
+    }
+    while (!name.empty() && name[0] == '/') {
+      name.erase(0, 1);
+    }
+    std::replace(name.begin(), name.end(), '/', '_');
+    return output_dir + "/" + name + ".out";
+  }
+
+  /**
+   * @brief Write the output of a file and its summary line
+   *
+   * @param index File index
+   * @param verdict passed, failed, compile_error, timed_out, busy or error
+   * @param result Decoded RESULT (zeroed when there was none)
+   * @param output Program or compiler output, or the reason for an error
+   */
+  void record(size_t index, const char *verdict,
+              const result_payload_t &result, const std::string &output) {
+    std::ofstream out(output_path(files[index]).c_str(), std::ios::binary);
+    out << output;
+
+    std::lock_guard<std::mutex> guard(lock);
+    finished++;
+    if (std::strcmp(verdict, "passed") == 0) {
+      passed++;
+    }
+    summary << files[index] << '\t' << verdict << '\t' << result.exit_code
+            << '\t' << result.cpu_us / 1000.0 << '\t'
+            << result.wall_us / 1000.0 << '\n';
+    std::cout << "[" << finished << "/" << files.size() << "] "
+              << files[index] << ": " << verdict;
+    if (result.flags & RESULT_COMPILE_ERROR || result.exit_code < 0) {
+      std::cout << std::endl;
+    } else {
+      std::cout << " (exit code " << result.exit_code << ")" << std::endl;
+    }
+    if (finished == files.size()) {
+      done.notify_all();
+    }
+  }
+
+  /**
+   * @brief Wait until every file is recorded
+   */
+  void wait() {
+    std::unique_lock<std::mutex> guard(lock);
+    done.wait(guard, [this] { return finished == files.size(); });
+  }
+};
 
 /**
  * @class RegularClient
@@ -47,38 +348,288 @@
 
 class RegularClient {
 private:
-  int sock;                     /**< Socket file descriptor */
-  struct sockaddr_in serv_addr; /**< Server address structure */
+  cce::Connection conn;        /**< Connection to the server */
+  cce::ReplyAssembler replies; /**< Replies of pipelined submissions */
+  uint32_t next_job_id;        /**< Identifier of the next submission */
+  std::string profile; /**< Compiler profile to request, "" for default */
+  bool trace;          /**< Ask for the timeline of every submission */
 
 public:
   /**
    * @brief Default constructor
    *
-   * Initializes the RegularClient with invalid socket descriptor.
+   * Initializes the RegularClient without a connection.
    */
-  RegularClient() : sock(-1) {}
+  RegularClient() : next_job_id(1), trace(false) {}
 
-  bool connect_to_server() {
-    if ((sock = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
-      std::cerr << "Socket creation error" << std::endl;
+  /**
+   * @brief Connect to the server
+   *
+   * @param verbose Print a line once connected
+   * @return true on success
+   */
+  bool connect_to_server(bool verbose = true) {
+    if (!conn.open(SERVER_IP, PORT)) {
+      std::cerr << "Connection Failed" << std::endl;
       return false;
     }
 
-    serv_addr.sin_family = AF_INET;
-    serv_addr.sin_port = htons(PORT);
+    if (verbose) {
+      std::cout << "Connected to server on port " << PORT << std::endl;
+    }
+    return true;
+  }
 
-    if (inet_pton(AF_INET, SERVER_IP, &serv_addr.sin_addr) <= 0) {
-      std::cerr << "Invalid address/ Address not supported" << std::endl;
-      return false;
+  /**
+   * @brief Send a submission
+   *
+   * The selected compiler profile, if any, is appended, and
+   * FRAME_FLAG_TRACE is set while tracing is on.
+   *
+   * @param job_id Request identifier
+   * @param submission Fields and flags
+   * @return true on success
+   */
+  bool send_submission(uint32_t job_id, cce::Submission submission) {
+    if (trace) {
+      submission.flags |= FRAME_FLAG_TRACE;
     }
+    submission.profile(profile);
+    return conn.send_submission(job_id, submission);
+  }
 
-    if (connect(sock, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) < 0) {
-      std::cerr << "Connection Failed" << std::endl;
-      return false;
+  /**
+   * @brief Print the limit, verdict and resource notes of a result
+   *
+   * @param result Decoded RESULT or CASE header
+   */
+  static void print_notes(const result_payload_t &result) {
+    if (result.flags & RESULT_WRONG_OUTPUT) {
+      std::cout << " [wrong output]";
+    }
+    if (result.flags & RESULT_TIMED_OUT) {
+      std::cout << " [time limit exceeded]";
+    }
+    if (result.flags & RESULT_TRUNCATED) {
+      std::cout << " [output truncated]";
+    }
+    if (result.flags & RESULT_MEMORY_LIMIT) {
+      std::cout << " [memory limit exceeded]";
     }
+    if (result.flags & RESULT_PROCESS_LIMIT) {
+      std::cout << " [process limit reached]";
+    }
+    if (result.flags & RESULT_CACHED) {
+      std::cout << " [cached]";
+    } else if (result.wall_us > 0) {
+      std::cout << std::fixed << std::setprecision(1) << " [cpu "
+                << result.cpu_us / 1000.0 << " ms, wall "
+                << result.wall_us / 1000.0 << " ms, peak "
+                << result.peak_kb / 1024.0 << " MB]";
+      std::cout.unsetf(std::ios::floatfield);
+    }
+  }
 
-    std::cout << "Connected to server on port " << PORT << std::endl;
-    return true;
+  /**
+   * @brief Print the summary line of a RESULT frame
+   *
+   * @param result Decoded RESULT
+   * @param cases Number of test cases of a batch, 0 for a single run
+   */
+  static void print_result(const result_payload_t &result, size_t cases) {
+    if (result.flags & RESULT_COMPILE_ERROR) {
+      std::cout << "[compilation failed]" << std::endl;
+    } else if (cases > 0 && result.exit_code >= 0) {
+      std::cout << "[" << cases - result.exit_code << " of " << cases
+                << " cases passed]";
+      print_notes(result);
+      std::cout << std::endl;
+    } else if (result.exit_code >= 0) {
+      std::cout << "[exit code " << result.exit_code << "]";
+      print_notes(result);
+      std::cout << std::endl;
+    }
+  }
+
+  /**
+   * @brief Print the reply to a submission
+   *
+   * OUTPUT frames are printed as they arrive. CASE frames are collected
+   * per case and each case is reported once its last frame is in, with
+   * its output shown only if it failed. A TRACE frame is printed after
+   * the output.
+   *
+   * @param cases Test cases of a batch, empty for a single run
+   */
+  void print_reply(const std::vector<TestCase> &cases) {
+    std::map<uint32_t, std::string> case_output;
+    frame_header_t header;
+    std::string payload;
+    const uint8_t *bytes;
+    bool line_open = false;
+
+    std::cout << "\n=== EXECUTION RESULT ===" << std::endl;
+    while (conn.recv_frame(header, payload)) {
+      bytes = reinterpret_cast<const uint8_t *>(payload.data());
+      if (header.type == FRAME_OUTPUT) {
+        std::cout << payload << std::flush;
+        line_open = !payload.empty() ? payload.back() != '\n' : line_open;
+        continue;
+      }
+
+      if (header.type == FRAME_CASE) {
+        result_payload_t result;
+        uint32_t index;
+        long start = case_decode_header(bytes, payload.size(), &index,
+                                        &result);
+        if (start < 0) {
+          continue;
+        }
+        std::string &output = case_output[index];
+        output.append(payload, static_cast<size_t>(start), std::string::npos);
+        if (header.flags & FRAME_FLAG_MORE) {
+          continue;
+        }
+        bool passed = result.exit_code == 0 &&
+                      !(result.flags & RESULT_WRONG_OUTPUT);
+        std::cout << "Case " << index;
+        if (index < cases.size()) {
+          std::cout << " (" << cases[index].name << ")";
+        }
+        std::cout << ": " << (passed ? "passed" : "FAILED") << " [exit code "
+                  << result.exit_code << "]";
+        print_notes(result);
+        std::cout << std::endl;
+        if (!passed && !output.empty()) {
+          std::cout << output;
+          if (output.back() != '\n') {
+            std::cout << std::endl;
+          }
+        }
+        case_output.erase(index);
+        continue;
+      }
+
+      if (header.type == FRAME_TRACE) {
+        if (line_open) {
+          std::cout << std::endl;
+          line_open = false;
+        }
+        std::cout << payload;
+        continue;
+      }
+
+      if (header.type == FRAME_RESULT) {
+        result_payload_t result;
+        result_decode(bytes, payload.size(), &result);
+        if (line_open) {
+          std::cout << std::endl;
+        }
+        print_result(result, cases.size());
+      } else if (header.type == FRAME_BUSY && payload.size() >= 4) {
+        std::cout << "Server busy, retry after "
+                  << protocol_get_u32(bytes) << " ms" << std::endl;
+      } else {
+        std::cout << payload;
+      }
+      std::cout << "======================" << std::endl;
+      return;
+    }
+    std::cerr << "Connection to server lost" << std::endl;
+  }
+
+  /**
+   * @brief Submit a program without waiting for its reply
+   *
+   * Any number of submissions may be in flight on the connection; the
+   * server works on several at once and answers them as they finish.
+   * Collect the replies with wait_any().
+   *
+   * @param code The C source code to compile and execute
+   *
+   * @return Job id of the submission, 0 if it could not be sent
+   */
+  uint32_t submit(std::string code) {
+    uint32_t job_id = next_job_id++;
+
+    if (!send_submission(job_id, cce::Submission(std::move(code)))) {
+      return 0;
+    }
+    return job_id;
+  }
+
+  /**
+   * @brief Wait for the next submission to be answered
+   *
+   * Frames are collected per job until the job's RESULT, BUSY or ERROR
+   * frame arrives, so replies may complete in any order.
+   *
+   * @param done Receives the reply
+   * @return true on success, false if the connection was lost
+   */
+  bool wait_any(cce::Result &done) {
+    frame_header_t header;
+    std::string payload;
+
+    while (conn.recv_frame(header, payload)) {
+      if (replies.feed(header, payload, done)) {
+        return true;
+      }
+    }
+    replies.clear();
+    return false;
+  }
+
+  /**
+   * @brief Run several programs at once over the connection
+   *
+   * Submits every file before reading any reply, then prints each
+   * program's output and result in the order they finish.
+   *
+   * @param filenames Source files to run
+   */
+  void send_pipelined(const std::vector<std::string> &filenames) {
+    std::map<uint32_t, std::string> names;
+    cce::Result done;
+
+    for (const std::string &filename : filenames) {
+      std::string code;
+      if (!read_file(filename, code)) {
+        std::cout << "Error: Cannot open file " << filename << std::endl;
+        continue;
+      }
+      uint32_t job_id = submit(std::move(code));
+      if (job_id == 0) {
+        std::cerr << "Send failed" << std::endl;
+        break;
+      }
+      names[job_id] = filename;
+    }
+    std::cout << "Submitted " << names.size() << " programs" << std::endl;
+
+    while (!names.empty()) {
+      if (!wait_any(done)) {
+        std::cerr << "Connection to server lost" << std::endl;
+        return;
+      }
+      std::map<uint32_t, std::string>::iterator name = names.find(done.job_id);
+      if (name == names.end()) {
+        continue;
+      }
+      std::cout << "\n=== " << name->second << " ===" << std::endl;
+      if (done.busy()) {
+        std::cout << "Server busy, retry after " << done.retry_ms << " ms"
+                  << std::endl;
+      }
+      std::cout << done.output;
+      if (!done.output.empty() && done.output.back() != '\n') {
+        std::cout << std::endl;
+      }
+      if (done.type == FRAME_RESULT) {
+        print_result(done.result, 0);
+      }
+      names.erase(name);
+    }
   }
 
   /**
@@ -88,27 +639,79 @@ public:
    * the compilation and execution results.
    *
    * @param code The C source code to compile and execute
+   * @param nocache Ask the server to run the program even if its result
+   *        is cached
+   * @param input Standard input of the program, or NULL for none
    *
    * @details The function:
-   * 1. Sends code to server via TCP socket
-   * 2. Waits for server response
-   * 3. Displays formatted execution results
+   * 1. Splits the code (and input) into SUBMIT frames
+   * 2. Prints OUTPUT frames as they arrive (the server streams them while
+   *    the program runs)
+   * 3. Displays the exit code from the RESULT frame (or the BUSY/ERROR
+   *    reason)
    * 4. Handles network errors gracefully
    */
-  void send_code(const std::string &code) {
-    if (send(sock, code.c_str(), code.length(), 0) < 0) {
+  void send_code(const std::string &code, bool nocache = false,
+                 const std::string *input = NULL) {
+    cce::Submission submission(code, FRAME_FLAG_STREAM);
+
+    if (nocache) {
+      submission.flags |= FRAME_FLAG_NOCACHE;
+    }
+    if (input) {
+      submission.input(*input);
+    }
+    if (!send_submission(next_job_id++, std::move(submission))) {
+      std::cerr << "Send failed" << std::endl;
+      return;
+    }
+    print_reply(std::vector<TestCase>());
+  }
+
+  /**
+   * @brief Send a multi-file project to the server for execution
+   *
+   * The server compiles the project's units in parallel, reusing the
+   * cached objects of unchanged ones, links them and runs the program.
+   *
+   * @param project Files from load_project()
+   * @param input Standard input of the program, or NULL for none
+   */
+  void send_project(cce::Submission project, const std::string *input = NULL) {
+    project.flags = FRAME_FLAG_STREAM;
+    if (input) {
+      project.input(*input);
+    }
+    if (!send_submission(next_job_id++, std::move(project))) {
       std::cerr << "Send failed" << std::endl;
       return;
     }
+    print_reply(std::vector<TestCase>());
+  }
 
-    char buffer[BUFFER_SIZE] = {0};
-    int bytes_received = recv(sock, buffer, BUFFER_SIZE - 1, 0);
+  /**
+   * @brief Run a program against a set of test cases in one batch
+   *
+   * The server compiles the code once and runs the cases in parallel;
+   * each case is reported as it finishes, followed by a summary.
+   *
+   * @param code The C source code to test
+   * @param cases Test cases (at least one)
+   */
+  void send_tests(const std::string &code, const std::vector<TestCase> &cases) {
+    cce::Submission submission(code);
 
-    if (bytes_received > 0) {
-      std::cout << "\n=== EXECUTION RESULT ===" << std::endl;
-      std::cout << buffer << std::endl;
-      std::cout << "======================" << std::endl;
+    for (const TestCase &test : cases) {
+      submission.test_case(test.input);
+      if (test.has_expected) {
+        submission.expect(test.expected);
+      }
+    }
+    if (!send_submission(next_job_id++, std::move(submission))) {
+      std::cerr << "Send failed" << std::endl;
+      return;
     }
+    print_reply(cases);
   }
 
   /**
@@ -123,6 +726,18 @@ public:
    * 3. Processes user input:
    *    - "quit": Exit the client
    *    - "load <filename>": Load and send code from file
+   *    - "nocache <filename>": Same, but bypass the server's result cache
+   *    - "run <filename> <input file>": Run with the file as stdin
+   *    - "test <filename> <directory>": Run against the directory's test
+   *      cases (NAME.in, optional NAME.out) in one batch
+   *    - "pipeline <filename>...": Submit every file at once and print
+   *      the results as they finish
+   *    - "project <directory> [input file]": Build the directory's .c and
+   *      .h files as one program and run it
+   *    - "profile [name]": Compile later submissions with a server
+   *      compiler profile (no name: the server's default)
+   *    - "trace on|off": Print the server's phase timeline of later
+   *      submissions
    *    - Default: Interactive multi-line code entry
    * 4. Handles file loading errors
    * 5. Provides multi-line code input (end with "END")
@@ -137,7 +752,25 @@ public:
     std::cout << "1. Type C code directly (end with 'END' on a new line)"
               << std::endl;
     std::cout << "2. 'load <filename>' - Load code from file" << std::endl;
-    std::cout << "3. 'quit' - Exit" << std::endl;
+    std::cout << "3. 'nocache <filename>' - Load code and always run it"
+              << std::endl;
+    std::cout << "4. 'run <filename> <input file>' - Run with input on stdin"
+              << std::endl;
+    std::cout << "5. 'test <filename> <directory>' - Run against every "
+                 "NAME.in (and NAME.out)"
+              << std::endl;
+    std::cout << "6. 'pipeline <filename>...' - Run several files at once"
+              << std::endl;
+    std::cout << "7. 'project <directory> [input file]' - Build and run a "
+                 "multi-file project"
+              << std::endl;
+    std::cout << "8. 'profile [name]' - Select a compiler profile (fast, O2, "
+                 "native, ...)"
+              << std::endl;
+    std::cout << "9. 'trace on|off' - Show where the server spent each "
+                 "job's time"
+              << std::endl;
+    std::cout << "10. 'quit' - Exit" << std::endl;
 
     std::string input;
     while (true) {
@@ -145,12 +778,92 @@ public:
       std::getline(std::cin, input);
 
       if (input == "quit") {
-        send(sock, "QUIT", 4, 0);
+        conn.send_frame(FRAME_QUIT, 0, 0, "");
         break;
       }
 
-      if (input.substr(0, 5) == "load ") {
-        std::string filename = input.substr(5);
+      if (input == "profile" || input.substr(0, 8) == "profile ") {
+        std::istringstream words(input.substr(7));
+        profile.clear();
+        words >> profile;
+        std::cout << "Compiler profile: "
+                  << (profile.empty() ? "server default" : profile)
+                  << std::endl;
+        continue;
+      }
+
+      if (input == "trace on" || input == "trace off") {
+        trace = input == "trace on";
+        std::cout << "Tracing " << (trace ? "on" : "off") << std::endl;
+        continue;
+      }
+
+      if (input.substr(0, 9) == "pipeline ") {
+        std::istringstream words(input.substr(9));
+        std::vector<std::string> filenames;
+        std::string filename;
+        while (words >> filename) {
+          filenames.push_back(filename);
+        }
+        send_pipelined(filenames);
+        continue;
+      }
+
+      if (input.substr(0, 8) == "project ") {
+        std::istringstream words(input.substr(8));
+        std::string dir, input_file, stdin_data;
+        cce::Submission project;
+        words >> dir >> input_file;
+        size_t loaded = load_project(dir, project);
+        if (loaded == 0) {
+          std::cout << "Error: No .c or .h files in " << dir << std::endl;
+        } else if (!input_file.empty() &&
+                   !read_file(input_file, stdin_data)) {
+          std::cout << "Error: Cannot open file " << input_file << std::endl;
+        } else {
+          std::cout << "Building " << loaded << " files from " << dir
+                    << std::endl;
+          send_project(std::move(project),
+                       input_file.empty() ? NULL : &stdin_data);
+        }
+        continue;
+      }
+
+      if (input.substr(0, 4) == "run " || input.substr(0, 5) == "test ") {
+        bool test = input[0] == 't';
+        std::istringstream words(input.substr(test ? 5 : 4));
+        std::string filename, argument, code;
+        words >> filename >> argument;
+        if (argument.empty()) {
+          std::cout << "Usage: " << (test ? "test <filename> <directory>"
+                                          : "run <filename> <input file>")
+                    << std::endl;
+        } else if (!read_file(filename, code)) {
+          std::cout << "Error: Cannot open file " << filename << std::endl;
+        } else if (test) {
+          std::vector<TestCase> cases;
+          if (!load_tests(argument, cases) || cases.empty()) {
+            std::cout << "Error: No test cases in " << argument << std::endl;
+          } else {
+            std::cout << "Testing " << filename << " against " << cases.size()
+                      << " cases" << std::endl;
+            send_tests(code, cases);
+          }
+        } else {
+          std::string stdin_data;
+          if (!read_file(argument, stdin_data)) {
+            std::cout << "Error: Cannot open file " << argument << std::endl;
+          } else {
+            std::cout << "Sending code from file: " << filename << std::endl;
+            send_code(code, false, &stdin_data);
+          }
+        }
+        continue;
+      }
+
+      bool nocache = input.substr(0, 8) == "nocache ";
+      if (input.substr(0, 5) == "load " || nocache) {
+        std::string filename = input.substr(nocache ? 8 : 5);
         std::ifstream file(filename);
         if (file.is_open()) {
           std::stringstream buffer;
@@ -159,7 +872,7 @@ public:
           file.close();
 
           std::cout << "Sending code from file: " << filename << std::endl;
-          send_code(code);
+          send_code(code, nocache);
         } else {
           std::cout << "Error: Cannot open file " << filename << std::endl;
         }
@@ -185,31 +898,209 @@ public:
       }
     }
 
-    close(sock);
+    conn.close();
     std::cout << "Disconnected from server." << std::endl;
   }
+};
 
-  /**
-   * @brief Destructor
-   *
-   * Ensures socket is properly closed when object is destroyed.
-   */
-  ~RegularClient() {
-    if (sock >= 0) {
-      close(sock);
+/**
+ * @brief Verdict of a finished submission for the bulk summary
+ *
+ * @param done Reply
+ * @return passed, failed, compile_error, timed_out, busy or error
+ */
+static const char *verdict(const cce::Result &done) {
+  if (done.type == FRAME_BUSY) {
+    return "busy";
+  }
+  if (done.type != FRAME_RESULT || (done.result.flags & RESULT_FAILED)) {
+    return "error";
+  }
+  if (done.result.flags & RESULT_COMPILE_ERROR) {
+    return "compile_error";
+  }
+  if (done.result.flags & RESULT_TIMED_OUT) {
+    return "timed_out";
+  }
+  return done.result.exit_code == 0 ? "passed" : "failed";
+}
+
+/**
+ * @brief Submit the next file of a bulk run, if any is left
+ *
+ * Files that cannot be read are recorded at once. The reply's callback
+ * records it and submits the next file, so each reply keeps one more job
+ * in flight until every file was taken.
+ *
+ * @param client Client of the run (its connections and retries)
+ * @param bulk Shared run state
+ */
+static void submit_next(cce::Client &client, BulkRun &bulk) {
+  const cce::Result none;
+  size_t index;
+
+  while (bulk.take(index)) {
+    std::string code;
+    if (!read_file(bulk.files[index], code)) {
+      bulk.record(index, "error", none.result, "ERROR: Cannot open file\n");
+      continue;
+    }
+    cce::Submission submission(std::move(code), FRAME_FLAG_BULK);
+    if (bulk.nocache) {
+      submission.flags |= FRAME_FLAG_NOCACHE;
     }
+    submission.profile(bulk.profile);
+    client.submit(std::move(submission),
+                  [&client, &bulk, index](cce::Result &&done) {
+                    if (done.busy()) {
+                      done.output = "Server busy, retry after " +
+                                    std::to_string(done.retry_ms) + " ms\n";
+                    } else if (!done.answered()) {
+                      done.output = "ERROR: " + done.output + "\n";
+                    }
+                    bulk.record(index, verdict(done), done.result,
+                                done.output);
+                    submit_next(client, bulk);
+                  });
+    return;
   }
-};
+}
+
+/**
+ * @brief Print the command line help
+ *
+ * @param prog Program name
+ */
+static void print_usage(const char *prog) {
+  std::cout << "Usage: " << prog << "                 Interactive session\n"
+            << "       " << prog
+            << " [options] <file.c|directory|'glob'>...\n"
+            << "Runs every source over pipelined connections and writes "
+               "NAME.out files and\n"
+            << SUMMARY_FILE << " (verdict, exit code, CPU and wall ms per "
+                               "file) to the output directory.\n"
+            << "  --concurrency N     Connections to use (default: "
+            << DEFAULT_CONCURRENCY << ")\n"
+            << "  --output-dir DIR    Output directory (default: "
+            << DEFAULT_OUTPUT_DIR << ")\n"
+            << "  --profile NAME      Compiler profile to request\n"
+            << "  --nocache           Bypass the server's result cache\n"
+            << "Exits with 0 only if every program compiled and exited with "
+               "0."
+            << std::endl;
+}
+
+/**
+ * @brief Run every source named on the command line
+ *
+ * Submissions are flagged FRAME_FLAG_BULK so the server runs them behind
+ * interactive jobs, BULK_DEPTH per connection are kept in flight, and a
+ * file refused with BUSY is sent again after the server's retry hint, up
+ * to BULK_MAX_RETRIES times.
+ *
+ * @param bulk Files and options
+ * @param concurrency Connections to open
+ * @return EXIT_SUCCESS if every program passed
+ */
+static int run_bulk(BulkRun &bulk, unsigned concurrency) {
+  cce::ClientOptions options;
+  std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+
+  mkdir(bulk.output_dir.c_str(), 0755);
+  bulk.summary.open((bulk.output_dir + "/" + SUMMARY_FILE).c_str());
+  if (!bulk.summary.is_open()) {
+    std::cerr << "Error: Cannot write to " << bulk.output_dir << std::endl;
+    return EXIT_FAILURE;
+  }
+  bulk.summary << std::fixed << std::setprecision(1);
+  bulk.summary << "file\tverdict\texit_code\tcpu_ms\twall_ms\n";
+
+  concurrency = std::max(1u, std::min<unsigned>(
+                                 concurrency,
+                                 static_cast<unsigned>(bulk.files.size())));
+  options.connections = concurrency;
+  options.max_in_flight = concurrency * BULK_DEPTH;
+  options.busy_retries = BULK_MAX_RETRIES;
+  {
+    cce::Client client(SERVER_IP, PORT, options);
+    for (unsigned i = 0; i < options.max_in_flight; i++) {
+      submit_next(client, bulk);
+    }
+    bulk.wait();
+  }
+
+  double elapsed = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+  std::cout << std::fixed << std::setprecision(2) << bulk.passed << " of "
+            << bulk.files.size() << " programs passed in " << elapsed
+            << " s; output in " << bulk.output_dir << "/" << std::endl;
+  return bulk.passed == bulk.files.size() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
 
 /**
  * @brief Main function for regular client
  *
- * Entry point for the regular client application.
- * Creates a RegularClient instance and runs the interactive interface.
+ * Entry point for the regular client application. Without arguments it
+ * runs the interactive interface; with source files it runs them all
+ * (see BulkRun).
  *
- * @return 0 on successful termination
+ * @param argc Argument count
+ * @param argv Argument vector
+ * @return 0 on successful termination (bulk mode: if every program
+ *         passed)
  */
-int main() {
+int main(int argc, char **argv) {
+  static const struct option options[] = {
+      {"concurrency", required_argument, NULL, 'c'},
+      {"output-dir", required_argument, NULL, 'd'},
+      {"profile", required_argument, NULL, 'p'},
+      {"nocache", no_argument, NULL, 'n'},
+      {"help", no_argument, NULL, 'h'},
+      {NULL, 0, NULL, 0}};
+  unsigned concurrency = DEFAULT_CONCURRENCY;
+  BulkRun bulk;
+  int opt;
+
+  bulk.output_dir = DEFAULT_OUTPUT_DIR;
+  while ((opt = getopt_long(argc, argv, "c:d:p:nh", options, NULL)) != -1) {
+    switch (opt) {
+    case 'c':
+      concurrency = static_cast<unsigned>(std::strtoul(optarg, NULL, 10));
+      break;
+    case 'd':
+      bulk.output_dir = optarg;
+      break;
+    case 'p':
+      bulk.profile = optarg;
+      break;
+    case 'n':
+      bulk.nocache = true;
+      break;
+    case 'h':
+      print_usage(argv[0]);
+      return EXIT_SUCCESS;
+    default:
+      print_usage(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (optind < argc) {
+    for (int i = optind; i < argc; i++) {
+      if (!expand_sources(argv[i], bulk.files)) {
+        std::cerr << "Warning: No source files match " << argv[i]
+                  << std::endl;
+      }
+    }
+    if (bulk.files.empty()) {
+      std::cerr << "Error: No source files to run" << std::endl;
+      return EXIT_FAILURE;
+    }
+    return run_bulk(bulk, concurrency);
+  }
+
   std::cout << "Code Compiler & Executor - Regular Client" << std::endl;
   std::cout << "=========================================" << std::endl;
 
@@ -13,14 +13,93 @@ functionality as the C++ client but with cross-platform compatibility
 @copyright This project is for educational purposes as part of the PCD course.
 """
 
-import socket
+import struct
 import sys
 import os
 
-# Server configuration constants
-SERVER_IP = "127.0.0.1"    #: Default server IP address
-PORT = 8080                #: Regular client server port
-BUFFER_SIZE = 4096         #: Maximum buffer size for network communications
+from cce_client import (
+    SERVER_IP, PORT, FRAME_OUTPUT, FRAME_RESULT, FRAME_BUSY, FRAME_ERROR,
+    FRAME_QUIT, FRAME_CASE, FRAME_TRACE, FRAME_FLAG_MORE, FRAME_FLAG_NOCACHE,
+    FRAME_FLAG_STREAM, FRAME_FLAG_TRACE, FIELD_SOURCE, FIELD_INPUT,
+    FIELD_EXPECTED, FIELD_CASE, FIELD_PROFILE, FIELD_FILE, RESULT,
+    CASE_HEADER, RESULT_COMPILE_ERROR, RESULT_TIMED_OUT, RESULT_TRUNCATED,
+    RESULT_CACHED, RESULT_MEMORY_LIMIT, RESULT_PROCESS_LIMIT,
+    RESULT_WRONG_OUTPUT, Connection, decode_result, encode_frame,
+    encode_submission)
+
+TEST_INPUT_SUFFIX = ".in"    #: Extension of test case input files
+TEST_OUTPUT_SUFFIX = ".out"  #: Extension of expected output files
+
+def result_notes(result_flags, cpu_us, wall_us, peak_kb):
+    """
+    Describe the limit, verdict and resource information of a result.
+    
+    Returns:
+        list: Bracketed notes
+    """
+    notes = []
+    if result_flags & RESULT_WRONG_OUTPUT:
+        notes.append("[wrong output]")
+    if result_flags & RESULT_TIMED_OUT:
+        notes.append("[time limit exceeded]")
+    if result_flags & RESULT_TRUNCATED:
+        notes.append("[output truncated]")
+    if result_flags & RESULT_MEMORY_LIMIT:
+        notes.append("[memory limit exceeded]")
+    if result_flags & RESULT_PROCESS_LIMIT:
+        notes.append("[process limit reached]")
+    if result_flags & RESULT_CACHED:
+        notes.append("[cached]")
+    elif wall_us:
+        notes.append(f"[cpu {cpu_us / 1000:.1f} ms, "
+                     f"wall {wall_us / 1000:.1f} ms, "
+                     f"peak {peak_kb / 1024:.1f} MB]")
+    return notes
+
+def load_tests(directory):
+    """
+    Load the test cases of a directory.
+    
+    Every NAME.in file is a case; NAME.out, if present, is its expected
+    output.
+    
+    Returns:
+        list: (name, input bytes, expected bytes or None), sorted by name
+    """
+    cases = []
+    for entry in sorted(os.listdir(directory)):
+        if not entry.endswith(TEST_INPUT_SUFFIX) or entry == TEST_INPUT_SUFFIX:
+            continue
+        name = entry[:-len(TEST_INPUT_SUFFIX)]
+        with open(os.path.join(directory, entry), 'rb') as file:
+            stdin_data = file.read()
+        expected = None
+        expected_path = os.path.join(directory, name + TEST_OUTPUT_SUFFIX)
+        if os.path.exists(expected_path):
+            with open(expected_path, 'rb') as file:
+                expected = file.read()
+        cases.append((name, stdin_data, expected))
+    return cases
+
+def load_project(directory):
+    """
+    Load a multi-file project.
+    
+    Every *.c and *.h file directly in the directory becomes a FIELD_FILE
+    with its name followed by a FIELD_SOURCE with its text.
+    
+    Returns:
+        list: SUBMIT fields, in file name order (empty if there are none)
+    """
+    fields = []
+    for entry in sorted(os.listdir(directory)):
+        if entry.startswith('.') or not entry.endswith(('.c', '.h')):
+            continue
+        with open(os.path.join(directory, entry), 'rb') as file:
+            text = file.read()
+        fields.append((FIELD_FILE, entry.encode('utf-8')))
+        fields.append((FIELD_SOURCE, text))
+    return fields
 
 class CrossPlatformClient:
     """
@@ -31,7 +110,7 @@ class CrossPlatformClient:
     features like built-in help and sample code.
     
     Attributes:
-        sock: Socket connection to the server
+        conn: Connection to the server (see cce_client.Connection)
     """
     
     def __init__(self):
@@ -40,7 +119,11 @@ class CrossPlatformClient:
         
         Sets up the client with no active socket connection.
         """
-        self.sock = None
+        self.conn = Connection(SERVER_IP, PORT)
+        self.next_job_id = 1
+        self.pending = {}  # job id -> output of jobs not yet answered
+        self.profile = None  # compiler profile to request, None for default
+        self.trace = False  # ask for the timeline of every submission
     
     def connect_to_server(self):
         """
@@ -55,35 +138,302 @@ class CrossPlatformClient:
             Displays connection status and error messages.
         """
         try:
-            self.sock = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
-            self.sock.connect((SERVER_IP, PORT))
+            self.conn.connect()
             print(f"Connected to server on port {PORT}")
             return True
         except Exception as e:
             print(f"Connection failed: {e}")
             return False
     
-    def send_code(self, code):
+    def send_frame(self, frame_type, flags, job_id, payload=b""):
+        """
+        Send one frame.
+        
+        Args:
+            frame_type (int): FRAME_* type
+            flags (int): FRAME_FLAG_* bits
+            job_id (int): Request identifier
+            payload (bytes): Frame payload
+        """
+        self.conn.send(encode_frame(frame_type, flags, job_id, payload))
+    
+    def recv_frame(self):
+        """
+        Receive one frame.
+        
+        Returns:
+            tuple: (type, flags, job_id, payload)
+            
+        Raises:
+            ConnectionError: On disconnect or a malformed header
+        """
+        return self.conn.recv_frame()
+    
+    def send_submission(self, job_id, flags, fields):
+        """
+        Send a SUBMIT sequence.
+        
+        The fields are framed by cce_client.encode_submission(). The
+        selected compiler profile, if any, is appended, and
+        FRAME_FLAG_TRACE is set while tracing is on. A connection the
+        server closed is reopened first.
+        
+        Args:
+            job_id (int): Request identifier
+            flags (int): FRAME_FLAG_* bits of every frame
+            fields (list): (tag, bytes) pairs in order
+        """
+        if self.trace:
+            flags |= FRAME_FLAG_TRACE
+        if self.profile:
+            fields = fields + [(FIELD_PROFILE, self.profile.encode('utf-8'))]
+        self.conn.send(encode_submission(job_id, flags, fields))
+    
+    def submit(self, code, nocache=False, stdin_data=None):
+        """
+        Submit a program without waiting for its reply.
+        
+        Any number of submissions may be in flight on the connection; the
+        server works on several at once and answers them as they finish.
+        Collect the replies with wait_any().
+        
+        Args:
+            code (str): The C source code to compile and execute
+            nocache (bool): Run the program even if its result is cached
+            stdin_data (bytes): Standard input of the program, or None
+            
+        Returns:
+            int: Job id of the submission
+        """
+        job_id = self.next_job_id
+        self.next_job_id += 1
+        fields = [(FIELD_SOURCE, code.encode('utf-8'))]
+        if stdin_data is not None:
+            fields.append((FIELD_INPUT, stdin_data))
+        self.send_submission(job_id, FRAME_FLAG_NOCACHE if nocache else 0,
+                             fields)
+        self.pending[job_id] = b""
+        return job_id
+    
+    def wait_any(self):
+        """
+        Wait for the next submission to be answered.
+        
+        Output frames are collected per job until the job's RESULT, BUSY
+        or ERROR frame arrives, so replies may complete in any order.
+        
+        Returns:
+            tuple: (job_id, frame_type, result, output) where result is the
+            decoded RESULT (None for BUSY and ERROR) and output holds the
+            program output or the BUSY/ERROR text
+            
+        Raises:
+            ConnectionError: If the connection was lost
+        """
+        while True:
+            frame_type, _, job_id, payload = self.recv_frame()
+            if frame_type == FRAME_OUTPUT:
+                self.pending[job_id] = self.pending.get(job_id, b"") + payload
+                continue
+            if frame_type not in (FRAME_RESULT, FRAME_BUSY, FRAME_ERROR):
+                continue
+            output = self.pending.pop(job_id, b"")
+            if frame_type == FRAME_RESULT:
+                return job_id, frame_type, decode_result(payload), output
+            if frame_type == FRAME_BUSY:
+                retry_ms, = struct.unpack("!I", payload[:4])
+                output = f"Server busy, retry after {retry_ms} ms\n".encode()
+            else:
+                output = payload
+            return job_id, frame_type, None, output
+    
+    def send_pipelined(self, filenames):
+        """
+        Run several programs at once over the connection.
+        
+        Every file is submitted before any reply is read; each program's
+        output and result are printed in the order they finish.
+        
+        Args:
+            filenames (list): Source files to run
+        """
+        try:
+            names = {}
+            for filename in filenames:
+                code = self.load_file(filename)
+                if code:
+                    names[self.submit(code)] = filename
+            print(f"Submitted {len(names)} programs")
+            while names:
+                job_id, frame_type, result, output = self.wait_any()
+                if job_id not in names:
+                    continue
+                print(f"\n=== {names.pop(job_id)} ===")
+                text = output.decode('utf-8', errors='replace')
+                if text:
+                    print(text, end="" if text.endswith("\n") else "\n")
+                if result is None:
+                    continue
+                exit_code, result_flags = result[0], result[1]
+                if result_flags & RESULT_COMPILE_ERROR:
+                    print("[compilation failed]")
+                elif exit_code >= 0:
+                    print(" ".join([f"[exit code {exit_code}]"]
+                                   + result_notes(*result[1:])))
+        except Exception as e:
+            print(f"Error running programs: {e}")
+    
+    def print_reply(self, cases=None):
+        """
+        Print the reply to a submission.
+        
+        OUTPUT frames are printed as they arrive. CASE frames are
+        collected per case and each case is reported once its last frame
+        is in, with its output shown only if it failed. A TRACE frame is
+        printed after the output.
+        
+        Args:
+            cases (list): Test cases of a batch as returned by
+                load_tests(), or None for a single run
+        """
+        print("\n=== EXECUTION RESULT ===")
+        line_open = False
+        case_output = {}
+        while True:
+            frame_type, frame_flags, _, payload = self.recv_frame()
+            if frame_type == FRAME_OUTPUT:
+                sys.stdout.write(payload.decode('utf-8', errors='replace'))
+                sys.stdout.flush()
+                if payload:
+                    line_open = not payload.endswith(b"\n")
+                continue
+            if frame_type == FRAME_CASE:
+                if len(payload) < CASE_HEADER.size + RESULT.size:
+                    continue
+                index, = CASE_HEADER.unpack(payload[:CASE_HEADER.size])
+                result = decode_result(payload[CASE_HEADER.size:])
+                start = CASE_HEADER.size + RESULT.size
+                output = case_output.get(index, b"") + payload[start:]
+                if frame_flags & FRAME_FLAG_MORE:
+                    case_output[index] = output
+                    continue
+                case_output.pop(index, None)
+                exit_code, result_flags = result[0], result[1]
+                passed = exit_code == 0 and not result_flags & RESULT_WRONG_OUTPUT
+                label = f"Case {index}"
+                if cases and index < len(cases):
+                    label += f" ({cases[index][0]})"
+                notes = [f"[exit code {exit_code}]"] + result_notes(*result[1:])
+                print(f"{label}: {'passed' if passed else 'FAILED'} "
+                      + " ".join(notes))
+                if not passed and output:
+                    text = output.decode('utf-8', errors='replace')
+                    print(text, end="" if text.endswith("\n") else "\n")
+                continue
+            if frame_type == FRAME_TRACE:
+                if line_open:
+                    print()
+                    line_open = False
+                print(payload.decode('utf-8', errors='replace'), end="")
+                continue
+            if frame_type == FRAME_RESULT:
+                exit_code, result_flags, cpu_us, wall_us, peak_kb = \
+                    decode_result(payload)
+                if line_open:
+                    print()
+                notes = result_notes(result_flags, cpu_us, wall_us, peak_kb)
+                if result_flags & RESULT_COMPILE_ERROR:
+                    print("[compilation failed]")
+                elif cases and exit_code >= 0:
+                    passed = len(cases) - exit_code
+                    print(" ".join([f"[{passed} of {len(cases)} cases passed]"]
+                                   + notes))
+                elif exit_code >= 0:
+                    print(" ".join([f"[exit code {exit_code}]"] + notes))
+            elif frame_type == FRAME_BUSY:
+                retry_ms, = struct.unpack("!I", payload[:4])
+                print(f"Server busy, retry after {retry_ms} ms")
+            else:
+                print(payload.decode('utf-8', errors='replace'), end="")
+            print("========================")
+            return
+    
+    def send_code(self, code, nocache=False, stdin_data=None):
         """
         Send C source code to server for compilation and execution.
         
+        Output is streamed by the server and printed as OUTPUT frames
+        arrive.
+        
         Args:
             code (str): The C source code to compile and execute
+            nocache (bool): Run the program even if its result is cached
+            stdin_data (bytes): Standard input of the program, or None
             
         Note:
             Displays formatted execution results and handles network errors.
         """
         try:
-            self.sock.send(code.encode('utf-8'))
-            response = self.sock.recv(BUFFER_SIZE).decode('utf-8')
-            
-            print("\n=== EXECUTION RESULT ===")
-            print(response)
-            print("========================")
-            
+            job_id = self.next_job_id
+            self.next_job_id += 1
+            flags = FRAME_FLAG_STREAM
+            if nocache:
+                flags |= FRAME_FLAG_NOCACHE
+            fields = [(FIELD_SOURCE, code.encode('utf-8'))]
+            if stdin_data is not None:
+                fields.append((FIELD_INPUT, stdin_data))
+            self.send_submission(job_id, flags, fields)
+            self.print_reply()
         except Exception as e:
             print(f"Error sending code: {e}")
     
+    def send_project(self, files, stdin_data=None):
+        """
+        Send a multi-file project to server for execution.
+        
+        The server compiles the units in parallel, reusing the cached
+        objects of unchanged ones, links them and runs the program.
+        
+        Args:
+            files (list): SUBMIT fields as returned by load_project()
+            stdin_data (bytes): Standard input of the program, or None
+        """
+        try:
+            job_id = self.next_job_id
+            self.next_job_id += 1
+            fields = list(files)
+            if stdin_data is not None:
+                fields.append((FIELD_INPUT, stdin_data))
+            self.send_submission(job_id, FRAME_FLAG_STREAM, fields)
+            self.print_reply()
+        except Exception as e:
+            print(f"Error sending project: {e}")
+    
+    def send_tests(self, code, cases):
+        """
+        Run a program against a set of test cases in one batch.
+        
+        The server compiles the code once and runs the cases in parallel;
+        each case is reported as it finishes, followed by a summary.
+        
+        Args:
+            code (str): The C source code to test
+            cases (list): Test cases as returned by load_tests()
+        """
+        try:
+            job_id = self.next_job_id
+            self.next_job_id += 1
+            fields = [(FIELD_SOURCE, code.encode('utf-8'))]
+            for _, stdin_data, expected in cases:
+                fields.append((FIELD_CASE, b""))
+                fields.append((FIELD_INPUT, stdin_data))
+                if expected is not None:
+                    fields.append((FIELD_EXPECTED, expected))
+            self.send_submission(job_id, 0, fields)
+            self.print_reply(cases)
+        except Exception as e:
+            print(f"Error sending tests: {e}")
+    
     def load_file(self, filename):
         """
         Load C source code from a file.
@@ -147,6 +497,16 @@ int main() {
         Features:
             - Interactive multi-line code entry (end with 'END')
             - File loading with 'load <filename>' command
+            - 'nocache <filename>' to bypass the server's result cache
+            - 'run <filename> <input file>' to run with the file as stdin
+            - 'test <filename> <directory>' to run against the directory's
+              test cases (NAME.in, optional NAME.out) in one batch
+            - 'pipeline <filename>...' to run several files at once
+            - 'project <directory> [input file]' to build the directory's
+              .c and .h files as one program and run it
+            - 'profile [name]' to compile with a server compiler profile
+            - 'trace on|off' to print the server's phase timeline of
+              later submissions
             - Built-in help with sample code
             - Graceful error handling and user feedback
             - Cross-platform compatibility
@@ -158,16 +518,27 @@ int main() {
         print("Commands:")
         print("1. Type C code directly (end with 'END' on a new line)")
         print("2. 'load <filename>' - Load code from file")
-        print("3. 'help' - Show sample code")
-        print("4. 'quit' - Exit")
+        print("3. 'nocache <filename>' - Load code and always run it")
+        print("4. 'run <filename> <input file>' - Run with input on stdin")
+        print("5. 'test <filename> <directory>' - Run against every NAME.in "
+              "(and NAME.out)")
+        print("6. 'pipeline <filename>...' - Run several files at once")
+        print("7. 'project <directory> [input file]' - Build and run a "
+              "multi-file project")
+        print("8. 'profile [name]' - Select a compiler profile (fast, O2, "
+              "native, ...)")
+        print("9. 'trace on|off' - Show where the server spent each job's "
+              "time")
+        print("10. 'help' - Show sample code")
+        print("11. 'quit' - Exit")
         
         while True:
             try:
                 command = input("\nClient> ").strip()
                 
                 if command == "quit":
-                    if self.sock:
-                        self.sock.send(b"QUIT")
+                    if self.conn.sock:
+                        self.send_frame(FRAME_QUIT, 0, 0)
                     break
                 
                 if command == "help":
@@ -181,6 +552,80 @@ int main() {
                         self.send_code(code)
                     continue
                 
+                if command == "profile" or command.startswith("profile "):
+                    self.profile = command[7:].strip() or None
+                    print("Compiler profile: "
+                          + (self.profile or "server default"))
+                    continue
+                
+                if command in ("trace on", "trace off"):
+                    self.trace = command == "trace on"
+                    print("Tracing " + ("on" if self.trace else "off"))
+                    continue
+                
+                if command.startswith("pipeline "):
+                    self.send_pipelined(command.split()[1:])
+                    continue
+                
+                if command.startswith("project "):
+                    words = command.split()
+                    if len(words) not in (2, 3):
+                        print("Usage: project <directory> [input file]")
+                        continue
+                    try:
+                        files = load_project(words[1])
+                        stdin_data = None
+                        if len(words) == 3:
+                            with open(words[2], 'rb') as file:
+                                stdin_data = file.read()
+                    except OSError as e:
+                        print(f"Error reading project: {e}")
+                        continue
+                    if not files:
+                        print(f"Error: No .c or .h files in {words[1]}")
+                        continue
+                    print(f"Building {len(files) // 2} files from {words[1]}")
+                    self.send_project(files, stdin_data)
+                    continue
+                
+                if command.startswith("run ") or command.startswith("test "):
+                    words = command.split()
+                    if len(words) != 3:
+                        print(f"Usage: {words[0]} <filename> "
+                              + ("<directory>" if words[0] == "test"
+                                 else "<input file>"))
+                        continue
+                    code = self.load_file(words[1])
+                    if not code:
+                        continue
+                    if words[0] == "test":
+                        try:
+                            cases = load_tests(words[2])
+                        except OSError as e:
+                            cases = []
+                            print(f"Error reading tests: {e}")
+                        if cases:
+                            print(f"Testing against {len(cases)} cases")
+                            self.send_tests(code, cases)
+                        else:
+                            print(f"Error: No test cases in {words[2]}")
+                        continue
+                    try:
+                        with open(words[2], 'rb') as file:
+                            stdin_data = file.read()
+                    except OSError as e:
+                        print(f"Error reading input: {e}")
+                        continue
+                    self.send_code(code, stdin_data=stdin_data)
+                    continue
+                
+                if command.startswith("nocache "):
+                    filename = command[8:].strip()
+                    code = self.load_file(filename)
+                    if code:
+                        self.send_code(code, nocache=True)
+                    continue
+                
                 # Multi-line code input
                 print("Enter your C code (type 'END' on a new line to finish):")
                 lines = []
@@ -203,8 +648,7 @@ int main() {
             except Exception as e:
                 print(f"Error: {e}")
         
-        if self.sock:
-            self.sock.close()
+        self.conn.close()
         print("Disconnected from server.")
 
 def main():
@@ -0,0 +1,815 @@
+/**
+ * @file cluster.c
+ * @brief Coordinator and worker node roles of a distributed deployment
+ * @author Rares-Nicholas Popa & Adrian-Petru Enache
+ * @version 1.0.0
+ *
+ * @details The coordinator keeps a fixed table of nodes that is never
+ * compacted, so a relaying worker can hold a node pointer without the
+ * lock; a node that comes back after a restart reuses its slot. Each node
+ * has a small stack of idle connections to its regular port. Relaying is
+ * plain blocking I/O on the worker thread, with a receive timeout so that
+ * a node that vanished without closing its sockets does not hold the
+ * worker forever.
+ *
+ * @copyright This project is for educational purposes as part of the PCD
+ * course.
+ */
+
+#include "cluster.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "logger.h"
+#include "protocol.h"
+#include "stats.h"
+
+/** @def NODE_IDLE_MAX
+ * @brief Idle connections kept open per node
+ */
+#define NODE_IDLE_MAX 32
+
+/** @def NODE_CONNECT_TIMEOUT_MS
+ * @brief Time allowed to connect to a node
+ */
+#define NODE_CONNECT_TIMEOUT_MS 2000
+
+/** @def NODE_REPLY_TIMEOUT_MS
+ * @brief Longest silence between two reply frames of a node: a compile
+ * plus one run, with room to spare
+ */
+#define NODE_REPLY_TIMEOUT_MS 60000
+
+/** @def LOAD_SCALE
+ * @brief Fixed-point unit of node loads: one job per worker
+ */
+#define LOAD_SCALE 1000
+
+/**
+ * @struct node_t
+ * @brief One worker node known to the coordinator
+ */
+typedef struct {
+  char host[48];           /**< Numeric address it registered from */
+  uint16_t port;           /**< Its regular port */
+  char address[64];        /**< host:port, for STATUS */
+  uint64_t id_hash;        /**< Hash of address for rendezvous hashing */
+  uint64_t last_seen_us;   /**< Last heartbeat, 0 once taken down */
+  cluster_load_t load;     /**< Last heartbeat */
+  uint32_t in_flight;      /**< Jobs being relayed to it */
+  uint64_t forwarded;      /**< Jobs it answered */
+  uint64_t affinity;       /**< Of those, as the preferred node */
+  int idle[NODE_IDLE_MAX]; /**< Idle connections */
+  size_t idle_count;       /**< Entries in idle */
+} node_t;
+
+/** @brief Protects cluster */
+static pthread_mutex_t cluster_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/** @brief Coordinator state */
+static struct {
+  node_t nodes[CLUSTER_MAX_NODES]; /**< Registration order */
+  size_t count;                    /**< Slots in use */
+  cluster_stats_t stats;           /**< Counters (nodes, alive unused) */
+} cluster;
+
+/** @brief Protects agent.running */
+static pthread_mutex_t agent_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/** @brief Signalled by cluster_leave() */
+static pthread_cond_t agent_wake = PTHREAD_COND_INITIALIZER;
+
+/** @brief Worker node heartbeat thread state */
+static struct {
+  pthread_t thread;     /**< Heartbeat thread */
+  int started;          /**< thread was created */
+  int running;          /**< Cleared by cluster_leave() */
+  int fd;               /**< Connection to the coordinator, or -1 */
+  char host[256];       /**< Coordinator host */
+  uint16_t port;        /**< Coordinator node port */
+  uint16_t job_port;    /**< Port advertised in heartbeats */
+  cluster_load_fn load; /**< Fills in heartbeats */
+} agent;
+
+/**
+ * @brief Scramble a 64-bit value (splitmix64 finalizer)
+ *
+ * @param value Value to mix
+ * @return Well-distributed hash of value
+ */
+static uint64_t mix64(uint64_t value) {
+  value ^= value >> 30;
+  value *= 0xbf58476d1ce4e5b9ULL;
+  value ^= value >> 27;
+  value *= 0x94d049bb133111ebULL;
+  return value ^ (value >> 31);
+}
+
+/**
+ * @brief Hash a string (FNV-1a)
+ *
+ * @param text Null-terminated string
+ * @return 64-bit hash
+ */
+static uint64_t hash_string(const char *text) {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+
+  while (*text) {
+    hash = (hash ^ (unsigned char)*text++) * 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+/**
+ * @brief Whether a node may receive jobs (caller holds the lock)
+ *
+ * @param node Node
+ * @param now_us stats_now_us()
+ * @return 1 if it sent a heartbeat recently
+ */
+static int node_alive(const node_t *node, uint64_t now_us) {
+  return node->last_seen_us != 0 &&
+         now_us - node->last_seen_us < (uint64_t)CLUSTER_NODE_TIMEOUT_MS * 1000;
+}
+
+/**
+ * @brief Jobs per worker on a node, in LOAD_SCALE units (caller holds the
+ * lock)
+ *
+ * The heartbeat is up to a second old and the coordinator's count misses
+ * jobs from other sources, so the larger of the two is used.
+ *
+ * @param node Node
+ * @return Load
+ */
+static uint64_t node_load(const node_t *node) {
+  uint64_t jobs = (uint64_t)node->load.active + node->load.queued;
+  uint32_t workers = node->load.workers > 0 ? node->load.workers : 1;
+
+  if (node->in_flight > jobs) {
+    jobs = node->in_flight;
+  }
+  return jobs * LOAD_SCALE / workers;
+}
+
+/**
+ * @brief Whether a node would refuse another job (caller holds the lock)
+ *
+ * @param node Node
+ * @return 1 if the coordinator already fills its workers and queue
+ */
+static int node_full(const node_t *node) {
+  return node->in_flight >= node->load.workers + node->load.queue_capacity;
+}
+
+/**
+ * @brief Close a node's idle connections and stop sending it jobs (caller
+ * holds the lock)
+ *
+ * @param node Node
+ */
+static void node_down(node_t *node) {
+  while (node->idle_count > 0) {
+    close(node->idle[--node->idle_count]);
+  }
+  node->last_seen_us = 0;
+}
+
+/**
+ * @brief Find a node's slot (caller holds the lock)
+ *
+ * @param host Numeric address
+ * @param port Regular port
+ * @return The node, or NULL if it never registered
+ */
+static node_t *node_find(const char *host, uint16_t port) {
+  for (size_t i = 0; i < cluster.count; i++) {
+    if (cluster.nodes[i].port == port &&
+        strcmp(cluster.nodes[i].host, host) == 0) {
+      return &cluster.nodes[i];
+    }
+  }
+  return NULL;
+}
+
+int cluster_heartbeat(const char *host, const char *text) {
+  unsigned long long jobs, successful, rejected, hits, misses;
+  cluster_load_t load;
+  unsigned port;
+  char message[128];
+  node_t *node;
+  int fresh;
+
+  if (sscanf(text, "LEAVE %u", &port) == 1) {
+    pthread_mutex_lock(&cluster_lock);
+    node = node_find(host, (uint16_t)port);
+    if (node) {
+      node_down(node);
+    }
+    pthread_mutex_unlock(&cluster_lock);
+    if (node) {
+      snprintf(message, sizeof(message), "Worker node %s:%u left", host, port);
+      logger_write(message);
+    }
+    return 0;
+  }
+
+  memset(&load, 0, sizeof(load));
+  if (sscanf(text, "NODE %u %u %u %u %u %llu %llu %llu %llu %llu", &port,
+             &load.workers, &load.active, &load.queued, &load.queue_capacity,
+             &jobs, &successful, &rejected, &hits, &misses) != 10 ||
+      port == 0 || port > 65535 || strlen(host) >= sizeof(node->host)) {
+    return -1;
+  }
+  load.jobs = jobs;
+  load.successful = successful;
+  load.rejected = rejected;
+  load.cache_hits = hits;
+  load.cache_misses = misses;
+
+  pthread_mutex_lock(&cluster_lock);
+  node = node_find(host, (uint16_t)port);
+  if (!node && cluster.count < CLUSTER_MAX_NODES) {
+    node = &cluster.nodes[cluster.count++];
+    snprintf(node->host, sizeof(node->host), "%s", host);
+    node->port = (uint16_t)port;
+    snprintf(node->address, sizeof(node->address), "%s:%u", host, port);
+    node->id_hash = hash_string(node->address);
+  }
+  if (!node) {
+    pthread_mutex_unlock(&cluster_lock);
+    return -1;
+  }
+  fresh = !node_alive(node, stats_now_us());
+  node->load = load;
+  node->last_seen_us = stats_now_us();
+  pthread_mutex_unlock(&cluster_lock);
+
+  if (fresh) {
+    snprintf(message, sizeof(message),
+             "Worker node %s:%u joined with %u workers", host, port,
+             load.workers);
+    logger_write(message);
+  }
+  return 0;
+}
+
+/**
+ * @brief Choose the node for a submission and count the job against it
+ * (caller holds the lock)
+ *
+ * @param key Submission hash
+ * @param tried Nodes already tried for this job, by slot
+ * @param preferred Set to 1 if the preferred node was chosen
+ * @param alive Set to 1 if any untried node is alive, even if all are full
+ *
+ * @return The node, or NULL if no untried node can take the job
+ */
+static node_t *node_pick(uint64_t key, const unsigned char *tried,
+                         int *preferred, int *alive) {
+  uint64_t now_us = stats_now_us();
+  uint64_t best_weight = 0, least_load = 0;
+  node_t *best = NULL, *least = NULL, *node;
+
+  *preferred = 0;
+  *alive = 0;
+  for (size_t i = 0; i < cluster.count; i++) {
+    node = &cluster.nodes[i];
+    if (tried[i] || !node_alive(node, now_us)) {
+      continue;
+    }
+    *alive = 1;
+
+    // Rendezvous hashing: the preferred node only changes for the sources
+    // of a node that joined or left
+    uint64_t weight = mix64(key ^ node->id_hash);
+    if (!best || weight > best_weight) {
+      best = node;
+      best_weight = weight;
+    }
+    if (!node_full(node) && (!least || node_load(node) < least_load)) {
+      least = node;
+      least_load = node_load(node);
+    }
+  }
+
+  node = least;
+  if (best && !node_full(best) &&
+      node_load(best) <= least_load + LOAD_SCALE) {
+    node = best;
+    *preferred = 1;
+  }
+  if (node) {
+    node->in_flight++;
+  }
+  return node;
+}
+
+/**
+ * @brief Open a connection to a node's regular port
+ *
+ * @param host Numeric address
+ * @param port Regular port
+ * @return Blocking socket with a reply timeout, or -1
+ */
+static int node_connect(const char *host, uint16_t port) {
+  struct sockaddr_in address;
+  struct timeval timeout;
+  int opt = 1;
+  int fd;
+
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_port = htons(port);
+  if (inet_pton(AF_INET, host, &address.sin_addr) != 1) {
+    return -1;
+  }
+  fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    return -1;
+  }
+
+  // On Linux the send timeout also bounds connect()
+  timeout.tv_sec = NODE_CONNECT_TIMEOUT_MS / 1000;
+  timeout.tv_usec = (NODE_CONNECT_TIMEOUT_MS % 1000) * 1000;
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+  if (connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0) {
+    close(fd);
+    return -1;
+  }
+  timeout.tv_sec = NODE_REPLY_TIMEOUT_MS / 1000;
+  timeout.tv_usec = (NODE_REPLY_TIMEOUT_MS % 1000) * 1000;
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+  return fd;
+}
+
+/**
+ * @brief Write a whole buffer to a blocking socket
+ *
+ * @param fd Socket
+ * @param data Bytes to send
+ * @param len Number of bytes
+ * @return 0 on success, -1 on failure
+ */
+static int write_all(int fd, const void *data, size_t len) {
+  const char *bytes = (const char *)data;
+
+  while (len > 0) {
+    ssize_t n = send(fd, bytes, len, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return -1;
+    }
+    bytes += n;
+    len -= (size_t)n;
+  }
+  return 0;
+}
+
+/**
+ * @brief Read exactly len bytes from a blocking socket
+ *
+ * @param fd Socket
+ * @param data Destination
+ * @param len Number of bytes
+ * @return 0 on success, -1 on EOF, error or timeout
+ */
+static int read_all(int fd, void *data, size_t len) {
+  char *bytes = (char *)data;
+
+  while (len > 0) {
+    ssize_t n = recv(fd, bytes, len, 0);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return -1;
+    }
+    bytes += n;
+    len -= (size_t)n;
+  }
+  return 0;
+}
+
+/**
+ * @enum relay_t
+ * @brief Outcome of relay()
+ */
+typedef enum {
+  RELAY_DONE,   /**< Reply relayed, connection reusable */
+  RELAY_CLOSED, /**< Reply relayed, connection must be closed */
+  RELAY_BUSY,   /**< Node answered BUSY, nothing relayed */
+  RELAY_FAILED, /**< Node unreachable, nothing relayed */
+  RELAY_LOST    /**< Node lost after part of the reply was relayed */
+} relay_t;
+
+/**
+ * @brief Send a submission to a node and copy the reply to the client
+ *
+ * Frames are copied one at a time as they arrive. If the client is gone
+ * the reply is still read to its end, which keeps the connection usable.
+ *
+ * @param fd Connection to the node
+ * @param conn Client connection
+ * @param request SUBMIT frames
+ * @param length Size of request
+ * @param frame Buffer of FRAME_HEADER_SIZE + FRAME_MAX_PAYLOAD bytes
+ *
+ * @return The outcome
+ */
+static relay_t relay(int fd, connection_t *conn, const void *request,
+                     size_t length, uint8_t *frame) {
+  frame_header_t header;
+  int relayed = 0;
+
+  if (write_all(fd, request, length) != 0) {
+    return RELAY_FAILED;
+  }
+  for (;;) {
+    struct iovec iov;
+
+    if (read_all(fd, frame, FRAME_HEADER_SIZE) != 0 ||
+        frame_decode_header(frame, &header) != 0 ||
+        read_all(fd, frame + FRAME_HEADER_SIZE, header.length) != 0) {
+      return relayed ? RELAY_LOST : RELAY_FAILED;
+    }
+    if (header.type == FRAME_BUSY && !relayed) {
+      return RELAY_BUSY;
+    }
+    iov.iov_base = frame;
+    iov.iov_len = FRAME_HEADER_SIZE + header.length;
+    conn_sendv(conn, &iov, 1);
+    relayed = 1;
+
+    switch (header.type) {
+    case FRAME_RESULT:
+    case FRAME_BUSY:
+      return RELAY_DONE;
+    case FRAME_ERROR:
+      return RELAY_CLOSED; /* the node drops a connection after an ERROR */
+    }
+  }
+}
+
+/**
+ * @brief Run a submission on one node, on a pooled connection if possible
+ *
+ * A pooled connection may have been closed by the node meanwhile (for
+ * instance by a restart), so a failure on one is retried once on a fresh
+ * connection before the node counts as unreachable.
+ *
+ * @param node Node chosen by node_pick()
+ * @param conn Client connection
+ * @param request SUBMIT frames
+ * @param length Size of request
+ * @param frame Frame buffer for relay()
+ *
+ * @return The outcome of relay()
+ */
+static relay_t node_run(node_t *node, connection_t *conn, const void *request,
+                        size_t length, uint8_t *frame) {
+  relay_t rc = RELAY_FAILED;
+
+  for (int attempt = 0; attempt < 2 && rc == RELAY_FAILED; attempt++) {
+    int fd = -1;
+    int pooled = 0;
+
+    pthread_mutex_lock(&cluster_lock);
+    if (attempt == 0 && node->idle_count > 0) {
+      fd = node->idle[--node->idle_count];
+      pooled = 1;
+    }
+    pthread_mutex_unlock(&cluster_lock);
+    if (fd < 0) {
+      fd = node_connect(node->host, node->port);
+    }
+    if (fd < 0) {
+      break;
+    }
+
+    rc = relay(fd, conn, request, length, frame);
+    if (rc != RELAY_DONE && rc != RELAY_BUSY) {
+      close(fd);
+    } else {
+      pthread_mutex_lock(&cluster_lock);
+      if (node->idle_count < NODE_IDLE_MAX) {
+        node->idle[node->idle_count++] = fd;
+        fd = -1;
+      }
+      pthread_mutex_unlock(&cluster_lock);
+      if (fd >= 0) {
+        close(fd);
+      }
+    }
+    if (!pooled) {
+      break;
+    }
+  }
+  return rc;
+}
+
+/**
+ * @brief Tell the client its job died with the node running it
+ *
+ * @param conn Client connection
+ * @param job_id Job identifier of the submission
+ */
+static void report_lost(connection_t *conn, uint32_t job_id) {
+  static const char message[] = "ERROR: Worker node lost while running the "
+                                "job\n";
+  uint8_t frame[FRAME_HEADER_SIZE + sizeof(message)];
+  result_payload_t result = {-1, RESULT_FAILED, 0, 0, 0};
+  struct iovec iov;
+
+  frame_encode_header(frame, FRAME_OUTPUT, 0, job_id, sizeof(message) - 1);
+  memcpy(frame + FRAME_HEADER_SIZE, message, sizeof(message) - 1);
+  iov.iov_base = frame;
+  iov.iov_len = FRAME_HEADER_SIZE + sizeof(message) - 1;
+  conn_sendv(conn, &iov, 1);
+
+  frame_encode_header(frame, FRAME_RESULT, 0, job_id, RESULT_PAYLOAD_SIZE);
+  result_encode(frame + FRAME_HEADER_SIZE, &result);
+  iov.iov_base = frame;
+  iov.iov_len = FRAME_HEADER_SIZE + RESULT_PAYLOAD_SIZE;
+  conn_sendv(conn, &iov, 1);
+}
+
+cluster_forward_t cluster_forward(connection_t *conn,
+                                  const uint8_t key[SHA256_DIGEST_SIZE],
+                                  const void *request, size_t length) {
+  unsigned char tried[CLUSTER_MAX_NODES] = {0};
+  uint64_t key64 = 0;
+  int preferred, alive, busy = 0;
+  char message[128];
+  frame_header_t header;
+  uint8_t *frame;
+  node_t *node;
+
+  frame_decode_header((const uint8_t *)request, &header);
+  memcpy(&key64, key, sizeof(key64));
+  frame = malloc(FRAME_HEADER_SIZE + FRAME_MAX_PAYLOAD);
+  if (!frame) {
+    return CLUSTER_NO_NODE;
+  }
+
+  for (;;) {
+    pthread_mutex_lock(&cluster_lock);
+    node = node_pick(key64, tried, &preferred, &alive);
+    pthread_mutex_unlock(&cluster_lock);
+    if (!node) {
+      break;
+    }
+    tried[node - cluster.nodes] = 1;
+
+    relay_t rc = node_run(node, conn, request, length, frame);
+
+    pthread_mutex_lock(&cluster_lock);
+    node->in_flight--;
+    if (rc == RELAY_BUSY || rc == RELAY_FAILED) {
+      cluster.stats.failovers++;
+      busy |= rc == RELAY_BUSY;
+      if (rc == RELAY_FAILED) {
+        node_down(node);
+      }
+      pthread_mutex_unlock(&cluster_lock);
+      if (rc == RELAY_FAILED) {
+        snprintf(message, sizeof(message),
+                 "Worker node %s unreachable, taken out of rotation",
+                 node->address);
+        logger_log(LOG_LEVEL_WARN, message);
+      }
+      continue;
+    }
+    node->forwarded++;
+    cluster.stats.forwarded++;
+    if (preferred) {
+      node->affinity++;
+      cluster.stats.affinity++;
+    }
+    if (rc == RELAY_LOST) {
+      node_down(node);
+    }
+    pthread_mutex_unlock(&cluster_lock);
+
+    if (rc == RELAY_LOST) {
+      report_lost(conn, header.job_id);
+      snprintf(message, sizeof(message),
+               "Worker node %s lost while running a job", node->address);
+      logger_log(LOG_LEVEL_WARN, message);
+    }
+    free(frame);
+    return CLUSTER_FORWARDED;
+  }
+  free(frame);
+  return busy || alive ? CLUSTER_BUSY : CLUSTER_NO_NODE;
+}
+
+void cluster_count_local(void) {
+  pthread_mutex_lock(&cluster_lock);
+  cluster.stats.local++;
+  pthread_mutex_unlock(&cluster_lock);
+}
+
+void cluster_stats(cluster_stats_t *stats) {
+  uint64_t now_us = stats_now_us();
+
+  pthread_mutex_lock(&cluster_lock);
+  *stats = cluster.stats;
+  stats->nodes = cluster.count;
+  stats->alive = 0;
+  for (size_t i = 0; i < cluster.count; i++) {
+    stats->alive += node_alive(&cluster.nodes[i], now_us);
+  }
+  pthread_mutex_unlock(&cluster_lock);
+}
+
+size_t cluster_nodes(cluster_node_t *nodes, size_t max) {
+  uint64_t now_us = stats_now_us();
+  size_t count;
+
+  pthread_mutex_lock(&cluster_lock);
+  count = cluster.count < max ? cluster.count : max;
+  for (size_t i = 0; i < count; i++) {
+    const node_t *node = &cluster.nodes[i];
+
+    memcpy(nodes[i].address, node->address, sizeof(nodes[i].address));
+    nodes[i].alive = node_alive(node, now_us);
+    nodes[i].load = node->load;
+    nodes[i].in_flight = node->in_flight;
+    nodes[i].forwarded = node->forwarded;
+    nodes[i].affinity = node->affinity;
+  }
+  pthread_mutex_unlock(&cluster_lock);
+  return count;
+}
+
+/**
+ * @brief Connect to the coordinator's node port
+ *
+ * @return Connected socket, or -1
+ */
+static int agent_connect(void) {
+  struct addrinfo hints, *found, *entry;
+  char port[8];
+  int fd = -1;
+
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  snprintf(port, sizeof(port), "%u", agent.port);
+  if (getaddrinfo(agent.host, port, &hints, &found) != 0) {
+    return -1;
+  }
+  for (entry = found; entry && fd < 0; entry = entry->ai_next) {
+    fd = socket(entry->ai_family, entry->ai_socktype | SOCK_CLOEXEC,
+                entry->ai_protocol);
+    if (fd >= 0 && connect(fd, entry->ai_addr, entry->ai_addrlen) != 0) {
+      close(fd);
+      fd = -1;
+    }
+  }
+  freeaddrinfo(found);
+  return fd;
+}
+
+/**
+ * @brief Send one heartbeat text as a COMMAND frame
+ *
+ * @param fd Connection to the coordinator
+ * @param text Heartbeat
+ * @return 0 on success, -1 on failure
+ */
+static int agent_send(int fd, const char *text) {
+  uint8_t frame[FRAME_HEADER_SIZE + 256];
+  size_t len = strlen(text);
+
+  frame_encode_header(frame, FRAME_COMMAND, 0, 0, (uint32_t)len);
+  memcpy(frame + FRAME_HEADER_SIZE, text, len);
+  return write_all(fd, frame, FRAME_HEADER_SIZE + len);
+}
+
+/**
+ * @brief Wait for the next heartbeat, or for cluster_leave() (caller
+ * holds agent.lock)
+ */
+static void agent_sleep(void) {
+  struct timespec until;
+
+  clock_gettime(CLOCK_REALTIME, &until);
+  until.tv_sec += CLUSTER_HEARTBEAT_MS / 1000;
+  until.tv_nsec += (long)(CLUSTER_HEARTBEAT_MS % 1000) * 1000000L;
+  if (until.tv_nsec >= 1000000000L) {
+    until.tv_sec++;
+    until.tv_nsec -= 1000000000L;
+  }
+  if (agent.running) {
+    pthread_cond_timedwait(&agent_wake, &agent_lock, &until);
+  }
+}
+
+/**
+ * @brief Heartbeat thread of a worker node
+ *
+ * @param arg Unused
+ * @return NULL
+ */
+static void *agent_main(void *arg) {
+  cluster_load_t load;
+  char text[256];
+  char message[320];
+  int connected = 0;
+
+  (void)arg;
+  pthread_mutex_lock(&agent_lock);
+  while (agent.running) {
+    pthread_mutex_unlock(&agent_lock);
+    if (agent.fd < 0) {
+      agent.fd = agent_connect();
+    }
+    if (agent.fd >= 0) {
+      memset(&load, 0, sizeof(load));
+      agent.load(&load);
+      snprintf(text, sizeof(text), "NODE %u %u %u %u %u %llu %llu %llu %llu "
+               "%llu", agent.job_port, load.workers, load.active, load.queued,
+               load.queue_capacity, (unsigned long long)load.jobs,
+               (unsigned long long)load.successful,
+               (unsigned long long)load.rejected,
+               (unsigned long long)load.cache_hits,
+               (unsigned long long)load.cache_misses);
+      if (agent_send(agent.fd, text) != 0) {
+        close(agent.fd);
+        agent.fd = -1;
+      }
+    }
+    if ((agent.fd >= 0) != connected) {
+      connected = agent.fd >= 0;
+      snprintf(message, sizeof(message), "Coordinator %s:%u %s", agent.host,
+               agent.port, connected ? "joined" : "unreachable");
+      logger_log(connected ? LOG_LEVEL_INFO : LOG_LEVEL_WARN, message);
+    }
+    pthread_mutex_lock(&agent_lock);
+    agent_sleep();
+  }
+  pthread_mutex_unlock(&agent_lock);
+  return NULL;
+}
+
+int cluster_join(const char *host, uint16_t port, uint16_t job_port,
+                 cluster_load_fn load) {
+  snprintf(agent.host, sizeof(agent.host), "%s", host);
+  agent.port = port;
+  agent.job_port = job_port;
+  agent.load = load;
+  agent.fd = -1;
+  agent.running = 1;
+  if (pthread_create(&agent.thread, NULL, agent_main, NULL) != 0) {
+    agent.running = 0;
+    return -1;
+  }
+  agent.started = 1;
+  return 0;
+}
+
+void cluster_leave(void) {
+  char text[32];
+
+  if (!agent.started) {
+    return;
+  }
+  pthread_mutex_lock(&agent_lock);
+  agent.running = 0;
+  pthread_cond_signal(&agent_wake);
+  pthread_mutex_unlock(&agent_lock);
+  pthread_join(agent.thread, NULL);
+  agent.started = 0;
+
+  if (agent.fd >= 0) {
+    snprintf(text, sizeof(text), "LEAVE %u", agent.job_port);
+    agent_send(agent.fd, text);
+    close(agent.fd);
+    agent.fd = -1;
+  }
+}
+
+void cluster_shutdown(void) {
+  pthread_mutex_lock(&cluster_lock);
+  for (size_t i = 0; i < cluster.count; i++) {
+    node_down(&cluster.nodes[i]);
+  }
+  pthread_mutex_unlock(&cluster_lock);
+}
@@ -0,0 +1,203 @@
+/**
+ * @file cluster.h
+ * @brief Coordinator and worker node roles of a distributed deployment
+ * @author Rares-Nicholas Popa & Adrian-Petru Enache
+ * @version 1.0.0
+ *
+ * @details A coordinator is an ordinary server that also accepts worker
+ * node registrations (-N). A worker node is an ordinary server that joins
+ * a coordinator (-j): a background thread connects to the coordinator's
+ * node port and sends a NODE heartbeat every CLUSTER_HEARTBEAT_MS with the
+ * port clients reach it on and its load. A node missing for
+ * CLUSTER_NODE_TIMEOUT_MS heartbeats is considered gone.
+ *
+ * The coordinator's workers relay submissions instead of running them:
+ * cluster_forward() sends the client's SUBMIT frames unchanged to the
+ * regular port of a node, over a pooled connection carrying one job at a
+ * time, and copies the node's reply frames back to the client as they
+ * arrive. Streaming, batches and profiles therefore behave exactly as on
+ * a single server.
+ *
+ * A node is chosen by cache affinity first: rendezvous hashing of the
+ * submission's cache key gives every source a preferred node, which keeps
+ * its executable in that node's compile cache. The preferred node is
+ * passed over when its load (jobs per worker, the larger of what the
+ * coordinator has in flight there and what the node last reported) is a
+ * job per worker above the least loaded node's, or when it is full.
+ *
+ * @copyright This project is for educational purposes as part of the PCD
+ * course.
+ */
+
+#ifndef CLUSTER_H
+#define CLUSTER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "reactor.h"
+#include "sha256.h"
+
+/** @def CLUSTER_NODE_PORT
+ * @brief Conventional port of a coordinator's node listener
+ */
+#define CLUSTER_NODE_PORT 8083
+
+/** @def CLUSTER_HEARTBEAT_MS
+ * @brief Interval between two heartbeats of a worker node
+ */
+#define CLUSTER_HEARTBEAT_MS 1000
+
+/** @def CLUSTER_NODE_TIMEOUT_MS
+ * @brief Heartbeat silence after which a node receives no more jobs
+ */
+#define CLUSTER_NODE_TIMEOUT_MS 3500
+
+/** @def CLUSTER_MAX_NODES
+ * @brief Most worker nodes a coordinator tracks
+ */
+#define CLUSTER_MAX_NODES 64
+
+/**
+ * @enum cluster_forward_t
+ * @brief Outcome of cluster_forward()
+ */
+typedef enum {
+  CLUSTER_FORWARDED, /**< A node answered; its reply was relayed */
+  CLUSTER_BUSY,      /**< Every node was full or refused with BUSY */
+  CLUSTER_NO_NODE    /**< No node is alive: run the job locally */
+} cluster_forward_t;
+
+/**
+ * @struct cluster_load_t
+ * @brief Load and counters a worker node reports in its heartbeat
+ */
+typedef struct {
+  uint32_t workers;        /**< Worker threads */
+  uint32_t active;         /**< Workers running a job */
+  uint32_t queued;         /**< Jobs waiting for a worker */
+  uint32_t queue_capacity; /**< Jobs that may wait before BUSY */
+  uint64_t jobs;           /**< Jobs started */
+  uint64_t successful;     /**< Jobs whose program exited with status 0 */
+  uint64_t rejected;       /**< Submissions refused with BUSY */
+  uint64_t cache_hits;     /**< Compile cache hits */
+  uint64_t cache_misses;   /**< Compile cache misses */
+} cluster_load_t;
+
+/**
+ * @struct cluster_node_t
+ * @brief Snapshot of one worker node, for STATUS
+ */
+typedef struct {
+  char address[64];    /**< host:port clients' jobs are relayed to */
+  int alive;           /**< Heard from within CLUSTER_NODE_TIMEOUT_MS */
+  cluster_load_t load; /**< Last heartbeat */
+  uint32_t in_flight;  /**< Jobs being relayed to it now */
+  uint64_t forwarded;  /**< Jobs it answered */
+  uint64_t affinity;   /**< Of those, sent to it as the preferred node */
+} cluster_node_t;
+
+/**
+ * @struct cluster_stats_t
+ * @brief Coordinator counters, for STATUS and /metrics
+ */
+typedef struct {
+  size_t nodes;       /**< Nodes ever registered */
+  size_t alive;       /**< Nodes currently alive */
+  uint64_t forwarded; /**< Jobs answered by a node */
+  uint64_t affinity;  /**< Of those, answered by their preferred node */
+  uint64_t failovers; /**< Jobs moved on after a node failed or was busy */
+  uint64_t local;     /**< Jobs run locally because no node was alive */
+} cluster_stats_t;
+
+/**
+ * @brief Record a heartbeat from a worker node (coordinator, reactor
+ * thread)
+ *
+ * "NODE <port> <load...>" registers the node or refreshes it; "LEAVE
+ * <port>" takes it out of rotation at once.
+ *
+ * @param host Address the heartbeat came from
+ * @param text Null-terminated heartbeat text
+ *
+ * @return 0 on success, -1 if the text is malformed or the table is full
+ */
+int cluster_heartbeat(const char *host, const char *text);
+
+/**
+ * @brief Have a worker node run a submission and relay its reply
+ *
+ * Blocks until the node answered. A node that cannot be reached, or drops
+ * the connection before replying, is taken out of rotation until its next
+ * heartbeat and the job is tried on another node; the same happens when a
+ * node answers BUSY. A node lost halfway through its reply is reported to
+ * the client as a failed job.
+ *
+ * @param conn Client connection (caller holds a reference)
+ * @param key Cache key of the submission (selects the preferred node)
+ * @param request The client's SUBMIT frames, as received
+ * @param length Size of request
+ *
+ * @return The outcome; nothing was sent to conn unless CLUSTER_FORWARDED
+ */
+cluster_forward_t cluster_forward(connection_t *conn,
+                                  const uint8_t key[SHA256_DIGEST_SIZE],
+                                  const void *request, size_t length);
+
+/**
+ * @brief Count a job the coordinator ran itself
+ */
+void cluster_count_local(void);
+
+/**
+ * @brief Read the coordinator counters
+ *
+ * @param stats Receives the snapshot
+ */
+void cluster_stats(cluster_stats_t *stats);
+
+/**
+ * @brief Snapshot the registered worker nodes
+ *
+ * @param nodes Receives up to max nodes, in registration order
+ * @param max Capacity of nodes
+ *
+ * @return Number of entries filled in
+ */
+size_t cluster_nodes(cluster_node_t *nodes, size_t max);
+
+/**
+ * @brief Callback filling in a worker node's heartbeat
+ *
+ * @param load Receives the node's current load and counters
+ */
+typedef void (*cluster_load_fn)(cluster_load_t *load);
+
+/**
+ * @brief Start sending heartbeats to a coordinator (worker node)
+ *
+ * A background thread connects to the coordinator, reconnecting whenever
+ * the connection fails, so nodes and coordinator may start in any order.
+ *
+ * @param host Coordinator host name or address
+ * @param port Coordinator's node port
+ * @param job_port This server's regular port, which jobs are relayed to
+ * @param load Called before every heartbeat
+ *
+ * @return 0 on success, -1 if the thread could not be started
+ */
+int cluster_join(const char *host, uint16_t port, uint16_t job_port,
+                 cluster_load_fn load);
+
+/**
+ * @brief Tell the coordinator this node is leaving and stop the heartbeat
+ * thread (worker node)
+ */
+void cluster_leave(void);
+
+/**
+ * @brief Close the pooled connections to worker nodes (coordinator)
+ */
+void cluster_shutdown(void);
+
+#endif /* CLUSTER_H */
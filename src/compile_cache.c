@@ -0,0 +1,654 @@
+/**
+ * @file compile_cache.c
+ * @brief Content-addressed cache of compiled programs and compile errors
+ * @author Rares-Nicholas Popa & Adrian-Petru Enache
+ * @version 1.0.0
+ *
+ * @details The index is a file of fixed-size slots mapped with MAP_SHARED:
+ * a header with the totals and a last-use clock, then an open-addressing
+ * hash table probed linearly from the first bytes of the key, whose slots
+ * hold the key, the kind and size of the entry and when it was last used.
+ * Removal shifts the following slots back instead of leaving tombstones,
+ * so a probe always stops at the first empty slot. Opening a cache maps
+ * the file and checks its header; nothing is read or rebuilt. Eviction
+ * approximates LRU: it drops the oldest of the next EVICT_SAMPLE entries
+ * after a clock hand kept in the header, so that a store into a full
+ * cache does not scan the whole table under the lock every server shares.
+ *
+ * Every change of the index, and every lookup, holds the cache mutex (the
+ * threads of this process) and an flock() of the index file (other
+ * processes). flock() locks are dropped by the kernel when a process dies,
+ * so a crashed server can never leave the cache locked. The entry files
+ * are written under temporary names and renamed into place with the lock
+ * held; executables are copied in and out rather than hard-linked, so a
+ * submitted program can never modify the cached copy later jobs run. File
+ * copies happen outside the lock: a lookup only opens the entry file while
+ * locked, which keeps the inode alive even if the entry is evicted
+ * meanwhile.
+ *
+ * @copyright This project is for educational purposes as part of the PCD
+ * course.
+ */
+
+#include "compile_cache.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/** @def INDEX_FILE
+ * @brief Name of the index in the cache directory
+ */
+#define INDEX_FILE "index"
+
+/** @def INDEX_MAGIC
+ * @brief First bytes of an index file, with its format version
+ */
+#define INDEX_MAGIC "CCEIDX1"
+
+/** @def INDEX_SLOTS
+ * @brief Slots of a new index (power of two)
+ */
+#define INDEX_SLOTS 32768
+
+/** @def INDEX_MAX_LOAD
+ * @brief Entries allowed per 4 slots before the oldest are evicted
+ */
+#define INDEX_MAX_LOAD 3
+
+/** @def EVICT_SAMPLE
+ * @brief Entries compared per eviction, from the clock hand on
+ */
+#define EVICT_SAMPLE 32
+
+/**
+ * @enum slot_state_t
+ * @brief What an index slot holds
+ */
+typedef enum {
+  SLOT_EMPTY,  /**< Free */
+  SLOT_BINARY, /**< Executable or object file */
+  SLOT_FAILED  /**< Compiler diagnostics of a failed compile */
+} slot_state_t;
+
+/**
+ * @struct index_header_t
+ * @brief Start of the index file
+ */
+typedef struct {
+  char magic[8];     /**< INDEX_MAGIC */
+  uint32_t slots;    /**< Slots that follow */
+  uint32_t hand;     /**< Slot the next eviction starts sampling at */
+  uint64_t clock;    /**< Last-use clock, advanced by every use */
+  uint64_t entries;  /**< Occupied slots */
+  uint64_t bytes;    /**< Total size of the entries */
+  uint8_t pad[24];   /**< Keeps the slots cache-line aligned */
+} index_header_t;
+
+/**
+ * @struct index_slot_t
+ * @brief One cached compilation
+ */
+typedef struct {
+  uint8_t key[SHA256_DIGEST_SIZE]; /**< Content hash */
+  uint64_t size;                   /**< Bytes of the entry file */
+  uint64_t last_use;               /**< Clock of the last hit or store */
+  uint32_t state;                  /**< slot_state_t */
+  uint8_t pad[12];                 /**< Fills the cache line */
+} index_slot_t;
+
+/** @brief Global cache state */
+static struct {
+  pthread_mutex_t lock;   /**< Serialises this process's threads */
+  char dir[PATH_MAX / 2]; /**< Directory of the index and entries */
+  size_t max_bytes;       /**< Size limit, 0 = disabled */
+  int keep;               /**< Leave the cache on disk at shutdown */
+  int fd;                 /**< Index file */
+  index_header_t *header; /**< Mapped index */
+  index_slot_t *slots;    /**< Hash table after the header */
+  size_t map_size;        /**< Bytes mapped */
+  cache_stats_t stats;    /**< This process's counters */
+} cache = {PTHREAD_MUTEX_INITIALIZER, "", 0, 0, -1, NULL, NULL, 0,
+           {0, 0, 0, 0, 0, 0}};
+
+/**
+ * @brief Take the cache lock and the index file lock
+ */
+static void index_lock(void) {
+  pthread_mutex_lock(&cache.lock);
+  while (cache.fd >= 0 && flock(cache.fd, LOCK_EX) != 0 && errno == EINTR) {
+  }
+}
+
+/**
+ * @brief Release the locks of index_lock()
+ */
+static void index_unlock(void) {
+  if (cache.fd >= 0) {
+    flock(cache.fd, LOCK_UN);
+  }
+  pthread_mutex_unlock(&cache.lock);
+}
+
+/**
+ * @brief Home slot of a key
+ *
+ * @param key Content hash
+ * @return Index into cache.slots
+ */
+static size_t home_of(const uint8_t key[SHA256_DIGEST_SIZE]) {
+  size_t index;
+
+  memcpy(&index, key, sizeof(index));
+  return index & (cache.header->slots - 1);
+}
+
+/**
+ * @brief Path of the entry file for a key
+ *
+ * @param key Content hash
+ * @param path Receives the path
+ * @param size Size of path
+ */
+static void entry_path(const uint8_t key[SHA256_DIGEST_SIZE], char *path,
+                       size_t size) {
+  char hex[SHA256_HEX_SIZE];
+
+  sha256_hex(key, hex);
+  snprintf(path, size, "%s/%s", cache.dir, hex);
+}
+
+/**
+ * @brief Find the slot of a key (locked)
+ *
+ * @param key Content hash
+ * @return The slot or NULL
+ */
+static index_slot_t *find_slot(const uint8_t key[SHA256_DIGEST_SIZE]) {
+  size_t mask = cache.header->slots - 1;
+
+  for (size_t i = home_of(key);; i = (i + 1) & mask) {
+    index_slot_t *slot = &cache.slots[i];
+
+    if (slot->state == SLOT_EMPTY) {
+      return NULL;
+    }
+    if (memcmp(slot->key, key, SHA256_DIGEST_SIZE) == 0) {
+      return slot;
+    }
+  }
+}
+
+/**
+ * @brief Mark a slot as just used (locked)
+ *
+ * @param slot Occupied slot
+ */
+static void touch_slot(index_slot_t *slot) {
+  slot->last_use = ++cache.header->clock;
+}
+
+/**
+ * @brief Remove an entry and its file (locked)
+ *
+ * The slots after it that probed past it move back, so that every key
+ * stays reachable from its home slot without crossing an empty one.
+ *
+ * @param slot Slot to empty
+ */
+static void remove_slot(index_slot_t *slot) {
+  size_t mask = cache.header->slots - 1;
+  size_t hole = (size_t)(slot - cache.slots);
+  char path[PATH_MAX];
+
+  entry_path(slot->key, path, sizeof(path));
+  unlink(path);
+  cache.header->entries--;
+  cache.header->bytes -= slot->size;
+
+  for (size_t i = (hole + 1) & mask; cache.slots[i].state != SLOT_EMPTY;
+       i = (i + 1) & mask) {
+    size_t home = home_of(cache.slots[i].key);
+    int stays = hole <= i ? (home > hole && home <= i)
+                          : (home > hole || home <= i);
+
+    if (!stays) {
+      cache.slots[hole] = cache.slots[i];
+      hole = i;
+    }
+  }
+  memset(&cache.slots[hole], 0, sizeof(cache.slots[hole]));
+}
+
+/**
+ * @brief Evict entries while the cache is over its limits (locked)
+ *
+ * Each eviction drops the least recently used of the EVICT_SAMPLE entries
+ * that follow the clock hand, then moves the hand past them, so that the
+ * whole table is sampled in turn.
+ *
+ * @param keep Entry that must stay, or NULL
+ */
+static void evict(const uint8_t *keep) {
+  size_t slots = cache.header->slots;
+  size_t mask = slots - 1;
+
+  while (cache.header->entries > 0 &&
+         (cache.header->bytes > cache.max_bytes ||
+          cache.header->entries * 4 > slots * INDEX_MAX_LOAD)) {
+    index_slot_t *oldest = NULL;
+    size_t i = cache.header->hand & mask;
+    size_t seen = 0;
+
+    for (size_t scanned = 0; scanned < slots && seen < EVICT_SAMPLE;
+         scanned++, i = (i + 1) & mask) {
+      index_slot_t *slot = &cache.slots[i];
+
+      if (slot->state == SLOT_EMPTY ||
+          (keep && memcmp(slot->key, keep, SHA256_DIGEST_SIZE) == 0)) {
+        continue;
+      }
+      seen++;
+      if (!oldest || slot->last_use < oldest->last_use) {
+        oldest = slot;
+      }
+    }
+    cache.header->hand = (uint32_t)i;
+    if (!oldest) {
+      return;
+    }
+    remove_slot(oldest);
+    cache.stats.evictions++;
+  }
+}
+
+/**
+ * @brief Copy an open file to a new file
+ *
+ * @param src Source descriptor positioned at offset 0
+ * @param dest_path Destination path (created or truncated)
+ *
+ * @return Number of bytes copied, or -1 on failure
+ */
+static ssize_t copy_to_path(int src, const char *dest_path) {
+  char buffer[65536];
+  ssize_t total = 0;
+  ssize_t n;
+  int dest = open(dest_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0700);
+
+  if (dest < 0) {
+    return -1;
+  }
+  while ((n = read(src, buffer, sizeof(buffer))) > 0) {
+    if (write(dest, buffer, (size_t)n) != n) {
+      total = -1;
+      break;
+    }
+    total += n;
+  }
+  if (n < 0) {
+    total = -1;
+  }
+  if (close(dest) != 0) {
+    total = -1;
+  }
+  return total;
+}
+
+/**
+ * @brief Delete the entry and temporary files of a cache directory
+ *
+ * @param dir Cache directory
+ */
+static void remove_entry_files(const char *dir) {
+  char path[PATH_MAX];
+  struct dirent *file;
+  DIR *listing = opendir(dir);
+
+  if (!listing) {
+    return;
+  }
+  while ((file = readdir(listing)) != NULL) {
+    // Entry files are named by a hex key, temporary ones start with one
+    if (strspn(file->d_name, "0123456789abcdef") >= SHA256_HEX_SIZE - 1) {
+      snprintf(path, sizeof(path), "%s/%s", dir, file->d_name);
+      unlink(path);
+    }
+  }
+  closedir(listing);
+}
+
+/**
+ * @brief Open the index of a cache directory, creating it if needed
+ *
+ * A missing index, or one of another format, is replaced by an empty one
+ * under a new inode, so a process still mapping the old file is not hurt.
+ *
+ * @param dir Cache directory
+ * @return 0 on success, -1 on failure
+ */
+static int open_index(const char *dir) {
+  size_t size = sizeof(index_header_t) + INDEX_SLOTS * sizeof(index_slot_t);
+  char path[PATH_MAX];
+  char fresh[PATH_MAX + 32];
+  index_header_t header;
+  struct stat info;
+  void *map;
+  int fd;
+
+  snprintf(path, sizeof(path), "%s/" INDEX_FILE, dir);
+  while (1) {
+    struct stat current;
+
+    fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0) {
+      return -1;
+    }
+    while (flock(fd, LOCK_EX) != 0 && errno == EINTR) {
+    }
+    // A server starting at the same time may have replaced the file
+    if (fstat(fd, &info) == 0 && stat(path, &current) == 0 &&
+        current.st_dev == info.st_dev && current.st_ino == info.st_ino) {
+      break;
+    }
+    close(fd);
+  }
+
+  if (pread(fd, &header, sizeof(header), 0) !=
+                                   (ssize_t)sizeof(header) ||
+      memcmp(header.magic, INDEX_MAGIC, sizeof(header.magic)) != 0 ||
+      header.slots == 0 || (header.slots & (header.slots - 1)) != 0 ||
+      (size_t)info.st_size !=
+          sizeof(header) + header.slots * sizeof(index_slot_t)) {
+    int created;
+
+    // Entry files of the old index are unknown to the new one
+    remove_entry_files(dir);
+    snprintf(fresh, sizeof(fresh), "%s.%d.tmp", path, (int)getpid());
+    created = open(fresh, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, INDEX_MAGIC, sizeof(header.magic));
+    header.slots = INDEX_SLOTS;
+    if (created < 0 || ftruncate(created, (off_t)size) != 0 ||
+        pwrite(created, &header, sizeof(header), 0) !=
+            (ssize_t)sizeof(header) ||
+        flock(created, LOCK_EX) != 0 || rename(fresh, path) != 0) {
+      if (created >= 0) {
+        close(created);
+        unlink(fresh);
+      }
+      close(fd);
+      return -1;
+    }
+    close(fd); /* releases the lock on the replaced file */
+    fd = created;
+  } else {
+    size = (size_t)info.st_size;
+  }
+
+  map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  flock(fd, LOCK_UN);
+  if (map == MAP_FAILED) {
+    close(fd);
+    return -1;
+  }
+  cache.fd = fd;
+  cache.header = map;
+  cache.slots = (index_slot_t *)(cache.header + 1);
+  cache.map_size = size;
+  return 0;
+}
+
+int compile_cache_init(const char *dir, size_t max_bytes, int keep) {
+  int rc = 0;
+
+  pthread_mutex_lock(&cache.lock);
+  cache.max_bytes = 0;
+  if (max_bytes > 0) {
+    if (!dir || strlen(dir) >= sizeof(cache.dir) || open_index(dir) != 0) {
+      rc = -1;
+    } else {
+      strcpy(cache.dir, dir);
+      cache.max_bytes = max_bytes;
+      cache.keep = keep;
+    }
+  }
+  cache.stats.max_bytes = cache.max_bytes;
+  pthread_mutex_unlock(&cache.lock);
+
+  // Another server may have filled the cache up to a larger limit
+  if (cache.max_bytes > 0) {
+    index_lock();
+    evict(NULL);
+    index_unlock();
+  }
+  return rc;
+}
+
+void compile_cache_key(const char *toolchain, const char *flags,
+                       const char *source, size_t source_len,
+                       uint8_t key[SHA256_DIGEST_SIZE]) {
+  sha256_ctx_t ctx;
+
+  sha256_init(&ctx);
+  sha256_update(&ctx, toolchain, strlen(toolchain) + 1);
+  sha256_update(&ctx, flags, strlen(flags) + 1);
+  sha256_update(&ctx, source, source_len);
+  sha256_final(&ctx, key);
+}
+
+cache_result_t compile_cache_lookup(const uint8_t key[SHA256_DIGEST_SIZE],
+                                    const char *program_path, char *diag,
+                                    size_t diag_size) {
+  char path[PATH_MAX];
+  index_slot_t *slot;
+  struct stat info;
+  int failed = 0;
+  ssize_t copied;
+  int fd = -1;
+
+  index_lock();
+  if (cache.max_bytes == 0) {
+    index_unlock();
+    return CACHE_MISS;
+  }
+
+  slot = find_slot(key);
+  if (slot) {
+    entry_path(key, path, sizeof(path));
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd >= 0 && fstat(fd, &info) == 0 &&
+        (uint64_t)info.st_size == slot->size) {
+      failed = slot->state == SLOT_FAILED;
+      touch_slot(slot);
+    } else {
+      /* Entry file vanished or was cut short (a crash or a full disk) */
+      if (fd >= 0) {
+        close(fd);
+        fd = -1;
+      }
+      remove_slot(slot);
+    }
+  }
+  if (fd < 0) {
+    cache.stats.misses++;
+  }
+  index_unlock();
+
+  if (fd < 0) {
+    return CACHE_MISS;
+  }
+
+  if (failed) {
+    size_t len = (size_t)info.st_size < diag_size ? (size_t)info.st_size
+                                                   : diag_size - 1;
+
+    copied = pread(fd, diag, len, 0);
+    if (copied >= 0) {
+      diag[copied] = '\0';
+    }
+  } else {
+    copied = copy_to_path(fd, program_path);
+  }
+  close(fd);
+
+  pthread_mutex_lock(&cache.lock);
+  if (copied < 0) {
+    cache.stats.misses++;
+  } else {
+    cache.stats.hits++;
+  }
+  pthread_mutex_unlock(&cache.lock);
+
+  if (copied < 0) {
+    if (!failed) {
+      unlink(program_path);
+    }
+    return CACHE_MISS;
+  }
+  return failed ? CACHE_HIT_FAILED : CACHE_HIT_BINARY;
+}
+
+/**
+ * @brief Add an entry whose file was written under a temporary name
+ *
+ * @param key Content hash
+ * @param state SLOT_BINARY or SLOT_FAILED
+ * @param tmp_path Entry file, renamed into place or removed
+ * @param size Its size
+ */
+static void store_entry(const uint8_t key[SHA256_DIGEST_SIZE],
+                        slot_state_t state, const char *tmp_path,
+                        size_t size) {
+  char path[PATH_MAX];
+  size_t mask;
+  size_t i;
+
+  index_lock();
+  entry_path(key, path, sizeof(path));
+  if (cache.max_bytes == 0 || find_slot(key) || rename(tmp_path, path) != 0) {
+    /* Another worker or server stored the same compilation first */
+    index_unlock();
+    unlink(tmp_path);
+    return;
+  }
+
+  mask = cache.header->slots - 1;
+  for (i = home_of(key); cache.slots[i].state != SLOT_EMPTY;
+       i = (i + 1) & mask) {
+  }
+  memcpy(cache.slots[i].key, key, SHA256_DIGEST_SIZE);
+  cache.slots[i].size = size;
+  cache.slots[i].state = state;
+  touch_slot(&cache.slots[i]);
+  cache.header->entries++;
+  cache.header->bytes += size;
+  evict(key);
+  index_unlock();
+}
+
+/**
+ * @brief Temporary name of an entry file being written
+ *
+ * @param key Content hash
+ * @param path Receives the path
+ * @param size Size of path
+ */
+static void temp_path(const uint8_t key[SHA256_DIGEST_SIZE], char *path,
+                      size_t size) {
+  char hex[SHA256_HEX_SIZE];
+
+  sha256_hex(key, hex);
+  snprintf(path, size, "%s/%s.%d.%lx.tmp", cache.dir, hex, (int)getpid(),
+           (unsigned long)pthread_self());
+}
+
+void compile_cache_store_binary(const uint8_t key[SHA256_DIGEST_SIZE],
+                                const char *program_path) {
+  char tmp_path[PATH_MAX + 64];
+  ssize_t copied;
+  int src;
+
+  if (__atomic_load_n(&cache.max_bytes, __ATOMIC_RELAXED) == 0) {
+    return;
+  }
+
+  temp_path(key, tmp_path, sizeof(tmp_path));
+  src = open(program_path, O_RDONLY | O_CLOEXEC);
+  if (src < 0) {
+    return;
+  }
+  copied = copy_to_path(src, tmp_path);
+  close(src);
+  if (copied < 0 || (size_t)copied > cache.max_bytes) {
+    unlink(tmp_path);
+    return;
+  }
+  store_entry(key, SLOT_BINARY, tmp_path, (size_t)copied);
+}
+
+void compile_cache_store_failure(const uint8_t key[SHA256_DIGEST_SIZE],
+                                 const char *diag) {
+  char tmp_path[PATH_MAX + 64];
+  size_t len = strlen(diag);
+  int fd;
+
+  if (__atomic_load_n(&cache.max_bytes, __ATOMIC_RELAXED) == 0 ||
+      len + 1 > cache.max_bytes) {
+    return;
+  }
+
+  temp_path(key, tmp_path, sizeof(tmp_path));
+  fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+  if (fd < 0) {
+    return;
+  }
+  if (write(fd, diag, len) != (ssize_t)len) {
+    close(fd);
+    unlink(tmp_path);
+    return;
+  }
+  close(fd);
+  store_entry(key, SLOT_FAILED, tmp_path, len);
+}
+
+void compile_cache_stats(cache_stats_t *stats) {
+  index_lock();
+  *stats = cache.stats;
+  if (cache.header) {
+    stats->entries = (size_t)cache.header->entries;
+    stats->bytes = (size_t)cache.header->bytes;
+  }
+  index_unlock();
+}
+
+void compile_cache_shutdown(void) {
+  char path[PATH_MAX];
+
+  pthread_mutex_lock(&cache.lock);
+  if (cache.header) {
+    if (!cache.keep) {
+      remove_entry_files(cache.dir);
+      snprintf(path, sizeof(path), "%s/" INDEX_FILE, cache.dir);
+      unlink(path);
+      rmdir(cache.dir);
+    }
+    munmap(cache.header, cache.map_size);
+    close(cache.fd);
+  }
+  cache.header = NULL;
+  cache.slots = NULL;
+  cache.fd = -1;
+  cache.max_bytes = 0;
+  cache.stats.max_bytes = 0;
+  pthread_mutex_unlock(&cache.lock);
+}
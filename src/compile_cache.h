@@ -0,0 +1,126 @@
+/**
+ * @file compile_cache.h
+ * @brief Content-addressed cache of compiled programs and compile errors
+ * @author Rares-Nicholas Popa & Adrian-Petru Enache
+ * @version 1.0.0
+ *
+ * @details Entries are keyed by the SHA-256 of the toolchain identity
+ * (compiler and version), the compiler flags and the source text, so a
+ * resubmitted program skips gcc entirely. Successful compiles keep the
+ * executable in the cache directory, and failed compiles keep the
+ * diagnostics there, so that a broken program resubmitted by CI fails
+ * instantly with the same message. The total size is bounded by evicting
+ * the least recently used of a sample of entries.
+ *
+ * The entries are indexed by a memory-mapped file in the same directory,
+ * so a cache kept on disk is usable as soon as the index is mapped, and
+ * several server processes on one host can share it: a restarted or
+ * upgraded server starts warm.
+ *
+ * @copyright This project is for educational purposes as part of the PCD
+ * course.
+ */
+
+#ifndef COMPILE_CACHE_H
+#define COMPILE_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sha256.h"
+
+/**
+ * @enum cache_result_t
+ * @brief Outcome of a cache lookup
+ */
+typedef enum {
+  CACHE_MISS,       /**< Not cached: compile normally */
+  CACHE_HIT_BINARY, /**< Executable copied into the job workspace */
+  CACHE_HIT_FAILED  /**< Cached compile failure: diagnostics returned */
+} cache_result_t;
+
+/**
+ * @struct cache_stats_t
+ * @brief Snapshot of cache counters for the STATUS command
+ */
+typedef struct {
+  uint64_t hits;      /**< Lookups answered from the cache */
+  uint64_t misses;    /**< Lookups that required a compile */
+  uint64_t evictions; /**< Entries dropped to respect the size limit */
+  size_t entries;     /**< Entries currently cached */
+  size_t bytes;       /**< Bytes currently cached */
+  size_t max_bytes;   /**< Configured size limit (0 = disabled) */
+} cache_stats_t;
+
+/**
+ * @brief Initialise the cache
+ *
+ * @param dir Existing directory of the index and the entries; a cache
+ *        another server left or is using there is opened as it is
+ * @param max_bytes Size limit; 0 disables caching entirely. Servers that
+ *        share a directory each keep it under their own limit
+ * @param keep Leave the cache in dir at shutdown instead of deleting it
+ *
+ * @return 0 on success, -1 on failure (the cache is then disabled)
+ */
+int compile_cache_init(const char *dir, size_t max_bytes, int keep);
+
+/**
+ * @brief Compute the cache key of a compilation
+ *
+ * @param toolchain Compiler identity, e.g. "gcc 12.2.0"
+ * @param flags Compiler flags that affect the output
+ * @param source Source text
+ * @param source_len Length of source in bytes
+ * @param key Receives the key
+ */
+void compile_cache_key(const char *toolchain, const char *flags,
+                       const char *source, size_t source_len,
+                       uint8_t key[SHA256_DIGEST_SIZE]);
+
+/**
+ * @brief Look up a compilation
+ *
+ * @param key Key from compile_cache_key()
+ * @param program_path Where to place the executable on CACHE_HIT_BINARY
+ * @param diag Receives diagnostics on CACHE_HIT_FAILED
+ * @param diag_size Size of diag
+ *
+ * @return The lookup outcome; hit/miss counters are updated
+ */
+cache_result_t compile_cache_lookup(const uint8_t key[SHA256_DIGEST_SIZE],
+                                    const char *program_path, char *diag,
+                                    size_t diag_size);
+
+/**
+ * @brief Remember a successfully compiled executable
+ *
+ * @param key Key from compile_cache_key()
+ * @param program_path Executable produced by the compiler (copied)
+ */
+void compile_cache_store_binary(const uint8_t key[SHA256_DIGEST_SIZE],
+                                const char *program_path);
+
+/**
+ * @brief Remember a failed compilation
+ *
+ * @param key Key from compile_cache_key()
+ * @param diag Compiler diagnostics (copied)
+ */
+void compile_cache_store_failure(const uint8_t key[SHA256_DIGEST_SIZE],
+                                 const char *diag);
+
+/**
+ * @brief Read the cache counters
+ *
+ * @param stats Receives the snapshot
+ */
+void compile_cache_stats(cache_stats_t *stats);
+
+/**
+ * @brief Close the cache; unless it is kept, delete the index, the entries
+ * and the directory
+ */
+void compile_cache_shutdown(void);
+
+#endif /* COMPILE_CACHE_H */
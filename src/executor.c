@@ -0,0 +1,973 @@
+/**
+ * @file executor.c
+ * @brief Pool of pre-forked executor processes that run jobs
+ * @author Rares-Nicholas Popa & Adrian-Petru Enache
+ * @version 1.0.0
+ *
+ * @details Server and executor talk over a SOCK_SEQPACKET socket pair, one
+ * fixed-size message per datagram. Every request carries a sequence
+ * number so that a late EXEC_KILL meant for a finished job can never hit
+ * the next one. An executor that stops answering is killed and removed
+ * from the pool; the server keeps working with the rest, and refuses
+ * programs once none is left rather than run them without the pool's
+ * isolation and limits. Only a server started without executors spawns
+ * programs itself.
+ *
+ * The executor is single-threaded, so it starts programs with a plain
+ * fork() and exec: the child can join its job cgroup or set its rlimits
+ * (see quota.h) in between, which posix_spawn() offers no hook for. For
+ * EXEC_JIT the child compiles the source passed in a memfd with jit.h
+ * instead of calling exec.
+ *
+ * @copyright This project is for educational purposes as part of the PCD
+ * course.
+ */
+
+#include "executor.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/prctl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "jit.h"
+#include "quota.h"
+
+/** @def EXEC_ARGS_MAX
+ * @brief Space for the NUL-separated argv strings of one request
+ */
+#define EXEC_ARGS_MAX 4096
+
+/** @def EXEC_ARGV_MAX
+ * @brief Maximum number of argv entries of one request
+ */
+#define EXEC_ARGV_MAX 64
+
+/** @def EXEC_GRACE_MS
+ * @brief Extra time the worker allows beyond the executor's own deadline
+ */
+#define EXEC_GRACE_MS 1000
+
+/** @def EXEC_REPLY_TIMEOUT_MS
+ * @brief Time an executor gets to answer after being told to kill
+ */
+#define EXEC_REPLY_TIMEOUT_MS 5000
+
+/** @def EXEC_FDS_MAX
+ * @brief Descriptors passed with one request (output pipe, then the
+ * source for EXEC_JIT, then the stdin pipe)
+ */
+#define EXEC_FDS_MAX 3
+
+/** @def EXIT_POLL_MS
+ * @brief Exit check interval when pidfd_open() is unavailable
+ */
+#define EXIT_POLL_MS 1
+
+/**
+ * @enum exec_op_t
+ * @brief Request operations
+ */
+typedef enum {
+  EXEC_RUN = 1,  /**< Spawn a program (carries the output and stdin pipes) */
+  EXEC_KILL = 2, /**< Kill the running program */
+  EXEC_JIT = 3   /**< Compile a source in memory and run it (see jit.h) */
+} exec_op_t;
+
+/**
+ * @struct exec_request_t
+ * @brief Message from a worker to an executor
+ */
+typedef struct {
+  uint32_t op;               /**< exec_op_t */
+  uint32_t seq;              /**< Job sequence number */
+  uint32_t timeout_ms;       /**< Wall clock limit, 0 for none */
+  uint32_t argc;             /**< Strings in args */
+  uint32_t search_path;      /**< Look argv[0] up in $PATH */
+  char cwd[PATH_MAX];        /**< Working directory, "" to inherit */
+  char args[EXEC_ARGS_MAX];  /**< argv, NUL-separated */
+} exec_request_t;
+
+/**
+ * @struct exec_reply_t
+ * @brief Message from an executor to a worker
+ */
+typedef struct {
+  uint32_t seq;           /**< Job sequence number (0 for the hello) */
+  int32_t error;          /**< errno if the program could not be spawned */
+  int32_t status;         /**< Wait status; isolation flags in the hello */
+  uint32_t timed_out;     /**< Killed at the deadline */
+  uint32_t memory_killed; /**< Killed by the memory limit */
+  uint32_t pids_limited;  /**< Hit the task limit */
+  uint64_t cpu_us;        /**< CPU time of the run */
+  uint64_t wall_us;       /**< Wall clock time of the run */
+  uint64_t peak_bytes;    /**< Peak memory use of the run */
+} exec_reply_t;
+
+/**
+ * @struct executor_t
+ * @brief Server-side handle of one executor
+ */
+typedef struct {
+  pid_t pid;    /**< Executor process */
+  int sock;     /**< Server end of the socket pair */
+  int busy;     /**< Borrowed by a worker */
+  int dead;     /**< Removed from the pool */
+  uint32_t seq; /**< Last sequence number used */
+} executor_t;
+
+/** @brief Global pool state */
+static struct {
+  pthread_mutex_t lock;   /**< Protects everything below */
+  pthread_cond_t idle;    /**< Signalled when an executor is returned */
+  executor_t *procs;      /**< Executors */
+  size_t count;           /**< Executors started */
+  size_t alive;           /**< Executors not dead */
+  int required;           /**< executor_start() was called */
+  unsigned isolation;     /**< Flags reported by the executors */
+  uint64_t jobs;          /**< Programs run by executors */
+  uint64_t fallbacks;     /**< Programs spawned directly */
+} pool = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, NULL, 0, 0, 0,
+          0, 0, 0};
+
+/**
+ * @brief Current monotonic time in milliseconds
+ *
+ * @return Milliseconds since an arbitrary epoch
+ */
+static long long now_ms(void) {
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (long long)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+/**
+ * @brief Milliseconds left until a deadline, for poll()
+ *
+ * @param deadline Absolute deadline from now_ms(), or 0 for none
+ * @return Remaining time clamped at 0, or -1 (infinite) without deadline
+ */
+static int remaining_ms(long long deadline) {
+  long long left;
+
+  if (deadline == 0) {
+    return -1;
+  }
+  left = deadline - now_ms();
+  return left > 0 ? (int)left : 0;
+}
+
+/**
+ * @brief Send a message, optionally passing file descriptors
+ *
+ * @param sock Socket
+ * @param data Message
+ * @param len Message size
+ * @param fds Descriptors to pass
+ * @param count Number of descriptors (0 to EXEC_FDS_MAX)
+ *
+ * @return 0 on success, -1 on failure
+ */
+static int send_message(int sock, const void *data, size_t len,
+                        const int *fds, size_t count) {
+  char control[CMSG_SPACE(sizeof(int) * EXEC_FDS_MAX)];
+  struct iovec iov;
+  struct msghdr msg;
+  ssize_t n;
+
+  memset(&msg, 0, sizeof(msg));
+  iov.iov_base = (void *)data;
+  iov.iov_len = len;
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  if (count > 0) {
+    struct cmsghdr *cmsg;
+    memset(control, 0, sizeof(control));
+    msg.msg_control = control;
+    msg.msg_controllen = CMSG_SPACE(sizeof(int) * count);
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * count);
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * count);
+  }
+
+  do {
+    n = sendmsg(sock, &msg, MSG_NOSIGNAL);
+  } while (n < 0 && errno == EINTR);
+  return n == (ssize_t)len ? 0 : -1;
+}
+
+/**
+ * @brief Receive a message and the descriptors passed with it, if any
+ *
+ * @param sock Socket
+ * @param data Receives the message
+ * @param len Size of data
+ * @param fds Receives EXEC_FDS_MAX descriptors, -1 where none was passed
+ *        (may be NULL to close whatever was passed)
+ *
+ * @return Bytes received, 0 if the peer closed, -1 on failure
+ */
+static ssize_t recv_message(int sock, void *data, size_t len, int *fds) {
+  char control[CMSG_SPACE(sizeof(int) * EXEC_FDS_MAX)];
+  struct iovec iov;
+  struct msghdr msg;
+  struct cmsghdr *cmsg;
+  size_t received = 0, i;
+  ssize_t n;
+
+  memset(&msg, 0, sizeof(msg));
+  iov.iov_base = data;
+  iov.iov_len = len;
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+
+  do {
+    n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+  } while (n < 0 && errno == EINTR);
+
+  for (i = 0; fds && i < EXEC_FDS_MAX; i++) {
+    fds[i] = -1;
+  }
+  for (cmsg = CMSG_FIRSTHDR(&msg); n > 0 && cmsg;
+       cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+    if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+      size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+      for (i = 0; i < count; i++) {
+        int passed;
+        memcpy(&passed, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+        if (fds && received < EXEC_FDS_MAX) {
+          fds[received++] = passed;
+        } else {
+          close(passed);
+        }
+      }
+    }
+  }
+  return n;
+}
+
+/**
+ * @brief Give the executor its sandbox (executor process only)
+ *
+ * @return EXECUTOR_ISOLATE_* flags that could be applied
+ */
+static unsigned isolate(void) {
+  struct rlimit no_core = {0, 0};
+
+  setrlimit(RLIMIT_CORE, &no_core);
+  if (unshare(CLONE_NEWNET | CLONE_NEWIPC) == 0) {
+    return EXECUTOR_ISOLATE_NET | EXECUTOR_ISOLATE_IPC;
+  }
+  // Unprivileged: the namespaces need a user namespace of their own
+  if (unshare(CLONE_NEWUSER | CLONE_NEWNET | CLONE_NEWIPC) == 0) {
+    return EXECUTOR_ISOLATE_USER | EXECUTOR_ISOLATE_NET | EXECUTOR_ISOLATE_IPC;
+  }
+  return 0;
+}
+
+/**
+ * @brief Wait for a spawned program to exit, a kill request or its
+ * deadline (executor process only)
+ *
+ * @param sock Executor socket
+ * @param pid Program pid
+ * @param seq Sequence number of the running job
+ * @param deadline Absolute deadline, or 0 for none
+ *
+ * @return 1 if the deadline passed, 0 otherwise
+ */
+static int supervise(int sock, pid_t pid, uint32_t seq, long long deadline) {
+  exec_request_t request;
+  struct pollfd fds[2];
+  siginfo_t info;
+  int pidfd = -1;
+
+#ifdef SYS_pidfd_open
+  pidfd = (int)syscall(SYS_pidfd_open, pid, 0);
+#endif
+
+  while (1) {
+    int exited = 0, timeout;
+
+    memset(&info, 0, sizeof(info));
+    if (waitid(P_PID, (id_t)pid, &info, WEXITED | WNOHANG | WNOWAIT) != 0 ||
+        info.si_pid == pid) {
+      exited = 1;
+    }
+    if (exited) {
+      break;
+    }
+    if (deadline != 0 && remaining_ms(deadline) == 0) {
+      if (pidfd >= 0) {
+        close(pidfd);
+      }
+      return 1;
+    }
+
+    fds[0].fd = sock;
+    fds[0].events = POLLIN;
+    fds[1].fd = pidfd;
+    fds[1].events = POLLIN;
+    timeout = remaining_ms(deadline);
+    if (pidfd < 0 && (timeout < 0 || timeout > EXIT_POLL_MS)) {
+      timeout = EXIT_POLL_MS;
+    }
+    if (poll(fds, pidfd >= 0 ? 2 : 1, timeout) > 0 && fds[0].revents) {
+      ssize_t n = recv_message(sock, &request, sizeof(request), NULL);
+      if (n <= 0) {
+        _exit(0); /* the server is gone; the process group dies with us */
+      }
+      if (request.op == EXEC_KILL && request.seq == seq) {
+        break;
+      }
+    }
+  }
+  if (pidfd >= 0) {
+    close(pidfd);
+  }
+  return 0;
+}
+
+/**
+ * @brief Start a program inside its job limits (executor process only)
+ *
+ * @param argv Program and arguments
+ * @param search_path Look argv[0] up in $PATH
+ * @param cwd Working directory, or NULL
+ * @param in_fd Becomes the program's stdin, or -1 for /dev/null
+ * @param out_fd Becomes the program's stdout and stderr
+ * @param source_fd Source to compile in memory instead of calling exec,
+ *        or -1
+ * @param job Limits to enter before exec
+ * @param pid Receives the program pid
+ *
+ * @return 0 or an errno value (reported by the child if exec failed, or
+ *         ENOEXEC if the source did not compile)
+ */
+static int spawn_limited(char *const *argv, int search_path, const char *cwd,
+                         int in_fd, int out_fd, int source_fd,
+                         const quota_job_t *job, pid_t *pid) {
+  int report[2];
+  int err = 0;
+  ssize_t n;
+
+  if (pipe2(report, O_CLOEXEC) != 0) {
+    return errno;
+  }
+  *pid = fork();
+  if (*pid < 0) {
+    err = errno;
+    close(report[0]);
+    close(report[1]);
+    return err;
+  }
+
+  if (*pid == 0) {
+    sigset_t none;
+
+    // Own process group (so the whole tree can be killed), then the limits
+    setpgid(0, 0);
+    err = quota_enter(job);
+    if (err == 0 && in_fd < 0) {
+      in_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    }
+    if (err == 0) {
+      if (in_fd < 0 || dup2(in_fd, STDIN_FILENO) < 0 ||
+          dup2(out_fd, STDOUT_FILENO) < 0 || dup2(out_fd, STDERR_FILENO) < 0 ||
+          (cwd && chdir(cwd) != 0)) {
+        err = errno;
+      }
+    }
+    if (err == 0) {
+      signal(SIGPIPE, SIG_DFL);
+      signal(SIGTERM, SIG_DFL);
+      signal(SIGINT, SIG_DFL);
+      sigemptyset(&none);
+      sigprocmask(SIG_SETMASK, &none, NULL);
+      if (source_fd >= 0) {
+        err = jit_exec(source_fd, argv, report[1]);
+      } else {
+        if (search_path) {
+          execvp(argv[0], argv);
+        } else {
+          execv(argv[0], argv);
+        }
+        err = errno;
+      }
+    }
+    // The report pipe is close-on-exec (and closed by jit_exec() once the
+    // source compiled): end of file means the program is running
+    n = write(report[1], &err, sizeof(err));
+    _exit(n == (ssize_t)sizeof(err) ? 127 : 126);
+  }
+
+  close(report[1]);
+  do {
+    n = read(report[0], &err, sizeof(err));
+  } while (n < 0 && errno == EINTR);
+  close(report[0]);
+  if (n == (ssize_t)sizeof(err)) {
+    waitpid(*pid, NULL, 0);
+    return err;
+  }
+  return 0;
+}
+
+/**
+ * @brief Executor main loop (executor process only, never returns)
+ *
+ * @param sock Executor end of the socket pair
+ * @param server Server pid, to detect that it died before prctl()
+ */
+static void executor_main(int sock, pid_t server) {
+  char *argv[EXEC_ARGV_MAX + 1];
+  exec_request_t request;
+  exec_reply_t reply;
+
+  prctl(PR_SET_PDEATHSIG, SIGKILL);
+  if (getppid() != server) {
+    _exit(0);
+  }
+  signal(SIGPIPE, SIG_IGN);
+  // A SIGTERM to the whole service or a terminal's ^C asks the server to
+  // drain; the executor must keep serving it, and dies with it anyway
+  signal(SIGTERM, SIG_IGN);
+  signal(SIGINT, SIG_IGN);
+
+  memset(&reply, 0, sizeof(reply));
+  reply.status = (int32_t)isolate();
+  send_message(sock, &reply, sizeof(reply), NULL, 0);
+
+  while (1) {
+    int fds[EXEC_FDS_MAX]; /* output pipe, [source,] stdin pipe */
+    ssize_t n = recv_message(sock, &request, sizeof(request), fds);
+    int jit = n == (ssize_t)sizeof(request) && request.op == EXEC_JIT;
+    int in_fd = jit ? fds[2] : fds[1];
+    struct rusage rusage;
+    quota_usage_t usage;
+    quota_job_t job;
+    long long deadline;
+    const char *arg;
+    size_t argc = 0, i;
+    pid_t pid = 0;
+    int rc;
+
+    if (n <= 0) {
+      _exit(0);
+    }
+    if (n != (ssize_t)sizeof(request) ||
+        (request.op != EXEC_RUN && !jit) || fds[0] < 0 ||
+        (jit && fds[1] < 0)) {
+      for (i = 0; i < EXEC_FDS_MAX; i++) {
+        if (fds[i] >= 0) {
+          close(fds[i]);
+        }
+      }
+      continue; /* a stale EXEC_KILL */
+    }
+
+    request.cwd[sizeof(request.cwd) - 1] = '\0';
+    request.args[sizeof(request.args) - 1] = '\0';
+    for (arg = request.args; argc < request.argc && argc < EXEC_ARGV_MAX &&
+                             arg < request.args + sizeof(request.args);
+         arg += strlen(arg) + 1) {
+      argv[argc++] = (char *)arg;
+    }
+    argv[argc] = NULL;
+
+    deadline = request.timeout_ms ? now_ms() + request.timeout_ms : 0;
+
+    memset(&reply, 0, sizeof(reply));
+    reply.seq = request.seq;
+    rc = argc > 0 ? quota_job_begin(&job, request.timeout_ms) : EINVAL;
+    if (rc == 0) {
+      rc = spawn_limited(argv, request.search_path != 0,
+                         request.cwd[0] ? request.cwd : NULL, in_fd, fds[0],
+                         jit ? fds[1] : -1, &job, &pid);
+      if (rc != 0) {
+        memset(&rusage, 0, sizeof(rusage));
+        quota_job_end(&job, &rusage, &usage);
+      }
+    }
+    for (i = 0; i < EXEC_FDS_MAX; i++) {
+      if (fds[i] >= 0) {
+        close(fds[i]);
+      }
+    }
+    if (rc != 0) {
+      reply.error = rc;
+      send_message(sock, &reply, sizeof(reply), NULL, 0);
+      continue;
+    }
+
+    reply.timed_out = (uint32_t)supervise(sock, pid, request.seq, deadline);
+    // Still unreaped, so the process group id cannot have been recycled
+    kill(-pid, SIGKILL);
+    while (wait4(pid, &reply.status, 0, &rusage) < 0 && errno == EINTR) {
+    }
+    quota_job_end(&job, &rusage, &usage);
+    reply.memory_killed = (uint32_t)usage.memory_killed;
+    reply.pids_limited = (uint32_t)usage.pids_limited;
+    reply.cpu_us = usage.cpu_us;
+    reply.wall_us = usage.wall_us;
+    reply.peak_bytes = usage.peak_bytes;
+    send_message(sock, &reply, sizeof(reply), NULL, 0);
+  }
+}
+
+size_t executor_start(size_t count) {
+  exec_reply_t hello;
+  pid_t server = getpid();
+  size_t i;
+
+  pool.required = 1;
+  pool.procs = calloc(count ? count : 1, sizeof(executor_t));
+  if (!pool.procs) {
+    return 0;
+  }
+
+  for (i = 0; i < count; i++) {
+    int sv[2];
+    pid_t pid;
+
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) != 0) {
+      break;
+    }
+    pid = fork();
+    if (pid < 0) {
+      close(sv[0]);
+      close(sv[1]);
+      break;
+    }
+    if (pid == 0) {
+      size_t j;
+      for (j = 0; j < pool.count; j++) {
+        close(pool.procs[j].sock);
+      }
+      close(sv[0]);
+      executor_main(sv[1], server);
+    }
+
+    close(sv[1]);
+    if (recv_message(sv[0], &hello, sizeof(hello), NULL) !=
+        (ssize_t)sizeof(hello)) {
+      close(sv[0]);
+      kill(pid, SIGKILL);
+      waitpid(pid, NULL, 0);
+      break;
+    }
+    pool.procs[pool.count].pid = pid;
+    pool.procs[pool.count].sock = sv[0];
+    pool.isolation = (unsigned)hello.status;
+    pool.count++;
+  }
+  pool.alive = pool.count;
+  return pool.count;
+}
+
+/**
+ * @brief Borrow an idle executor, waiting while all are busy
+ *
+ * @return The executor, or NULL if none is alive
+ */
+static executor_t *acquire(void) {
+  size_t i;
+
+  pthread_mutex_lock(&pool.lock);
+  while (pool.alive > 0) {
+    for (i = 0; i < pool.count; i++) {
+      if (!pool.procs[i].busy && !pool.procs[i].dead) {
+        pool.procs[i].busy = 1;
+        pool.jobs++;
+        pthread_mutex_unlock(&pool.lock);
+        return &pool.procs[i];
+      }
+    }
+    pthread_cond_wait(&pool.idle, &pool.lock);
+  }
+  pthread_mutex_unlock(&pool.lock);
+  return NULL;
+}
+
+/**
+ * @brief Return a borrowed executor, or retire it if it misbehaved
+ *
+ * @param executor Executor from acquire()
+ * @param failed Kill it and remove it from the pool
+ */
+static void release(executor_t *executor, int failed) {
+  if (failed) {
+    kill(executor->pid, SIGKILL);
+    waitpid(executor->pid, NULL, 0);
+    close(executor->sock);
+  }
+
+  pthread_mutex_lock(&pool.lock);
+  executor->busy = 0;
+  if (failed) {
+    executor->dead = 1;
+    pool.alive--;
+  }
+  pthread_cond_broadcast(&pool.idle);
+  pthread_mutex_unlock(&pool.lock);
+}
+
+/**
+ * @brief Ask the executor to kill the running program
+ *
+ * @param executor Borrowed executor
+ * @return 0 on success, -1 if the executor is unreachable
+ */
+static int request_kill(executor_t *executor) {
+  exec_request_t request;
+
+  memset(&request, 0, sizeof(request));
+  request.op = EXEC_KILL;
+  request.seq = executor->seq;
+  // Only the header matters; size distinguishes it from a run request
+  return send_message(executor->sock, &request, sizeof(request.op) * 4, NULL,
+                      0);
+}
+
+/**
+ * @brief Read what is left in the output pipe after the program ended
+ *
+ * @param spec Output buffer and callback
+ * @param out_fd Read end of the output pipe
+ * @param result Output length and flags, updated
+ */
+static void drain_output(const process_spec_t *spec, int out_fd,
+                         process_result_t *result) {
+  ssize_t n;
+
+  // A daemonised grandchild may keep the pipe open: stop once it is empty
+  fcntl(out_fd, F_SETFL, O_NONBLOCK);
+  do {
+    n = process_collect(spec, out_fd, result);
+  } while ((n > 0 || (n < 0 && errno == EINTR)) && !result->cancelled);
+}
+
+/**
+ * @brief Close both ends of a pipe that are still open
+ *
+ * @param fds Pipe descriptors, -1 where already closed
+ */
+static void close_pipe(int fds[2]) {
+  if (fds[0] >= 0) {
+    close(fds[0]);
+  }
+  if (fds[1] >= 0) {
+    close(fds[1]);
+  }
+}
+
+/**
+ * @brief Run a spec the executors cannot take
+ *
+ * Only a server without executors spawns it itself: with them, a program
+ * spawned here would escape their namespaces and the per-job limits.
+ *
+ * @param spec What to run
+ * @param source_fd Source of an in-memory compile, or -1
+ * @param err errno to refuse the run with when executors are required
+ * @param result Receives the outcome
+ *
+ * @return As process_run(); -1 with ENOSYS for an in-memory compile,
+ *         which needs an executor, or with err if executors are required
+ */
+static int run_directly(const process_spec_t *spec, int source_fd, int err,
+                        process_result_t *result) {
+  if (source_fd >= 0) {
+    errno = ENOSYS;
+    return -1;
+  }
+  if (pool.required) {
+    errno = err;
+    return -1;
+  }
+  pthread_mutex_lock(&pool.lock);
+  pool.fallbacks++;
+  pthread_mutex_unlock(&pool.lock);
+  return process_run(spec, result);
+}
+
+/**
+ * @brief Run a program, or compile and run a source, on an idle executor
+ *
+ * @param spec What to run (argv is passed to main() for a source)
+ * @param source_fd Source to compile in memory, or -1 to exec argv
+ * @param result Receives the outcome
+ *
+ * @return As executor_run()
+ */
+static int dispatch(const process_spec_t *spec, int source_fd,
+                    process_result_t *result) {
+  exec_request_t request;
+  exec_reply_t reply;
+  executor_t *executor;
+  struct pollfd fds[3];
+  long long deadline;
+  size_t used = 0, written = 0, count, i;
+  int out_pipe[2], in_pipe[2] = {-1, -1}, passed[EXEC_FDS_MAX];
+  int killed = 0, got_reply = 0, failed = 0;
+
+  if (pool.count == 0) {
+    return run_directly(spec, source_fd, EAGAIN, result);
+  }
+
+  memset(&request, 0, sizeof(request));
+  request.op = source_fd >= 0 ? EXEC_JIT : EXEC_RUN;
+  request.timeout_ms = spec->timeout_ms;
+  for (i = 0; spec->argv[i]; i++) {
+    size_t len = strlen(spec->argv[i]) + 1;
+    if (i == EXEC_ARGV_MAX || used + len > sizeof(request.args)) {
+      return run_directly(spec, source_fd, E2BIG, result);
+    }
+    memcpy(request.args + used, spec->argv[i], len);
+    used += len;
+  }
+  request.argc = (uint32_t)i;
+  request.search_path = spec->search_path != 0;
+  if (spec->cwd) {
+    if (strlen(spec->cwd) >= sizeof(request.cwd)) {
+      return run_directly(spec, source_fd, ENAMETOOLONG, result);
+    }
+    strcpy(request.cwd, spec->cwd);
+  }
+
+  executor = acquire();
+  if (!executor) {
+    return run_directly(spec, source_fd, EAGAIN, result);
+  }
+  memset(result, 0, sizeof(*result));
+  spec->output[0] = '\0';
+
+  if (pipe2(out_pipe, O_CLOEXEC) != 0) {
+    release(executor, 0);
+    return -1;
+  }
+  if (spec->input && pipe2(in_pipe, O_CLOEXEC) != 0) {
+    close_pipe(out_pipe);
+    release(executor, 0);
+    return -1;
+  }
+  count = 0;
+  passed[count++] = out_pipe[1];
+  if (source_fd >= 0) {
+    passed[count++] = source_fd;
+  }
+  if (spec->input) {
+    passed[count++] = in_pipe[0];
+  }
+  request.seq = ++executor->seq;
+  if (send_message(executor->sock, &request, sizeof(request), passed,
+                   count) != 0) {
+    close_pipe(out_pipe);
+    close_pipe(in_pipe);
+    release(executor, 1);
+    // Retired, so this ends once no executor is left
+    return dispatch(spec, source_fd, result);
+  }
+  close(out_pipe[1]);
+  out_pipe[1] = -1;
+  if (spec->input) {
+    close(in_pipe[0]);
+    in_pipe[0] = -1;
+    fcntl(in_pipe[1], F_SETFL, O_NONBLOCK);
+    if (spec->input_len == 0) {
+      close(in_pipe[1]);
+      in_pipe[1] = -1;
+    }
+  }
+
+  // The executor enforces the limit; this deadline only guards against a
+  // stuck executor
+  deadline = spec->timeout_ms ? now_ms() + spec->timeout_ms + EXEC_GRACE_MS
+                              : 0;
+  while (!got_reply) {
+    nfds_t polled = 1, out_slot = 0, in_slot = 0;
+    int ready;
+
+    fds[0].fd = executor->sock;
+    fds[0].events = POLLIN;
+    fds[0].revents = 0;
+    if (out_pipe[0] >= 0) {
+      out_slot = polled++;
+      fds[out_slot].fd = out_pipe[0];
+      fds[out_slot].events = POLLIN;
+      fds[out_slot].revents = 0;
+    }
+    if (in_pipe[1] >= 0) {
+      in_slot = polled++;
+      fds[in_slot].fd = in_pipe[1];
+      fds[in_slot].events = POLLOUT;
+      fds[in_slot].revents = 0;
+    }
+
+    ready = poll(fds, polled, remaining_ms(deadline));
+    if (ready < 0 && errno == EINTR) {
+      continue;
+    }
+    if (ready <= 0) {
+      if (killed) {
+        failed = 1; /* it ignored the kill request too */
+        break;
+      }
+      result->timed_out = 1;
+      killed = 1;
+      deadline = now_ms() + EXEC_REPLY_TIMEOUT_MS;
+      if (request_kill(executor) != 0) {
+        failed = 1;
+        break;
+      }
+      continue;
+    }
+
+    // Output first: it was written before the program exited
+    if (out_slot && fds[out_slot].revents) {
+      ssize_t n = process_collect(spec, out_pipe[0], result);
+      if (result->cancelled || n == 0 ||
+          (n < 0 && errno != EINTR && errno != EAGAIN)) {
+        close(out_pipe[0]);
+        out_pipe[0] = -1;
+      }
+      if (result->cancelled && !killed) {
+        killed = 1;
+        deadline = now_ms() + EXEC_REPLY_TIMEOUT_MS;
+        if (request_kill(executor) != 0) {
+          failed = 1;
+          break;
+        }
+      }
+    }
+
+    if (in_slot && fds[in_slot].revents) {
+      ssize_t n = write(in_pipe[1], spec->input + written,
+                        spec->input_len - written);
+      if (n > 0) {
+        written += (size_t)n;
+      }
+      if (written == spec->input_len ||
+          (n < 0 && errno != EAGAIN && errno != EINTR)) {
+        close(in_pipe[1]); /* EOF for the program, or it stopped reading */
+        in_pipe[1] = -1;
+      }
+    }
+
+    if (fds[0].revents) {
+      ssize_t n = recv_message(executor->sock, &reply, sizeof(reply), NULL);
+      if (n != (ssize_t)sizeof(reply)) {
+        failed = 1;
+        break;
+      }
+      got_reply = reply.seq == executor->seq;
+    }
+  }
+
+  if (in_pipe[1] >= 0) {
+    close(in_pipe[1]);
+  }
+  if (out_pipe[0] >= 0) {
+    if (got_reply) {
+      drain_output(spec, out_pipe[0], result);
+    }
+    close(out_pipe[0]);
+  }
+  release(executor, failed);
+
+  if (failed) {
+    result->timed_out = 1;
+    result->status = SIGKILL; /* as if killed at the deadline */
+    return 0;
+  }
+  if (reply.error != 0) {
+    errno = reply.error;
+    return -1;
+  }
+  result->status = reply.status;
+  result->timed_out |= reply.timed_out != 0;
+  result->memory_killed = reply.memory_killed != 0;
+  result->pids_limited = reply.pids_limited != 0;
+  result->cpu_us = reply.cpu_us;
+  result->wall_us = reply.wall_us;
+  result->peak_bytes = reply.peak_bytes;
+  return 0;
+}
+
+int executor_run(const process_spec_t *spec, process_result_t *result) {
+  return dispatch(spec, -1, result);
+}
+
+int executor_jit(const process_spec_t *spec, const char *source,
+                 size_t length, process_result_t *result) {
+  size_t written = 0;
+  int fd, rc;
+
+  if (pool.count == 0 || !jit_available()) {
+    errno = ENOSYS;
+    return -1;
+  }
+  // Anonymous memory only: no file is written anywhere
+  fd = memfd_create("cce-source", MFD_CLOEXEC);
+  if (fd < 0) {
+    return -1;
+  }
+  while (written < length) {
+    ssize_t n = write(fd, source + written, length - written);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      close(fd);
+      return -1;
+    }
+    written += (size_t)n;
+  }
+  rc = dispatch(spec, fd, result);
+  close(fd);
+  return rc;
+}
+
+void executor_stats(executor_stats_t *stats) {
+  pthread_mutex_lock(&pool.lock);
+  stats->processes = pool.count;
+  stats->alive = pool.alive;
+  stats->isolation = pool.isolation;
+  stats->jobs = pool.jobs;
+  stats->fallbacks = pool.fallbacks;
+  pthread_mutex_unlock(&pool.lock);
+}
+
+void executor_shutdown(void) {
+  size_t i;
+
+  pthread_mutex_lock(&pool.lock);
+  for (i = 0; i < pool.count; i++) {
+    if (!pool.procs[i].dead) {
+      close(pool.procs[i].sock); /* the executor exits on end of file */
+      waitpid(pool.procs[i].pid, NULL, 0);
+      pool.procs[i].dead = 1;
+    }
+  }
+  pool.alive = 0;
+  pthread_cond_broadcast(&pool.idle);
+  pthread_mutex_unlock(&pool.lock);
+}
@@ -0,0 +1,123 @@
+/**
+ * @file executor.h
+ * @brief Pool of pre-forked executor processes that run jobs
+ * @author Rares-Nicholas Popa & Adrian-Petru Enache
+ * @version 1.0.0
+ *
+ * @details The executors are forked once at startup, while the server is
+ * still single-threaded. Each one sets up its isolation then: private
+ * network and IPC namespaces (inside a user namespace when the server is
+ * not root), a core dump limit and death with the server. After that it
+ * only spawns the compiler and the compiled programs inside that
+ * environment, so the setup cost is paid once per executor rather than
+ * once per job. Each run also gets the per-job limits of quota.h.
+ *
+ * A worker borrows an idle executor and sends it the program's argv and
+ * working directory, along with the write end of an output pipe and, for
+ * programs with input, the read end of a stdin pipe (SCM_RIGHTS). The
+ * executor spawns the program, enforces the time limit and replies with
+ * the wait status and the resources used. The worker feeds stdin and
+ * reads the output directly from the pipes, so streaming and truncation
+ * work as with process_run(). executor_jit() passes a source instead of a
+ * path, which the executor compiles in memory (see jit.h).
+ *
+ * @copyright This project is for educational purposes as part of the PCD
+ * course.
+ */
+
+#ifndef EXECUTOR_H
+#define EXECUTOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "process.h"
+
+/** @def EXECUTOR_ISOLATE_NET
+ * @brief Isolation flag: programs run in a private network namespace
+ */
+#define EXECUTOR_ISOLATE_NET 0x1
+
+/** @def EXECUTOR_ISOLATE_IPC
+ * @brief Isolation flag: programs run in a private IPC namespace
+ */
+#define EXECUTOR_ISOLATE_IPC 0x2
+
+/** @def EXECUTOR_ISOLATE_USER
+ * @brief Isolation flag: the namespaces are owned by a user namespace
+ */
+#define EXECUTOR_ISOLATE_USER 0x4
+
+/**
+ * @struct executor_stats_t
+ * @brief Snapshot of executor pool counters
+ */
+typedef struct {
+  size_t processes;   /**< Executors started */
+  size_t alive;       /**< Executors still usable */
+  unsigned isolation; /**< EXECUTOR_ISOLATE_* flags applied */
+  uint64_t jobs;      /**< Programs run by executors */
+  uint64_t fallbacks; /**< Programs spawned directly (no executors) */
+} executor_stats_t;
+
+/**
+ * @brief Fork the executor processes
+ *
+ * Must be called before the server starts any thread. From then on,
+ * programs only run on executors (see executor_run()).
+ *
+ * @param count Number of executors
+ * @return Number of executors running
+ */
+size_t executor_start(size_t count);
+
+/**
+ * @brief Run a program on an idle executor
+ *
+ * Same contract as process_run(). Waits for an executor if all of them
+ * are busy. Without executor_start() the program is spawned with
+ * process_run(), outside any isolation or per-job limits. Once executors
+ * were started, a run that none can take is refused rather than run
+ * unconfined: EAGAIN once every executor died, E2BIG or ENAMETOOLONG for
+ * an argv or working directory too long for one request.
+ *
+ * @param spec What to run
+ * @param result Receives the outcome
+ *
+ * @return 0 if the program was started, -1 if it could not be (errno set)
+ */
+int executor_run(const process_spec_t *spec, process_result_t *result);
+
+/**
+ * @brief Compile a source in memory on an idle executor and run it
+ *
+ * Same contract as executor_run(), except that the executor's child
+ * compiles the source with jit.h instead of executing spec->argv[0];
+ * spec->argv becomes the program's arguments. There is no fallback to a
+ * direct spawn.
+ *
+ * @param spec How to run the program (argv, cwd, input, limit, output)
+ * @param source C source code
+ * @param length Length of source
+ * @param result Receives the outcome
+ *
+ * @return 0 if the program was started, -1 otherwise: errno is ENOEXEC if
+ *         the source did not compile in memory, ENOSYS if the server has
+ *         no libtcc or no executor
+ */
+int executor_jit(const process_spec_t *spec, const char *source,
+                 size_t length, process_result_t *result);
+
+/**
+ * @brief Read the pool counters
+ *
+ * @param stats Receives the snapshot
+ */
+void executor_stats(executor_stats_t *stats);
+
+/**
+ * @brief Stop every executor and wait for it to exit
+ */
+void executor_shutdown(void);
+
+#endif /* EXECUTOR_H */
@@ -0,0 +1,233 @@
+/**
+ * @file handover.c
+ * @brief Passing the listening sockets to a new server process
+ * @author Rares-Nicholas Popa & Adrian-Petru Enache
+ * @version 1.0.0
+ *
+ * @details The handover socket is created with mode 0600, so only the user
+ * running the server can take its ports. Both sides bound every wait with
+ * HANDOVER_TIMEOUT_MS: a stuck peer makes the handover fail, never hang.
+ *
+ * @copyright This project is for educational purposes as part of the PCD
+ * course.
+ */
+
+#include "handover.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/** @def HANDOVER_MAGIC
+ * @brief First bytes of a handover message
+ */
+#define HANDOVER_MAGIC "CCEH"
+
+/** @def MAGIC_LEN
+ * @brief Length of HANDOVER_MAGIC
+ */
+#define MAGIC_LEN 4
+
+/**
+ * @brief Fill in the address of a handover socket
+ *
+ * @param path Socket path
+ * @param address Receives the address
+ *
+ * @return 0 on success, -1 if the path is too long (errno is set)
+ */
+static int handover_address(const char *path, struct sockaddr_un *address) {
+  memset(address, 0, sizeof(*address));
+  address->sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(address->sun_path)) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  strcpy(address->sun_path, path);
+  return 0;
+}
+
+/**
+ * @brief Bound the blocking reads of a socket
+ *
+ * @param fd Socket
+ */
+static void handover_timeout(int fd) {
+  struct timeval timeout;
+
+  timeout.tv_sec = HANDOVER_TIMEOUT_MS / 1000;
+  timeout.tv_usec = (HANDOVER_TIMEOUT_MS % 1000) * 1000;
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+}
+
+int handover_receive(const char *path, reactor_listener_t *listeners,
+                     size_t max, int *peer) {
+  char data[MAGIC_LEN + 1 + HANDOVER_MAX];
+  union {
+    struct cmsghdr align;
+    char buffer[CMSG_SPACE(sizeof(int) * HANDOVER_MAX)];
+  } control;
+  int fds[HANDOVER_MAX];
+  struct sockaddr_un address;
+  struct cmsghdr *cmsg;
+  struct msghdr msg;
+  struct iovec iov;
+  size_t received = 0;
+  size_t count;
+  ssize_t n;
+  int fd;
+
+  if (handover_address(path, &address) != 0) {
+    return -1;
+  }
+  fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  if (connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0) {
+    int saved = errno;
+
+    close(fd);
+    errno = saved;
+    return saved == ENOENT || saved == ECONNREFUSED ? 0 : -1;
+  }
+  handover_timeout(fd);
+
+  iov.iov_base = data;
+  iov.iov_len = sizeof(data);
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buffer;
+  msg.msg_controllen = sizeof(control.buffer);
+  do {
+    n = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+  } while (n < 0 && errno == EINTR);
+
+  for (cmsg = n > 0 ? CMSG_FIRSTHDR(&msg) : NULL; cmsg;
+       cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+    if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+      size_t more = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+
+      for (size_t i = 0; i < more && received < HANDOVER_MAX; i++) {
+        memcpy(&fds[received++], CMSG_DATA(cmsg) + i * sizeof(int),
+               sizeof(int));
+      }
+    }
+  }
+
+  count = n > MAGIC_LEN ? (unsigned char)data[MAGIC_LEN] : 0;
+  if (n < 0 || n < MAGIC_LEN + 1 || memcmp(data, HANDOVER_MAGIC, MAGIC_LEN) ||
+      (msg.msg_flags & MSG_CTRUNC) || count != received || count > max ||
+      (size_t)n != MAGIC_LEN + 1 + count) {
+    int saved = n < 0 ? errno : EPROTO;
+
+    for (size_t i = 0; i < received; i++) {
+      close(fds[i]);
+    }
+    close(fd);
+    errno = saved;
+    return -1;
+  }
+
+  for (size_t i = 0; i < count; i++) {
+    listeners[i].fd = fds[i];
+    listeners[i].kind = (conn_kind_t)(unsigned char)data[MAGIC_LEN + 1 + i];
+    fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL) | O_NONBLOCK);
+  }
+  *peer = fd;
+  return (int)count;
+}
+
+void handover_done(int peer) {
+  ssize_t ignored = send(peer, "K", 1, MSG_NOSIGNAL);
+
+  (void)ignored;
+  close(peer);
+}
+
+int handover_listen(const char *path) {
+  struct sockaddr_un address;
+  int fd;
+
+  if (handover_address(path, &address) != 0) {
+    return -1;
+  }
+  fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  unlink(path);
+  if (bind(fd, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+      chmod(path, 0600) != 0 || listen(fd, 1) != 0) {
+    int saved = errno;
+
+    close(fd);
+    errno = saved;
+    return -1;
+  }
+  return fd;
+}
+
+int handover_send(int fd, const reactor_listener_t *listeners, size_t count) {
+  char data[MAGIC_LEN + 1 + HANDOVER_MAX];
+  union {
+    struct cmsghdr align;
+    char buffer[CMSG_SPACE(sizeof(int) * HANDOVER_MAX)];
+  } control;
+  struct cmsghdr *cmsg;
+  struct msghdr msg;
+  struct iovec iov;
+  char ack;
+  ssize_t n;
+
+  if (count == 0 || count > HANDOVER_MAX) {
+    errno = EINVAL;
+    return -1;
+  }
+  handover_timeout(fd);
+
+  memcpy(data, HANDOVER_MAGIC, MAGIC_LEN);
+  data[MAGIC_LEN] = (char)count;
+  memset(&control, 0, sizeof(control));
+  memset(&msg, 0, sizeof(msg));
+  iov.iov_base = data;
+  iov.iov_len = MAGIC_LEN + 1 + count;
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buffer;
+  msg.msg_controllen = CMSG_SPACE(sizeof(int) * count);
+  cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(int) * count);
+  for (size_t i = 0; i < count; i++) {
+    data[MAGIC_LEN + 1 + i] = (char)listeners[i].kind;
+    memcpy(CMSG_DATA(cmsg) + i * sizeof(int), &listeners[i].fd, sizeof(int));
+  }
+
+  do {
+    n = sendmsg(fd, &msg, MSG_NOSIGNAL);
+  } while (n < 0 && errno == EINTR);
+  if (n != (ssize_t)iov.iov_len) {
+    return -1;
+  }
+
+  // The new server confirms once it watches the sockets
+  do {
+    n = recv(fd, &ack, 1, 0);
+  } while (n < 0 && errno == EINTR);
+  if (n != 1 || ack != 'K') {
+    if (n >= 0) {
+      errno = ECONNRESET;
+    }
+    return -1;
+  }
+  return 0;
+}
@@ -0,0 +1,84 @@
+/**
+ * @file handover.h
+ * @brief Passing the listening sockets to a new server process
+ * @author Rares-Nicholas Popa & Adrian-Petru Enache
+ * @version 1.0.0
+ *
+ * @details A server started with a handover socket path listens on that
+ * Unix socket. A new server started with the same path connects first and
+ * receives the listening sockets of the running one as SCM_RIGHTS
+ * ancillary data, so the ports are never closed: connections arriving
+ * during the upgrade wait in the same listen queue and the new server
+ * accepts them. Once the new server has registered them it confirms, and
+ * the old server stops accepting and drains; if the new server dies
+ * before confirming, the old one keeps serving.
+ *
+ * The message is "CCEH", a socket count and one conn_kind_t byte per
+ * socket, in the order of the passed descriptors.
+ *
+ * @copyright This project is for educational purposes as part of the PCD
+ * course.
+ */
+
+#ifndef HANDOVER_H
+#define HANDOVER_H
+
+#include <stddef.h>
+
+#include "reactor.h"
+
+/** @def HANDOVER_MAX
+ * @brief Most listening sockets passed in one handover
+ */
+#define HANDOVER_MAX 8
+
+/** @def HANDOVER_TIMEOUT_MS
+ * @brief How long either side waits for the other
+ */
+#define HANDOVER_TIMEOUT_MS 5000
+
+/**
+ * @brief Take over the listening sockets of a running server
+ *
+ * @param path Handover socket of the running server
+ * @param listeners Receives the sockets (close-on-exec, non-blocking)
+ * @param max Capacity of listeners
+ * @param peer Receives the connection to confirm on with handover_done()
+ *
+ * @return Number of sockets received, 0 if no server listens on path, -1
+ *         if the handover failed (errno is set)
+ */
+int handover_receive(const char *path, reactor_listener_t *listeners,
+                     size_t max, int *peer);
+
+/**
+ * @brief Tell the old server that the sockets are being served, so it
+ * can stop accepting
+ *
+ * @param peer Connection returned by handover_receive(); closed
+ */
+void handover_done(int peer);
+
+/**
+ * @brief Listen for the next server on a handover socket
+ *
+ * A stale socket file left by a server that crashed is replaced.
+ *
+ * @param path Handover socket path
+ * @return Listening socket, or -1 on failure (errno is set)
+ */
+int handover_listen(const char *path);
+
+/**
+ * @brief Send the listening sockets to a new server
+ *
+ * @param fd Connection accepted on the handover socket
+ * @param listeners Sockets to pass; this process keeps its copies
+ * @param count Number of sockets, at most HANDOVER_MAX
+ *
+ * @return 0 once the new server confirmed, -1 if it failed or did not
+ *         confirm in time (errno is set)
+ */
+int handover_send(int fd, const reactor_listener_t *listeners, size_t count);
+
+#endif /* HANDOVER_H */
@@ -0,0 +1,51 @@
+/**
+ * @file jit.h
+ * @brief In-memory compilation of small submissions with libtcc
+ * @author Rares-Nicholas Popa & Adrian-Petru Enache
+ * @version 1.0.0
+ *
+ * @details For a short program most of the turnaround is spent starting
+ * gcc, cc1, as and ld and passing files between them. When the server is
+ * built with libtcc (HAVE_LIBTCC), an executor can instead compile the
+ * source straight into the memory of the forked child that runs it: no
+ * compiler process, no source file, no executable.
+ *
+ * tcc implements C99 and most GNU extensions but not everything gcc
+ * accepts. A source it rejects is reported as such before anything runs,
+ * so the caller can compile it with gcc as usual; tcc's own diagnostics
+ * are discarded.
+ *
+ * The program runs inside a fork of the executor rather than a fresh
+ * image, with the same isolation and per-run limits as an exec()ed one.
+ *
+ * @copyright This project is for educational purposes as part of the PCD
+ * course.
+ */
+
+#ifndef JIT_H
+#define JIT_H
+
+/**
+ * @brief Whether the server was built with libtcc
+ *
+ * @return 1 if jit_exec() can compile, 0 otherwise
+ */
+int jit_available(void);
+
+/**
+ * @brief Compile a source in memory and run its main() (forked child only)
+ *
+ * Closes report_fd once the source compiled, so the parent can tell a
+ * rejected source from a program that failed; the program's exit status
+ * is then the child's.
+ *
+ * @param source_fd Descriptor holding the source (read from offset 0)
+ * @param argv Program arguments, NULL-terminated
+ * @param report_fd Descriptor to close before main() is called
+ *
+ * @return Only on failure: ENOEXEC if tcc rejected the source, ENOSYS
+ *         without libtcc, or the errno value of what else went wrong
+ */
+int jit_exec(int source_fd, char *const *argv, int report_fd);
+
+#endif /* JIT_H */
@@ -0,0 +1,418 @@
+/**
+ * @file log_query.c
+ * @brief Filtered searches of the activity log without reading all of it
+ * @author Rares-Nicholas Popa & Adrian-Petru Enache
+ * @version 1.0.0
+ *
+ * @details Every line starts with a fixed-width "[Www Mmm dd hh:mm:ss
+ * yyyy]" stamp. Converting one costs a strptime() and a mktime(), so the
+ * stamp last converted is remembered: consecutive lines of the same second
+ * compare equal with a memcmp().
+ *
+ * @copyright This project is for educational purposes as part of the PCD
+ * course.
+ */
+
+#include "log_query.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+/** @def STAMP_LEN
+ * @brief Length of the bracketed timestamp that opens every line
+ */
+#define STAMP_LEN 26
+
+/**
+ * @struct log_scan_t
+ * @brief A mapped log file and the last converted timestamp
+ */
+typedef struct {
+  const char *data;       /**< Mapped file */
+  size_t size;            /**< Bytes of whole lines in data */
+  char stamp[STAMP_LEN];  /**< Last stamp converted */
+  int64_t stamp_time;     /**< Its time, -1 if none */
+} log_scan_t;
+
+/**
+ * @brief Time of a line
+ *
+ * @param scan Cache of the last conversion, or NULL
+ * @param line Start of the line
+ * @param len Length of the line
+ *
+ * @return Unix seconds, or -1 if the line has no timestamp
+ */
+static int64_t line_time(log_scan_t *scan, const char *line, size_t len) {
+  char text[STAMP_LEN];
+  struct tm tm;
+  const char *end;
+  int64_t when;
+
+  if (len < STAMP_LEN || line[0] != '[' || line[STAMP_LEN - 1] != ']') {
+    return -1;
+  }
+  if (scan && scan->stamp_time >= 0 &&
+      memcmp(line, scan->stamp, STAMP_LEN) == 0) {
+    return scan->stamp_time;
+  }
+
+  memcpy(text, line + 1, STAMP_LEN - 2);
+  text[STAMP_LEN - 2] = '\0';
+  memset(&tm, 0, sizeof(tm));
+  end = strptime(text, "%a %b %d %H:%M:%S %Y", &tm);
+  if (!end || *end != '\0') {
+    return -1;
+  }
+  tm.tm_isdst = -1;
+  when = (int64_t)mktime(&tm);
+  if (scan) {
+    memcpy(scan->stamp, line, STAMP_LEN);
+    scan->stamp_time = when;
+  }
+  return when;
+}
+
+/**
+ * @brief Level of a line
+ *
+ * @param line Start of the line
+ * @param len Length of the line
+ *
+ * @return Its level; lines without one (older logs) are LOG_LEVEL_INFO
+ */
+static log_level_t line_level(const char *line, size_t len) {
+  for (int i = LOG_LEVEL_COUNT - 1; i > LOG_LEVEL_INFO; i--) {
+    const char *name = logger_level_name((log_level_t)i);
+    size_t name_len = strlen(name);
+
+    if (len > STAMP_LEN + 1 + name_len &&
+        memcmp(line + STAMP_LEN + 1, name, name_len) == 0 &&
+        line[STAMP_LEN + 1 + name_len] == ' ') {
+      return (log_level_t)i;
+    }
+  }
+  return LOG_LEVEL_INFO;
+}
+
+/**
+ * @brief Check a line against a filter
+ *
+ * @param filter Filter
+ * @param scan Timestamp cache, or NULL
+ * @param line Start of the line
+ * @param len Length of the line
+ *
+ * @return 1 if the line matches
+ */
+static int line_matches(const log_filter_t *filter, log_scan_t *scan,
+                        const char *line, size_t len) {
+  if (filter->level > LOG_LEVEL_INFO && line_level(line, len) < filter->level) {
+    return 0;
+  }
+  if (filter->match[0] &&
+      !memmem(line, len, filter->match, strlen(filter->match))) {
+    return 0;
+  }
+  if (filter->since > 0 || filter->until > 0) {
+    int64_t when = line_time(scan, line, len);
+
+    if (when < 0 || (filter->since > 0 && when < filter->since) ||
+        (filter->until > 0 && when > filter->until)) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+int log_filter_match(const log_filter_t *filter, const char *line,
+                     size_t len) {
+  return line_matches(filter, NULL, line, len);
+}
+
+/**
+ * @brief Start of the line containing a position
+ *
+ * @param scan Mapped file
+ * @param pos Position in the file
+ * @param floor Known line start at or before pos
+ *
+ * @return Offset of the line start
+ */
+static size_t line_start(const log_scan_t *scan, size_t pos, size_t floor) {
+  const char *newline;
+
+  if (pos <= floor) {
+    return floor;
+  }
+  newline = memrchr(scan->data + floor, '\n', pos - floor);
+  return newline ? (size_t)(newline - scan->data) + 1 : floor;
+}
+
+/**
+ * @brief End of the line starting at a position
+ *
+ * @param scan Mapped file
+ * @param start Line start
+ *
+ * @return Offset just past its newline
+ */
+static size_t line_end(const log_scan_t *scan, size_t start) {
+  const char *newline =
+      memchr(scan->data + start, '\n', scan->size - start);
+
+  return newline ? (size_t)(newline - scan->data) + 1 : scan->size;
+}
+
+/**
+ * @brief First line stamped at or after a time, by binary search
+ *
+ * @param scan Mapped file
+ * @param when Unix seconds
+ *
+ * @return Offset of that line, or the file size if there is none
+ */
+static size_t first_at(log_scan_t *scan, int64_t when) {
+  size_t lo = 0;
+  size_t hi = scan->size;
+
+  // lo and hi stay line starts; the answer lies in [lo, hi]
+  while (lo < hi) {
+    size_t start = line_start(scan, lo + (hi - lo) / 2, lo);
+    size_t end = line_end(scan, start);
+
+    if (line_time(scan, scan->data + start, end - start) < when) {
+      lo = end;
+    } else {
+      hi = start;
+    }
+  }
+  return lo;
+}
+
+/**
+ * @brief Parse a filter time
+ *
+ * @param text Time as described for log_filter_parse()
+ * @param when Receives Unix seconds
+ *
+ * @return 0 on success, -1 if text is not a time
+ */
+static int parse_time(const char *text, int64_t *when) {
+  time_t now = time(NULL);
+  struct tm tm;
+  const char *end;
+  char *unit;
+
+  if (text[0] == '-') {
+    long long amount = strtoll(text + 1, &unit, 10);
+    long long scale;
+
+    if (unit == text + 1 || amount < 0) {
+      return -1;
+    }
+    switch (*unit) {
+    case '\0':
+    case 's':
+      scale = 1;
+      break;
+    case 'm':
+      scale = 60;
+      break;
+    case 'h':
+      scale = 3600;
+      break;
+    case 'd':
+      scale = 86400;
+      break;
+    default:
+      return -1;
+    }
+    if (*unit != '\0' && unit[1] != '\0') {
+      return -1;
+    }
+    *when = (int64_t)now - amount * scale;
+    return 0;
+  }
+
+  if (strspn(text, "0123456789") == strlen(text)) {
+    *when = strtoll(text, NULL, 10);
+    return 0;
+  }
+
+  localtime_r(&now, &tm);
+  tm.tm_sec = 0;
+  end = strchr(text, 'T') ? strptime(text, "%Y-%m-%dT%H:%M", &tm)
+                          : strptime(text, "%H:%M", &tm);
+  if (end && *end == ':') {
+    end = strptime(end + 1, "%S", &tm);
+  }
+  if (!end || *end != '\0') {
+    return -1;
+  }
+  tm.tm_isdst = -1;
+  *when = (int64_t)mktime(&tm);
+  return 0;
+}
+
+int log_filter_parse(const char *args, log_filter_t *filter, char *error,
+                     size_t error_size) {
+  char word[32];
+  char value[64];
+  int used;
+
+  memset(filter, 0, sizeof(*filter));
+  filter->level = LOG_LEVEL_INFO;
+
+  while (sscanf(args, " %31s%n", word, &used) == 1) {
+    args += used;
+    if (strcasecmp(word, "FOLLOW") == 0) {
+      filter->follow = 1;
+      continue;
+    }
+    if (strcasecmp(word, "GREP") == 0) {
+      args += strspn(args, " ");
+      if (*args == '\0' || strlen(args) >= sizeof(filter->match)) {
+        snprintf(error, error_size, "GREP needs a text of 1 to %d bytes\n",
+                 LOG_MATCH_MAX - 1);
+        return -1;
+      }
+      strcpy(filter->match, args);
+      break;
+    }
+    if (strcasecmp(word, "TAIL") != 0 && strcasecmp(word, "LEVEL") != 0 &&
+        strcasecmp(word, "SINCE") != 0 && strcasecmp(word, "UNTIL") != 0) {
+      snprintf(error, error_size,
+               "Unknown LOGS option '%s' (TAIL, LEVEL, SINCE, UNTIL, GREP, "
+               "FOLLOW)\n",
+               word);
+      return -1;
+    }
+    if (sscanf(args, " %63s%n", value, &used) != 1) {
+      snprintf(error, error_size, "%s needs a value\n", word);
+      return -1;
+    }
+    args += used;
+
+    if (strcasecmp(word, "TAIL") == 0) {
+      char *end;
+      long long lines = strtoll(value, &end, 10);
+
+      if (*end != '\0' || lines <= 0) {
+        snprintf(error, error_size, "TAIL needs a positive line count\n");
+        return -1;
+      }
+      filter->tail = (size_t)lines;
+    } else if (strcasecmp(word, "LEVEL") == 0) {
+      int i;
+
+      for (i = 0; i < LOG_LEVEL_COUNT; i++) {
+        if (strcasecmp(value, logger_level_name((log_level_t)i)) == 0) {
+          break;
+        }
+      }
+      if (i == LOG_LEVEL_COUNT) {
+        snprintf(error, error_size, "LEVEL is one of INFO, WARN, ERROR\n");
+        return -1;
+      }
+      filter->level = (log_level_t)i;
+    } else {
+      int since = strcasecmp(word, "SINCE") == 0;
+
+      if (parse_time(value, since ? &filter->since : &filter->until) != 0) {
+        snprintf(error, error_size,
+                 "Bad time '%s' (seconds, -15m, HH:MM[:SS] or "
+                 "YYYY-MM-DDTHH:MM[:SS])\n",
+                 value);
+        return -1;
+      }
+    }
+  }
+  return 0;
+}
+
+long log_query(const char *path, const log_filter_t *filter,
+               log_line_fn line, void *context, uint64_t *searched) {
+  log_scan_t scan;
+  struct stat info;
+  const char *last;
+  void *map;
+  size_t begin = 0;
+  size_t end;
+  long passed = 0;
+  int fd;
+
+  fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return -1;
+  }
+  if (fstat(fd, &info) != 0) {
+    close(fd);
+    return -1;
+  }
+  if (info.st_size == 0) {
+    close(fd);
+    if (searched) {
+      *searched = 0;
+    }
+    return 0;
+  }
+  map = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    return -1;
+  }
+
+  // Leave out a last line that is still being written
+  scan.data = map;
+  last = memrchr(scan.data, '\n', (size_t)info.st_size);
+  scan.size = last ? (size_t)(last - scan.data) + 1 : 0;
+  scan.stamp_time = -1;
+  end = scan.size;
+  if (searched) {
+    *searched = scan.size;
+  }
+
+  if (filter->since > 0) {
+    begin = first_at(&scan, filter->since);
+  }
+  if (filter->until > 0) {
+    end = first_at(&scan, filter->until + 1);
+  }
+
+  // The last n matches: walk back from the end until n were seen
+  if (filter->tail > 0) {
+    size_t found = 0;
+    size_t pos = end;
+
+    while (pos > begin && found < filter->tail) {
+      size_t start = line_start(&scan, pos - 1, begin);
+
+      found += line_matches(filter, &scan, scan.data + start, pos - start);
+      pos = start;
+    }
+    begin = pos;
+  }
+
+  while (begin < end) {
+    size_t next = line_end(&scan, begin);
+
+    if (line_matches(filter, &scan, scan.data + begin, next - begin)) {
+      passed++;
+      if (line(context, scan.data + begin, next - begin) != 0) {
+        break;
+      }
+    }
+    begin = next;
+  }
+
+  munmap(map, (size_t)info.st_size);
+  return passed;
+}
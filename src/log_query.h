@@ -0,0 +1,104 @@
+/**
+ * @file log_query.h
+ * @brief Filtered searches of the activity log without reading all of it
+ * @author Rares-Nicholas Popa & Adrian-Petru Enache
+ * @version 1.0.0
+ *
+ * @details The log file is memory-mapped and searched in place. Lines are
+ * written in time order, so the first line of a time range is found by
+ * binary search over line starts, and the last n matching lines by
+ * scanning backwards from the end: a query touches the pages holding its
+ * answer rather than the whole file. The line format is the one of
+ * logger.h.
+ *
+ * @copyright This project is for educational purposes as part of the PCD
+ * course.
+ */
+
+#ifndef LOG_QUERY_H
+#define LOG_QUERY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "logger.h"
+
+/** @def LOG_MATCH_MAX
+ * @brief Longest text a filter searches lines for
+ */
+#define LOG_MATCH_MAX 128
+
+/**
+ * @struct log_filter_t
+ * @brief Which lines a query or a follower wants
+ */
+typedef struct {
+  int64_t since;               /**< Earliest time (Unix seconds), 0: any */
+  int64_t until;               /**< Latest time (Unix seconds), 0: any */
+  log_level_t level;           /**< Least severe level wanted */
+  char match[LOG_MATCH_MAX];   /**< Text lines must contain, "" for any */
+  size_t tail;                 /**< Only the last tail matches, 0 for all */
+  int follow;                  /**< FOLLOW was given */
+} log_filter_t;
+
+/**
+ * @brief Receives one matching line
+ *
+ * @param context Passed through from log_query()
+ * @param line Start of the line
+ * @param len Length including the newline
+ *
+ * @return 0 to continue, non-zero to stop the query
+ */
+typedef int (*log_line_fn)(void *context, const char *line, size_t len);
+
+/**
+ * @brief Parse the arguments of a LOGS command
+ *
+ * Words, in any order: "TAIL n", "LEVEL info|warn|error", "SINCE time",
+ * "UNTIL time", "FOLLOW" and "GREP text", the last taking the rest of the
+ * line. A time is Unix seconds, a negative number of seconds, minutes,
+ * hours or days before now ("-90s", "-15m", "-2h", "-1d"), HH:MM[:SS]
+ * today or YYYY-MM-DDTHH:MM[:SS], in local time.
+ *
+ * @param args Text after "LOGS"
+ * @param filter Receives the filter
+ * @param error Receives a message if the arguments are invalid
+ * @param error_size Size of error
+ *
+ * @return 0 on success, -1 on invalid arguments
+ */
+int log_filter_parse(const char *args, log_filter_t *filter, char *error,
+                     size_t error_size);
+
+/**
+ * @brief Check one line against a filter (the tail count is ignored)
+ *
+ * @param filter Filter
+ * @param line Start of the line
+ * @param len Length of the line
+ *
+ * @return 1 if the line matches, 0 otherwise
+ */
+int log_filter_match(const log_filter_t *filter, const char *line,
+                     size_t len);
+
+/**
+ * @brief Pass the matching lines of a log file to a callback, oldest first
+ *
+ * Lines appended after the query started are not seen, nor is a last line
+ * still being written.
+ *
+ * @param path Log file
+ * @param filter Lines wanted
+ * @param line Called for every match
+ * @param context Passed to line
+ * @param searched Receives the file offset just past the last line searched
+ * (lines from there on were not seen), or NULL
+ *
+ * @return Number of lines passed, or -1 if the file cannot be read
+ */
+long log_query(const char *path, const log_filter_t *filter,
+               log_line_fn line, void *context, uint64_t *searched);
+
+#endif /* LOG_QUERY_H */
@@ -0,0 +1,322 @@
+/**
+ * @file logger.c
+ * @brief Asynchronous activity log with batched writes and rotation
+ * @author Rares-Nicholas Popa & Adrian-Petru Enache
+ * @version 1.0.0
+ *
+ * @details Double buffering: producers append to the active buffer while
+ * the flusher thread writes the other one, so the lock only ever covers a
+ * memcpy or a buffer swap, never I/O. The flusher wakes every
+ * FLUSH_INTERVAL_MS, or early once the active buffer is half full or a
+ * flush was requested. Timestamps are formatted once per second per
+ * thread.
+ *
+ * @copyright This project is for educational purposes as part of the PCD
+ * course.
+ */
+
+#include "logger.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+/** @def LOG_BUFFER_SIZE
+ * @brief Size of each of the two in-memory buffers
+ */
+#define LOG_BUFFER_SIZE (256 * 1024)
+
+/** @def LOG_LINE_MAX
+ * @brief Longest line written; longer messages are cut
+ */
+#define LOG_LINE_MAX 1024
+
+/** @def FLUSH_INTERVAL_MS
+ * @brief Longest time a line waits in memory before being written
+ */
+#define FLUSH_INTERVAL_MS 100
+
+/** @brief Global logger state */
+static struct {
+  pthread_mutex_t lock;            /**< Protects everything below */
+  pthread_cond_t wake;             /**< Wakes the flusher */
+  pthread_cond_t flushed;          /**< Signalled after every batch */
+  char buffers[2][LOG_BUFFER_SIZE]; /**< Active and in-flight buffers */
+  int active;                      /**< Buffer producers append to */
+  size_t used;                     /**< Bytes in the active buffer */
+  uint64_t appended;               /**< Bytes accepted since start */
+  uint64_t written;                /**< Bytes handed to the file */
+  int flush_requested;             /**< logger_flush() is waiting */
+  int running;                     /**< Accepting lines */
+  int started;                     /**< Flusher thread exists */
+  pthread_t thread;                /**< Flusher thread */
+  int fd;                          /**< Open log file */
+  char path[PATH_MAX];             /**< Log file path */
+  size_t max_bytes;                /**< Rotation threshold */
+  size_t file_bytes;               /**< Current file size */
+  unsigned keep;                   /**< Rotated files kept */
+  logger_stats_t stats;            /**< Counters */
+  logger_tap_fn tap;               /**< Sees every written batch */
+} logger = {PTHREAD_MUTEX_INITIALIZER,
+            PTHREAD_COND_INITIALIZER,
+            PTHREAD_COND_INITIALIZER,
+            {{0}},
+            0, 0, 0, 0, 0, 0, 0, 0,
+            -1,
+            "",
+            0, 0, 0,
+            {0, 0, 0, 0},
+            NULL};
+
+/** @brief Level names, as written to the log */
+static const char *const level_names[LOG_LEVEL_COUNT] = {"INFO", "WARN",
+                                                          "ERROR"};
+
+/** @brief Second the calling thread last formatted a timestamp for */
+static __thread time_t stamp_second = -1;
+
+/** @brief Timestamp text of stamp_second (ctime() format) */
+static __thread char stamp[32];
+
+/**
+ * @brief Open the log file for appending and record its size
+ *
+ * @param truncate Start from an empty file
+ * @return 0 on success, -1 on failure
+ */
+static int open_log(int truncate) {
+  struct stat st;
+  int flags = O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC;
+
+  logger.fd = open(logger.path, flags | (truncate ? O_TRUNC : 0), 0644);
+  if (logger.fd < 0) {
+    return -1;
+  }
+  logger.file_bytes = fstat(logger.fd, &st) == 0 ? (size_t)st.st_size : 0;
+  return 0;
+}
+
+/**
+ * @brief Shift path.N to path.N+1, move the live file to path.1 and start
+ * a new one (flusher thread only)
+ */
+static void rotate_log(void) {
+  char from[PATH_MAX + 16];
+  char to[PATH_MAX + 16];
+  unsigned i;
+
+  close(logger.fd);
+  for (i = logger.keep; i > 1; i--) {
+    snprintf(from, sizeof(from), "%s.%u", logger.path, i - 1);
+    snprintf(to, sizeof(to), "%s.%u", logger.path, i);
+    rename(from, to);
+  }
+  if (logger.keep > 0) {
+    snprintf(to, sizeof(to), "%s.1", logger.path);
+    rename(logger.path, to);
+  }
+  open_log(logger.keep == 0);
+
+  pthread_mutex_lock(&logger.lock);
+  logger.stats.rotations++;
+  pthread_mutex_unlock(&logger.lock);
+}
+
+/**
+ * @brief Write a batch to the log file (flusher thread only)
+ *
+ * @param data Batch
+ * @param len Batch size
+ */
+static void write_batch(const char *data, size_t len) {
+  while (len > 0 && logger.fd >= 0) {
+    ssize_t n = write(logger.fd, data, len);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      break; /* disk full or similar: the batch is lost */
+    }
+    data += n;
+    len -= (size_t)n;
+    logger.file_bytes += (size_t)n;
+  }
+  if (logger.max_bytes > 0 && logger.file_bytes >= logger.max_bytes) {
+    rotate_log();
+  }
+}
+
+/**
+ * @brief Flusher thread: swap buffers and write the full one
+ *
+ * @param arg Unused
+ * @return NULL
+ */
+static void *flusher_main(void *arg) {
+  struct timespec deadline;
+  (void)arg;
+
+  pthread_mutex_lock(&logger.lock);
+  while (1) {
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_nsec += FLUSH_INTERVAL_MS * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000L;
+    }
+    while (logger.running && !logger.flush_requested &&
+           logger.used < LOG_BUFFER_SIZE / 2) {
+      if (pthread_cond_timedwait(&logger.wake, &logger.lock, &deadline) ==
+          ETIMEDOUT) {
+        break;
+      }
+    }
+
+    char *batch = logger.buffers[logger.active];
+    size_t len = logger.used;
+    uint64_t target = logger.appended;
+    logger_tap_fn tap = logger.tap;
+    logger.active ^= 1;
+    logger.used = 0;
+    logger.flush_requested = 0;
+    if (len > 0) {
+      logger.stats.batches++;
+    }
+    pthread_mutex_unlock(&logger.lock);
+
+    // Only this thread writes, so the batch lands at the current size
+    size_t offset = logger.file_bytes;
+    write_batch(batch, len);
+    if (tap && len > 0) {
+      tap(batch, len, offset);
+    }
+
+    pthread_mutex_lock(&logger.lock);
+    logger.written = target;
+    pthread_cond_broadcast(&logger.flushed);
+    if (!logger.running && logger.used == 0) {
+      break;
+    }
+  }
+  pthread_mutex_unlock(&logger.lock);
+  return NULL;
+}
+
+int logger_init(const char *path, size_t max_bytes, unsigned keep) {
+  pthread_mutex_lock(&logger.lock);
+  if (logger.started || strlen(path) >= sizeof(logger.path)) {
+    pthread_mutex_unlock(&logger.lock);
+    return -1;
+  }
+  strcpy(logger.path, path);
+  logger.max_bytes = max_bytes;
+  logger.keep = keep;
+  if (open_log(0) != 0) {
+    pthread_mutex_unlock(&logger.lock);
+    return -1;
+  }
+
+  logger.running = 1;
+  if (pthread_create(&logger.thread, NULL, flusher_main, NULL) != 0) {
+    logger.running = 0;
+    close(logger.fd);
+    pthread_mutex_unlock(&logger.lock);
+    return -1;
+  }
+  logger.started = 1;
+  pthread_mutex_unlock(&logger.lock);
+  return 0;
+}
+
+void logger_log(log_level_t level, const char *message) {
+  char line[LOG_LINE_MAX];
+  time_t now = time(NULL);
+  int len;
+
+  // Format outside the lock; ctime_r() only runs once a second per thread
+  if (now != stamp_second) {
+    ctime_r(&now, stamp);
+    stamp[strcspn(stamp, "\n")] = '\0';
+    stamp_second = now;
+  }
+  len = snprintf(line, sizeof(line), "[%s] %s %s\n", stamp,
+                 logger_level_name(level), message);
+  if (len < 0) {
+    return;
+  }
+  if ((size_t)len >= sizeof(line)) {
+    len = sizeof(line) - 1;
+    line[len - 1] = '\n';
+  }
+
+  pthread_mutex_lock(&logger.lock);
+  if (!logger.running) {
+    pthread_mutex_unlock(&logger.lock);
+    return;
+  }
+  if (logger.used + (size_t)len > LOG_BUFFER_SIZE) {
+    logger.stats.dropped++;
+  } else {
+    memcpy(logger.buffers[logger.active] + logger.used, line, (size_t)len);
+    logger.used += (size_t)len;
+    logger.appended += (size_t)len;
+    logger.stats.lines++;
+    if (logger.used >= LOG_BUFFER_SIZE / 2) {
+      pthread_cond_signal(&logger.wake);
+    }
+  }
+  pthread_mutex_unlock(&logger.lock);
+}
+
+void logger_write(const char *message) {
+  logger_log(LOG_LEVEL_INFO, message);
+}
+
+const char *logger_level_name(log_level_t level) {
+  return level < LOG_LEVEL_COUNT ? level_names[level] : "INFO";
+}
+
+void logger_set_tap(logger_tap_fn tap) {
+  pthread_mutex_lock(&logger.lock);
+  logger.tap = tap;
+  pthread_mutex_unlock(&logger.lock);
+}
+
+void logger_flush(void) {
+  pthread_mutex_lock(&logger.lock);
+  uint64_t target = logger.appended;
+  while (logger.running && logger.written < target) {
+    logger.flush_requested = 1;
+    pthread_cond_signal(&logger.wake);
+    pthread_cond_wait(&logger.flushed, &logger.lock);
+  }
+  pthread_mutex_unlock(&logger.lock);
+}
+
+void logger_stats(logger_stats_t *stats) {
+  pthread_mutex_lock(&logger.lock);
+  *stats = logger.stats;
+  pthread_mutex_unlock(&logger.lock);
+}
+
+void logger_shutdown(void) {
+  pthread_mutex_lock(&logger.lock);
+  if (!logger.started) {
+    pthread_mutex_unlock(&logger.lock);
+    return;
+  }
+  logger.running = 0;
+  logger.started = 0;
+  pthread_cond_signal(&logger.wake);
+  pthread_mutex_unlock(&logger.lock);
+
+  pthread_join(logger.thread, NULL);
+  close(logger.fd);
+  logger.fd = -1;
+}
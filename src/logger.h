@@ -0,0 +1,124 @@
+/**
+ * @file logger.h
+ * @brief Asynchronous activity log with batched writes and rotation
+ * @author Rares-Nicholas Popa & Adrian-Petru Enache
+ * @version 1.0.0
+ *
+ * @details Callers format their line into an in-memory buffer under a
+ * short critical section; a background thread writes whole batches to a
+ * log file that stays open, and rotates it once it exceeds a size limit.
+ * A caller never waits for the disk: if the buffer is full (the disk is
+ * far behind) the message is dropped and counted instead.
+ *
+ * Every line reads "[<ctime() timestamp>] <LEVEL> <message>"; log_query.h
+ * searches files in that format.
+ *
+ * @copyright This project is for educational purposes as part of the PCD
+ * course.
+ */
+
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @enum log_level_t
+ * @brief Severity of a log line
+ */
+typedef enum {
+  LOG_LEVEL_INFO,  /**< Normal activity */
+  LOG_LEVEL_WARN,  /**< A request was refused or a peer misbehaved */
+  LOG_LEVEL_ERROR, /**< The server failed to do its job */
+  LOG_LEVEL_COUNT  /**< Number of levels */
+} log_level_t;
+
+/**
+ * @brief Receives every batch right after it was written to the file
+ *
+ * Runs on the flusher thread; lines logged meanwhile wait for it.
+ *
+ * @param batch Whole lines, each ending in a newline
+ * @param len Size of batch
+ * @param offset Where batch starts in the log file (a rotation starts the
+ * next file at 0)
+ */
+typedef void (*logger_tap_fn)(const char *batch, size_t len,
+                              uint64_t offset);
+
+/**
+ * @struct logger_stats_t
+ * @brief Snapshot of logger counters
+ */
+typedef struct {
+  uint64_t lines;     /**< Lines accepted */
+  uint64_t dropped;   /**< Lines dropped because the buffer was full */
+  uint64_t batches;   /**< write() calls issued by the flusher */
+  uint64_t rotations; /**< Times the file was rotated */
+} logger_stats_t;
+
+/**
+ * @brief Open the log file and start the flusher thread
+ *
+ * @param path Log file, appended to
+ * @param max_bytes Rotate once the file grows beyond this size (0 = never)
+ * @param keep Rotated files kept as path.1 ... path.keep
+ *
+ * @return 0 on success, -1 if the file or thread could not be created
+ */
+int logger_init(const char *path, size_t max_bytes, unsigned keep);
+
+/**
+ * @brief Append a timestamped line to the log
+ *
+ * Safe from any thread. Before logger_init() and after logger_shutdown()
+ * the message is discarded.
+ *
+ * @param level Severity
+ * @param message Text of the line (without trailing newline)
+ */
+void logger_log(log_level_t level, const char *message);
+
+/**
+ * @brief Append a timestamped LOG_LEVEL_INFO line to the log
+ *
+ * @param message Text of the line (without trailing newline)
+ */
+void logger_write(const char *message);
+
+/**
+ * @brief Name of a level as written to the log
+ *
+ * @param level Severity
+ * @return "INFO", "WARN" or "ERROR"
+ */
+const char *logger_level_name(log_level_t level);
+
+/**
+ * @brief Install the function that sees every written batch
+ *
+ * @param tap Function to call, or NULL to stop
+ */
+void logger_set_tap(logger_tap_fn tap);
+
+/**
+ * @brief Wait until every line logged so far has been written to the file
+ */
+void logger_flush(void);
+
+/**
+ * @brief Read the logger counters
+ *
+ * @param stats Receives the snapshot
+ */
+void logger_stats(logger_stats_t *stats);
+
+/**
+ * @brief Flush, stop the flusher thread and close the file
+ *
+ * Suitable for atexit().
+ */
+void logger_shutdown(void);
+
+#endif /* LOGGER_H */
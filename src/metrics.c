@@ -0,0 +1,230 @@
+/**
+ * @file metrics.c
+ * @brief Prometheus text exposition over a minimal HTTP/1.x responder
+ * @author Rares-Nicholas Popa & Adrian-Petru Enache
+ * @version 1.0.0
+ *
+ * @details The exposition is rendered fresh on every scrape into a heap
+ * buffer that doubles as needed; nothing is kept between scrapes.
+ *
+ * @copyright This project is for educational purposes as part of the PCD
+ * course.
+ */
+
+#include "metrics.h"
+
+#include <dirent.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include "stats.h"
+
+/** @def METRICS_INITIAL_SIZE
+ * @brief First allocation of an exposition buffer
+ */
+#define METRICS_INITIAL_SIZE 8192
+
+/** @brief Histogram bucket bounds in microseconds (100 us ... 30 s) */
+static const uint64_t bucket_bounds_us[] = {
+    100,    250,    500,     1000,    2500,    5000,     10000,   25000,
+    50000,  100000, 250000,  500000,  1000000, 2500000,  5000000, 10000000,
+    30000000};
+
+/** @def BOUND_COUNT
+ * @brief Number of finite histogram buckets
+ */
+#define BOUND_COUNT (sizeof(bucket_bounds_us) / sizeof(bucket_bounds_us[0]))
+
+/**
+ * @brief Append formatted text
+ *
+ * @param text Exposition
+ * @param format printf() format
+ */
+static void append(metrics_text_t *text, const char *format, ...)
+    __attribute__((format(printf, 2, 3)));
+
+static void append(metrics_text_t *text, const char *format, ...) {
+  va_list args;
+  int needed;
+
+  if (text->failed) {
+    return;
+  }
+  while (1) {
+    va_start(args, format);
+    needed = vsnprintf(text->data + text->len, text->cap - text->len, format,
+                       args);
+    va_end(args);
+    if (needed < 0) {
+      text->failed = 1;
+      return;
+    }
+    if ((size_t)needed < text->cap - text->len) {
+      text->len += (size_t)needed;
+      return;
+    }
+
+    char *grown = realloc(text->data, text->cap * 2 + (size_t)needed);
+    if (!grown) {
+      text->failed = 1;
+      return;
+    }
+    text->data = grown;
+    text->cap = text->cap * 2 + (size_t)needed;
+  }
+}
+
+void metrics_init(metrics_text_t *text) {
+  text->data = malloc(METRICS_INITIAL_SIZE);
+  text->len = 0;
+  text->cap = text->data ? METRICS_INITIAL_SIZE : 0;
+  text->failed = text->data == NULL;
+  if (text->data) {
+    text->data[0] = '\0';
+  }
+}
+
+void metrics_free(metrics_text_t *text) {
+  free(text->data);
+  text->data = NULL;
+  text->len = text->cap = 0;
+}
+
+void metrics_family(metrics_text_t *text, const char *name, const char *type,
+                    const char *help) {
+  append(text, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+void metrics_sample(metrics_text_t *text, const char *name, const char *labels,
+                    double value) {
+  if (labels) {
+    append(text, "%s{%s} %.15g\n", name, labels, value);
+  } else {
+    append(text, "%s %.15g\n", name, value);
+  }
+}
+
+void metrics_single(metrics_text_t *text, const char *name, const char *type,
+                    const char *help, double value) {
+  metrics_family(text, name, type, help);
+  metrics_sample(text, name, NULL, value);
+}
+
+void metrics_phase_histograms(metrics_text_t *text, const char *name) {
+  uint64_t cumulative[BOUND_COUNT];
+  uint64_t total, sum_us;
+  size_t i;
+  int phase;
+
+  metrics_family(text, name, "histogram",
+                 "Time spent in each job phase in seconds");
+  for (phase = 0; phase < STAT_PHASE_COUNT; phase++) {
+    const char *label = stats_phase_name((stat_phase_t)phase);
+
+    stats_cumulative((stat_phase_t)phase, bucket_bounds_us, BOUND_COUNT,
+                     cumulative, &total, &sum_us);
+    for (i = 0; i < BOUND_COUNT; i++) {
+      append(text, "%s_bucket{phase=\"%s\",le=\"%g\"} %llu\n", name, label,
+             (double)bucket_bounds_us[i] / 1e6,
+             (unsigned long long)cumulative[i]);
+    }
+    append(text, "%s_bucket{phase=\"%s\",le=\"+Inf\"} %llu\n", name, label,
+           (unsigned long long)total);
+    append(text, "%s_sum{phase=\"%s\"} %.6f\n", name, label,
+           (double)sum_us / 1e6);
+    append(text, "%s_count{phase=\"%s\"} %llu\n", name, label,
+           (unsigned long long)total);
+  }
+}
+
+/**
+ * @brief Count the open file descriptors of this process
+ *
+ * @return Number of descriptors, or -1 if /proc is unavailable
+ */
+static long count_open_fds(void) {
+  struct dirent *entry;
+  DIR *dir = opendir("/proc/self/fd");
+  long count = 0;
+
+  if (!dir) {
+    return -1;
+  }
+  while ((entry = readdir(dir)) != NULL) {
+    if (entry->d_name[0] != '.') {
+      count++;
+    }
+  }
+  closedir(dir);
+  return count - 1; /* the descriptor opendir() itself holds */
+}
+
+void metrics_process(metrics_text_t *text) {
+  struct rusage usage;
+  unsigned long pages = 0, resident = 0;
+  FILE *statm = fopen("/proc/self/statm", "r");
+  long fds = count_open_fds();
+
+  if (statm) {
+    if (fscanf(statm, "%lu %lu", &pages, &resident) == 2) {
+      metrics_single(text, "process_resident_memory_bytes", "gauge",
+                     "Resident memory size in bytes",
+                     (double)resident * (double)sysconf(_SC_PAGESIZE));
+    }
+    fclose(statm);
+  }
+  if (getrusage(RUSAGE_SELF, &usage) == 0) {
+    metrics_single(
+        text, "process_cpu_seconds_total", "counter",
+        "Total user and system CPU time spent in seconds",
+        (double)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) +
+            (double)(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6);
+  }
+  if (fds >= 0) {
+    metrics_single(text, "process_open_fds", "gauge",
+                   "Number of open file descriptors", (double)fds);
+  }
+}
+
+long metrics_parse_request(const char *in, size_t len, char *method,
+                           size_t method_size, char *path, size_t path_size) {
+  const char *end = NULL;
+  const char *p, *space;
+  size_t i, n;
+
+  // The head ends at the first empty line
+  for (i = 0; i + 3 < len; i++) {
+    if (memcmp(in + i, "\r\n\r\n", 4) == 0) {
+      end = in + i + 4;
+      break;
+    }
+  }
+  if (!end) {
+    return len >= METRICS_MAX_REQUEST ? -1 : 0;
+  }
+
+  // Request line: METHOD SP target SP HTTP/x.y
+  space = memchr(in, ' ', (size_t)(end - in));
+  if (!space || space == in || (size_t)(space - in) >= method_size) {
+    return -1;
+  }
+  memcpy(method, in, (size_t)(space - in));
+  method[space - in] = '\0';
+
+  p = space + 1;
+  n = strcspn(p, " ?\r\n");
+  if (n == 0 || n >= path_size || p + n >= end) {
+    return -1;
+  }
+  memcpy(path, p, n);
+  path[n] = '\0';
+  if (strncmp(p + n + strcspn(p + n, " \r\n"), " HTTP/", 6) != 0) {
+    return -1;
+  }
+  return (long)(end - in);
+}
@@ -0,0 +1,125 @@
+/**
+ * @file metrics.h
+ * @brief Prometheus text exposition over a minimal HTTP/1.x responder
+ * @author Rares-Nicholas Popa & Adrian-Petru Enache
+ * @version 1.0.0
+ *
+ * @details The server answers `GET /metrics` on METRICS_PORT with the
+ * Prometheus text format (version 0.0.4) so standard scrapers can collect
+ * it. This module builds the text: metric families with HELP and TYPE
+ * lines, samples, the job phase histograms from stats.h and the usual
+ * process_* metrics. It also parses just enough of an HTTP request to
+ * find the method and path; every response closes the connection.
+ *
+ * @copyright This project is for educational purposes as part of the PCD
+ * course.
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** @def METRICS_CONTENT_TYPE
+ * @brief Content-Type of the exposition
+ */
+#define METRICS_CONTENT_TYPE "text/plain; version=0.0.4; charset=utf-8"
+
+/** @def METRICS_MAX_REQUEST
+ * @brief Largest HTTP request head accepted
+ */
+#define METRICS_MAX_REQUEST 8192
+
+/**
+ * @struct metrics_text_t
+ * @brief Growing text buffer for one exposition
+ */
+typedef struct {
+  char *data;  /**< Text, NUL-terminated */
+  size_t len;  /**< Length of the text */
+  size_t cap;  /**< Allocated size */
+  int failed;  /**< An allocation failed; the text is incomplete */
+} metrics_text_t;
+
+/**
+ * @brief Start an empty exposition
+ *
+ * @param text Buffer to initialise
+ */
+void metrics_init(metrics_text_t *text);
+
+/**
+ * @brief Release an exposition
+ *
+ * @param text Buffer from metrics_init()
+ */
+void metrics_free(metrics_text_t *text);
+
+/**
+ * @brief Start a metric family (HELP and TYPE lines)
+ *
+ * @param text Exposition
+ * @param name Metric name
+ * @param type "counter", "gauge" or "histogram"
+ * @param help One-line description
+ */
+void metrics_family(metrics_text_t *text, const char *name, const char *type,
+                    const char *help);
+
+/**
+ * @brief Append one sample
+ *
+ * @param text Exposition
+ * @param name Metric name
+ * @param labels Label set without braces (e.g. `phase="compile"`), or NULL
+ * @param value Sample value
+ */
+void metrics_sample(metrics_text_t *text, const char *name, const char *labels,
+                    double value);
+
+/**
+ * @brief Append a family with a single unlabelled sample
+ *
+ * @param text Exposition
+ * @param name Metric name
+ * @param type "counter" or "gauge"
+ * @param help One-line description
+ * @param value Sample value
+ */
+void metrics_single(metrics_text_t *text, const char *name, const char *type,
+                    const char *help, double value);
+
+/**
+ * @brief Append every job phase histogram as one family, in seconds
+ *
+ * @param text Exposition
+ * @param name Metric name (the _bucket, _sum and _count series are added)
+ */
+void metrics_phase_histograms(metrics_text_t *text, const char *name);
+
+/**
+ * @brief Append process_resident_memory_bytes, process_cpu_seconds_total
+ * and process_open_fds
+ *
+ * @param text Exposition
+ */
+void metrics_process(metrics_text_t *text);
+
+/**
+ * @brief Parse the head of an HTTP request
+ *
+ * @param in Received bytes
+ * @param len Number of bytes
+ * @param method Receives the method
+ * @param method_size Size of method
+ * @param path Receives the path without query string
+ * @param path_size Size of path
+ *
+ * @return Length of the request head if it is complete, 0 if more input
+ *         is needed, -1 if it is malformed or too large
+ */
+long metrics_parse_request(const char *in, size_t len, char *method,
+                           size_t method_size, char *path, size_t path_size);
+
+#endif /* METRICS_H */
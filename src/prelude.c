@@ -0,0 +1,359 @@
+/**
+ * @file prelude.c
+ * @brief Precompiled headers for the standard includes submissions start
+ * with
+ * @author Rares-Nicholas Popa & Adrian-Petru Enache
+ * @version 1.0.0
+ *
+ * @details The table of preludes is a small array searched linearly under
+ * a mutex; the compiler runs outside the lock while the entry is marked
+ * as building. Failed builds are remembered so a header that cannot be
+ * precompiled is not retried on every submission.
+ *
+ * @copyright This project is for educational purposes as part of the PCD
+ * course.
+ */
+
+#include "prelude.h"
+
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "process.h"
+
+/** @def PRELUDE_KEY_MAX
+ * @brief Longest include sequence ("name\n" per header) a prelude covers
+ */
+#define PRELUDE_KEY_MAX 512
+
+/** @def PRELUDE_NAME_MAX
+ * @brief Longest header name accepted
+ */
+#define PRELUDE_NAME_MAX 64
+
+/** @def PRELUDE_MAX_ARGS
+ * @brief Maximum number of compiler argv entries for a build
+ */
+#define PRELUDE_MAX_ARGS 32
+
+/** @def PRELUDE_BUILD_TIMEOUT_MS
+ * @brief Wall clock limit for precompiling one prelude
+ */
+#define PRELUDE_BUILD_TIMEOUT_MS 30000
+
+/**
+ * @enum prelude_state_t
+ * @brief Life cycle of a prelude
+ */
+typedef enum {
+  PRELUDE_BUILDING, /**< A thread is running the compiler */
+  PRELUDE_READY,    /**< The .gch exists and may be used */
+  PRELUDE_FAILED    /**< The compiler rejected it; never retried */
+} prelude_state_t;
+
+/**
+ * @struct prelude_entry_t
+ * @brief One precompiled include sequence
+ */
+typedef struct {
+  char key[PRELUDE_KEY_MAX]; /**< Header names, one per line, in order */
+  prelude_state_t state;     /**< Build state */
+} prelude_entry_t;
+
+/** @brief Global prelude state */
+static struct {
+  pthread_mutex_t lock;                 /**< Protects everything below */
+  int enabled;                          /**< prelude_init() succeeded */
+  char dir[PATH_MAX / 2];               /**< Prelude directory */
+  char compiler[PRELUDE_NAME_MAX];      /**< Compiler to run */
+  char flags[PRELUDE_KEY_MAX];          /**< Compiler flags */
+  char headers[PRELUDE_KEY_MAX];        /**< Eligible headers, comma list */
+  prelude_entry_t entries[PRELUDE_MAX]; /**< Known preludes */
+  size_t count;                         /**< Entries in use */
+  prelude_stats_t stats;                /**< Counters */
+} prelude = {PTHREAD_MUTEX_INITIALIZER, 0, "", "", "", "",
+             {{"", PRELUDE_BUILDING}}, 0, {0, 0, 0, 0, 0}};
+
+/**
+ * @brief Check whether a header is in the configured set
+ *
+ * @param name Header name
+ * @param len Length of name
+ * @return 1 if eligible, 0 otherwise
+ */
+static int header_allowed(const char *name, size_t len) {
+  const char *p = prelude.headers;
+
+  while (*p) {
+    size_t item = strcspn(p, ",");
+    if (item == len && strncmp(p, name, len) == 0) {
+      return 1;
+    }
+    p += item;
+    if (*p == ',') {
+      p++;
+    }
+  }
+  return 0;
+}
+
+/**
+ * @brief Collect the eligible `#include <...>` lines a submission starts
+ * with
+ *
+ * Scanning stops at the first thing that is not blank space, a comment or
+ * an eligible include on a line of its own, so everything the prelude
+ * covers precedes all of the submission's own code and macros.
+ *
+ * @param source Submission
+ * @param key Receives the header names, one per line
+ * @param size Size of key
+ *
+ * @return Number of headers found
+ */
+static size_t scan_includes(const char *source, char *key, size_t size) {
+  const char *p = source;
+  size_t used = 0, found = 0;
+
+  key[0] = '\0';
+  while (1) {
+    const char *name, *end;
+
+    p += strspn(p, " \t\r\n");
+    if (strncmp(p, "//", 2) == 0) {
+      p += strcspn(p, "\n");
+      continue;
+    }
+    if (strncmp(p, "/*", 2) == 0) {
+      const char *close = strstr(p + 2, "*/");
+      if (!close) {
+        break;
+      }
+      p = close + 2;
+      continue;
+    }
+
+    // #include <name> with nothing but blanks or a comment after it
+    if (*p != '#') {
+      break;
+    }
+    name = p + 1 + strspn(p + 1, " \t");
+    if (strncmp(name, "include", 7) != 0) {
+      break;
+    }
+    name += 7;
+    name += strspn(name, " \t");
+    if (*name != '<') {
+      break;
+    }
+    name++;
+    end = name + strcspn(name, ">\n");
+    if (*end != '>' || end == name || end - name >= PRELUDE_NAME_MAX ||
+        !header_allowed(name, (size_t)(end - name))) {
+      break;
+    }
+    p = end + 1 + strspn(end + 1, " \t\r");
+    if (*p != '\0' && *p != '\n' && strncmp(p, "//", 2) != 0 &&
+        strncmp(p, "/*", 2) != 0) {
+      break;
+    }
+    if (used + (size_t)(end - name) + 2 > size) {
+      break;
+    }
+    memcpy(key + used, name, (size_t)(end - name));
+    used += (size_t)(end - name);
+    key[used++] = '\n';
+    key[used] = '\0';
+    found++;
+  }
+  return found;
+}
+
+/**
+ * @brief Path of a prelude header
+ *
+ * @param index Entry index
+ * @param suffix "" for the header, ".gch" for the precompiled file
+ * @param path Receives the path
+ * @param size Size of path
+ */
+static void prelude_path(size_t index, const char *suffix, char *path,
+                         size_t size) {
+  snprintf(path, size, "%s/prelude-%zu.h%s", prelude.dir, index, suffix);
+}
+
+/**
+ * @brief Write and precompile a prelude (called without the lock)
+ *
+ * @param index Entry index
+ * @param key Header names, one per line
+ *
+ * @return 0 if the .gch was produced, -1 otherwise
+ */
+static int build_prelude(size_t index, const char *key) {
+  char path[PATH_MAX];
+  char header[PRELUDE_NAME_MAX];
+  char gch[PRELUDE_NAME_MAX];
+  char flags[PRELUDE_KEY_MAX];
+  char diag[1024];
+  char *argv[PRELUDE_MAX_ARGS];
+  size_t argc = 0;
+  process_spec_t spec;
+  process_result_t result;
+  const char *line;
+  char *flag;
+  FILE *file;
+
+  prelude_path(index, "", path, sizeof(path));
+  file = fopen(path, "w");
+  if (!file) {
+    return -1;
+  }
+  for (line = key; *line; line += strcspn(line, "\n") + 1) {
+    fprintf(file, "#include <%.*s>\n", (int)strcspn(line, "\n"), line);
+  }
+  fclose(file);
+
+  snprintf(header, sizeof(header), "prelude-%zu.h", index);
+  snprintf(gch, sizeof(gch), "prelude-%zu.h.gch", index);
+  snprintf(flags, sizeof(flags), "%s", prelude.flags);
+  argv[argc++] = prelude.compiler;
+  for (flag = strtok(flags, " "); flag && argc < PRELUDE_MAX_ARGS - 6;
+       flag = strtok(NULL, " ")) {
+    argv[argc++] = flag;
+  }
+  argv[argc++] = "-x";
+  argv[argc++] = "c-header";
+  argv[argc++] = header;
+  argv[argc++] = "-o";
+  argv[argc++] = gch;
+  argv[argc] = NULL;
+
+  memset(&spec, 0, sizeof(spec));
+  spec.argv = argv;
+  spec.search_path = 1;
+  spec.cwd = prelude.dir;
+  spec.timeout_ms = PRELUDE_BUILD_TIMEOUT_MS;
+  spec.output = diag;
+  spec.output_size = sizeof(diag);
+
+  if (process_run(&spec, &result) != 0 || result.timed_out ||
+      !WIFEXITED(result.status) || WEXITSTATUS(result.status) != 0) {
+    prelude_path(index, ".gch", path, sizeof(path));
+    unlink(path);
+    return -1;
+  }
+  return 0;
+}
+
+int prelude_init(const char *dir, const char *compiler, const char *flags,
+                 const char *headers) {
+  pthread_mutex_lock(&prelude.lock);
+  if (strlen(dir) >= sizeof(prelude.dir) ||
+      strlen(compiler) >= sizeof(prelude.compiler) ||
+      strlen(flags) >= sizeof(prelude.flags) ||
+      strlen(headers) >= sizeof(prelude.headers)) {
+    pthread_mutex_unlock(&prelude.lock);
+    return -1;
+  }
+  strcpy(prelude.dir, dir);
+  strcpy(prelude.compiler, compiler);
+  strcpy(prelude.flags, flags);
+  strcpy(prelude.headers, headers);
+  __atomic_store_n(&prelude.enabled, 1, __ATOMIC_RELEASE);
+  pthread_mutex_unlock(&prelude.lock);
+  return 0;
+}
+
+int prelude_lookup(const char *source, char *path, size_t size) {
+  char key[PRELUDE_KEY_MAX];
+  size_t found, i;
+  int ok;
+
+  if (!__atomic_load_n(&prelude.enabled, __ATOMIC_ACQUIRE)) {
+    return 0;
+  }
+
+  // The eligible set never changes after init, so scan without the lock
+  found = scan_includes(source, key, sizeof(key));
+  pthread_mutex_lock(&prelude.lock);
+  if (found == 0) {
+    prelude.stats.misses++;
+    pthread_mutex_unlock(&prelude.lock);
+    return 0;
+  }
+
+  for (i = 0; i < prelude.count; i++) {
+    if (strcmp(prelude.entries[i].key, key) == 0) {
+      break;
+    }
+  }
+  if (i < prelude.count) {
+    ok = prelude.entries[i].state == PRELUDE_READY;
+    if (ok) {
+      prelude.stats.hits++;
+      prelude_path(i, "", path, size);
+    } else {
+      prelude.stats.misses++;
+    }
+    pthread_mutex_unlock(&prelude.lock);
+    return ok;
+  }
+  if (prelude.count == PRELUDE_MAX) {
+    prelude.stats.misses++;
+    pthread_mutex_unlock(&prelude.lock);
+    return 0;
+  }
+
+  // First submission with this sequence: build it while others skip it
+  i = prelude.count++;
+  strcpy(prelude.entries[i].key, key);
+  prelude.entries[i].state = PRELUDE_BUILDING;
+  pthread_mutex_unlock(&prelude.lock);
+
+  ok = build_prelude(i, key) == 0;
+
+  pthread_mutex_lock(&prelude.lock);
+  prelude.entries[i].state = ok ? PRELUDE_READY : PRELUDE_FAILED;
+  if (ok) {
+    prelude.stats.builds++;
+    prelude.stats.preludes++;
+    prelude.stats.hits++;
+    prelude_path(i, "", path, size);
+  } else {
+    prelude.stats.failures++;
+    prelude.stats.misses++;
+  }
+  pthread_mutex_unlock(&prelude.lock);
+  return ok;
+}
+
+void prelude_stats(prelude_stats_t *stats) {
+  pthread_mutex_lock(&prelude.lock);
+  *stats = prelude.stats;
+  pthread_mutex_unlock(&prelude.lock);
+}
+
+void prelude_shutdown(void) {
+  char path[PATH_MAX];
+  size_t i;
+
+  pthread_mutex_lock(&prelude.lock);
+  if (prelude.enabled) {
+    for (i = 0; i < prelude.count; i++) {
+      prelude_path(i, "", path, sizeof(path));
+      unlink(path);
+      prelude_path(i, ".gch", path, sizeof(path));
+      unlink(path);
+    }
+    rmdir(prelude.dir);
+  }
+  __atomic_store_n(&prelude.enabled, 0, __ATOMIC_RELEASE);
+  prelude.count = 0;
+  prelude.stats.preludes = 0;
+  pthread_mutex_unlock(&prelude.lock);
+}
@@ -0,0 +1,94 @@
+/**
+ * @file prelude.h
+ * @brief Precompiled headers for the standard includes submissions start
+ * with
+ * @author Rares-Nicholas Popa & Adrian-Petru Enache
+ * @version 1.0.0
+ *
+ * @details Most submissions begin with the same few `#include <...>`
+ * lines, and the compiler front end spends a large part of every compile
+ * parsing them again. A prelude is a header made of exactly those lines,
+ * precompiled once (`gcc -x c-header`) with the server's compiler flags.
+ * A submission whose leading includes are all in the configured set is
+ * compiled with `-include prelude-N.h`, and gcc loads the matching .gch
+ * instead of parsing the headers. Only the leading block is covered, in
+ * the submission's own order, so the submission sees exactly the
+ * declarations it would have seen without the prelude; its own #include
+ * lines are then skipped by the headers' include guards.
+ *
+ * Preludes are built lazily, one per distinct include sequence, up to
+ * PRELUDE_MAX of them. If a .gch is unusable gcc silently falls back to
+ * parsing the prelude text, which is still correct.
+ *
+ * @copyright This project is for educational purposes as part of the PCD
+ * course.
+ */
+
+#ifndef PRELUDE_H
+#define PRELUDE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** @def PRELUDE_MAX
+ * @brief Distinct include sequences precompiled at most
+ */
+#define PRELUDE_MAX 32
+
+/**
+ * @struct prelude_stats_t
+ * @brief Snapshot of prelude counters for the STATUS command
+ */
+typedef struct {
+  uint64_t hits;     /**< Compiles that used a precompiled prelude */
+  uint64_t misses;   /**< Compiles that parsed their headers */
+  uint64_t builds;   /**< Preludes precompiled successfully */
+  uint64_t failures; /**< Preludes the compiler rejected */
+  size_t preludes;   /**< Preludes currently usable */
+} prelude_stats_t;
+
+/**
+ * @brief Enable preludes
+ *
+ * @param dir Existing directory that holds the preludes and their .gch
+ *        files
+ * @param compiler Compiler used for submissions
+ * @param flags Compiler flags used for submissions (space-separated); a
+ *        precompiled header is only valid for the flags it was built with
+ * @param headers Comma-separated headers eligible for preludes, e.g.
+ *        "stdio.h,stdlib.h"; they must have include guards
+ *
+ * @return 0 on success, -1 if the arguments do not fit (preludes stay
+ *         disabled)
+ */
+int prelude_init(const char *dir, const char *compiler, const char *flags,
+                 const char *headers);
+
+/**
+ * @brief Find (or build) the prelude matching a submission
+ *
+ * A missing prelude is built by the calling thread; other threads asking
+ * for the same sequence meanwhile compile without it rather than wait.
+ *
+ * @param source Null-terminated submission
+ * @param path Receives the absolute prelude path to pass to -include
+ * @param size Size of path
+ *
+ * @return 1 if path was filled in, 0 if the submission does not start
+ *         with eligible includes or no prelude is available
+ */
+int prelude_lookup(const char *source, char *path, size_t size);
+
+/**
+ * @brief Read the prelude counters
+ *
+ * @param stats Receives the snapshot
+ */
+void prelude_stats(prelude_stats_t *stats);
+
+/**
+ * @brief Delete every prelude and the directory
+ */
+void prelude_shutdown(void);
+
+#endif /* PRELUDE_H */
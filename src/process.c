@@ -0,0 +1,307 @@
+/**
+ * @file process.c
+ * @brief Run a child process directly with captured output and a deadline
+ * @author Rares-Nicholas Popa & Adrian-Petru Enache
+ * @version 1.0.0
+ *
+ * @details glibc implements posix_spawn() with clone(CLONE_VFORK), so the
+ * server's address space is never copied. The parent multiplexes the
+ * output pipe and the optional stdin pipe with poll() until the child
+ * closes its output or the deadline passes.
+ *
+ * @copyright This project is for educational purposes as part of the PCD
+ * course.
+ */
+
+#include "process.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+extern char **environ;
+
+/** @def EXIT_POLL_MS
+ * @brief Interval between exit checks once the child closed its output
+ */
+#define EXIT_POLL_MS 1
+
+/**
+ * @brief Current monotonic time in milliseconds
+ *
+ * @return Milliseconds since an arbitrary epoch
+ */
+static long long now_ms(void) {
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (long long)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+/**
+ * @brief Milliseconds left until a deadline, for poll()
+ *
+ * @param deadline Absolute deadline from now_ms(), or 0 for none
+ * @return Remaining time clamped at 0, or -1 (infinite) without deadline
+ */
+static int remaining_ms(long long deadline) {
+  long long left;
+
+  if (deadline == 0) {
+    return -1;
+  }
+  left = deadline - now_ms();
+  return left > 0 ? (int)left : 0;
+}
+
+/**
+ * @brief Set up the child's file descriptors and attributes and spawn it
+ *
+ * @param spec What to run
+ * @param in_fd Read end of the stdin pipe, or -1 for /dev/null
+ * @param out_fd Write end of the output pipe
+ * @param pid Receives the child pid
+ *
+ * @return 0 or an errno value
+ */
+static int spawn_child(const process_spec_t *spec, int in_fd, int out_fd,
+                       pid_t *pid) {
+  posix_spawn_file_actions_t actions;
+  posix_spawnattr_t attr;
+  sigset_t signals;
+  int rc;
+
+  posix_spawn_file_actions_init(&actions);
+  posix_spawnattr_init(&attr);
+
+  if (in_fd >= 0) {
+    posix_spawn_file_actions_adddup2(&actions, in_fd, STDIN_FILENO);
+  } else {
+    posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null",
+                                     O_RDONLY, 0);
+  }
+  posix_spawn_file_actions_adddup2(&actions, out_fd, STDOUT_FILENO);
+  posix_spawn_file_actions_adddup2(&actions, out_fd, STDERR_FILENO);
+  if (spec->cwd) {
+    posix_spawn_file_actions_addchdir_np(&actions, spec->cwd);
+  }
+
+  // Own process group (so the whole tree can be killed), clean signal state
+  sigemptyset(&signals);
+  posix_spawnattr_setsigmask(&attr, &signals);
+  sigaddset(&signals, SIGPIPE);
+  posix_spawnattr_setsigdefault(&attr, &signals);
+  posix_spawnattr_setpgroup(&attr, 0);
+  posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP |
+                                      POSIX_SPAWN_SETSIGMASK |
+                                      POSIX_SPAWN_SETSIGDEF);
+
+  if (spec->search_path) {
+    rc = posix_spawnp(pid, spec->argv[0], &actions, &attr, spec->argv,
+                      environ);
+  } else {
+    rc = posix_spawn(pid, spec->argv[0], &actions, &attr, spec->argv, environ);
+  }
+
+  posix_spawnattr_destroy(&attr);
+  posix_spawn_file_actions_destroy(&actions);
+  return rc;
+}
+
+ssize_t process_collect(const process_spec_t *spec, int out_fd,
+                        process_result_t *result) {
+  char discard[4096];
+  size_t held = result->output_len + result->spliced;
+  size_t room = held < spec->output_size - 1 ? spec->output_size - 1 - held
+                                             : 0;
+  ssize_t n;
+  int waiting;
+
+  // Readable but nothing waiting is the end of output: read() reports it
+  if (room > 0 && spec->on_splice && ioctl(out_fd, FIONREAD, &waiting) == 0 &&
+      waiting > 0) {
+    size_t len = (size_t)waiting < room ? (size_t)waiting : room;
+
+    result->spliced += len;
+    if (spec->on_splice(spec->context, out_fd, len) != 0) {
+      result->cancelled = 1;
+    }
+    return (ssize_t)len;
+  }
+
+  if (room == 0) {
+    n = read(out_fd, discard, sizeof(discard));
+    if (n > 0) {
+      result->truncated = 1;
+    }
+    return n;
+  }
+
+  n = read(out_fd, spec->output + result->output_len, room);
+  if (n > 0) {
+    const char *chunk = spec->output + result->output_len;
+    result->output_len += (size_t)n;
+    spec->output[result->output_len] = '\0';
+    if (spec->on_output &&
+        spec->on_output(spec->context, chunk, (size_t)n) != 0) {
+      result->cancelled = 1;
+    }
+  }
+  return n;
+}
+
+/**
+ * @brief Wait until the child has exited, without reaping it
+ *
+ * @param pid Child pid
+ * @param deadline Absolute deadline, or 0 for none
+ *
+ * @return 1 if it exited, 0 if the deadline passed first
+ */
+static int wait_exit(pid_t pid, long long deadline) {
+  siginfo_t info;
+
+  while (1) {
+    memset(&info, 0, sizeof(info));
+    if (waitid(P_PID, (id_t)pid, &info, WEXITED | WNOHANG | WNOWAIT) != 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return 1;
+    }
+    if (info.si_pid == pid) {
+      return 1;
+    }
+    if (deadline != 0 && remaining_ms(deadline) == 0) {
+      return 0;
+    }
+    poll(NULL, 0, EXIT_POLL_MS);
+  }
+}
+
+int process_run(const process_spec_t *spec, process_result_t *result) {
+  int out_pipe[2], in_pipe[2] = {-1, -1};
+  struct pollfd fds[2];
+  size_t written = 0;
+  long long started = now_ms();
+  long long deadline = spec->timeout_ms ? started + spec->timeout_ms : 0;
+  struct rusage usage;
+  pid_t pid;
+  int rc;
+
+  memset(result, 0, sizeof(*result));
+  spec->output[0] = '\0';
+
+  if (pipe2(out_pipe, O_CLOEXEC) != 0) {
+    return -1;
+  }
+  if (spec->input && pipe2(in_pipe, O_CLOEXEC) != 0) {
+    close(out_pipe[0]);
+    close(out_pipe[1]);
+    return -1;
+  }
+
+  rc = spawn_child(spec, in_pipe[0], out_pipe[1], &pid);
+  close(out_pipe[1]);
+  if (in_pipe[0] >= 0) {
+    close(in_pipe[0]);
+  }
+  if (rc != 0) {
+    close(out_pipe[0]);
+    if (in_pipe[1] >= 0) {
+      close(in_pipe[1]);
+    }
+    errno = rc;
+    return -1;
+  }
+
+  if (in_pipe[1] >= 0) {
+    fcntl(in_pipe[1], F_SETFL, O_NONBLOCK);
+    if (spec->input_len == 0) {
+      close(in_pipe[1]);
+      in_pipe[1] = -1;
+    }
+  }
+
+  // Pump stdin and collect output until the child closes its end
+  while (out_pipe[0] >= 0) {
+    nfds_t count = 1;
+    fds[0].fd = out_pipe[0];
+    fds[0].events = POLLIN;
+    fds[0].revents = 0;
+    if (in_pipe[1] >= 0) {
+      fds[1].fd = in_pipe[1];
+      fds[1].events = POLLOUT;
+      fds[1].revents = 0;
+      count = 2;
+    }
+
+    // A child that keeps the pipe readable never lets poll() time out
+    int ready = deadline != 0 && remaining_ms(deadline) == 0
+                    ? 0
+                    : poll(fds, count, remaining_ms(deadline));
+    if (ready < 0 && errno == EINTR) {
+      continue;
+    }
+    if (ready == 0) {
+      result->timed_out = 1;
+      break;
+    }
+
+    if (fds[0].revents) {
+      ssize_t n = process_collect(spec, out_pipe[0], result);
+      if (result->cancelled) {
+        break;
+      }
+      if (n == 0 || (n < 0 && errno != EINTR && errno != EAGAIN)) {
+        close(out_pipe[0]);
+        out_pipe[0] = -1;
+      }
+    }
+
+    if (count == 2 && fds[1].revents) {
+      ssize_t n = write(in_pipe[1], spec->input + written,
+                        spec->input_len - written);
+      if (n > 0) {
+        written += (size_t)n;
+      }
+      if (written == spec->input_len ||
+          (n < 0 && errno != EAGAIN && errno != EINTR)) {
+        close(in_pipe[1]); /* EOF for the child, or it stopped reading */
+        in_pipe[1] = -1;
+      }
+    }
+  }
+
+  if (out_pipe[0] >= 0) {
+    close(out_pipe[0]);
+  }
+  if (in_pipe[1] >= 0) {
+    close(in_pipe[1]);
+  }
+  spec->output[result->output_len] = '\0';
+
+  if (!result->timed_out && !result->cancelled && !wait_exit(pid, deadline)) {
+    result->timed_out = 1;
+  }
+
+  // The group leader is still unreaped, so its pgid cannot be recycled yet
+  kill(-pid, SIGKILL);
+  while (wait4(pid, &result->status, 0, &usage) < 0 && errno == EINTR) {
+  }
+  result->wall_us = (uint64_t)(now_ms() - started) * 1000u;
+  result->cpu_us =
+      (uint64_t)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000u +
+      (uint64_t)(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec);
+  result->peak_bytes = (uint64_t)usage.ru_maxrss * 1024u;
+  return 0;
+}
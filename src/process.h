@@ -0,0 +1,123 @@
+/**
+ * @file process.h
+ * @brief Run a child process directly with captured output and a deadline
+ * @author Rares-Nicholas Popa & Adrian-Petru Enache
+ * @version 1.0.0
+ *
+ * @details Replaces system()/popen(): the child is started with
+ * posix_spawn() (no /bin/sh, no timeout(1) helper), its stdout and stderr
+ * are collected from one pipe and the time limit is enforced by the caller
+ * with poll() and SIGKILL. The child runs in its own process group so that
+ * anything it forks is killed with it.
+ *
+ * @copyright This project is for educational purposes as part of the PCD
+ * course.
+ */
+
+#ifndef PROCESS_H
+#define PROCESS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/**
+ * @brief Receives output as soon as it is read from the child
+ *
+ * The call may block (e.g. on a slow client); the child then blocks on
+ * the full pipe, so output is throttled instead of buffered.
+ *
+ * @param context process_spec_t::context
+ * @param data Bytes just appended to process_spec_t::output
+ * @param len Number of bytes
+ *
+ * @return 0 to continue, non-zero to kill the child and stop
+ */
+typedef int (*process_output_fn)(void *context, const char *data, size_t len);
+
+/**
+ * @brief Takes output straight out of the child's pipe
+ *
+ * Used instead of process_output_fn when output need not be kept: the
+ * consumer moves the bytes on itself, e.g. with splice(), and nothing is
+ * stored in process_spec_t::output.
+ *
+ * @param context process_spec_t::context
+ * @param fd Read end of the output pipe, holding at least len bytes
+ * @param len Number of bytes to take, exactly
+ *
+ * @return 0 to continue, non-zero to kill the child and stop
+ */
+typedef int (*process_splice_fn)(void *context, int fd, size_t len);
+
+/**
+ * @struct process_spec_t
+ * @brief What to run and how
+ */
+typedef struct {
+  char *const *argv;  /**< Program and arguments, NULL-terminated */
+  int search_path;    /**< Look argv[0] up in $PATH */
+  const char *cwd;    /**< Working directory, or NULL to inherit */
+  const char *input;  /**< Bytes written to stdin, or NULL for /dev/null */
+  size_t input_len;   /**< Length of input */
+  unsigned timeout_ms; /**< Wall clock limit, 0 for none */
+  char *output;       /**< Receives stdout+stderr, NUL-terminated */
+  size_t output_size; /**< Size of output (at least 1) */
+  process_output_fn on_output; /**< Optional incremental output consumer */
+  process_splice_fn on_splice; /**< Optional zero-copy output consumer,
+                                    needs on_output for what is read */
+  void *context;      /**< Passed to on_output */
+} process_spec_t;
+
+/**
+ * @struct process_result_t
+ * @brief How the child ended
+ */
+typedef struct {
+  int status;        /**< Wait status as returned by waitpid() */
+  int timed_out;     /**< Killed because the deadline passed */
+  int truncated;     /**< Output did not fit and was cut short */
+  int cancelled;     /**< Killed because on_output asked to stop */
+  size_t output_len; /**< Bytes stored in spec->output */
+  size_t spliced;    /**< Bytes on_splice took instead */
+  uint64_t cpu_us;   /**< User and system CPU time used */
+  uint64_t wall_us;  /**< Time from spawn to reap */
+  uint64_t peak_bytes; /**< Peak memory use */
+  int memory_killed; /**< Killed by the job memory limit (see quota.h) */
+  int pids_limited;  /**< Hit the job task limit (see quota.h) */
+} process_result_t;
+
+/**
+ * @brief Run a process to completion
+ *
+ * Output beyond spec->output_size - 1 bytes is read and discarded so the
+ * child never blocks on a full pipe.
+ *
+ * @param spec What to run
+ * @param result Receives the outcome
+ *
+ * @return 0 if the process was started (see result), -1 if it could not be
+ *         spawned (errno is set)
+ */
+int process_run(const process_spec_t *spec, process_result_t *result);
+
+/**
+ * @brief Read once from a child's output pipe into spec->output
+ *
+ * Applies the same rules as process_run(): output beyond the buffer is
+ * discarded and flagged as truncated, and spec->on_output is called with
+ * what was stored (result->cancelled is set if it asks to stop). With
+ * spec->on_splice the bytes waiting in the pipe are handed to it instead;
+ * they count against the buffer size as if they had been stored.
+ *
+ * @param spec Output buffer and callback
+ * @param out_fd Read end of the output pipe
+ * @param result Output length and flags, updated
+ *
+ * @return Bytes read, 0 at end of output, -1 on error (errno is set, e.g.
+ *         EAGAIN for an empty non-blocking pipe)
+ */
+ssize_t process_collect(const process_spec_t *spec, int out_fd,
+                        process_result_t *result);
+
+#endif /* PROCESS_H */
@@ -0,0 +1,233 @@
+/**
+ * @file project.c
+ * @brief Multi-file submissions: file names, include dependencies and the
+ * cache keys of their translation units
+ * @author Rares-Nicholas Popa & Adrian-Petru Enache
+ * @version 1.0.0
+ *
+ * @details The includes of a file are found by a line scan for
+ * `#include "name"`, without preprocessing: an include inside a comment or
+ * a disabled #if block still counts, which at worst recompiles a unit
+ * that did not need it. Dependencies are kept as bit masks over the
+ * project's files, so the headers a unit reaches are a small fixed-point
+ * loop.
+ *
+ * @copyright This project is for educational purposes as part of the PCD
+ * course.
+ */
+
+#include "project.h"
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+int project_name_valid(const char *name, size_t len) {
+  if (len < 3 || len >= PROJECT_NAME_MAX || name[0] == '.' ||
+      name[len - 2] != '.' || (name[len - 1] != 'c' && name[len - 1] != 'h')) {
+    return 0;
+  }
+  for (size_t i = 0; i < len; i++) {
+    char c = name[i];
+
+    if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+          (c >= '0' && c <= '9') || c == '_' || c == '-' || c == '.')) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+int project_is_unit(const project_file_t *file) {
+  return file->name[strlen(file->name) - 1] == 'c';
+}
+
+/**
+ * @brief Mask of every header of a project
+ *
+ * @param files Files of the project
+ * @param count Number of files
+ * @return Bit i set for every header files[i]
+ */
+static uint64_t all_headers(const project_file_t *files, size_t count) {
+  uint64_t mask = 0;
+
+  for (size_t i = 0; i < count; i++) {
+    if (!project_is_unit(&files[i])) {
+      mask |= (uint64_t)1 << i;
+    }
+  }
+  return mask;
+}
+
+/**
+ * @brief Project headers a file includes itself
+ *
+ * @param text Text of every file
+ * @param files Files of the project
+ * @param count Number of files
+ * @param index File to scan
+ *
+ * @return Bit i set for every header files[i] it includes; every header if
+ *         an include is not a plain "name" or <name>
+ */
+static uint64_t direct_includes(const char *text, const project_file_t *files,
+                                size_t count, size_t index) {
+  const char *pos = text + files[index].offset;
+  const char *end = pos + files[index].len;
+  uint64_t mask = 0;
+
+  while (pos < end) {
+    const char *eol = memchr(pos, '\n', (size_t)(end - pos));
+    const char *p = pos;
+
+    if (!eol) {
+      eol = end;
+    }
+    pos = eol + 1;
+
+    while (p < eol && (*p == ' ' || *p == '\t')) {
+      p++;
+    }
+    if (p == eol || *p++ != '#') {
+      continue;
+    }
+    while (p < eol && (*p == ' ' || *p == '\t')) {
+      p++;
+    }
+    if ((size_t)(eol - p) < 7 || memcmp(p, "include", 7) != 0) {
+      continue;
+    }
+    p += 7;
+    while (p < eol && (*p == ' ' || *p == '\t')) {
+      p++;
+    }
+    if (p < eol && *p == '<') {
+      continue;
+    }
+    if (p == eol || *p != '"') {
+      return all_headers(files, count);
+    }
+
+    const char *name = ++p;
+    const char *close = memchr(name, '"', (size_t)(eol - name));
+    size_t len = close ? (size_t)(close - name) : 0;
+
+    for (size_t i = 0; i < count; i++) {
+      if (strlen(files[i].name) == len &&
+          memcmp(files[i].name, name, len) == 0 &&
+          !project_is_unit(&files[i])) {
+        mask |= (uint64_t)1 << i;
+      }
+    }
+  }
+  return mask;
+}
+
+/**
+ * @brief Hash one file: its name, its length and its text
+ *
+ * @param ctx Digest being computed
+ * @param text Text of every file
+ * @param file File to add
+ */
+static void hash_file(sha256_ctx_t *ctx, const char *text,
+                      const project_file_t *file) {
+  uint8_t len[8];
+
+  for (int i = 0; i < 8; i++) {
+    len[i] = (uint8_t)((uint64_t)file->len >> (56 - 8 * i));
+  }
+  sha256_update(ctx, file->name, strlen(file->name) + 1);
+  sha256_update(ctx, len, sizeof(len));
+  sha256_update(ctx, text + file->offset, file->len);
+}
+
+/**
+ * @brief Start a project digest
+ *
+ * @param ctx Digest to start
+ * @param kind "project" or "unit", so the two kinds of key never collide
+ * @param toolchain Compiler identity
+ * @param flags Compiler flags
+ */
+static void hash_start(sha256_ctx_t *ctx, const char *kind,
+                       const char *toolchain, const char *flags) {
+  sha256_init(ctx);
+  sha256_update(ctx, kind, strlen(kind) + 1);
+  sha256_update(ctx, toolchain, strlen(toolchain) + 1);
+  sha256_update(ctx, flags, strlen(flags) + 1);
+}
+
+void project_key(const char *toolchain, const char *flags, const char *text,
+                 const project_file_t *files, size_t count,
+                 uint8_t key[SHA256_DIGEST_SIZE]) {
+  sha256_ctx_t ctx;
+
+  hash_start(&ctx, "project", toolchain, flags);
+  for (size_t i = 0; i < count; i++) {
+    hash_file(&ctx, text, &files[i]);
+  }
+  sha256_final(&ctx, key);
+}
+
+void project_unit_key(const char *toolchain, const char *flags,
+                      const char *text, const project_file_t *files,
+                      size_t count, size_t unit,
+                      uint8_t key[SHA256_DIGEST_SIZE]) {
+  uint64_t needed = direct_includes(text, files, count, unit);
+  uint64_t scanned = 0;
+  sha256_ctx_t ctx;
+
+  // Follow includes of included headers until no new header turns up
+  while (needed != scanned) {
+    for (size_t i = 0; i < count; i++) {
+      uint64_t bit = (uint64_t)1 << i;
+
+      if ((needed & bit) && !(scanned & bit)) {
+        scanned |= bit;
+        needed |= direct_includes(text, files, count, i);
+      }
+    }
+  }
+
+  hash_start(&ctx, "unit", toolchain, flags);
+  hash_file(&ctx, text, &files[unit]);
+  for (size_t i = 0; i < count; i++) {
+    if (needed & ((uint64_t)1 << i)) {
+      hash_file(&ctx, text, &files[i]);
+    }
+  }
+  sha256_final(&ctx, key);
+}
+
+int project_write(const char *dir, const char *text,
+                  const project_file_t *files, size_t count) {
+  char path[PATH_MAX];
+
+  for (size_t i = 0; i < count; i++) {
+    const char *data = text + files[i].offset;
+    size_t left = files[i].len;
+    int fd;
+
+    snprintf(path, sizeof(path), "%s/%s", dir, files[i].name);
+    fd = open(path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    if (fd < 0) {
+      return -1;
+    }
+    while (left > 0) {
+      ssize_t n = write(fd, data, left);
+
+      if (n <= 0) {
+        close(fd);
+        return -1;
+      }
+      data += n;
+      left -= (size_t)n;
+    }
+    close(fd);
+  }
+  return 0;
+}
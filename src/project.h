@@ -0,0 +1,111 @@
+/**
+ * @file project.h
+ * @brief Multi-file submissions: file names, include dependencies and the
+ * cache keys of their translation units
+ * @author Rares-Nicholas Popa & Adrian-Petru Enache
+ * @version 1.0.0
+ *
+ * @details A project is a flat set of ".c" and ".h" files. Every ".c"
+ * file is a translation unit compiled on its own into an object file, and
+ * the objects are linked into the program. The key of a unit covers the
+ * toolchain, the flags, its name and text, and the text of every project
+ * header it includes, directly or through other headers: resubmitting a
+ * project with one unit changed gives every other unit the key of its
+ * cached object. A unit that computes its includes with a macro is keyed
+ * on every header of the project.
+ *
+ * @copyright This project is for educational purposes as part of the PCD
+ * course.
+ */
+
+#ifndef PROJECT_H
+#define PROJECT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sha256.h"
+
+/** @def PROJECT_MAX_FILES
+ * @brief Files a project may have (the include sets are 64-bit masks)
+ */
+#define PROJECT_MAX_FILES 64
+
+/** @def PROJECT_NAME_MAX
+ * @brief Size of a file name, including the terminating NUL
+ */
+#define PROJECT_NAME_MAX 64
+
+/**
+ * @struct project_file_t
+ * @brief One file of a project, its text stored with all the others
+ */
+typedef struct {
+  char name[PROJECT_NAME_MAX]; /**< File name, e.g. "list.c" */
+  size_t offset;               /**< Start of its text in the project */
+  size_t len;                  /**< Length of its text */
+} project_file_t;
+
+/**
+ * @brief Check a file name sent by a client
+ *
+ * @param name Name (not NUL-terminated)
+ * @param len Length of name
+ *
+ * @return 1 if it is a ".c" or ".h" name of letters, digits, '_', '-' and
+ *         '.' that does not start with '.', 0 otherwise
+ */
+int project_name_valid(const char *name, size_t len);
+
+/**
+ * @brief Whether a file is a translation unit
+ *
+ * @param file Project file
+ * @return 1 for a ".c" file, 0 for a header
+ */
+int project_is_unit(const project_file_t *file);
+
+/**
+ * @brief Key of a linked project, for the compile cache
+ *
+ * @param toolchain Compiler identity
+ * @param flags Compiler flags
+ * @param text Text of every file
+ * @param files Files of the project
+ * @param count Number of files
+ * @param key Receives the key
+ */
+void project_key(const char *toolchain, const char *flags, const char *text,
+                 const project_file_t *files, size_t count,
+                 uint8_t key[SHA256_DIGEST_SIZE]);
+
+/**
+ * @brief Key of the object file of one translation unit
+ *
+ * @param toolchain Compiler identity
+ * @param flags Compiler flags
+ * @param text Text of every file
+ * @param files Files of the project
+ * @param count Number of files
+ * @param unit Index of the unit in files
+ * @param key Receives the key
+ */
+void project_unit_key(const char *toolchain, const char *flags,
+                      const char *text, const project_file_t *files,
+                      size_t count, size_t unit,
+                      uint8_t key[SHA256_DIGEST_SIZE]);
+
+/**
+ * @brief Write every file of a project into a directory
+ *
+ * @param dir Existing directory
+ * @param text Text of every file
+ * @param files Files of the project
+ * @param count Number of files
+ *
+ * @return 0 on success, -1 if a file could not be written
+ */
+int project_write(const char *dir, const char *text,
+                  const project_file_t *files, size_t count);
+
+#endif /* PROJECT_H */
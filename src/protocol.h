@@ -0,0 +1,436 @@
+/**
+ * @file protocol.h
+ * @brief Binary framing shared by the server and the C++ clients
+ * @author Rares-Nicholas Popa & Adrian-Petru Enache
+ * @version 1.0.0
+ *
+ * @details Every message on both ports is a frame: a fixed 16-byte header
+ * followed by `length` payload bytes. All integers are big-endian.
+ *
+ *     offset  size  field
+ *          0     4  magic    FRAME_MAGIC ("CCE1")
+ *          4     1  version  PROTOCOL_VERSION
+ *          5     1  type     frame_type_t
+ *          6     2  flags    FRAME_FLAG_*
+ *          8     4  job_id   chosen by the client, echoed in every reply
+ *         12     4  length   payload size, at most FRAME_MAX_PAYLOAD
+ *
+ * A SUBMIT payload is a list of fields (2-byte tag, 4-byte length, value).
+ * Large sources are sent as several SUBMIT frames with the same job id,
+ * all but the last carrying FRAME_FLAG_MORE; the server concatenates the
+ * FIELD_SOURCE values of the whole sequence. Unknown fields are ignored.
+ *
+ * FIELD_INPUT and FIELD_EXPECTED give the program's stdin and the output
+ * it should produce; repeated fields are concatenated as well. A
+ * submission that contains FIELD_CASE fields is a batch: the program is
+ * compiled once and run once per case, each FIELD_CASE opening a case
+ * that the INPUT and EXPECTED fields after it belong to. FIELD_PROFILE
+ * picks one of the server's compiler profiles (the last one counts); a
+ * profile the server does not offer is answered with RESULT_FAILED.
+ *
+ * A submission that contains FIELD_FILE fields is a project: each
+ * FIELD_FILE names a ".c" or ".h" file (no directories) and the
+ * FIELD_SOURCE values after it, up to the next FIELD_FILE, are its text.
+ * Every ".c" file is compiled on its own, in parallel, and the objects
+ * are linked into the program; objects are cached by content, so a
+ * resubmitted project only recompiles the units whose text or included
+ * headers changed. A project may also be a batch.
+ *
+ * The server answers a job with any number of OUTPUT frames followed by
+ * exactly one RESULT, ERROR or BUSY frame. With FRAME_FLAG_STREAM the
+ * OUTPUT frames are sent as the program produces output rather than
+ * after it exits. A batch is answered with CASE frames instead of OUTPUT
+ * frames: a CASE_HEADER_SIZE header (case number and the case's RESULT
+ * payload) followed by a chunk of that case's output, all but the last
+ * chunk of a case carrying FRAME_FLAG_MORE. Cases run in parallel, so
+ * their frames may interleave; the RESULT frame comes after all of them.
+ * Batches and submissions with FRAME_FLAG_BULK wait in the server's batch
+ * priority class, so they only get workers interactive jobs leave idle.
+ * With FRAME_FLAG_TRACE a TRACE frame just before the RESULT frame holds
+ * the job's timeline as text: its trace id and when each phase (recv,
+ * queue, compile, exec, send, ...) started and how long it took.
+ * Admin commands are answered with REPLY frames, all but the last
+ * carrying FRAME_FLAG_MORE.
+ *
+ * A client may send further submissions before earlier ones are
+ * answered. Replies come in completion order and the frames of different
+ * jobs may interleave, so job ids must be unique among a connection's
+ * unanswered jobs.
+ *
+ * The helpers are static inline so that C and C++ code can include this
+ * header without linking anything.
+ *
+ * @copyright This project is for educational purposes as part of the PCD
+ * course.
+ */
+
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** @def FRAME_MAGIC
+ * @brief First four bytes of every frame ("CCE1")
+ */
+#define FRAME_MAGIC 0x43434531u
+
+/** @def PROTOCOL_VERSION
+ * @brief Protocol revision carried in every header
+ */
+#define PROTOCOL_VERSION 1
+
+/** @def FRAME_HEADER_SIZE
+ * @brief Encoded size of a frame header
+ */
+#define FRAME_HEADER_SIZE 16
+
+/** @def FRAME_MAX_PAYLOAD
+ * @brief Largest payload a single frame may carry
+ */
+#define FRAME_MAX_PAYLOAD (64 * 1024)
+
+/** @def FIELD_HEADER_SIZE
+ * @brief Encoded size of a SUBMIT field header (tag + length)
+ */
+#define FIELD_HEADER_SIZE 6
+
+/** @def RESULT_PAYLOAD_SIZE
+ * @brief Encoded size of the RESULT payload defined by this version
+ */
+#define RESULT_PAYLOAD_SIZE 20
+
+/** @def CASE_HEADER_SIZE
+ * @brief Encoded size of the header that starts every CASE payload
+ */
+#define CASE_HEADER_SIZE (4 + RESULT_PAYLOAD_SIZE)
+
+/** @def FRAME_FLAG_MORE
+ * @brief More frames of the same SUBMIT or REPLY sequence follow
+ */
+#define FRAME_FLAG_MORE 0x0001
+
+/** @def FRAME_FLAG_NOCACHE
+ * @brief SUBMIT: always run the program, never answer from the result cache
+ */
+#define FRAME_FLAG_NOCACHE 0x0002
+
+/** @def FRAME_FLAG_STREAM
+ * @brief SUBMIT: forward program output while the program is still running
+ */
+#define FRAME_FLAG_STREAM 0x0004
+
+/** @def FRAME_FLAG_BULK
+ * @brief SUBMIT: queue in the batch priority class, behind interactive jobs
+ */
+#define FRAME_FLAG_BULK 0x0008
+
+/** @def FRAME_FLAG_TRACE
+ * @brief SUBMIT: send the job's timeline in a TRACE frame before RESULT
+ */
+#define FRAME_FLAG_TRACE 0x0010
+
+/** @def RESULT_COMPILE_ERROR
+ * @brief RESULT flag: the source did not compile, output holds diagnostics
+ */
+#define RESULT_COMPILE_ERROR 0x0001
+
+/** @def RESULT_TIMED_OUT
+ * @brief RESULT flag: the program was killed at the time limit
+ */
+#define RESULT_TIMED_OUT 0x0002
+
+/** @def RESULT_TRUNCATED
+ * @brief RESULT flag: output exceeded the server's limit and was cut short
+ */
+#define RESULT_TRUNCATED 0x0004
+
+/** @def RESULT_CACHED
+ * @brief RESULT flag: answered from the result cache without running
+ */
+#define RESULT_CACHED 0x0008
+
+/** @def RESULT_FAILED
+ * @brief RESULT flag: the server could not run the job at all
+ */
+#define RESULT_FAILED 0x0010
+
+/** @def RESULT_MEMORY_LIMIT
+ * @brief RESULT flag: the program was killed at the job memory limit
+ */
+#define RESULT_MEMORY_LIMIT 0x0020
+
+/** @def RESULT_PROCESS_LIMIT
+ * @brief RESULT flag: the program tried to exceed the job task limit
+ */
+#define RESULT_PROCESS_LIMIT 0x0040
+
+/** @def RESULT_PASSED
+ * @brief RESULT flag: the output matched FIELD_EXPECTED
+ */
+#define RESULT_PASSED 0x0080
+
+/** @def RESULT_WRONG_OUTPUT
+ * @brief RESULT flag: the output differed from FIELD_EXPECTED
+ */
+#define RESULT_WRONG_OUTPUT 0x0100
+
+/**
+ * @enum frame_type_t
+ * @brief Frame types
+ */
+typedef enum {
+  FRAME_SUBMIT = 1,  /**< Client: source code fields */
+  FRAME_OUTPUT = 2,  /**< Server: a chunk of compiler or program output */
+  FRAME_RESULT = 3,  /**< Server: job finished (exit code and flags) */
+  FRAME_BUSY = 4,    /**< Server: queue full, payload is retry-after ms */
+  FRAME_ERROR = 5,   /**< Server: request rejected, payload is a message */
+  FRAME_COMMAND = 6, /**< Admin client: command text */
+  FRAME_REPLY = 7,   /**< Server: a chunk of an admin reply */
+  FRAME_QUIT = 8,    /**< Client: close the connection */
+  FRAME_CASE = 9,    /**< Server: result and output of one batch case */
+  FRAME_TRACE = 10   /**< Server: phase timeline of a job, as text */
+} frame_type_t;
+
+/**
+ * @enum field_tag_t
+ * @brief SUBMIT payload fields
+ */
+typedef enum {
+  FIELD_SOURCE = 1,   /**< C source code (concatenated across frames) */
+  FIELD_INPUT = 2,    /**< Bytes fed to the program's stdin */
+  FIELD_EXPECTED = 3, /**< Output the program should produce */
+  FIELD_CASE = 4,     /**< Empty: starts the next test case of a batch */
+  FIELD_PROFILE = 5,  /**< Compiler profile name, e.g. "O2" */
+  FIELD_FILE = 6      /**< Project file name; SOURCE fields after it are
+                           its text */
+} field_tag_t;
+
+/**
+ * @struct frame_header_t
+ * @brief Decoded frame header
+ */
+typedef struct {
+  uint32_t magic;   /**< FRAME_MAGIC */
+  uint8_t version;  /**< PROTOCOL_VERSION */
+  uint8_t type;     /**< frame_type_t */
+  uint16_t flags;   /**< FRAME_FLAG_* */
+  uint32_t job_id;  /**< Request identifier */
+  uint32_t length;  /**< Payload size */
+} frame_header_t;
+
+/**
+ * @struct result_payload_t
+ * @brief Decoded RESULT payload
+ *
+ * Later protocol versions may append fields; readers decode the prefix
+ * they know and treat missing fields as zero.
+ */
+typedef struct {
+  int32_t exit_code; /**< Exit status, 128 + signal, or -1 if it never ran;
+                          for a batch, the number of failed cases */
+  uint32_t flags;    /**< RESULT_* */
+  uint32_t cpu_us;   /**< CPU time of the program run (0 if it did not run) */
+  uint32_t wall_us;  /**< Wall clock time of the program run */
+  uint32_t peak_kb;  /**< Peak memory of the program run in KiB */
+} result_payload_t;
+
+/**
+ * @brief Store a 16-bit big-endian integer
+ *
+ * @param out Destination (2 bytes)
+ * @param value Value to store
+ */
+static inline void protocol_put_u16(uint8_t *out, uint16_t value) {
+  out[0] = (uint8_t)(value >> 8);
+  out[1] = (uint8_t)value;
+}
+
+/**
+ * @brief Store a 32-bit big-endian integer
+ *
+ * @param out Destination (4 bytes)
+ * @param value Value to store
+ */
+static inline void protocol_put_u32(uint8_t *out, uint32_t value) {
+  out[0] = (uint8_t)(value >> 24);
+  out[1] = (uint8_t)(value >> 16);
+  out[2] = (uint8_t)(value >> 8);
+  out[3] = (uint8_t)value;
+}
+
+/**
+ * @brief Load a 16-bit big-endian integer
+ *
+ * @param in Source (2 bytes)
+ * @return Decoded value
+ */
+static inline uint16_t protocol_get_u16(const uint8_t *in) {
+  return (uint16_t)((in[0] << 8) | in[1]);
+}
+
+/**
+ * @brief Load a 32-bit big-endian integer
+ *
+ * @param in Source (4 bytes)
+ * @return Decoded value
+ */
+static inline uint32_t protocol_get_u32(const uint8_t *in) {
+  return ((uint32_t)in[0] << 24) | ((uint32_t)in[1] << 16) |
+         ((uint32_t)in[2] << 8) | (uint32_t)in[3];
+}
+
+/**
+ * @brief Encode a frame header
+ *
+ * @param out Destination (FRAME_HEADER_SIZE bytes)
+ * @param type frame_type_t
+ * @param flags FRAME_FLAG_*
+ * @param job_id Request identifier
+ * @param length Payload size
+ */
+static inline void frame_encode_header(uint8_t *out, uint8_t type,
+                                       uint16_t flags, uint32_t job_id,
+                                       uint32_t length) {
+  protocol_put_u32(out, FRAME_MAGIC);
+  out[4] = PROTOCOL_VERSION;
+  out[5] = type;
+  protocol_put_u16(out + 6, flags);
+  protocol_put_u32(out + 8, job_id);
+  protocol_put_u32(out + 12, length);
+}
+
+/**
+ * @brief Decode a frame header
+ *
+ * @param in Source (FRAME_HEADER_SIZE bytes)
+ * @param header Receives the fields
+ *
+ * @return 0 if magic, version and length are acceptable, -1 otherwise
+ */
+static inline int frame_decode_header(const uint8_t *in,
+                                      frame_header_t *header) {
+  header->magic = protocol_get_u32(in);
+  header->version = in[4];
+  header->type = in[5];
+  header->flags = protocol_get_u16(in + 6);
+  header->job_id = protocol_get_u32(in + 8);
+  header->length = protocol_get_u32(in + 12);
+
+  if (header->magic != FRAME_MAGIC || header->version != PROTOCOL_VERSION ||
+      header->length > FRAME_MAX_PAYLOAD) {
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ * @brief Encode a SUBMIT field header
+ *
+ * @param out Destination (FIELD_HEADER_SIZE bytes)
+ * @param tag field_tag_t
+ * @param length Size of the value that follows
+ */
+static inline void field_encode_header(uint8_t *out, uint16_t tag,
+                                       uint32_t length) {
+  protocol_put_u16(out, tag);
+  protocol_put_u32(out + 2, length);
+}
+
+/**
+ * @brief Step to the next field of a SUBMIT payload
+ *
+ * @param payload Payload bytes
+ * @param length Payload size
+ * @param offset Position of the next field; advanced past it
+ * @param tag Receives the field tag
+ * @param value Receives a pointer to the field value
+ * @param value_length Receives the field value size
+ *
+ * @return 1 if a field was read, 0 at the end, -1 if the payload is
+ *         malformed
+ */
+static inline int field_next(const uint8_t *payload, size_t length,
+                             size_t *offset, uint16_t *tag,
+                             const uint8_t **value, uint32_t *value_length) {
+  if (*offset == length) {
+    return 0;
+  }
+  if (length - *offset < FIELD_HEADER_SIZE) {
+    return -1;
+  }
+  *tag = protocol_get_u16(payload + *offset);
+  *value_length = protocol_get_u32(payload + *offset + 2);
+  if (length - *offset - FIELD_HEADER_SIZE < *value_length) {
+    return -1;
+  }
+  *value = payload + *offset + FIELD_HEADER_SIZE;
+  *offset += FIELD_HEADER_SIZE + *value_length;
+  return 1;
+}
+
+/**
+ * @brief Encode a RESULT payload
+ *
+ * @param out Destination (RESULT_PAYLOAD_SIZE bytes)
+ * @param result Values to encode
+ */
+static inline void result_encode(uint8_t *out, const result_payload_t *result) {
+  protocol_put_u32(out, (uint32_t)result->exit_code);
+  protocol_put_u32(out + 4, result->flags);
+  protocol_put_u32(out + 8, result->cpu_us);
+  protocol_put_u32(out + 12, result->wall_us);
+  protocol_put_u32(out + 16, result->peak_kb);
+}
+
+/**
+ * @brief Decode a RESULT payload of any length
+ *
+ * @param in Payload bytes
+ * @param length Payload size
+ * @param result Receives the values; fields beyond length are zero
+ */
+static inline void result_decode(const uint8_t *in, size_t length,
+                                 result_payload_t *result) {
+  result->exit_code = length >= 4 ? (int32_t)protocol_get_u32(in) : -1;
+  result->flags = length >= 8 ? protocol_get_u32(in + 4) : 0;
+  result->cpu_us = length >= 12 ? protocol_get_u32(in + 8) : 0;
+  result->wall_us = length >= 16 ? protocol_get_u32(in + 12) : 0;
+  result->peak_kb = length >= 20 ? protocol_get_u32(in + 16) : 0;
+}
+
+/**
+ * @brief Encode the header of a CASE payload
+ *
+ * @param out Destination (CASE_HEADER_SIZE bytes)
+ * @param index Case number, starting at 0
+ * @param result Outcome of the case
+ */
+static inline void case_encode_header(uint8_t *out, uint32_t index,
+                                      const result_payload_t *result) {
+  protocol_put_u32(out, index);
+  result_encode(out + 4, result);
+}
+
+/**
+ * @brief Decode the header of a CASE payload
+ *
+ * @param in Payload bytes
+ * @param length Payload size
+ * @param index Receives the case number
+ * @param result Receives the outcome of the case
+ *
+ * @return Offset of the output chunk, or -1 if the payload is too short
+ */
+static inline long case_decode_header(const uint8_t *in, size_t length,
+                                      uint32_t *index,
+                                      result_payload_t *result) {
+  if (length < CASE_HEADER_SIZE) {
+    return -1;
+  }
+  *index = protocol_get_u32(in);
+  result_decode(in + 4, RESULT_PAYLOAD_SIZE, result);
+  return CASE_HEADER_SIZE;
+}
+
+#endif /* PROTOCOL_H */
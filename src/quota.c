@@ -0,0 +1,440 @@
+/**
+ * @file quota.c
+ * @brief Per-job resource limits and accounting (cgroup v2, rlimit fallback)
+ * @author Rares-Nicholas Popa & Adrian-Petru Enache
+ * @version 1.0.0
+ *
+ * @details A job enters its cgroup from the forked child, before exec, by
+ * writing "0" to the cgroup.procs descriptor the executor opened: the
+ * program and everything it forks are limited from their first
+ * instruction, with no window in which they run unconstrained.
+ *
+ * @copyright This project is for educational purposes as part of the PCD
+ * course.
+ */
+
+#include "quota.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <mntent.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+/** @def CPU_PERIOD_US
+ * @brief cpu.max enforcement period
+ */
+#define CPU_PERIOD_US 100000
+
+/** @def RMDIR_TRIES
+ * @brief Attempts to remove a job cgroup whose tasks are still dying
+ */
+#define RMDIR_TRIES 100
+
+/** @brief Global quota state, inherited by the executors */
+static struct {
+  quota_mode_t mode;     /**< Enforcement mode */
+  quota_limits_t limits; /**< Limits of every job */
+  char jobs[PATH_MAX];   /**< Parent of the job cgroups */
+  unsigned next;         /**< Job cgroups created by this process */
+} quota = {QUOTA_OFF, {0, 0, 0}, "", 0};
+
+/**
+ * @brief Current monotonic time in microseconds
+ *
+ * @return Microseconds since an arbitrary epoch
+ */
+static uint64_t now_us(void) {
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000u + (uint64_t)now.tv_nsec / 1000u;
+}
+
+/**
+ * @brief Write a string to a cgroup file
+ *
+ * @param dir Cgroup directory
+ * @param name File name
+ * @param value Text to write
+ *
+ * @return 0 on success, or an errno value
+ */
+static int write_file(const char *dir, const char *name, const char *value) {
+  char path[PATH_MAX];
+  size_t len = strlen(value);
+  int fd, rc = 0;
+
+  if ((size_t)snprintf(path, sizeof(path), "%s/%s", dir, name) >=
+      sizeof(path)) {
+    return ENAMETOOLONG;
+  }
+  fd = open(path, O_WRONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return errno;
+  }
+  if (write(fd, value, len) != (ssize_t)len) {
+    rc = errno ? errno : EIO;
+  }
+  close(fd);
+  return rc;
+}
+
+/**
+ * @brief Read a small cgroup file
+ *
+ * @param dir Cgroup directory
+ * @param name File name
+ * @param buffer Receives the NUL-terminated contents
+ * @param size Size of buffer
+ *
+ * @return 0 on success, -1 if the file cannot be read
+ */
+static int read_file(const char *dir, const char *name, char *buffer,
+                     size_t size) {
+  char path[PATH_MAX];
+  ssize_t n;
+  int fd;
+
+  if ((size_t)snprintf(path, sizeof(path), "%s/%s", dir, name) >=
+      sizeof(path)) {
+    return -1;
+  }
+  fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return -1;
+  }
+  n = read(fd, buffer, size - 1);
+  close(fd);
+  if (n < 0) {
+    return -1;
+  }
+  buffer[n] = '\0';
+  return 0;
+}
+
+/**
+ * @brief Look a "key value" line up in a flat-keyed cgroup file
+ *
+ * @param dir Cgroup directory
+ * @param name File name (cpu.stat, memory.events, ...)
+ * @param key Key to find
+ * @param value Receives the value
+ *
+ * @return 0 if found, -1 otherwise
+ */
+static int read_key(const char *dir, const char *name, const char *key,
+                    uint64_t *value) {
+  char buffer[1024];
+  size_t len = strlen(key);
+  const char *line = buffer;
+
+  if (read_file(dir, name, buffer, sizeof(buffer)) != 0) {
+    return -1;
+  }
+  while (*line) {
+    unsigned long long parsed;
+    size_t line_len = strcspn(line, "\n");
+
+    if (strncmp(line, key, len) == 0 && line[len] == ' ' &&
+        sscanf(line + len + 1, "%llu", &parsed) == 1) {
+      *value = parsed;
+      return 0;
+    }
+    line += line_len + (line[line_len] != '\0');
+  }
+  return -1;
+}
+
+/**
+ * @brief Check a space-separated list for a word
+ *
+ * @param list List, e.g. the contents of cgroup.controllers
+ * @param word Word to find
+ * @return 1 if present, 0 otherwise
+ */
+static int has_word(const char *list, const char *word) {
+  size_t len = strlen(word);
+  const char *p;
+
+  for (p = strstr(list, word); p; p = strstr(p + 1, word)) {
+    if ((p == list || p[-1] == ' ') &&
+        (p[len] == '\0' || p[len] == ' ' || p[len] == '\n')) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * @brief Find the cgroup v2 directory this process belongs to
+ *
+ * @param path Receives the absolute directory
+ * @param size Size of path
+ *
+ * @return 0 on success, -1 if there is no cgroup v2 hierarchy
+ */
+static int own_cgroup(char *path, size_t size) {
+  char line[PATH_MAX], mount[PATH_MAX] = "";
+  struct mntent *entry;
+  FILE *file;
+
+  file = setmntent("/proc/self/mounts", "r");
+  if (!file) {
+    return -1;
+  }
+  while ((entry = getmntent(file)) != NULL) {
+    if (strcmp(entry->mnt_type, "cgroup2") == 0) {
+      snprintf(mount, sizeof(mount), "%s", entry->mnt_dir);
+      break;
+    }
+  }
+  endmntent(file);
+  if (mount[0] == '\0') {
+    return -1;
+  }
+
+  // The unified hierarchy is the "0::" line
+  file = fopen("/proc/self/cgroup", "r");
+  if (!file) {
+    return -1;
+  }
+  while (fgets(line, sizeof(line), file)) {
+    if (strncmp(line, "0::", 3) == 0) {
+      line[strcspn(line, "\n")] = '\0';
+      fclose(file);
+      return (size_t)snprintf(path, size, "%s%s", mount,
+                              strcmp(line + 3, "/") == 0 ? "" : line + 3) <
+                     size
+                 ? 0
+                 : -1;
+    }
+  }
+  fclose(file);
+  return -1;
+}
+
+/**
+ * @brief Delegate the controllers the limits need to a cgroup's children
+ *
+ * @param dir Cgroup directory
+ * @return 0 on success, or an errno value
+ */
+static int enable_controllers(const char *dir) {
+  int rc = write_file(dir, "cgroup.subtree_control", "+memory +pids");
+
+  // Without the cpu controller the job still gets cpu.stat accounting
+  if (rc == 0 && quota.limits.cpu_percent > 0) {
+    rc = write_file(dir, "cgroup.subtree_control", "+cpu");
+  }
+  return rc;
+}
+
+/**
+ * @brief Set up the "server" and "jobs" children of the server's cgroup
+ *
+ * @return 0 on success, -1 if cgroup limits are unavailable
+ */
+static int setup_hierarchy(void) {
+  char base[PATH_MAX], server[PATH_MAX], buffer[256], pid[32];
+  size_t len;
+
+  if (own_cgroup(base, sizeof(base)) != 0 ||
+      read_file(base, "cgroup.controllers", buffer, sizeof(buffer)) != 0 ||
+      !has_word(buffer, "memory") || !has_word(buffer, "pids") ||
+      (quota.limits.cpu_percent > 0 && !has_word(buffer, "cpu"))) {
+    return -1;
+  }
+
+  len = strlen(base);
+  if (len + sizeof("/server") > sizeof(server)) {
+    return -1;
+  }
+  memcpy(server, base, len);
+  memcpy(server + len, "/server", sizeof("/server"));
+  memcpy(quota.jobs, base, len);
+  memcpy(quota.jobs + len, "/jobs", sizeof("/jobs"));
+
+  // Processes may only live in leaves: move out before delegating
+  snprintf(pid, sizeof(pid), "%ld", (long)getpid());
+  if ((mkdir(server, 0755) != 0 && errno != EEXIST) ||
+      write_file(server, "cgroup.procs", pid) != 0 ||
+      enable_controllers(base) != 0 ||
+      (mkdir(quota.jobs, 0755) != 0 && errno != EEXIST) ||
+      enable_controllers(quota.jobs) != 0) {
+    quota.jobs[0] = '\0';
+    return -1;
+  }
+  return 0;
+}
+
+quota_mode_t quota_init(const quota_limits_t *limits) {
+  quota.limits = *limits;
+  if (limits->cpu_percent == 0 && limits->memory_bytes == 0 &&
+      limits->pids == 0) {
+    quota.mode = QUOTA_OFF;
+  } else if (setup_hierarchy() == 0) {
+    quota.mode = QUOTA_CGROUP;
+  } else {
+    quota.mode = QUOTA_RLIMIT;
+  }
+  return quota.mode;
+}
+
+const char *quota_mode_name(quota_mode_t mode) {
+  switch (mode) {
+  case QUOTA_CGROUP:
+    return "cgroup v2";
+  case QUOTA_RLIMIT:
+    return "rlimit";
+  default:
+    return "off";
+  }
+}
+
+int quota_job_begin(quota_job_t *job, unsigned timeout_ms) {
+  char value[64];
+  int rc = 0;
+
+  job->path[0] = '\0';
+  job->procs_fd = -1;
+  job->cpu_seconds = 0;
+  job->started_us = now_us();
+
+  if (quota.mode == QUOTA_RLIMIT) {
+    // CPU time cannot exceed wall time on one core: a loose backstop
+    job->cpu_seconds = timeout_ms ? (timeout_ms + 999) / 1000 : 0;
+    return 0;
+  }
+  if (quota.mode != QUOTA_CGROUP) {
+    return 0;
+  }
+
+  if ((size_t)snprintf(job->path, sizeof(job->path), "%s/job-%ld-%u",
+                       quota.jobs, (long)getpid(), ++quota.next) >=
+      sizeof(job->path)) {
+    job->path[0] = '\0';
+    return ENAMETOOLONG;
+  }
+  if (mkdir(job->path, 0755) != 0 && errno != EEXIST) {
+    rc = errno;
+    job->path[0] = '\0';
+    return rc;
+  }
+
+  if (quota.limits.cpu_percent > 0) {
+    snprintf(value, sizeof(value), "%llu %d",
+             (unsigned long long)quota.limits.cpu_percent * CPU_PERIOD_US /
+                 100,
+             CPU_PERIOD_US);
+    rc = write_file(job->path, "cpu.max", value);
+  }
+  if (rc == 0 && quota.limits.memory_bytes > 0) {
+    snprintf(value, sizeof(value), "%zu", quota.limits.memory_bytes);
+    rc = write_file(job->path, "memory.max", value);
+    // Optional: no swap controller means no swap to escape into anyway
+    write_file(job->path, "memory.swap.max", "0");
+    write_file(job->path, "memory.oom.group", "1");
+  }
+  if (rc == 0 && quota.limits.pids > 0) {
+    snprintf(value, sizeof(value), "%u", quota.limits.pids);
+    rc = write_file(job->path, "pids.max", value);
+  }
+  if (rc == 0) {
+    char procs[PATH_MAX + sizeof("/cgroup.procs")];
+    snprintf(procs, sizeof(procs), "%s/cgroup.procs", job->path);
+    job->procs_fd = open(procs, O_WRONLY | O_CLOEXEC);
+    if (job->procs_fd < 0) {
+      rc = errno;
+    }
+  }
+
+  if (rc != 0) {
+    rmdir(job->path);
+    job->path[0] = '\0';
+  }
+  return rc;
+}
+
+int quota_enter(const quota_job_t *job) {
+  struct rlimit limit;
+
+  if (job->procs_fd >= 0) {
+    return write(job->procs_fd, "0", 1) == 1 ? 0 : errno;
+  }
+  if (quota.mode != QUOTA_RLIMIT) {
+    return 0;
+  }
+  if (quota.limits.memory_bytes > 0) {
+    limit.rlim_cur = limit.rlim_max = (rlim_t)quota.limits.memory_bytes;
+    if (setrlimit(RLIMIT_AS, &limit) != 0) {
+      return errno;
+    }
+  }
+  if (job->cpu_seconds > 0) {
+    // SIGXCPU at the soft limit, SIGKILL a second later
+    limit.rlim_cur = job->cpu_seconds;
+    limit.rlim_max = job->cpu_seconds + 1;
+    if (setrlimit(RLIMIT_CPU, &limit) != 0) {
+      return errno;
+    }
+  }
+  return 0;
+}
+
+void quota_job_end(quota_job_t *job, const struct rusage *rusage,
+                   quota_usage_t *usage) {
+  char buffer[32];
+  unsigned long long peak;
+  uint64_t value;
+  int i;
+
+  memset(usage, 0, sizeof(*usage));
+  usage->wall_us = now_us() - job->started_us;
+  usage->cpu_us =
+      (uint64_t)(rusage->ru_utime.tv_sec + rusage->ru_stime.tv_sec) * 1000000u +
+      (uint64_t)(rusage->ru_utime.tv_usec + rusage->ru_stime.tv_usec);
+  usage->peak_bytes = (uint64_t)rusage->ru_maxrss * 1024u;
+
+  if (job->procs_fd >= 0) {
+    close(job->procs_fd);
+    job->procs_fd = -1;
+  }
+  if (job->path[0] == '\0') {
+    return;
+  }
+
+  // Anything that escaped the process group dies here (Linux 5.14+)
+  write_file(job->path, "cgroup.kill", "1");
+
+  // The cgroup also counts descendants the program did not wait for
+  if (read_key(job->path, "cpu.stat", "usage_usec", &value) == 0) {
+    usage->cpu_us = value;
+  }
+  if (read_file(job->path, "memory.peak", buffer, sizeof(buffer)) == 0 &&
+      sscanf(buffer, "%llu", &peak) == 1) {
+    usage->peak_bytes = peak; /* Linux 5.19+; ru_maxrss otherwise */
+  }
+  if (read_key(job->path, "memory.events", "oom_kill", &value) == 0) {
+    usage->memory_killed = value > 0;
+  }
+  if (read_key(job->path, "pids.events", "max", &value) == 0) {
+    usage->pids_limited = value > 0;
+  }
+
+  for (i = 0; i < RMDIR_TRIES && rmdir(job->path) != 0 && errno == EBUSY;
+       i++) {
+    poll(NULL, 0, 1);
+  }
+  job->path[0] = '\0';
+}
+
+void quota_shutdown(void) {
+  if (quota.mode == QUOTA_CGROUP) {
+    rmdir(quota.jobs);
+  }
+}
@@ -0,0 +1,137 @@
+/**
+ * @file quota.h
+ * @brief Per-job resource limits and accounting (cgroup v2, rlimit fallback)
+ * @author Rares-Nicholas Popa & Adrian-Petru Enache
+ * @version 1.0.0
+ *
+ * @details Every compiler and program run started by an executor gets a
+ * cgroup of its own with a CPU bandwidth limit (cpu.max), a memory limit
+ * (memory.max, no swap) and a task limit (pids.max). When the job ends
+ * its CPU time, peak memory and limit hits are read back from the cgroup
+ * and the cgroup is removed together with anything left running in it.
+ *
+ * This needs a cgroup v2 hierarchy in which the server may create
+ * children and enable the cpu, memory and pids controllers, i.e. a
+ * cgroup delegated to the server (for instance a systemd unit with
+ * Delegate=yes). quota_init() moves the server into a "server" child and
+ * creates the job cgroups under a sibling "jobs", as the v2 rule that
+ * only leaf cgroups hold processes requires.
+ *
+ * Without such a hierarchy the limits fall back to setrlimit() in the
+ * child: RLIMIT_AS for memory and RLIMIT_CPU derived from the time limit.
+ * CPU bandwidth and the task count cannot be bounded that way, and usage
+ * comes from wait4(), which only covers the direct child.
+ *
+ * @copyright This project is for educational purposes as part of the PCD
+ * course.
+ */
+
+#ifndef QUOTA_H
+#define QUOTA_H
+
+#include <limits.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/resource.h>
+
+/**
+ * @enum quota_mode_t
+ * @brief How the limits are enforced
+ */
+typedef enum {
+  QUOTA_OFF,    /**< No limits */
+  QUOTA_RLIMIT, /**< setrlimit() in each child */
+  QUOTA_CGROUP  /**< One cgroup v2 per job */
+} quota_mode_t;
+
+/**
+ * @struct quota_limits_t
+ * @brief Limits applied to every job; 0 leaves a resource unlimited
+ */
+typedef struct {
+  unsigned cpu_percent; /**< CPU bandwidth, 100 is one core */
+  size_t memory_bytes;  /**< Memory limit */
+  unsigned pids;        /**< Processes and threads */
+} quota_limits_t;
+
+/**
+ * @struct quota_job_t
+ * @brief Limits of one run, prepared before the child is forked
+ */
+typedef struct {
+  char path[PATH_MAX]; /**< Job cgroup, "" in rlimit mode */
+  int procs_fd;        /**< Its cgroup.procs, or -1 */
+  rlim_t cpu_seconds;  /**< RLIMIT_CPU in rlimit mode, 0 for none */
+  uint64_t started_us; /**< Wall clock start */
+} quota_job_t;
+
+/**
+ * @struct quota_usage_t
+ * @brief Resources used by one run
+ */
+typedef struct {
+  uint64_t cpu_us;     /**< User and system CPU time */
+  uint64_t wall_us;    /**< Wall clock time */
+  uint64_t peak_bytes; /**< Peak memory use */
+  int memory_killed;   /**< Killed by the memory limit */
+  int pids_limited;    /**< A fork or clone failed at the task limit */
+} quota_usage_t;
+
+/**
+ * @brief Choose the enforcement mode and prepare the cgroup hierarchy
+ *
+ * Must be called while the server is single-threaded, before the
+ * executors are forked (they inherit the configuration).
+ *
+ * @param limits Limits for every job
+ * @return Mode in effect
+ */
+quota_mode_t quota_init(const quota_limits_t *limits);
+
+/**
+ * @brief Human-readable name of a mode
+ *
+ * @param mode Mode from quota_init()
+ * @return Static string
+ */
+const char *quota_mode_name(quota_mode_t mode);
+
+/**
+ * @brief Prepare the limits of one run (executor process)
+ *
+ * @param job Receives the job state
+ * @param timeout_ms Wall clock limit of the run, 0 for none
+ *
+ * @return 0 on success, or an errno value if the cgroup could not be set up
+ */
+int quota_job_begin(quota_job_t *job, unsigned timeout_ms);
+
+/**
+ * @brief Enter the job's limits (forked child, before exec)
+ *
+ * Only async-signal-safe calls are made.
+ *
+ * @param job Job from quota_job_begin()
+ * @return 0 on success, or an errno value
+ */
+int quota_enter(const quota_job_t *job);
+
+/**
+ * @brief Collect the usage of a finished run and release its cgroup
+ * (executor process)
+ *
+ * Kills whatever is still running in the cgroup first.
+ *
+ * @param job Job from quota_job_begin()
+ * @param rusage wait4() usage of the reaped child
+ * @param usage Receives the measurements
+ */
+void quota_job_end(quota_job_t *job, const struct rusage *rusage,
+                   quota_usage_t *usage);
+
+/**
+ * @brief Remove the job cgroup parent once no executor is left
+ */
+void quota_shutdown(void);
+
+#endif /* QUOTA_H */
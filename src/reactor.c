@@ -0,0 +1,1007 @@
+/**
+ * @file reactor.c
+ * @brief Single-threaded epoll reactor for all listening and client sockets
+ * @author Rares-Nicholas Popa & Adrian-Petru Enache
+ * @version 1.0.0
+ *
+ * @details Level-triggered epoll watches the listening sockets, every
+ * client socket and an eventfd used to wake the loop from other threads
+ * (reactor_stop(), reactor_stop_accepting() and conn_resume()). Epoll
+ * user data holds either a small watch index (eventfd, listeners) or a
+ * connection_t pointer. A connection with output queued by conn_postv()
+ * is also watched for EPOLLOUT until the queue is empty. Lock order:
+ * write_lock, then out_lock; the reactor thread only ever tries for
+ * write_lock while it holds out_lock.
+ *
+ * @copyright This project is for educational purposes as part of the PCD
+ * course.
+ */
+
+#include "reactor.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+/** @def MAX_LISTENERS
+ * @brief Maximum number of listening sockets per reactor
+ */
+#define MAX_LISTENERS 8
+
+/** @def MAX_EVENTS
+ * @brief Events fetched per epoll_wait() call
+ */
+#define MAX_EVENTS 256
+
+/** @def READ_CHUNK
+ * @brief Minimum free input space requested before each recv()
+ */
+#define READ_CHUNK 4096
+
+/** @def SEND_STALL_MS
+ * @brief How long a writer waits for a peer that stopped reading
+ */
+#define SEND_STALL_MS 30000
+
+/** @def OUTPUT_QUEUE_CAP
+ * @brief Output the reactor thread queues for a peer before dropping it
+ */
+#define OUTPUT_QUEUE_CAP (1024 * 1024)
+
+/** @def IDLE_INPUT_CAP
+ * @brief Input buffers larger than this are freed once drained
+ */
+#define IDLE_INPUT_CAP (64 * 1024)
+
+/** @def WATCH_WAKEUP
+ * @brief Epoll user data of the wake-up eventfd
+ */
+#define WATCH_WAKEUP 0
+
+/**
+ * @struct reactor
+ * @brief Internal reactor state
+ */
+struct reactor {
+  int epoll_fd;                         /**< epoll instance */
+  int wake_fd;                          /**< eventfd for cross-thread wake-ups */
+  int running;                          /**< Cleared by reactor_stop() */
+  reactor_input_fn on_input;            /**< Input callback */
+  reactor_input_fn wind_down;           /**< Set by reactor_stop_accepting() */
+  size_t max_input;                     /**< Per-connection buffer limit */
+  reactor_listener_t listeners[MAX_LISTENERS]; /**< Listening sockets */
+  size_t listener_count;                /**< Used listener slots */
+  connection_t *conns;                  /**< Live connections */
+  size_t conn_count;                    /**< Length of conns */
+  pthread_mutex_t resume_lock;          /**< Protects resumed */
+  connection_t *resumed;                /**< Connections to re-arm */
+  pthread_t thread;                     /**< Thread in reactor_run() */
+  int has_thread;                       /**< Whether thread is set (atomic) */
+};
+
+static void conn_unlink(connection_t *conn);
+static void reactor_flush(connection_t *conn);
+
+/**
+ * @brief Wake the event loop from any thread
+ *
+ * @param reactor Reactor to wake
+ */
+static void reactor_wake(reactor_t *reactor) {
+  uint64_t one = 1;
+  ssize_t ignored = write(reactor->wake_fd, &one, sizeof(one));
+  (void)ignored;
+}
+
+/**
+ * @brief Update the epoll interest set of a connection
+ *
+ * @param conn Connection to update
+ */
+static void conn_watch(connection_t *conn) {
+  struct epoll_event ev;
+
+  memset(&ev, 0, sizeof(ev));
+  ev.events = conn->paused || conn->closing ? 0 : EPOLLIN;
+  pthread_mutex_lock(&conn->out_lock);
+  if (conn->out_len > 0) {
+    ev.events |= EPOLLOUT;
+  }
+  pthread_mutex_unlock(&conn->out_lock);
+  ev.data.ptr = conn;
+  epoll_ctl(conn->reactor->epoll_fd, EPOLL_CTL_MOD, conn->fd, &ev);
+}
+
+reactor_t *reactor_create(reactor_input_fn on_input, size_t max_input) {
+  struct epoll_event ev;
+  reactor_t *reactor = calloc(1, sizeof(*reactor));
+
+  if (!reactor) {
+    return NULL;
+  }
+
+  reactor->on_input = on_input;
+  reactor->max_input = max_input;
+  reactor->running = 1;
+  pthread_mutex_init(&reactor->resume_lock, NULL);
+
+  reactor->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  reactor->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (reactor->epoll_fd < 0 || reactor->wake_fd < 0) {
+    reactor_destroy(reactor);
+    return NULL;
+  }
+
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN;
+  ev.data.u64 = WATCH_WAKEUP;
+  epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD, reactor->wake_fd, &ev);
+  return reactor;
+}
+
+int reactor_listen(reactor_t *reactor, uint16_t port, int backlog,
+                   conn_kind_t kind) {
+  struct sockaddr_in address;
+  int opt = 1;
+  int fd;
+
+  if (reactor->listener_count == MAX_LISTENERS) {
+    errno = ENOSPC;
+    return -1;
+  }
+
+  fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    return -1;
+  }
+
+  /* SO_REUSEPORT lets a new server bind next to an old one that did not
+   * hand its sockets over (see handover.h) */
+  if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) != 0 ||
+      setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) != 0) {
+    close(fd);
+    return -1;
+  }
+
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = INADDR_ANY;
+  address.sin_port = htons(port);
+
+  if (bind(fd, (struct sockaddr *)&address, sizeof(address)) < 0 ||
+      listen(fd, backlog) < 0 || reactor_adopt(reactor, fd, kind) != 0) {
+    close(fd);
+    return -1;
+  }
+  return 0;
+}
+
+int reactor_adopt(reactor_t *reactor, int fd, conn_kind_t kind) {
+  struct epoll_event ev;
+
+  if (reactor->listener_count == MAX_LISTENERS) {
+    errno = ENOSPC;
+    return -1;
+  }
+
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN;
+  ev.data.u64 = reactor->listener_count + 1; /* 1-based, 0 is WATCH_WAKEUP */
+  if (epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+    return -1;
+  }
+  reactor->listeners[reactor->listener_count].fd = fd;
+  reactor->listeners[reactor->listener_count].kind = kind;
+  reactor->listener_count++;
+  return 0;
+}
+
+size_t reactor_listeners(reactor_t *reactor, reactor_listener_t *listeners,
+                         size_t max) {
+  size_t count = 0;
+
+  for (size_t i = 0; i < reactor->listener_count && count < max; i++) {
+    reactor_listener_t listener;
+
+    listener.fd = __atomic_load_n(&reactor->listeners[i].fd, __ATOMIC_ACQUIRE);
+    listener.kind = reactor->listeners[i].kind;
+    if (listener.fd >= 0) {
+      listeners[count++] = listener;
+    }
+  }
+  return count;
+}
+
+/**
+ * @brief Current CLOCK_MONOTONIC time
+ *
+ * @return Microseconds
+ */
+static uint64_t now_us(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+/**
+ * @brief Accept every pending connection on a listener
+ *
+ * @param reactor Owning reactor
+ * @param listener Listener that became readable
+ */
+static void reactor_accept(reactor_t *reactor, reactor_listener_t *listener) {
+  struct epoll_event ev;
+  int one = 1;
+
+  while (listener->fd >= 0) {
+    struct sockaddr_in peer;
+    socklen_t peer_len = sizeof(peer);
+    int fd = accept4(listener->fd, (struct sockaddr *)&peer, &peer_len,
+                     SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+      /* EAGAIN: backlog drained; EMFILE and friends: retry next event */
+      return;
+    }
+
+    /* Replies go out frame by frame: without this, Nagle holds a RESULT
+     * back until the client acknowledged the OUTPUT before it */
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    connection_t *conn = calloc(1, sizeof(*conn));
+    if (!conn) {
+      close(fd);
+      continue;
+    }
+    conn->fd = fd;
+    conn->kind = listener->kind;
+    conn->peer_addr = ntohl(peer.sin_addr.s_addr);
+    conn->refs = 1; /* owned by the reactor until conn_close() */
+    conn->accepted_us = now_us();
+    conn->reactor = reactor;
+    pthread_mutex_init(&conn->write_lock, NULL);
+    pthread_mutex_init(&conn->out_lock, NULL);
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.ptr = conn;
+    if (epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+      pthread_mutex_destroy(&conn->write_lock);
+      pthread_mutex_destroy(&conn->out_lock);
+      free(conn);
+      close(fd);
+      continue;
+    }
+
+    conn->next = reactor->conns;
+    if (reactor->conns) {
+      reactor->conns->prev = conn;
+    }
+    reactor->conns = conn;
+    __atomic_add_fetch(&reactor->conn_count, 1, __ATOMIC_RELAXED);
+  }
+}
+
+/**
+ * @brief Read everything available on a connection and run the callback
+ *
+ * @param conn Readable connection
+ */
+static void reactor_read(connection_t *conn) {
+  reactor_t *reactor = conn->reactor;
+
+  conn_retain(conn); /* the callback may close it under our feet */
+  while (!conn->paused && !conn->closing) {
+    if (conn->in_len == reactor->max_input) {
+      /* The callback could not make sense of a full buffer: oversized */
+      conn_close(conn);
+      break;
+    }
+
+    if (conn->in_cap - conn->in_len < READ_CHUNK &&
+        conn->in_cap < reactor->max_input) {
+      size_t cap = conn->in_cap ? conn->in_cap * 2 : READ_CHUNK;
+      if (cap > reactor->max_input) {
+        cap = reactor->max_input;
+      }
+      char *grown = realloc(conn->in, cap);
+      if (!grown) {
+        conn_close(conn);
+        break;
+      }
+      conn->in = grown;
+      conn->in_cap = cap;
+    }
+
+    ssize_t n = recv(conn->fd, conn->in + conn->in_len,
+                     conn->in_cap - conn->in_len, 0);
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      break;
+    }
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      conn_close(conn);
+      break;
+    }
+
+    conn->read_us = now_us();
+    if (conn->in_len == 0) {
+      conn->input_us = conn->read_us;
+    }
+    conn->in_len += (size_t)n;
+    reactor->on_input(conn);
+  }
+  conn_release(conn);
+}
+
+/**
+ * @brief Re-arm connections resumed by worker threads
+ *
+ * @param reactor Reactor whose resume list is drained
+ */
+static void reactor_drain_resumed(reactor_t *reactor) {
+  connection_t *conn;
+
+  pthread_mutex_lock(&reactor->resume_lock);
+  conn = reactor->resumed;
+  reactor->resumed = NULL;
+  pthread_mutex_unlock(&reactor->resume_lock);
+
+  while (conn) {
+    connection_t *next = conn->resumed;
+    conn->resumed = NULL;
+    __atomic_store_n(&conn->resume_queued, 0, __ATOMIC_RELEASE);
+
+    if (!conn->closing && conn->paused) {
+      conn->paused = 0;
+      conn_watch(conn);
+      if (conn->in_len > 0) {
+        reactor->on_input(conn);
+      }
+    }
+    conn_release(conn); /* reference taken by conn_resume() */
+    conn = next;
+  }
+}
+
+/**
+ * @brief Close the listeners and hand every connection to the wind-down
+ * callback, once reactor_stop_accepting() asked for it
+ *
+ * @param reactor Reactor to wind down
+ */
+static void reactor_wind_down(reactor_t *reactor) {
+  reactor_input_fn wind_down =
+      __atomic_exchange_n(&reactor->wind_down, NULL, __ATOMIC_ACQ_REL);
+  connection_t *conn;
+
+  if (!wind_down) {
+    return;
+  }
+
+  /* A copy of a socket passed to another process keeps its epoll
+   * registration alive, so take it out of the interest set first */
+  for (size_t i = 0; i < reactor->listener_count; i++) {
+    reactor_listener_t *listener = &reactor->listeners[i];
+
+    if (listener->fd >= 0) {
+      epoll_ctl(reactor->epoll_fd, EPOLL_CTL_DEL, listener->fd, NULL);
+      close(listener->fd);
+      __atomic_store_n(&listener->fd, -1, __ATOMIC_RELEASE);
+    }
+  }
+
+  /* Closing a connection unlinks it, so step ahead first */
+  conn = reactor->conns;
+  while (conn) {
+    connection_t *next = conn->next;
+
+    wind_down(conn);
+    conn = next;
+  }
+}
+
+void reactor_run(reactor_t *reactor) {
+  struct epoll_event events[MAX_EVENTS];
+  int i;
+
+  reactor->thread = pthread_self();
+  __atomic_store_n(&reactor->has_thread, 1, __ATOMIC_RELEASE);
+  while (__atomic_load_n(&reactor->running, __ATOMIC_ACQUIRE)) {
+    int woken = 0;
+    int n = epoll_wait(reactor->epoll_fd, events, MAX_EVENTS, -1);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      break;
+    }
+
+    for (i = 0; i < n; i++) {
+      uint64_t watch = events[i].data.u64;
+
+      if (watch == WATCH_WAKEUP) {
+        /* Resuming or winding down may free a connection that still
+         * has an event later in this batch, so wait for the batch */
+        woken = 1;
+      } else if (watch <= reactor->listener_count) {
+        reactor_accept(reactor, &reactor->listeners[watch - 1]);
+      } else {
+        connection_t *conn = (connection_t *)events[i].data.ptr;
+        uint32_t ready = events[i].events;
+
+        conn_retain(conn); /* a flush may unlink it */
+        if (ready & EPOLLOUT) {
+          reactor_flush(conn);
+        }
+        if (conn->lingering) {
+          if (ready & (EPOLLHUP | EPOLLERR)) {
+            conn_unlink(conn);
+          }
+        } else if (conn->closing) {
+          /* Unlinked by the flush */
+        } else if ((ready & (EPOLLHUP | EPOLLERR)) && conn->paused) {
+          /* Reported even while paused: drop it instead of spinning */
+          conn_close(conn);
+        } else if (ready & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+          reactor_read(conn);
+        }
+        conn_release(conn);
+      }
+    }
+
+    if (woken) {
+      uint64_t count;
+      ssize_t ignored = read(reactor->wake_fd, &count, sizeof(count));
+      (void)ignored;
+      reactor_drain_resumed(reactor);
+      reactor_wind_down(reactor);
+    }
+  }
+  __atomic_store_n(&reactor->has_thread, 0, __ATOMIC_RELEASE);
+}
+
+void reactor_stop_accepting(reactor_t *reactor, reactor_input_fn wind_down) {
+  __atomic_store_n(&reactor->wind_down, wind_down, __ATOMIC_RELEASE);
+  reactor_wake(reactor);
+}
+
+void reactor_stop(reactor_t *reactor) {
+  __atomic_store_n(&reactor->running, 0, __ATOMIC_RELEASE);
+  reactor_wake(reactor);
+}
+
+void reactor_destroy(reactor_t *reactor) {
+  size_t i;
+
+  if (!reactor) {
+    return;
+  }
+
+  reactor_drain_resumed(reactor);
+  while (reactor->conns) {
+    if (reactor->conns->lingering) {
+      conn_unlink(reactor->conns);
+    } else {
+      conn_close(reactor->conns);
+    }
+  }
+  for (i = 0; i < reactor->listener_count; i++) {
+    if (reactor->listeners[i].fd >= 0) {
+      close(reactor->listeners[i].fd);
+    }
+  }
+  if (reactor->wake_fd >= 0) {
+    close(reactor->wake_fd);
+  }
+  if (reactor->epoll_fd >= 0) {
+    close(reactor->epoll_fd);
+  }
+  pthread_mutex_destroy(&reactor->resume_lock);
+  free(reactor);
+}
+
+size_t reactor_connections(reactor_t *reactor) {
+  return __atomic_load_n(&reactor->conn_count, __ATOMIC_RELAXED);
+}
+
+void conn_retain(connection_t *conn) {
+  __atomic_add_fetch(&conn->refs, 1, __ATOMIC_RELAXED);
+}
+
+void conn_release(connection_t *conn) {
+  if (__atomic_sub_fetch(&conn->refs, 1, __ATOMIC_ACQ_REL) != 0) {
+    return;
+  }
+  close(conn->fd);
+  pthread_mutex_destroy(&conn->write_lock);
+  pthread_mutex_destroy(&conn->out_lock);
+  free(conn->in);
+  free(conn->out);
+  free(conn);
+}
+
+int conn_send(connection_t *conn, const void *data, size_t len) {
+  struct iovec iov;
+
+  iov.iov_base = (void *)data;
+  iov.iov_len = len;
+  return conn_sendv(conn, &iov, 1);
+}
+
+/**
+ * @brief Mark a connection whose stream can no longer be trusted
+ *
+ * Makes the reactor notice and fails every later writer.
+ *
+ * @param conn Connection (a writer in the middle of a frame holds
+ *        write_lock; the reactor thread may call it without)
+ */
+static void conn_break(connection_t *conn) {
+  __atomic_store_n(&conn->broken, 1, __ATOMIC_RELAXED);
+  shutdown(conn->fd, SHUT_RDWR);
+}
+
+/**
+ * @brief Wait for socket space after a write returned EAGAIN
+ *
+ * @param conn Connection (write_lock held)
+ * @return 0 to try again, -1 if the peer is gone or stalled
+ */
+static int conn_wait_writable(connection_t *conn) {
+  struct pollfd pfd;
+
+  pfd.fd = conn->fd;
+  pfd.events = POLLOUT;
+  pfd.revents = 0;
+  int ready = poll(&pfd, 1, SEND_STALL_MS);
+  if ((ready > 0 && !(pfd.revents & (POLLERR | POLLHUP))) ||
+      (ready < 0 && errno == EINTR)) {
+    return 0;
+  }
+  return -1;
+}
+
+/**
+ * @brief Drop the first bytes of a buffer list
+ *
+ * @param iov Buffers, advanced past the bytes
+ * @param iovcnt Number of buffers, reduced accordingly
+ * @param len Number of bytes
+ */
+static void iov_advance(struct iovec **iov, int *iovcnt, size_t len) {
+  while (*iovcnt > 0 && len >= (*iov)->iov_len) {
+    len -= (*iov)->iov_len;
+    (*iov)++;
+    (*iovcnt)--;
+  }
+  if (*iovcnt > 0) {
+    (*iov)->iov_base = (char *)(*iov)->iov_base + len;
+    (*iov)->iov_len -= len;
+  }
+}
+
+/**
+ * @brief Write as much as the socket takes (write_lock held)
+ *
+ * @param conn Connection to write to
+ * @param iov Buffers to send, advanced past what was sent
+ * @param iovcnt Number of buffers, reduced accordingly
+ * @param flags Extra sendmsg() flags (MSG_MORE)
+ * @param wait Whether to wait for socket space while the peer reads
+ *
+ * @return 0 if everything was sent, 1 if the socket is full (only when
+ *         not waiting), -1 if the peer is gone (the connection is broken)
+ */
+static int conn_write_iov(connection_t *conn, struct iovec **iov,
+                          int *iovcnt, int flags, int wait) {
+  struct msghdr msg;
+
+  memset(&msg, 0, sizeof(msg));
+  if (__atomic_load_n(&conn->broken, __ATOMIC_RELAXED)) {
+    return -1;
+  }
+  while (*iovcnt > 0) {
+    if ((*iov)->iov_len == 0) {
+      (*iov)++;
+      (*iovcnt)--;
+      continue;
+    }
+
+    msg.msg_iov = *iov;
+    msg.msg_iovlen = (size_t)*iovcnt;
+    ssize_t n = sendmsg(conn->fd, &msg, MSG_NOSIGNAL | flags);
+    if (n > 0) {
+      iov_advance(iov, iovcnt, (size_t)n);
+      continue;
+    }
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      if (!wait) {
+        return 1;
+      }
+      if (conn_wait_writable(conn) == 0) {
+        continue;
+      }
+    }
+    /* Gone or stalled */
+    conn_break(conn);
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ * @brief Take the output queued by the reactor thread
+ *
+ * @param conn Connection
+ * @param len Receives the number of bytes
+ *
+ * @return The queue, to be freed by the caller, or NULL if it was empty
+ */
+static char *conn_take_queued(connection_t *conn, size_t *len) {
+  char *out;
+
+  pthread_mutex_lock(&conn->out_lock);
+  out = conn->out;
+  *len = conn->out_len;
+  conn->out = NULL;
+  conn->out_len = 0;
+  conn->out_cap = 0;
+  pthread_mutex_unlock(&conn->out_lock);
+  if (out && *len == 0) {
+    free(out);
+    out = NULL;
+  }
+  return out;
+}
+
+/**
+ * @brief Write buffers completely (write_lock held)
+ *
+ * Output the reactor thread queued goes first, since it may end with part
+ * of a frame.
+ *
+ * @param conn Connection to write to
+ * @param iov Buffers to send (modified while sending)
+ * @param iovcnt Number of buffers
+ * @param flags Extra sendmsg() flags (MSG_MORE)
+ *
+ * @return 0 on success, -1 if the peer is gone (the connection is broken)
+ */
+static int conn_write_locked(connection_t *conn, struct iovec *iov,
+                             int iovcnt, int flags) {
+  struct iovec queued;
+  struct iovec *pending = &queued;
+  int pending_count = 1;
+
+  queued.iov_base = conn_take_queued(conn, &queued.iov_len);
+  if (queued.iov_base) {
+    int result = conn_write_iov(conn, &pending, &pending_count, 0, 1);
+
+    free(queued.iov_base);
+    if (result != 0) {
+      return -1;
+    }
+  }
+  return conn_write_iov(conn, &iov, &iovcnt, flags, 1);
+}
+
+/**
+ * @brief Append buffers to the output queue (out_lock held)
+ *
+ * @param conn Connection
+ * @param iov Buffers to queue
+ * @param iovcnt Number of buffers
+ *
+ * @return 0 on success, -1 if the queue would exceed OUTPUT_QUEUE_CAP
+ */
+static int conn_queue(connection_t *conn, const struct iovec *iov,
+                      int iovcnt) {
+  size_t len = 0;
+
+  for (int i = 0; i < iovcnt; i++) {
+    len += iov[i].iov_len;
+  }
+  if (len > OUTPUT_QUEUE_CAP - conn->out_len) {
+    return -1;
+  }
+  if (conn->out_len + len > conn->out_cap) {
+    size_t cap = conn->out_cap ? conn->out_cap : READ_CHUNK;
+    while (cap < conn->out_len + len) {
+      cap *= 2;
+    }
+    char *grown = realloc(conn->out, cap);
+    if (!grown) {
+      return -1;
+    }
+    conn->out = grown;
+    conn->out_cap = cap;
+  }
+  for (int i = 0; i < iovcnt; i++) {
+    memcpy(conn->out + conn->out_len, iov[i].iov_base, iov[i].iov_len);
+    conn->out_len += iov[i].iov_len;
+  }
+  return 0;
+}
+
+/**
+ * @brief Write queued output as far as the socket takes it, without
+ * waiting (out_lock held, reactor thread)
+ *
+ * If a worker holds the write lock the queue is left alone: that worker
+ * or a later EPOLLOUT sends it.
+ *
+ * @param conn Connection
+ * @return 0 on success, -1 if the peer is gone
+ */
+static int conn_flush_queued(connection_t *conn) {
+  struct iovec queued;
+  struct iovec *pending = &queued;
+  int pending_count = 1;
+  int result;
+
+  if (conn->out_len == 0 || pthread_mutex_trylock(&conn->write_lock) != 0) {
+    return 0;
+  }
+  queued.iov_base = conn->out;
+  queued.iov_len = conn->out_len;
+  result = conn_write_iov(conn, &pending, &pending_count, 0, 0);
+  pthread_mutex_unlock(&conn->write_lock);
+  if (result < 0) {
+    return -1;
+  }
+  size_t left = pending_count > 0 ? pending->iov_len : 0;
+  memmove(conn->out, conn->out + (conn->out_len - left), left);
+  conn->out_len = left;
+  return 0;
+}
+
+/**
+ * @brief Forget the queued output of a broken connection (out_lock held)
+ *
+ * @param conn Connection
+ */
+static void conn_discard_queued(connection_t *conn) {
+  free(conn->out);
+  conn->out = NULL;
+  conn->out_len = 0;
+  conn->out_cap = 0;
+}
+
+/**
+ * @brief Send queued output once the socket is writable (reactor thread)
+ *
+ * A lingering connection is closed once its queue is empty or its peer is
+ * gone.
+ *
+ * @param conn Writable connection
+ */
+static void reactor_flush(connection_t *conn) {
+  int done;
+
+  pthread_mutex_lock(&conn->out_lock);
+  if (__atomic_load_n(&conn->broken, __ATOMIC_RELAXED) ||
+      conn_flush_queued(conn) != 0) {
+    conn_discard_queued(conn);
+  }
+  done = conn->out_len == 0;
+  pthread_mutex_unlock(&conn->out_lock);
+
+  if (done && conn->lingering) {
+    conn_unlink(conn);
+  } else if (!conn->closing || conn->lingering) {
+    conn_watch(conn);
+  }
+}
+
+int conn_sendv(connection_t *conn, struct iovec *iov, int iovcnt) {
+  int result;
+
+  pthread_mutex_lock(&conn->write_lock);
+  result = conn_write_locked(conn, iov, iovcnt, 0);
+  pthread_mutex_unlock(&conn->write_lock);
+  return result;
+}
+
+int conn_postv(connection_t *conn, struct iovec *iov, int iovcnt) {
+  reactor_t *reactor = conn->reactor;
+  int result = 0;
+  int queued;
+
+  if (!__atomic_load_n(&reactor->has_thread, __ATOMIC_ACQUIRE) ||
+      !pthread_equal(pthread_self(), reactor->thread)) {
+    return conn_sendv(conn, iov, iovcnt);
+  }
+  if (__atomic_load_n(&conn->broken, __ATOMIC_RELAXED)) {
+    return -1;
+  }
+
+  pthread_mutex_lock(&conn->out_lock);
+  /* Behind queued output, or behind a worker's frame, it has to wait */
+  if (conn->out_len == 0 && pthread_mutex_trylock(&conn->write_lock) == 0) {
+    result = conn_write_iov(conn, &iov, &iovcnt, 0, 0);
+    pthread_mutex_unlock(&conn->write_lock);
+  }
+  if (result == 1) {
+    result = 0;
+  }
+  if (result == 0 && iovcnt > 0 && conn_queue(conn, iov, iovcnt) != 0) {
+    /* The peer is not reading: the stream cannot be completed */
+    conn_break(conn);
+    result = -1;
+  }
+  if (result != 0) {
+    conn_discard_queued(conn);
+  }
+  queued = conn->out_len > 0;
+  pthread_mutex_unlock(&conn->out_lock);
+
+  if (queued && !conn->closing) {
+    conn_watch(conn);
+  }
+  return result;
+}
+
+int conn_trysendv(connection_t *conn, struct iovec *iov, int iovcnt) {
+  struct iovec queued;
+  struct iovec *pending = &queued;
+  int pending_count = 1;
+  int result = 0;
+
+  pthread_mutex_lock(&conn->write_lock);
+  queued.iov_base = conn_take_queued(conn, &queued.iov_len);
+  if (queued.iov_base) {
+    result = conn_write_iov(conn, &pending, &pending_count, 0, 0);
+    free(queued.iov_base);
+  }
+  if (result == 0) {
+    result = conn_write_iov(conn, &iov, &iovcnt, 0, 0);
+  }
+  if (result == 1) {
+    conn_break(conn);
+  }
+  pthread_mutex_unlock(&conn->write_lock);
+  return result == 0 ? 0 : -1;
+}
+
+int conn_sendfd(connection_t *conn, const void *head, size_t head_len,
+                int fd, off_t *offset, size_t len) {
+  struct iovec iov;
+  int result;
+
+  iov.iov_base = (void *)head;
+  iov.iov_len = head_len;
+  pthread_mutex_lock(&conn->write_lock);
+  result = conn_write_locked(conn, &iov, 1, len > 0 ? MSG_MORE : 0);
+  while (result == 0 && len > 0) {
+    ssize_t n;
+
+    // Pages go from the page cache or the pipe straight to the socket
+    if (offset) {
+      n = sendfile(conn->fd, fd, offset, len);
+    } else {
+      n = splice(fd, NULL, conn->fd, NULL, len, SPLICE_F_MOVE);
+    }
+    if (n > 0) {
+      len -= (size_t)n;
+      continue;
+    }
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) &&
+        conn_wait_writable(conn) == 0) {
+      continue;
+    }
+    /* The peer is gone, or the source ended early: the frame announced
+     * more bytes than can follow, so the stream is lost either way */
+    conn_break(conn);
+    result = -1;
+  }
+  pthread_mutex_unlock(&conn->write_lock);
+  return result;
+}
+
+void conn_consume(connection_t *conn, size_t len) {
+  if (len >= conn->in_len) {
+    conn->in_len = 0;
+    if (conn->in_cap > IDLE_INPUT_CAP) {
+      free(conn->in);
+      conn->in = NULL;
+      conn->in_cap = 0;
+    }
+    return;
+  }
+  memmove(conn->in, conn->in + len, conn->in_len - len);
+  conn->in_len -= len;
+  /* The rest came with the last read at the latest */
+  conn->input_us = conn->read_us;
+}
+
+void conn_pause(connection_t *conn) {
+  if (!conn->paused && !conn->closing) {
+    conn->paused = 1;
+    conn_watch(conn);
+  }
+}
+
+void conn_resume(connection_t *conn) {
+  reactor_t *reactor = conn->reactor;
+
+  if (__atomic_exchange_n(&conn->resume_queued, 1, __ATOMIC_ACQ_REL)) {
+    return; /* already on the resume list */
+  }
+  conn_retain(conn);
+  pthread_mutex_lock(&reactor->resume_lock);
+  conn->resumed = reactor->resumed;
+  reactor->resumed = conn;
+  pthread_mutex_unlock(&reactor->resume_lock);
+  reactor_wake(reactor);
+}
+
+void conn_hangup(connection_t *conn) {
+  pthread_mutex_lock(&conn->write_lock);
+  shutdown(conn->fd, SHUT_RDWR);
+  pthread_mutex_unlock(&conn->write_lock);
+}
+
+void conn_close(connection_t *conn) {
+  int queued;
+
+  if (conn->closing) {
+    return;
+  }
+  conn->closing = 1;
+
+  pthread_mutex_lock(&conn->out_lock);
+  queued = conn->out_len > 0;
+  pthread_mutex_unlock(&conn->out_lock);
+  if (queued) {
+    /* Stop reading and send the rest first (see reactor_flush()) */
+    conn->lingering = 1;
+    conn_watch(conn);
+    return;
+  }
+  conn_unlink(conn);
+}
+
+/**
+ * @brief Stop watching a closed connection and drop the reactor's
+ * reference
+ *
+ * @param conn Connection being closed (closing set)
+ */
+static void conn_unlink(connection_t *conn) {
+  reactor_t *reactor = conn->reactor;
+
+  conn->lingering = 0;
+  epoll_ctl(reactor->epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL);
+
+  if (conn->prev) {
+    conn->prev->next = conn->next;
+  } else {
+    reactor->conns = conn->next;
+  }
+  if (conn->next) {
+    conn->next->prev = conn->prev;
+  }
+  conn->prev = conn->next = NULL;
+  __atomic_sub_fetch(&reactor->conn_count, 1, __ATOMIC_RELAXED);
+
+  conn_release(conn);
+}
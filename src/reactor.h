@@ -0,0 +1,343 @@
+/**
+ * @file reactor.h
+ * @brief Single-threaded epoll reactor for all listening and client sockets
+ * @author Rares-Nicholas Popa & Adrian-Petru Enache
+ * @version 1.0.0
+ *
+ * @details The reactor accepts connections on any number of listening
+ * ports, reads from every client socket without blocking and hands the
+ * buffered input to one callback. An idle client therefore costs one file
+ * descriptor and a small connection_t instead of a thread and its stack.
+ *
+ * Connections are reference counted so that a worker thread can keep
+ * replying on a socket after the reactor has stopped watching it. Input
+ * buffers belong to the reactor thread; output is written by whoever holds
+ * a reference, serialised by the connection's write lock. The reactor
+ * thread itself never waits for a peer: what the socket cannot take at
+ * once is queued on the connection and written when it becomes writable
+ * (see conn_postv()).
+ *
+ * Connections carry CLOCK_MONOTONIC timestamps in microseconds (the clock
+ * of stats_now_us()) of when they were accepted and when their buffered
+ * input arrived, so a request can be timed from its first byte.
+ *
+ * @copyright This project is for educational purposes as part of the PCD
+ * course.
+ */
+
+#ifndef REACTOR_H
+#define REACTOR_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+/**
+ * @enum conn_kind_t
+ * @brief Which listener a connection was accepted on
+ */
+typedef enum {
+  CONN_REGULAR, /**< Code submission client (PORT) */
+  CONN_ADMIN,   /**< Administration client (ADMIN_PORT) */
+  CONN_METRICS, /**< HTTP metrics scraper (METRICS_PORT) */
+  CONN_NODE     /**< Worker node heartbeats (coordinator, see cluster.h) */
+} conn_kind_t;
+
+/** @brief Opaque reactor handle */
+typedef struct reactor reactor_t;
+
+/**
+ * @struct reactor_listener_t
+ * @brief One listening socket
+ */
+typedef struct {
+  int fd;           /**< Listening socket, -1 once closed */
+  conn_kind_t kind; /**< Kind of connections it accepts */
+} reactor_listener_t;
+
+/**
+ * @struct connection_t
+ * @brief One accepted client socket
+ */
+typedef struct connection {
+  int fd;                     /**< Non-blocking client socket */
+  conn_kind_t kind;           /**< Listener the client arrived on */
+  uint32_t peer_addr;         /**< Client IPv4 address, host byte order */
+  char *in;                   /**< Buffered, not yet consumed input */
+  size_t in_len;              /**< Bytes currently in the input buffer */
+  size_t in_cap;              /**< Allocated size of the input buffer */
+  int paused;                 /**< Reading suspended (reactor thread only) */
+  int closing;                /**< Removed from the reactor (reactor thread) */
+  int refs;                   /**< Reference count (atomic) */
+  int broken;                 /**< A send failed, fail the rest (atomic) */
+  int in_flight;              /**< Requests being served (atomic, callback) */
+  uint64_t accepted_us;       /**< Accept time, 0 once the callback took it */
+  uint64_t input_us;          /**< Arrival of the first buffered byte */
+  uint64_t read_us;           /**< Arrival of the last buffered byte */
+  pthread_mutex_t write_lock; /**< Serialises writers on fd */
+  pthread_mutex_t out_lock;   /**< Guards out, out_len and out_cap */
+  char *out;                  /**< Output queued by the reactor thread */
+  size_t out_len;             /**< Bytes queued in out */
+  size_t out_cap;             /**< Allocated size of out */
+  int lingering;              /**< Closed, still sending out (reactor) */
+  reactor_t *reactor;         /**< Owning reactor */
+  struct connection *prev;    /**< Live connection list (reactor thread) */
+  struct connection *next;    /**< Live connection list (reactor thread) */
+  struct connection *resumed; /**< Link in the reactor's resume list */
+  int resume_queued;          /**< Set while on the resume list (atomic) */
+} connection_t;
+
+/**
+ * @brief Callback invoked on the reactor thread when a connection has input
+ *
+ * The callback inspects conn->in, removes what it used with
+ * conn_consume() and may pause or close the connection. It must not block.
+ *
+ * @param conn Connection with new or still unconsumed input
+ */
+typedef void (*reactor_input_fn)(connection_t *conn);
+
+/**
+ * @brief Create a reactor
+ *
+ * @param on_input Callback for readable connections
+ * @param max_input Maximum bytes buffered per connection; a client whose
+ *        unconsumed input reaches this size is disconnected
+ *
+ * @return The reactor, or NULL on failure
+ */
+reactor_t *reactor_create(reactor_input_fn on_input, size_t max_input);
+
+/**
+ * @brief Open a non-blocking listening socket watched by the reactor
+ *
+ * @param reactor Reactor to register with
+ * @param port TCP port to bind on all interfaces
+ * @param backlog listen() backlog
+ * @param kind Kind assigned to connections accepted on this port
+ *
+ * @return 0 on success, -1 on failure (errno is set)
+ */
+int reactor_listen(reactor_t *reactor, uint16_t port, int backlog,
+                   conn_kind_t kind);
+
+/**
+ * @brief Watch a listening socket that is already bound, e.g. one
+ * inherited from another process
+ *
+ * @param reactor Reactor to register with
+ * @param fd Non-blocking listening socket; owned by the reactor on success
+ * @param kind Kind assigned to connections accepted on it
+ *
+ * @return 0 on success, -1 on failure (errno is set, fd is left open)
+ */
+int reactor_adopt(reactor_t *reactor, int fd, conn_kind_t kind);
+
+/**
+ * @brief List the listening sockets; safe from any thread while no
+ * listener is being added
+ *
+ * @param reactor Reactor to inspect
+ * @param listeners Receives the open listeners
+ * @param max Capacity of listeners
+ *
+ * @return Number of entries written
+ */
+size_t reactor_listeners(reactor_t *reactor, reactor_listener_t *listeners,
+                         size_t max);
+
+/**
+ * @brief Stop accepting connections; safe from any thread
+ *
+ * The reactor thread closes every listening socket. Connections still
+ * waiting in a listen queue stay there for another process that holds a
+ * copy of the socket (see handover.h). Then wind_down is called once for
+ * every open connection, so the caller can close or pause them; the
+ * reactor keeps serving whatever is left open until reactor_stop().
+ *
+ * @param reactor Reactor to wind down
+ * @param wind_down Called on the reactor thread for every connection
+ */
+void reactor_stop_accepting(reactor_t *reactor, reactor_input_fn wind_down);
+
+/**
+ * @brief Run the event loop on the calling thread until reactor_stop()
+ *
+ * @param reactor Reactor to run
+ */
+void reactor_run(reactor_t *reactor);
+
+/**
+ * @brief Ask reactor_run() to return; safe from any thread
+ *
+ * @param reactor Reactor to stop
+ */
+void reactor_stop(reactor_t *reactor);
+
+/**
+ * @brief Close all listeners and connections and free the reactor
+ *
+ * @param reactor Reactor to destroy (must not be running)
+ */
+void reactor_destroy(reactor_t *reactor);
+
+/**
+ * @brief Number of client connections currently open
+ *
+ * @param reactor Reactor to inspect
+ * @return Open connection count
+ */
+size_t reactor_connections(reactor_t *reactor);
+
+/**
+ * @brief Take an additional reference on a connection
+ *
+ * @param conn Connection to retain
+ */
+void conn_retain(connection_t *conn);
+
+/**
+ * @brief Drop a reference; the socket is closed when the last one goes
+ *
+ * @param conn Connection to release
+ */
+void conn_release(connection_t *conn);
+
+/**
+ * @brief Write a whole buffer to the client
+ *
+ * Waits for socket space when the kernel buffer is full, so a slow reader
+ * throttles the writer rather than growing server memory. A peer that
+ * reads nothing for SEND_STALL_MS is treated as gone: the socket is shut
+ * down and every later send on it fails immediately.
+ *
+ * @param conn Connection to write to (caller holds a reference)
+ * @param data Bytes to send
+ * @param len Number of bytes
+ *
+ * @return 0 on success, -1 if the peer is gone
+ */
+int conn_send(connection_t *conn, const void *data, size_t len);
+
+/**
+ * @brief Write several buffers to the client as one uninterrupted unit
+ *
+ * Like conn_send(), but no other writer can interleave between the
+ * buffers, so a frame header and its payload stay together.
+ *
+ * @param conn Connection to write to (caller holds a reference)
+ * @param iov Buffers to send (modified while sending)
+ * @param iovcnt Number of buffers
+ *
+ * @return 0 on success, -1 if the peer is gone
+ */
+int conn_sendv(connection_t *conn, struct iovec *iov, int iovcnt);
+
+/**
+ * @brief Write several buffers to the client without waiting on the
+ * reactor thread
+ *
+ * On the reactor thread, whatever the socket does not take at once is
+ * queued on the connection, behind any output queued before, and written
+ * by the reactor as the peer reads it; every other writer sends the queue
+ * first. A peer that lets more than OUTPUT_QUEUE_CAP bytes pile up is
+ * treated as gone. Called from any other thread, this is conn_sendv().
+ *
+ * @param conn Connection to write to (caller holds a reference)
+ * @param iov Buffers to send (modified while sending)
+ * @param iovcnt Number of buffers
+ *
+ * @return 0 on success (sent or queued), -1 if the peer is gone
+ */
+int conn_postv(connection_t *conn, struct iovec *iov, int iovcnt);
+
+/**
+ * @brief Write several buffers to the client only if it can be done
+ * without waiting for the peer
+ *
+ * For threads that must not stall on one slow reader among many. Output
+ * queued by the reactor thread goes first. If the socket cannot take all
+ * of it at once the connection is broken, since part of a frame may have
+ * gone out. Waits for the write lock, so it must not be used on a
+ * connection other threads write to with conn_sendv().
+ *
+ * @param conn Connection to write to (caller holds a reference)
+ * @param iov Buffers to send (modified while sending)
+ * @param iovcnt Number of buffers
+ *
+ * @return 0 on success, -1 if the peer is gone or not keeping up
+ */
+int conn_trysendv(connection_t *conn, struct iovec *iov, int iovcnt);
+
+/**
+ * @brief Write a header followed by bytes taken straight from a descriptor
+ *
+ * Like conn_sendv(), but the len bytes after head are moved by the kernel
+ * without passing through user space: with sendfile() from a regular file
+ * at *offset, or with splice() from a pipe that already holds at least
+ * len bytes. If fewer bytes can be had, the connection is broken, since
+ * head promised them.
+ *
+ * @param conn Connection to write to (caller holds a reference)
+ * @param head Bytes sent first, typically a frame header
+ * @param head_len Size of head
+ * @param fd Regular file or read end of a pipe
+ * @param offset File position, advanced by the bytes sent; NULL for a pipe
+ * @param len Number of bytes to take from fd
+ *
+ * @return 0 on success, -1 if the peer is gone
+ */
+int conn_sendfd(connection_t *conn, const void *head, size_t head_len,
+                int fd, off_t *offset, size_t len);
+
+/**
+ * @brief Remove bytes from the front of the input buffer (reactor thread)
+ *
+ * A buffer that grew for a large request is released once it is empty,
+ * so an idle connection goes back to costing almost nothing.
+ *
+ * @param conn Connection whose input was used
+ * @param len Number of bytes consumed
+ */
+void conn_consume(connection_t *conn, size_t len);
+
+/**
+ * @brief Stop reading from a connection (reactor thread)
+ *
+ * @param conn Connection to pause
+ */
+void conn_pause(connection_t *conn);
+
+/**
+ * @brief Resume reading from a paused connection; safe from any thread
+ *
+ * Input buffered while paused is delivered to the callback again.
+ *
+ * @param conn Connection to resume (caller holds a reference)
+ */
+void conn_resume(connection_t *conn);
+
+/**
+ * @brief Close a connection from any thread
+ *
+ * Output already sent is still delivered; the reactor then sees the end
+ * of the input and closes the connection.
+ *
+ * @param conn Connection to hang up (caller holds a reference)
+ */
+void conn_hangup(connection_t *conn);
+
+/**
+ * @brief Stop watching a connection and drop the reactor's reference
+ * (reactor thread)
+ *
+ * Output queued by conn_postv() is still sent first: the connection is no
+ * longer read, and goes once the queue is empty or the peer is gone.
+ *
+ * @param conn Connection to close
+ */
+void conn_close(connection_t *conn);
+
+#endif /* REACTOR_H */
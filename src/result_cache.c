@@ -0,0 +1,250 @@
+/**
+ * @file result_cache.c
+ * @brief Opt-in memoization of program output for deterministic programs
+ * @author Rares-Nicholas Popa & Adrian-Petru Enache
+ * @version 1.0.0
+ *
+ * @details Same layout as the compile cache: a chained hash table for
+ * lookups and a doubly linked list in least-recently-used order. Outputs
+ * are small (bounded by the reply buffer), so they are kept in memory.
+ *
+ * @copyright This project is for educational purposes as part of the PCD
+ * course.
+ */
+
+#include "result_cache.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/** @def RESULT_BUCKETS
+ * @brief Number of hash table buckets (power of two)
+ */
+#define RESULT_BUCKETS 4096
+
+/**
+ * @struct result_entry_t
+ * @brief One memoized run
+ */
+typedef struct result_entry {
+  uint8_t key[SHA256_DIGEST_SIZE]; /**< Run identity */
+  char *output;                    /**< Captured output */
+  size_t output_len;               /**< Bytes of output */
+  size_t bytes;                    /**< Size charged against the limit */
+  int status;                      /**< Wait status of the program */
+  time_t expires;                  /**< Monotonic expiry time */
+  struct result_entry *chain;      /**< Next entry in the same bucket */
+  struct result_entry *newer;      /**< LRU neighbour towards the head */
+  struct result_entry *older;      /**< LRU neighbour towards the tail */
+} result_entry_t;
+
+/** @brief Global cache state */
+static struct {
+  pthread_mutex_t lock;                    /**< Protects everything below */
+  unsigned ttl;                            /**< Entry lifetime, 0 = off */
+  size_t max_bytes;                        /**< Size limit */
+  result_entry_t *buckets[RESULT_BUCKETS]; /**< Hash table */
+  result_entry_t *newest;                  /**< LRU head */
+  result_entry_t *oldest;                  /**< LRU tail */
+  result_cache_stats_t stats;              /**< Counters */
+} results = {PTHREAD_MUTEX_INITIALIZER, 0, 0, {NULL}, NULL, NULL,
+             {0, 0, 0, 0, 0, 0}};
+
+/**
+ * @brief Current monotonic time in seconds
+ *
+ * @return Seconds since an arbitrary epoch
+ */
+static time_t monotonic_seconds(void) {
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec;
+}
+
+/**
+ * @brief Bucket index of a key
+ *
+ * @param key Run identity
+ * @return Index into results.buckets
+ */
+static size_t bucket_of(const uint8_t key[SHA256_DIGEST_SIZE]) {
+  size_t index;
+
+  memcpy(&index, key, sizeof(index));
+  return index & (RESULT_BUCKETS - 1);
+}
+
+/**
+ * @brief Unlink an entry from the LRU list (lock held)
+ *
+ * @param entry Entry to detach
+ */
+static void lru_detach(result_entry_t *entry) {
+  if (entry->newer) {
+    entry->newer->older = entry->older;
+  } else {
+    results.newest = entry->older;
+  }
+  if (entry->older) {
+    entry->older->newer = entry->newer;
+  } else {
+    results.oldest = entry->newer;
+  }
+  entry->newer = entry->older = NULL;
+}
+
+/**
+ * @brief Make an entry the most recently used (lock held)
+ *
+ * @param entry Detached entry
+ */
+static void lru_push(result_entry_t *entry) {
+  entry->older = results.newest;
+  entry->newer = NULL;
+  if (results.newest) {
+    results.newest->newer = entry;
+  }
+  results.newest = entry;
+  if (!results.oldest) {
+    results.oldest = entry;
+  }
+}
+
+/**
+ * @brief Remove and free an entry (lock held)
+ *
+ * @param entry Entry to remove
+ */
+static void remove_entry(result_entry_t *entry) {
+  result_entry_t **link = &results.buckets[bucket_of(entry->key)];
+
+  while (*link != entry) {
+    link = &(*link)->chain;
+  }
+  *link = entry->chain;
+  lru_detach(entry);
+  results.stats.entries--;
+  results.stats.bytes -= entry->bytes;
+  free(entry->output);
+  free(entry);
+}
+
+void result_cache_init(unsigned ttl_seconds, size_t max_bytes) {
+  pthread_mutex_lock(&results.lock);
+  results.ttl = max_bytes > 0 ? ttl_seconds : 0;
+  results.max_bytes = max_bytes;
+  results.stats.ttl = results.ttl;
+  pthread_mutex_unlock(&results.lock);
+}
+
+int result_cache_enabled(void) {
+  return __atomic_load_n(&results.ttl, __ATOMIC_RELAXED) != 0;
+}
+
+void result_cache_key(const uint8_t binary[SHA256_DIGEST_SIZE],
+                      const char *args, const char *input, size_t input_len,
+                      uint8_t key[SHA256_DIGEST_SIZE]) {
+  sha256_ctx_t ctx;
+  uint64_t len = input_len;
+
+  sha256_init(&ctx);
+  sha256_update(&ctx, binary, SHA256_DIGEST_SIZE);
+  sha256_update(&ctx, args, strlen(args) + 1);
+  sha256_update(&ctx, &len, sizeof(len));
+  sha256_update(&ctx, input, input_len);
+  sha256_final(&ctx, key);
+}
+
+int result_cache_lookup(const uint8_t key[SHA256_DIGEST_SIZE], char *output,
+                        size_t output_size, size_t *output_len, int *status) {
+  result_entry_t *entry;
+  int hit = 0;
+
+  pthread_mutex_lock(&results.lock);
+  if (results.ttl == 0) {
+    pthread_mutex_unlock(&results.lock);
+    return 0;
+  }
+
+  entry = results.buckets[bucket_of(key)];
+  while (entry && memcmp(entry->key, key, SHA256_DIGEST_SIZE) != 0) {
+    entry = entry->chain;
+  }
+
+  if (entry && entry->expires <= monotonic_seconds()) {
+    remove_entry(entry);
+    results.stats.expired++;
+    entry = NULL;
+  }
+
+  if (entry) {
+    *output_len = entry->output_len < output_size ? entry->output_len
+                                                  : output_size - 1;
+    memcpy(output, entry->output, *output_len);
+    output[*output_len] = '\0';
+    *status = entry->status;
+    lru_detach(entry);
+    lru_push(entry);
+    results.stats.hits++;
+    hit = 1;
+  } else {
+    results.stats.misses++;
+  }
+  pthread_mutex_unlock(&results.lock);
+  return hit;
+}
+
+void result_cache_store(const uint8_t key[SHA256_DIGEST_SIZE],
+                        const char *output, size_t output_len, int status) {
+  size_t len = output_len;
+  result_entry_t *entry, *existing;
+  size_t bucket = bucket_of(key);
+
+  if (!result_cache_enabled() || len + 1 > results.max_bytes) {
+    return;
+  }
+
+  entry = calloc(1, sizeof(*entry));
+  if (!entry || !(entry->output = malloc(len + 1))) {
+    free(entry);
+    return;
+  }
+  memcpy(entry->key, key, SHA256_DIGEST_SIZE);
+  memcpy(entry->output, output, len);
+  entry->output[len] = '\0';
+  entry->output_len = len;
+  entry->bytes = len + 1;
+  entry->status = status;
+
+  pthread_mutex_lock(&results.lock);
+  entry->expires = monotonic_seconds() + results.ttl;
+
+  existing = results.buckets[bucket];
+  while (existing && memcmp(existing->key, key, SHA256_DIGEST_SIZE) != 0) {
+    existing = existing->chain;
+  }
+  if (existing) {
+    remove_entry(existing); /* refresh with the newer run */
+  }
+
+  entry->chain = results.buckets[bucket];
+  results.buckets[bucket] = entry;
+  lru_push(entry);
+  results.stats.entries++;
+  results.stats.bytes += entry->bytes;
+
+  while (results.stats.bytes > results.max_bytes && results.oldest != entry) {
+    remove_entry(results.oldest);
+  }
+  pthread_mutex_unlock(&results.lock);
+}
+
+void result_cache_stats(result_cache_stats_t *stats) {
+  pthread_mutex_lock(&results.lock);
+  *stats = results.stats;
+  pthread_mutex_unlock(&results.lock);
+}
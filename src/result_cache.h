@@ -0,0 +1,100 @@
+/**
+ * @file result_cache.h
+ * @brief Opt-in memoization of program output for deterministic programs
+ * @author Rares-Nicholas Popa & Adrian-Petru Enache
+ * @version 1.0.0
+ *
+ * @details Stores the captured output and exit status of a run keyed by
+ * (binary identity, arguments, stdin). A hit is answered without forking
+ * anything. Entries expire after a configurable TTL and the total size is
+ * bounded with LRU eviction. The cache is only correct for programs whose
+ * output depends on nothing but their inputs, so it is disabled unless the
+ * operator enables it, and clients can bypass it per request.
+ *
+ * @copyright This project is for educational purposes as part of the PCD
+ * course.
+ */
+
+#ifndef RESULT_CACHE_H
+#define RESULT_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sha256.h"
+
+/**
+ * @struct result_cache_stats_t
+ * @brief Snapshot of result cache counters
+ */
+typedef struct {
+  uint64_t hits;    /**< Runs answered from the cache */
+  uint64_t misses;  /**< Lookups that had to run the program */
+  uint64_t expired; /**< Entries dropped because their TTL elapsed */
+  size_t entries;   /**< Entries currently cached */
+  size_t bytes;     /**< Bytes of output currently cached */
+  unsigned ttl;     /**< Configured TTL in seconds (0 = disabled) */
+} result_cache_stats_t;
+
+/**
+ * @brief Enable the cache
+ *
+ * @param ttl_seconds Lifetime of an entry; 0 disables the cache
+ * @param max_bytes Upper bound on cached output
+ */
+void result_cache_init(unsigned ttl_seconds, size_t max_bytes);
+
+/**
+ * @brief Whether the cache is enabled
+ *
+ * @return 1 if enabled, 0 otherwise
+ */
+int result_cache_enabled(void);
+
+/**
+ * @brief Compute the key of a run
+ *
+ * @param binary Identity of the executable (its compile cache key)
+ * @param args Command line arguments joined into one string
+ * @param input Bytes fed to stdin
+ * @param input_len Length of input
+ * @param key Receives the key
+ */
+void result_cache_key(const uint8_t binary[SHA256_DIGEST_SIZE],
+                      const char *args, const char *input, size_t input_len,
+                      uint8_t key[SHA256_DIGEST_SIZE]);
+
+/**
+ * @brief Look up a run
+ *
+ * @param key Key from result_cache_key()
+ * @param output Receives the cached output (NUL-terminated)
+ * @param output_size Size of output
+ * @param output_len Receives the bytes stored in output, which may include
+ * NUL bytes the program printed
+ * @param status Receives the cached wait status
+ *
+ * @return 1 on a hit, 0 on a miss
+ */
+int result_cache_lookup(const uint8_t key[SHA256_DIGEST_SIZE], char *output,
+                        size_t output_size, size_t *output_len, int *status);
+
+/**
+ * @brief Remember the outcome of a run
+ *
+ * @param key Key from result_cache_key()
+ * @param output Captured output (copied)
+ * @param output_len Bytes of output
+ * @param status Wait status of the program
+ */
+void result_cache_store(const uint8_t key[SHA256_DIGEST_SIZE],
+                        const char *output, size_t output_len, int status);
+
+/**
+ * @brief Read the cache counters
+ *
+ * @param stats Receives the snapshot
+ */
+void result_cache_stats(result_cache_stats_t *stats);
+
+#endif /* RESULT_CACHE_H */
@@ -8,27 +8,65 @@
  * and execution requests from clients. It supports both regular clients
  * (for code submission) and admin clients (for server management).
  *
- * The server uses a multi-threaded architecture with specialized threads:
- * - Main thread: Coordinates other threads
- * - Regular client thread: Handles code compilation requests (port 8080)
- * - Admin thread: Handles administration requests (port 8081)
- * - Client handler threads: One per connected client
+ * The server uses an event-driven architecture:
+ * - Main thread: Runs the epoll reactor that accepts and reads every
+ *   regular (port 8080) and admin (port 8081) connection without blocking
+ *   and answers admin commands inline
+ * - Worker pool: A fixed number of threads that compile and execute the
+ *   complete requests dispatched by the reactor
+ *
+ * Both ports speak the framed protocol described in protocol.h.
+ *
+ * Several servers can form a cluster (see cluster.h): a coordinator (-N)
+ * accepts the clients and relays their submissions to worker nodes (-j),
+ * which are ordinary servers that report their load to it.
  *
  * @copyright This project is for educational purposes as part of the PCD
  * course.
  */
 
+#include <arpa/inet.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
 #include <fcntl.h>
+#include <ftw.h>
+#include <getopt.h>
+#include <limits.h>
 #include <netinet/in.h>
 #include <pthread.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
+#include <sys/resource.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
 #include <sys/wait.h>
 #include <time.h>
 #include <unistd.h>
 
+#include "cluster.h"
+#include "compile_cache.h"
+#include "executor.h"
+#include "handover.h"
+#include "jit.h"
+#include "log_query.h"
+#include "logger.h"
+#include "metrics.h"
+#include "prelude.h"
+#include "process.h"
+#include "project.h"
+#include "protocol.h"
+#include "quota.h"
+#include "reactor.h"
+#include "result_cache.h"
+#include "stats.h"
+#include "trace.h"
+#include "worker_pool.h"
+
 /** @def PORT
  * @brief Default port for regular client connections
  */
@@ -39,452 +77,5155 @@
  */
 #define ADMIN_PORT 8081
 
-/** @def BUFFER_SIZE
- * @brief Maximum buffer size for network communications
- */
-#define BUFFER_SIZE 4096
+/** @def METRICS_PORT
+ * @brief Default port of the HTTP /metrics endpoint
+ */
+#define METRICS_PORT 8082
+
+/** @def BUFFER_SIZE
+ * @brief Buffer size for admin commands and replies
+ */
+#define BUFFER_SIZE 4096
+
+/** @def MAX_SOURCE_BYTES
+ * @brief Largest source file accepted in one submission
+ */
+#define MAX_SOURCE_BYTES (8 * 1024 * 1024)
+
+/** @def MAX_OUTPUT_BYTES
+ * @brief Compiler or program output kept per job; the rest is discarded
+ */
+#define MAX_OUTPUT_BYTES (8 * 1024 * 1024)
+
+/** @def MAX_INPUT_BYTES
+ * @brief Largest total of stdin and expected output in one submission
+ */
+#define MAX_INPUT_BYTES (8 * 1024 * 1024)
+
+/** @def MAX_REQUEST_BYTES
+ * @brief Per-connection input limit: a maximal source and input plus the
+ * framing overhead of sending them in reasonably sized chunks
+ */
+#define MAX_REQUEST_BYTES                                                      \
+  ((MAX_SOURCE_BYTES + MAX_INPUT_BYTES) +                                      \
+   (MAX_SOURCE_BYTES + MAX_INPUT_BYTES) / 16)
+
+/** @def BATCH_MAX_CASES
+ * @brief Most test cases accepted in one batch submission
+ */
+#define BATCH_MAX_CASES 1024
+
+/** @def BATCH_OUTPUT_BYTES
+ * @brief Output kept per batch case; the rest is discarded
+ */
+#define BATCH_OUTPUT_BYTES (1024 * 1024)
+
+/** @def UNIT_OUTPUT_BYTES
+ * @brief Compiler diagnostics kept per project translation unit
+ */
+#define UNIT_OUTPUT_BYTES (64 * 1024)
+
+/** @def MAX_CLIENTS
+ * @brief Listen backlog for the regular client socket
+ */
+#define MAX_CLIENTS 10
+
+/** @def QUEUE_PER_WORKER
+ * @brief Default job queue slots per worker thread
+ */
+#define QUEUE_PER_WORKER 4
+
+/** @def MAX_TENANT_WEIGHTS
+ * @brief Client addresses the WEIGHT admin command can give a share to
+ */
+#define MAX_TENANT_WEIGHTS 64
+
+/** @def TENANT_WEIGHT_MAX
+ * @brief Largest weight WEIGHT accepts
+ */
+#define TENANT_WEIGHT_MAX 100
+
+/** @def DEFAULT_PIPELINE_DEPTH
+ * @brief Default number of jobs one connection may have queued or running
+ */
+#define DEFAULT_PIPELINE_DEPTH 8
+
+/** @def DEFAULT_DRAIN_S
+ * @brief Default time a graceful shutdown waits for unfinished jobs
+ */
+#define DEFAULT_DRAIN_S 30
+
+/** @def DRAIN_POLL_MS
+ * @brief How often a draining server checks for unfinished jobs
+ */
+#define DRAIN_POLL_MS 20
+
+/** @def DEFAULT_RETRY_AFTER_MS
+ * @brief Default back-off hint sent to clients rejected with BUSY
+ */
+#define DEFAULT_RETRY_AFTER_MS 500
+
+/** @def DEFAULT_CACHE_MB
+ * @brief Default compile cache size limit in megabytes
+ */
+#define DEFAULT_CACHE_MB 64
+
+/** @def LOG_FILE
+ * @brief Activity log written by log_activity()
+ */
+#define LOG_FILE "server.log"
+
+/** @def DEFAULT_LOG_MB
+ * @brief Default size at which the activity log is rotated
+ */
+#define DEFAULT_LOG_MB 16
+
+/** @def LOG_KEEP
+ * @brief Rotated activity logs kept (server.log.1 ... server.log.N)
+ */
+#define LOG_KEEP 3
+
+/** @def RESULT_CACHE_MB
+ * @brief Memory reserved for memoized program output when enabled
+ */
+#define RESULT_CACHE_MB 16
+
+/** @def JOB_NO_CACHE
+ * @brief Job flag: always run the program, never answer from the result
+ * cache
+ */
+#define JOB_NO_CACHE 0x1
+
+/** @def JOB_STREAM
+ * @brief Job flag: forward program output to the client as it is produced
+ */
+#define JOB_STREAM 0x2
+
+/** @def JOB_TRACE
+ * @brief Job flag: send the job's trace to the client before its result
+ */
+#define JOB_TRACE 0x4
+
+/** @def TRACE_TEXT_BYTES
+ * @brief Size of the TRACE frame text
+ */
+#define TRACE_TEXT_BYTES 8192
+
+/** @def EXEC_TIMEOUT_MS
+ * @brief Wall clock limit for a submitted program
+ */
+#define EXEC_TIMEOUT_MS 5000
+
+/** @def COMPILE_TIMEOUT_MS
+ * @brief Wall clock limit for the compiler
+ */
+#define COMPILE_TIMEOUT_MS 30000
+
+/** @def DEFAULT_CPU_PERCENT
+ * @brief Default CPU bandwidth of one compiler or program run (100 = a core)
+ */
+#define DEFAULT_CPU_PERCENT 100
+
+/** @def DEFAULT_MEMORY_MB
+ * @brief Default memory limit of one compiler or program run
+ */
+#define DEFAULT_MEMORY_MB 256
+
+/** @def DEFAULT_PIDS
+ * @brief Default task limit of one compiler or program run
+ */
+#define DEFAULT_PIDS 64
+
+/** @def DEFAULT_JIT_MAX
+ * @brief Default size limit of sources compiled in memory (see jit.h)
+ */
+#define DEFAULT_JIT_MAX 16384
+
+/** @def JIT_REJECTED
+ * @brief run_program() result: the source did not compile in memory
+ */
+#define JIT_REJECTED (-2)
+
+/** @def MAX_COMPILE_ARGS
+ * @brief Maximum number of compiler argv entries
+ */
+#define MAX_COMPILE_ARGS 32
+
+/** @def COMPILER
+ * @brief Compiler of the "fast" profile, which the preludes are built for
+ */
+#define COMPILER "gcc"
+
+/** @def COMPILER_FLAGS
+ * @brief Flags of the "fast" profile; part of the compile cache key
+ */
+#define COMPILER_FLAGS ""
+
+/** @def PROFILE_FLAGS_MAX
+ * @brief Longest flag string of a compiler profile
+ */
+#define PROFILE_FLAGS_MAX 128
+
+/** @def PROFILE_COUNT
+ * @brief Number of entries in profiles
+ */
+#define PROFILE_COUNT (sizeof(profiles) / sizeof(profiles[0]))
+
+/** @def PRELUDE_HEADERS
+ * @brief Default headers eligible for precompiled preludes (see prelude.h)
+ */
+#define PRELUDE_HEADERS                                                        \
+  "stdio.h,stdlib.h,string.h,math.h,ctype.h,stdint.h,stdbool.h,limits.h,"     \
+  "time.h,unistd.h"
+
+/** @def WORKSPACE_TEMPLATE
+ * @brief mkdtemp() template for per-job scratch directories
+ */
+#define WORKSPACE_TEMPLATE "cce-job-XXXXXX"
+
+/** @def CACHE_DIR_TEMPLATE
+ * @brief mkdtemp() template for the compile cache directory
+ */
+#define CACHE_DIR_TEMPLATE "cce-cache-XXXXXX"
+
+/** @def PRELUDE_DIR_TEMPLATE
+ * @brief mkdtemp() template for the precompiled prelude directory
+ */
+#define PRELUDE_DIR_TEMPLATE "cce-pch-XXXXXX"
+
+/** @def REMOVE_OPEN_FDS
+ * @brief Directories nftw() keeps open while removing a job directory
+ */
+#define REMOVE_OPEN_FDS 16
+
+/**
+ * @struct workspace_t
+ * @brief Private scratch directory owned by a single compilation job
+ *
+ * @var workspace_t::dir
+ * Absolute path of the job directory
+ * @var workspace_t::source
+ * Path of the submitted source file inside the job directory
+ * @var workspace_t::program
+ * Path of the compiled executable inside the job directory
+ */
+typedef struct {
+  char dir[PATH_MAX / 2];  /**< Job directory */
+  char source[PATH_MAX];  /**< Source file path */
+  char program[PATH_MAX]; /**< Executable path */
+} workspace_t;
+
+/** @brief A batch whose cases are being run (see run_batch()) */
+typedef struct batch batch_t;
+
+/** @brief A project whose units are being compiled (see build_project()) */
+typedef struct build build_t;
+
+/**
+ * @struct profile_t
+ * @brief A compiler and flags that submissions may select (FIELD_PROFILE)
+ *
+ * @var profile_t::name
+ * Name clients send
+ * @var profile_t::compiler
+ * Compiler, looked up in $PATH
+ * @var profile_t::version_flag
+ * Argument that makes the compiler print its version
+ * @var profile_t::flags
+ * Space-separated compiler flags; part of the compile cache key
+ * @var profile_t::prelude
+ * Whether the precompiled preludes (built with COMPILER and
+ * COMPILER_FLAGS) are valid for this profile
+ * @var profile_t::enabled
+ * Installed and allowed by -o
+ * @var profile_t::toolchain
+ * Compiler name and version, part of every compile cache key; "" if the
+ * compiler is not installed
+ */
+typedef struct {
+  const char *name;         /**< Profile name */
+  const char *compiler;     /**< Compiler executable */
+  const char *version_flag; /**< Version query argument */
+  const char *flags;        /**< Compiler flags */
+  int prelude;              /**< Uses precompiled preludes */
+  int enabled;              /**< Selectable */
+  char toolchain[128];      /**< Compiler version */
+} profile_t;
+
+/**
+ * @struct job_case_t
+ * @brief Standard input and expected output of one run of a submission
+ *
+ * @var job_case_t::input
+ * Bytes fed to the program's stdin (part of job_t::data)
+ * @var job_case_t::input_len
+ * Length of input; 0 runs the program on /dev/null
+ * @var job_case_t::expected
+ * Output the program should produce (part of job_t::data)
+ * @var job_case_t::expected_len
+ * Length of expected
+ * @var job_case_t::has_expected
+ * Whether the output is checked at all
+ */
+typedef struct {
+  const char *input;    /**< Stdin bytes */
+  size_t input_len;     /**< Length of input */
+  const char *expected; /**< Expected output */
+  size_t expected_len;  /**< Length of expected */
+  int has_expected;     /**< FIELD_EXPECTED was given */
+} job_case_t;
+
+/**
+ * @struct job_t
+ * @brief One code submission waiting for or running on a worker
+ *
+ * @var job_t::conn
+ * Connection the result is sent back on (a reference is held)
+ * @var job_t::job_id
+ * Client-chosen identifier echoed in every reply frame
+ * @var job_t::code
+ * Null-terminated copy of the submitted source code
+ * @var job_t::flags
+ * JOB_* request flags
+ * @var job_t::queued_us
+ * stats_now_us() when the job was handed to the worker pool
+ * @var job_t::data
+ * Storage of every case's input and expected output
+ * @var job_t::cases
+ * Runs of the program: one, or one per FIELD_CASE of a batch
+ * @var job_t::case_count
+ * Number of entries in cases
+ * @var job_t::batch
+ * Submitted with FIELD_CASE fields: answered with CASE frames
+ * @var job_t::helping
+ * Set on the helper tasks run_batch() queues; every other field is unused
+ * @var job_t::profile
+ * Compiler profile the submission selected, or the default one
+ * @var job_t::request
+ * The SUBMIT frames as received, kept by a coordinator to relay them to a
+ * worker node (NULL otherwise)
+ * @var job_t::request_len
+ * Size of request
+ * @var job_t::priority
+ * Worker pool class: batch for batches and FRAME_FLAG_BULK submissions
+ * @var job_t::tenant
+ * Client the job is shared fairly for (its IPv4 address)
+ * @var job_t::weight
+ * Share of the tenant within its class, see tenant_weight()
+ * @var job_t::files
+ * Files of a project submission; their text is stored in code (NULL
+ * for a single source)
+ * @var job_t::file_count
+ * Number of entries in files
+ * @var job_t::building
+ * Set on the helper tasks build_project() queues; every other field is
+ * unused
+ * @var job_t::trace
+ * Timeline of the job when it is traced (trace file open, or
+ * FRAME_FLAG_TRACE), NULL otherwise
+ * @var job_t::logs
+ * Set on the LOGS tasks of admin connections: the text after "LOGS";
+ * only conn and job_id are used besides
+ */
+typedef struct {
+  connection_t *conn; /**< Requesting client */
+  uint32_t job_id;    /**< Request identifier */
+  char *code;         /**< Submitted source code */
+  unsigned flags;     /**< Request flags */
+  uint64_t queued_us; /**< Submission time */
+  char *data;         /**< Case input storage */
+  job_case_t *cases;  /**< Runs to perform */
+  size_t case_count;  /**< Number of runs */
+  int batch;          /**< Batch submission */
+  batch_t *helping;   /**< Batch this helper task works on */
+  const profile_t *profile; /**< Compiler and flags */
+  char *request;      /**< Raw submission (coordinator) */
+  size_t request_len; /**< Size of request */
+  worker_class_t priority; /**< Scheduling class */
+  uint64_t tenant;    /**< Fair queuing tenant */
+  unsigned weight;    /**< Tenant weight */
+  project_file_t *files; /**< Project files */
+  size_t file_count;  /**< Number of files */
+  build_t *building;  /**< Project this helper task compiles */
+  trace_t *trace;     /**< Phase timeline */
+  char *logs;         /**< LOGS arguments */
+} job_t;
+
+/**
+ * @struct job_outcome_t
+ * @brief How a job ended, beyond its exit status
+ *
+ * @var job_outcome_t::flags
+ * RESULT_* flags reported to the client
+ * @var job_outcome_t::output_len
+ * Bytes of output, which may include NUL bytes the program printed
+ * @var job_outcome_t::streamed
+ * Leading bytes of the output already sent while the program ran
+ * @var job_outcome_t::cpu_us
+ * CPU time of the program run
+ * @var job_outcome_t::wall_us
+ * Wall clock time of the program run
+ * @var job_outcome_t::peak_bytes
+ * Peak memory use of the program run
+ */
+typedef struct {
+  unsigned flags;      /**< RESULT_* */
+  size_t output_len;   /**< Output bytes */
+  size_t streamed;     /**< Output bytes already forwarded */
+  uint64_t cpu_us;     /**< Program CPU time */
+  uint64_t wall_us;    /**< Program wall time */
+  uint64_t peak_bytes; /**< Program peak memory */
+} job_outcome_t;
+
+/**
+ * @struct batch
+ * @brief A batch submission whose cases are being run
+ *
+ * The worker that took the submission compiles it once; then it and the
+ * helper tasks it queued on the other workers claim cases from the same
+ * counter until none is left.
+ *
+ * @var batch::job
+ * The submission, owned by the coordinating worker
+ * @var batch::ws
+ * Workspace holding the compiled program
+ * @var batch::cache_key
+ * Compile cache key of the submission, the base of every result key
+ * @var batch::count
+ * Number of cases
+ * @var batch::lock
+ * Guards the fields below
+ * @var batch::idle
+ * Signalled when active drops to zero
+ * @var batch::next
+ * Next case to claim
+ * @var batch::active
+ * Threads running a case
+ * @var batch::refs
+ * The coordinator plus every helper task not yet finished
+ * @var batch::failed
+ * Cases that did not exit with status 0 or produced the wrong output
+ * @var batch::flags
+ * Limit and output RESULT_* flags of the cases, combined
+ * @var batch::cpu_us
+ * CPU time of every case, summed
+ * @var batch::peak_bytes
+ * Largest peak memory use of a case
+ */
+struct batch {
+  const job_t *job;                      /**< Submission */
+  workspace_t ws;                        /**< Compiled program */
+  uint8_t cache_key[SHA256_DIGEST_SIZE]; /**< Compile cache key */
+  size_t count;                          /**< Cases */
+  pthread_mutex_t lock;                  /**< Guards what follows */
+  pthread_cond_t idle;                   /**< No case running */
+  size_t next;                           /**< Next case */
+  size_t active;                         /**< Cases running */
+  size_t refs;                           /**< References */
+  size_t failed;                         /**< Failed cases */
+  unsigned flags;                        /**< RESULT_* of the cases */
+  uint64_t cpu_us;                       /**< Total CPU time */
+  uint64_t peak_bytes;                   /**< Largest peak memory */
+};
+
+/**
+ * @struct build
+ * @brief A project whose translation units are being compiled
+ *
+ * Like a batch: the worker that took the submission and the helper tasks
+ * it queued claim units from the same counter, and the coordinator links
+ * once every claimed unit is done.
+ *
+ * @var build::job
+ * The submission, owned by the coordinating worker
+ * @var build::ws
+ * Workspace holding the project files and their objects
+ * @var build::units
+ * Indices into job_t::files of the ".c" files
+ * @var build::count
+ * Number of units
+ * @var build::lock
+ * Guards the fields below
+ * @var build::idle
+ * Signalled when active drops to zero
+ * @var build::next
+ * Next unit to claim
+ * @var build::active
+ * Threads compiling a unit
+ * @var build::refs
+ * The coordinator plus every helper task not yet finished
+ * @var build::failed
+ * 0, or 1 with diagnostics in output, or -1 after another failure
+ * @var build::compiled
+ * Units compiled
+ * @var build::cached
+ * Units whose object came from the compile cache
+ * @var build::output
+ * Receives the reason the first failed unit did not compile
+ * @var build::output_size
+ * Size of output
+ */
+struct build {
+  const job_t *job;                /**< Submission */
+  const workspace_t *ws;           /**< Project directory */
+  size_t units[PROJECT_MAX_FILES]; /**< Translation units */
+  size_t count;                    /**< Units */
+  pthread_mutex_t lock;            /**< Guards what follows */
+  pthread_cond_t idle;             /**< No unit compiling */
+  size_t next;                     /**< Next unit */
+  size_t active;                   /**< Units compiling */
+  size_t refs;                     /**< References */
+  int failed;                      /**< Outcome of the failed unit */
+  size_t compiled;                 /**< Units compiled */
+  size_t cached;                   /**< Units from the cache */
+  char *output;                    /**< Diagnostics of the failure */
+  size_t output_size;              /**< Size of output */
+};
+
+/**
+ * @struct submit_size_t
+ * @brief Sizes of a SUBMIT sequence, accumulated frame by frame
+ *
+ * @var submit_size_t::source
+ * FIELD_SOURCE bytes
+ * @var submit_size_t::data
+ * FIELD_INPUT and FIELD_EXPECTED bytes
+ * @var submit_size_t::cases
+ * FIELD_CASE fields
+ * @var submit_size_t::loose
+ * Whether INPUT or EXPECTED fields came before the first FIELD_CASE
+ * @var submit_size_t::files
+ * FIELD_FILE fields
+ * @var submit_size_t::loose_source
+ * FIELD_SOURCE bytes before the first FIELD_FILE
+ * @var submit_size_t::bad_name
+ * Whether a FIELD_FILE name was not a valid project file name
+ */
+typedef struct {
+  size_t source;       /**< Source bytes */
+  size_t data;         /**< Input and expected output bytes */
+  size_t cases;        /**< Test cases */
+  int loose;           /**< Case data outside a case */
+  size_t files;        /**< Project files */
+  size_t loose_source; /**< Source outside a file */
+  int bad_name;        /**< Invalid file name */
+} submit_size_t;
+
+/**
+ * @struct server_config_t
+ * @brief Runtime configuration parsed from the command line
+ *
+ * @var server_config_t::workers
+ * Number of worker threads serving regular clients
+ * @var server_config_t::queue_capacity
+ * Maximum number of jobs of each priority class waiting for a worker
+ * @var server_config_t::pipeline_depth
+ * Jobs one connection may have queued or running before reading pauses
+ * @var server_config_t::retry_after_ms
+ * Back-off hint included in BUSY rejections
+ * @var server_config_t::cache_mb
+ * Compile cache size limit in megabytes (0 disables the cache)
+ * @var server_config_t::cache_dir
+ * Directory the compile cache is kept in across restarts and shared with
+ * other servers (NULL: a private one, deleted at exit)
+ * @var server_config_t::result_ttl
+ * Lifetime of memoized program output in seconds (0 disables memoization)
+ * @var server_config_t::log_mb
+ * Size in megabytes at which server.log is rotated (0 disables rotation)
+ * @var server_config_t::prelude_headers
+ * Comma-separated headers eligible for precompiled preludes ("" disables)
+ * @var server_config_t::metrics_port
+ * Port of the HTTP /metrics endpoint (0 disables it)
+ * @var server_config_t::executors
+ * Pre-forked executor processes that run programs (0 spawns directly)
+ * @var server_config_t::limits
+ * CPU, memory and task limits of every compiler and program run
+ * @var server_config_t::profiles
+ * Comma-separated compiler profiles clients may select, the first being
+ * the default (NULL allows every installed one, "fast" first)
+ * @var server_config_t::jit_max
+ * Largest "fast" profile source compiled in memory with libtcc (0
+ * disables it)
+ * @var server_config_t::port
+ * Port of regular clients
+ * @var server_config_t::admin_port
+ * Port of admin clients
+ * @var server_config_t::node_port
+ * Port worker nodes register on; non-zero makes this server a coordinator
+ * @var server_config_t::coordinator
+ * host[:port] of the coordinator this server works for (NULL if none)
+ * @var server_config_t::trace_file
+ * Chrome trace file every job's timeline is appended to (NULL: only
+ * jobs submitted with FRAME_FLAG_TRACE are traced)
+ * @var server_config_t::drain_s
+ * Seconds a graceful shutdown waits for queued and running jobs
+ * @var server_config_t::handover_path
+ * Unix socket the listening sockets are taken from and handed over on
+ * (NULL disables handovers)
+ */
+typedef struct {
+  size_t workers;              /**< Worker pool size */
+  size_t queue_capacity;       /**< Bounded queue length per class */
+  unsigned pipeline_depth;     /**< In-flight jobs per connection */
+  unsigned retry_after_ms;     /**< BUSY retry hint in milliseconds */
+  size_t cache_mb;             /**< Compile cache limit */
+  const char *cache_dir;       /**< Persistent compile cache */
+  unsigned result_ttl;         /**< Result cache TTL */
+  size_t log_mb;               /**< Log rotation threshold */
+  const char *prelude_headers; /**< Precompiled header set */
+  unsigned metrics_port;       /**< Prometheus endpoint port */
+  size_t executors;            /**< Executor pool size */
+  quota_limits_t limits;       /**< Per-run resource limits */
+  const char *profiles;        /**< Compiler profile whitelist */
+  size_t jit_max;              /**< In-memory compile size limit */
+  unsigned port;               /**< Regular client port */
+  unsigned admin_port;         /**< Admin client port */
+  unsigned node_port;          /**< Coordinator's node port */
+  const char *coordinator;     /**< Coordinator to join */
+  const char *trace_file;      /**< Trace output */
+  unsigned drain_s;            /**< Drain deadline */
+  const char *handover_path;   /**< Handover socket */
+} server_config_t;
+
+/** @brief Active server configuration */
+server_config_t config;
+
+/** @brief Global flag to control server running state */
+int server_running = 1;
+
+/** @brief Worker pool that executes regular client jobs */
+worker_pool_t *job_pool = NULL;
+
+/** @brief Event loop serving every client socket */
+reactor_t *reactor = NULL;
+
+/**
+ * @struct drain_state_t
+ * @brief Progress of a graceful shutdown
+ *
+ * @var drain_state_t::lock
+ * Serialises the starts of a drain (admin, signal and handover threads)
+ * @var drain_state_t::draining
+ * Set once no new connection or submission is taken (atomic)
+ * @var drain_state_t::started_us
+ * stats_now_us() time the drain started
+ * @var drain_state_t::deadline_us
+ * stats_now_us() time unfinished jobs are abandoned
+ * @var drain_state_t::thread
+ * Waits for the jobs, then stops the reactor
+ * @var drain_state_t::started
+ * Whether thread was created
+ */
+typedef struct {
+  pthread_mutex_t lock; /**< Guards the start */
+  int draining;         /**< Drain in progress */
+  uint64_t started_us;  /**< Start */
+  uint64_t deadline_us; /**< Deadline */
+  pthread_t thread;     /**< Drain thread */
+  int started;          /**< Thread created */
+} drain_state_t;
+
+/** @brief Graceful shutdown state */
+drain_state_t drain = {PTHREAD_MUTEX_INITIALIZER, 0, 0, 0, 0, 0};
+
+/**
+ * @struct handover_state_t
+ * @brief Listening sockets taken from a predecessor and the socket a
+ * successor takes them from (see handover.h)
+ *
+ * @var handover_state_t::inherited
+ * Sockets received at startup; entries are set to -1 once adopted
+ * @var handover_state_t::inherited_count
+ * Entries of inherited
+ * @var handover_state_t::fd
+ * Handover socket a successor connects to (-1 if none)
+ * @var handover_state_t::dev
+ * Device of the socket file bound, so that it is removed at exit only if
+ * no successor replaced it
+ * @var handover_state_t::ino
+ * Inode of the socket file bound
+ * @var handover_state_t::thread
+ * Waits for a successor
+ * @var handover_state_t::started
+ * Whether thread was created
+ */
+typedef struct {
+  reactor_listener_t inherited[HANDOVER_MAX]; /**< Received sockets */
+  size_t inherited_count;                     /**< Received count */
+  int fd;                                     /**< Handover socket */
+  dev_t dev;                                  /**< Socket file device */
+  ino_t ino;                                  /**< Socket file inode */
+  pthread_t thread;                           /**< Handover thread */
+  int started;                                /**< Thread created */
+} handover_state_t;
+
+/** @brief Socket handover state */
+handover_state_t handover = {{{-1, CONN_REGULAR}}, 0, -1, 0, 0, 0, 0};
+
+/**
+ * @struct tenant_weight_t
+ * @brief Fair queuing share of one client address, set with WEIGHT
+ *
+ * @var tenant_weight_t::addr
+ * IPv4 address, host byte order
+ * @var tenant_weight_t::weight
+ * Jobs started per round in its class (every other client has 1)
+ */
+typedef struct {
+  uint32_t addr;   /**< Client address */
+  unsigned weight; /**< Share */
+} tenant_weight_t;
+
+/** @brief Weighted clients (reactor thread only) */
+tenant_weight_t tenant_weights[MAX_TENANT_WEIGHTS];
+
+/** @brief Entries in use in tenant_weights */
+size_t tenant_weight_count = 0;
+
+/** @brief How config.limits are enforced */
+quota_mode_t quota_mode = QUOTA_OFF;
+
+/**
+ * @brief Compiler profiles the server knows; the whitelist of
+ * FIELD_PROFILE values
+ */
+profile_t profiles[] = {
+    {"fast", COMPILER, "--version", COMPILER_FLAGS, 1, 0, ""},
+    {"O2", "gcc", "--version", "-O2", 0, 0, ""},
+    {"native", "gcc", "--version", "-O3 -march=native", 0, 0, ""},
+    {"clang", "clang", "--version", "-O2", 0, 0, ""},
+    {"tcc", "tcc", "-v", "", 0, 0, ""},
+};
+
+/** @brief Profile of submissions that do not select one */
+const profile_t *default_profile = &profiles[0];
+
+/**
+ * @brief Log activities to server log file
+ *
+ * This function queues a timestamped log message for server.log. The
+ * line is copied into the logger's memory buffer and written to disk in
+ * a batch by the logger thread, so callers never wait for file I/O.
+ *
+ * @param message The message to log
+ *
+ * @note The function is thread-safe; lines from different threads are
+ * never interleaved.
+ *
+ * @warning If the logger falls far behind, the message is dropped and
+ * counted (see STATUS).
+ */
+void log_activity(const char *message) {
+  logger_write(message);
+}
+
+/**
+ * @brief Log a problem the server recovered from, at level WARN
+ *
+ * @param message The message to log
+ */
+static void log_warning(const char *message) {
+  logger_log(LOG_LEVEL_WARN, message);
+}
+
+/**
+ * @brief Log a failure of the server itself, at level ERROR
+ *
+ * @param message The message to log
+ */
+static void log_error(const char *message) {
+  logger_log(LOG_LEVEL_ERROR, message);
+}
+
+/** @brief Parent directory of job workspaces, chosen once at first use */
+static const char *workspace_root_dir = "/tmp";
+
+/** @brief Guards the one-time selection of workspace_root_dir */
+static pthread_once_t workspace_root_once = PTHREAD_ONCE_INIT;
+
+/**
+ * @brief Check whether a directory can host job workspaces
+ *
+ * @param path Candidate directory
+ * @return 1 if the directory is writable and allows executing files, else 0
+ */
+static int workspace_root_usable(const char *path) {
+  struct statvfs fs;
+
+  if (!path || !*path || access(path, W_OK | X_OK) != 0) {
+    return 0;
+  }
+  if (statvfs(path, &fs) != 0 || (fs.f_flag & ST_NOEXEC)) {
+    return 0;
+  }
+  return 1;
+}
+
+/**
+ * @brief Pick the parent directory for job workspaces
+ *
+ * Prefers /dev/shm so that sources and executables never touch the disk.
+ * Falls back to $TMPDIR and finally /tmp if /dev/shm is missing, not
+ * writable or mounted noexec (the compiled program must be runnable).
+ */
+static void workspace_pick_root(void) {
+  const char *candidates[3];
+  size_t i;
+
+  candidates[0] = "/dev/shm";
+  candidates[1] = getenv("TMPDIR");
+  candidates[2] = "/tmp";
+
+  for (i = 0; i < sizeof(candidates) / sizeof(candidates[0]); i++) {
+    if (workspace_root_usable(candidates[i])) {
+      workspace_root_dir = candidates[i];
+      return;
+    }
+  }
+}
+
+/**
+ * @brief Create a private directory under the workspace root
+ *
+ * @param path Receives the directory path
+ * @param size Size of path
+ * @param name_template mkdtemp() template for the directory name
+ *
+ * @return 0 on success, -1 on failure
+ */
+static int workspace_mkdtemp(char *path, size_t size,
+                             const char *name_template) {
+  pthread_once(&workspace_root_once, workspace_pick_root);
+
+  snprintf(path, size, "%s/%s", workspace_root_dir, name_template);
+  return mkdtemp(path) ? 0 : -1;
+}
+
+/**
+ * @brief Create a fresh, uniquely named workspace for one job
+ *
+ * @param ws Workspace descriptor to fill in
+ * @return 0 on success, -1 if the directory could not be created
+ *
+ * @note The directory is created with mode 0700 by mkdtemp(), so
+ * concurrent jobs can never see or overwrite each other's files.
+ */
+static int workspace_create(workspace_t *ws) {
+  if (workspace_mkdtemp(ws->dir, sizeof(ws->dir), WORKSPACE_TEMPLATE) != 0) {
+    return -1;
+  }
+
+  snprintf(ws->source, sizeof(ws->source), "%s/code.c", ws->dir);
+  snprintf(ws->program, sizeof(ws->program), "%s/program", ws->dir);
+  return 0;
+}
+
+/**
+ * @brief nftw() callback removing one entry of a job directory
+ *
+ * @param path Entry to remove
+ * @param info Unused
+ * @param type Unused
+ * @param ftw Unused
+ *
+ * @return 0, so that the walk goes on past entries that cannot be removed
+ */
+static int remove_entry(const char *path, const struct stat *info, int type,
+                        struct FTW *ftw) {
+  (void)info;
+  (void)type;
+  (void)ftw;
+  remove(path);
+  return 0;
+}
+
+/**
+ * @brief Remove a job directory and everything inside it
+ *
+ * @param path Directory to remove
+ *
+ * @details Programs run with the directory as their working directory and
+ * may create subdirectories in it, so the tree is walked depth first
+ * (contents before their directory) without following symbolic links.
+ */
+static void remove_directory(const char *path) {
+  nftw(path, remove_entry, REMOVE_OPEN_FDS, FTW_DEPTH | FTW_PHYS);
+}
+
+/**
+ * @brief Remove a workspace and everything the job left inside it
+ *
+ * @param ws Workspace previously set up by workspace_create()
+ */
+static void workspace_destroy(const workspace_t *ws) {
+  remove_directory(ws->dir);
+}
+
+/**
+ * @brief Send one frame (header and payload) without interleaving
+ *
+ * Workers wait for a slow reader; on the reactor thread (protocol errors,
+ * BUSY and profile rejections, admin replies) the frame is queued instead,
+ * see conn_postv().
+ *
+ * @param conn Destination connection
+ * @param type frame_type_t
+ * @param flags FRAME_FLAG_*
+ * @param job_id Request identifier to echo
+ * @param payload Payload bytes
+ * @param len Payload size (at most FRAME_MAX_PAYLOAD)
+ *
+ * @return 0 on success, -1 if the client is gone
+ */
+static int send_frame(connection_t *conn, uint8_t type, uint16_t flags,
+                      uint32_t job_id, const void *payload, size_t len) {
+  uint8_t header[FRAME_HEADER_SIZE];
+  struct iovec iov[2];
+
+  frame_encode_header(header, type, flags, job_id, (uint32_t)len);
+  iov[0].iov_base = header;
+  iov[0].iov_len = sizeof(header);
+  iov[1].iov_base = (void *)payload;
+  iov[1].iov_len = len;
+  return conn_postv(conn, iov, 2);
+}
+
+/**
+ * @brief Send job output as a sequence of OUTPUT frames
+ *
+ * @param conn Destination connection
+ * @param job_id Request identifier to echo
+ * @param data Output bytes
+ * @param len Output size (may be 0: nothing is sent)
+ *
+ * @return 0 on success, -1 if the client is gone
+ */
+static int send_output(connection_t *conn, uint32_t job_id, const char *data,
+                       size_t len) {
+  while (len > 0) {
+    size_t chunk = len < FRAME_MAX_PAYLOAD ? len : FRAME_MAX_PAYLOAD;
+    if (send_frame(conn, FRAME_OUTPUT, 0, job_id, data, chunk) != 0) {
+      return -1;
+    }
+    data += chunk;
+    len -= chunk;
+  }
+  return 0;
+}
+
+/**
+ * @brief Send part of an admin reply as REPLY frames
+ *
+ * @param conn Destination connection
+ * @param job_id Request identifier to echo
+ * @param data Reply text
+ * @param len Reply size
+ * @param more Nonzero if more of the reply follows, so that the last frame
+ * also carries FRAME_FLAG_MORE
+ * @return 0 on success, -1 if the connection failed
+ */
+static int send_reply_part(connection_t *conn, uint32_t job_id,
+                           const char *data, size_t len, int more) {
+  do {
+    size_t chunk = len < FRAME_MAX_PAYLOAD ? len : FRAME_MAX_PAYLOAD;
+    uint16_t flags = chunk < len || more ? FRAME_FLAG_MORE : 0;
+    if (send_frame(conn, FRAME_REPLY, flags, job_id, data, chunk) != 0) {
+      return -1;
+    }
+    data += chunk;
+    len -= chunk;
+  } while (len > 0);
+  return 0;
+}
+
+/**
+ * @brief Send an admin reply as REPLY frames (FRAME_FLAG_MORE on all but
+ * the last)
+ *
+ * @param conn Destination connection
+ * @param job_id Request identifier to echo
+ * @param data Reply text
+ * @param len Reply size
+ */
+static void send_reply(connection_t *conn, uint32_t job_id, const char *data,
+                       size_t len) {
+  send_reply_part(conn, job_id, data, len, 0);
+}
+
+/**
+ * @brief Send part of the activity log as REPLY frames
+ *
+ * The bytes go from the page cache to the socket with sendfile(), so a
+ * log of any size is sent without being read into the server. Lines
+ * written while it is being sent are not included.
+ *
+ * @param conn Destination connection
+ * @param job_id Request identifier to echo
+ * @param start First byte to send; negative counts back from the end
+ */
+static void send_log(connection_t *conn, uint32_t job_id, long long start) {
+  uint8_t header[FRAME_HEADER_SIZE];
+  struct stat info;
+  off_t offset;
+  size_t len;
+  int fd;
+
+  logger_flush();
+  fd = open(LOG_FILE, O_RDONLY | O_CLOEXEC);
+  if (fd < 0 || fstat(fd, &info) != 0) {
+    const char *missing = "No logs available\n";
+
+    send_reply(conn, job_id, missing, strlen(missing));
+    if (fd >= 0) {
+      close(fd);
+    }
+    return;
+  }
+
+  if (start < 0) {
+    offset = -start < info.st_size ? info.st_size + start : 0;
+  } else {
+    offset = start < info.st_size ? start : info.st_size;
+  }
+  len = (size_t)(info.st_size - offset);
+  do {
+    size_t chunk = len < FRAME_MAX_PAYLOAD ? len : FRAME_MAX_PAYLOAD;
+    uint16_t flags = chunk < len ? FRAME_FLAG_MORE : 0;
+
+    frame_encode_header(header, FRAME_REPLY, flags, job_id, (uint32_t)chunk);
+    if (conn_sendfd(conn, header, sizeof(header), fd, &offset, chunk) != 0) {
+      break;
+    }
+    stats_add(STAT_SENDFILE_BYTES, chunk);
+    len -= chunk;
+  } while (len > 0);
+  close(fd);
+}
+
+/** @def MAX_LOG_FOLLOWERS
+ * @brief Admin connections that may follow the log at once
+ */
+#define MAX_LOG_FOLLOWERS 8
+
+/** @def LOG_FOLLOW_HELD_MAX
+ * @brief New log bytes held for a follower while its catch-up is sent
+ */
+#define LOG_FOLLOW_HELD_MAX (1024 * 1024)
+
+/**
+ * @struct log_reply_t
+ * @brief Matching log lines collected into REPLY frames
+ */
+typedef struct {
+  connection_t *conn;              /**< Destination connection */
+  uint32_t job_id;                 /**< Request identifier to echo */
+  size_t used;                     /**< Bytes in data */
+  int failed;                      /**< A send failed */
+  int (*send)(connection_t *, struct iovec *, int); /**< Frame writer */
+  char data[FRAME_MAX_PAYLOAD];    /**< Frame payload being filled */
+} log_reply_t;
+
+/**
+ * @struct log_follower_t
+ * @brief An admin connection that is sent new log lines as they are written
+ */
+typedef struct {
+  connection_t *conn;   /**< Follower, retained */
+  uint32_t job_id;      /**< Identifier of its FOLLOW request */
+  log_filter_t filter;  /**< Lines it wants */
+  int catching_up;      /**< Lines already written are still being sent */
+  char *held;           /**< Batches written meanwhile, unfiltered */
+  size_t held_len;      /**< Bytes in held */
+  uint64_t held_offset; /**< File offset of the first held byte */
+  int held_rotated;     /**< The log rotated while batches were held */
+  int held_lost;        /**< held outgrew LOG_FOLLOW_HELD_MAX */
+} log_follower_t;
+
+/** @brief Connections following the log */
+static log_follower_t log_followers[MAX_LOG_FOLLOWERS];
+
+/** @brief Number of entries in log_followers */
+static size_t log_follower_count = 0;
+
+/** @brief Guards log_followers against the logger thread */
+static pthread_mutex_t log_follow_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/** @brief Lines for a follower, filled on the logger thread only */
+static log_reply_t log_follow_reply;
+
+/**
+ * @brief Send the collected lines as one REPLY frame
+ *
+ * @param reply Collected lines
+ * @param flags Frame flags (FRAME_FLAG_MORE unless it is the last frame)
+ */
+static void log_reply_flush(log_reply_t *reply, uint16_t flags) {
+  uint8_t header[FRAME_HEADER_SIZE];
+  struct iovec iov[2];
+
+  if (!reply->failed) {
+    frame_encode_header(header, FRAME_REPLY, flags, reply->job_id,
+                        (uint32_t)reply->used);
+    iov[0].iov_base = header;
+    iov[0].iov_len = sizeof(header);
+    iov[1].iov_base = reply->data;
+    iov[1].iov_len = reply->used;
+    if (reply->send(reply->conn, iov, 2) != 0) {
+      reply->failed = 1;
+    }
+  }
+  reply->used = 0;
+}
+
+/**
+ * @brief log_line_fn() adding a line to a log_reply_t
+ *
+ * @param context The log_reply_t
+ * @param line Matching line
+ * @param len Its length
+ *
+ * @return 0 to go on, -1 once the connection failed
+ */
+static int log_reply_line(void *context, const char *line, size_t len) {
+  log_reply_t *reply = context;
+
+  if (reply->used + len > sizeof(reply->data)) {
+    log_reply_flush(reply, FRAME_FLAG_MORE);
+  }
+  len = len < sizeof(reply->data) ? len : sizeof(reply->data);
+  memcpy(reply->data + reply->used, line, len);
+  reply->used += len;
+  return reply->failed ? -1 : 0;
+}
+
+/**
+ * @brief Stop sending new log lines to a connection
+ *
+ * @param conn Admin connection
+ * @param job_id Receives the identifier of its FOLLOW request, or NULL
+ *
+ * @return 0 if it was following the log, -1 otherwise
+ */
+static int log_unfollow(connection_t *conn, uint32_t *job_id) {
+  int found = -1;
+
+  pthread_mutex_lock(&log_follow_lock);
+  for (size_t i = 0; i < log_follower_count; i++) {
+    if (log_followers[i].conn == conn) {
+      if (job_id) {
+        *job_id = log_followers[i].job_id;
+      }
+      conn_release(conn);
+      free(log_followers[i].held);
+      log_followers[i] = log_followers[--log_follower_count];
+      found = 0;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&log_follow_lock);
+  return found;
+}
+
+/**
+ * @brief Whether a connection follows the log
+ *
+ * @param conn Admin connection
+ * @return 1 if it does, 0 otherwise
+ */
+static int log_following(connection_t *conn) {
+  int found = 0;
+
+  pthread_mutex_lock(&log_follow_lock);
+  for (size_t i = 0; i < log_follower_count; i++) {
+    if (log_followers[i].conn == conn) {
+      found = 1;
+    }
+  }
+  pthread_mutex_unlock(&log_follow_lock);
+  return found;
+}
+
+/**
+ * @brief Add the lines of a batch that a follower wants to a reply
+ *
+ * @param reply Reply to the follower
+ * @param filter Lines it wants
+ * @param batch Whole lines
+ * @param len Length of batch
+ */
+static void log_follow_lines(log_reply_t *reply, const log_filter_t *filter,
+                             const char *batch, size_t len) {
+  const char *line = batch;
+  const char *end = batch + len;
+
+  while (line < end && !reply->failed) {
+    const char *newline = memchr(line, '\n', (size_t)(end - line));
+    size_t line_len =
+        newline ? (size_t)(newline - line) + 1 : (size_t)(end - line);
+
+    if (log_filter_match(filter, line, line_len)) {
+      log_reply_line(reply, line, line_len);
+    }
+    line += line_len;
+  }
+}
+
+/**
+ * @brief Keep a batch for a follower whose catch-up is still being sent
+ * (log_follow_lock held)
+ *
+ * @param follower Follower catching up
+ * @param batch Newly written lines
+ * @param len Length of batch
+ * @param offset File offset of batch
+ */
+static void log_follow_hold(log_follower_t *follower, const char *batch,
+                            size_t len, uint64_t offset) {
+  char *grown;
+
+  if (follower->held_lost) {
+    return;
+  }
+  if (follower->held_len == 0) {
+    follower->held_offset = offset;
+  } else if (offset != follower->held_offset + follower->held_len) {
+    follower->held_rotated = 1;
+  }
+  grown = follower->held_len + len <= LOG_FOLLOW_HELD_MAX
+              ? realloc(follower->held, follower->held_len + len)
+              : NULL;
+  if (!grown) {
+    free(follower->held);
+    follower->held = NULL;
+    follower->held_len = 0;
+    follower->held_lost = 1;
+    return;
+  }
+  memcpy(grown + follower->held_len, batch, len);
+  follower->held = grown;
+  follower->held_len += len;
+}
+
+/**
+ * @brief Pass new log lines on to the followers (logger thread)
+ *
+ * Installed with logger_set_tap(), so it sees every batch just after it
+ * was written. Followers still being sent their catch-up get the batch
+ * held for them instead. The others are sent to outside log_follow_lock
+ * and without waiting: one whose socket buffer is full is disconnected
+ * and dropped, so that a stalled admin client cannot hold up the logger
+ * (and with it every server thread that logs).
+ *
+ * @param batch Newly written lines
+ * @param len Length of batch
+ * @param offset File offset of batch
+ */
+static void log_follow_tap(const char *batch, size_t len, uint64_t offset) {
+  log_follower_t followers[MAX_LOG_FOLLOWERS];
+  size_t count = 0;
+
+  pthread_mutex_lock(&log_follow_lock);
+  for (size_t i = 0; i < log_follower_count; i++) {
+    if (log_followers[i].catching_up) {
+      log_follow_hold(&log_followers[i], batch, len, offset);
+    } else {
+      followers[count] = log_followers[i];
+      conn_retain(followers[count++].conn);
+    }
+  }
+  pthread_mutex_unlock(&log_follow_lock);
+
+  for (size_t i = 0; i < count; i++) {
+    log_follower_t *follower = &followers[i];
+    log_reply_t *reply = &log_follow_reply;
+
+    reply->conn = follower->conn;
+    reply->job_id = follower->job_id;
+    reply->send = conn_trysendv;
+    reply->used = 0;
+    reply->failed = 0;
+    log_follow_lines(reply, &follower->filter, batch, len);
+    if (reply->used > 0) {
+      log_reply_flush(reply, FRAME_FLAG_MORE);
+    }
+    if (reply->failed) {
+      log_unfollow(follower->conn, NULL);
+    }
+    conn_release(follower->conn);
+  }
+}
+
+/**
+ * @brief End a follower's catch-up: send the lines held for it that the
+ * catch-up did not include, and hand it over to log_follow_tap()
+ *
+ * The held lines are sent under log_follow_lock, so that none of the
+ * tap's can overtake them, and without waiting, as the tap sends.
+ *
+ * @param reply Reply to the follower, empty
+ * @param searched File offset the catch-up query ended at
+ *
+ * @return 0 if the connection follows the log, -1 if it was dropped
+ */
+static int log_follow_caught_up(log_reply_t *reply, uint64_t searched) {
+  log_follower_t *follower = NULL;
+  int lost = 0;
+
+  reply->send = conn_trysendv;
+  pthread_mutex_lock(&log_follow_lock);
+  for (size_t i = 0; i < log_follower_count; i++) {
+    if (log_followers[i].conn == reply->conn) {
+      follower = &log_followers[i];
+    }
+  }
+  if (!follower) {
+    pthread_mutex_unlock(&log_follow_lock);
+    return -1;
+  }
+  lost = follower->held_lost;
+  if (follower->held_len > 0) {
+    const char *batch = follower->held;
+    size_t len = follower->held_len;
+    // What the query saw was sent already; after a rotation it may have
+    // searched either file, so repeat rather than lose lines
+    if (!follower->held_rotated && searched > follower->held_offset) {
+      size_t seen = searched - follower->held_offset;
+
+      seen = seen < len ? seen : len;
+      batch += seen;
+      len -= seen;
+    }
+    log_follow_lines(reply, &follower->filter, batch, len);
+    if (reply->used > 0) {
+      log_reply_flush(reply, FRAME_FLAG_MORE);
+    }
+  }
+  free(follower->held);
+  follower->held = NULL;
+  follower->held_len = 0;
+  follower->catching_up = 0;
+  pthread_mutex_unlock(&log_follow_lock);
+
+  if (reply->failed || lost) {
+    log_unfollow(reply->conn, NULL);
+    if (lost && !reply->failed) {
+      const char *refusal = "The log grew faster than it was read; FOLLOW "
+                            "stopped\n";
+
+      send_reply(reply->conn, reply->job_id, refusal, strlen(refusal));
+    }
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ * @brief Drop every follower, at shutdown
+ */
+static void log_unfollow_all(void) {
+  logger_set_tap(NULL);
+  pthread_mutex_lock(&log_follow_lock);
+  while (log_follower_count > 0) {
+    log_follower_count--;
+    conn_release(log_followers[log_follower_count].conn);
+    free(log_followers[log_follower_count].held);
+  }
+  pthread_mutex_unlock(&log_follow_lock);
+}
+
+/**
+ * @brief Answer a LOGS command other than STOP (worker)
+ *
+ * Without arguments or with a byte offset the log is sent as is by
+ * send_log(). Otherwise the arguments are a filter for log_query(), which
+ * finds the lines without reading the whole file. With FOLLOW the matching
+ * lines already written are sent, then every new matching line, until
+ * "LOGS STOP"; all those frames carry FRAME_FLAG_MORE.
+ *
+ * @param conn Admin connection, not following the log
+ * @param job_id Request identifier to echo
+ * @param args Text after "LOGS"
+ */
+static void send_log_query(connection_t *conn, uint32_t job_id,
+                           const char *args) {
+  log_reply_t *reply;
+  char error[160];
+  log_filter_t filter;
+  uint64_t searched = 0;
+  long matched;
+  int catch_up;
+  int added = 0;
+
+  args += strspn(args, " ");
+  if (*args == '\0' || strspn(args, "-0123456789") == strlen(args)) {
+    send_log(conn, job_id, strtoll(args, NULL, 10));
+    return;
+  }
+  if (log_filter_parse(args, &filter, error, sizeof(error)) != 0) {
+    send_reply(conn, job_id, error, strlen(error));
+    return;
+  }
+  // A plain FOLLOW starts with new lines only
+  catch_up = !filter.follow || filter.tail > 0 || filter.since > 0;
+
+  reply = malloc(sizeof(*reply));
+  if (!reply) {
+    const char *failure = "Out of memory\n";
+
+    send_reply(conn, job_id, failure, strlen(failure));
+    return;
+  }
+  reply->conn = conn;
+  reply->job_id = job_id;
+  reply->send = conn_sendv;
+  reply->used = 0;
+  reply->failed = 0;
+
+  // Follow before the catch-up query, so that no line written meanwhile
+  // falls between the two; log_follow_caught_up() drops the repeats
+  if (filter.follow) {
+    conn_retain(conn);
+    pthread_mutex_lock(&log_follow_lock);
+    added = log_follower_count < MAX_LOG_FOLLOWERS;
+    if (added) {
+      log_follower_t *follower = &log_followers[log_follower_count++];
+
+      memset(follower, 0, sizeof(*follower));
+      follower->conn = conn;
+      follower->job_id = job_id;
+      follower->filter = filter;
+      follower->catching_up = catch_up;
+    }
+    pthread_mutex_unlock(&log_follow_lock);
+    if (!added) {
+      const char *refusal = "Too many connections following the log\n";
+
+      conn_release(conn);
+      free(reply);
+      send_reply(conn, job_id, refusal, strlen(refusal));
+      return;
+    }
+    logger_set_tap(log_follow_tap);
+  }
+
+  matched = 0;
+  if (catch_up) {
+    logger_flush();
+    matched = log_query(LOG_FILE, &filter, log_reply_line, reply, &searched);
+  }
+
+  if (!filter.follow) {
+    if (matched < 0) {
+      log_reply_line(reply, "No logs available\n", 18);
+    } else if (matched == 0) {
+      log_reply_line(reply, "No matching log lines\n", 22);
+    }
+    log_reply_flush(reply, 0);
+    free(reply);
+    return;
+  }
+  if (catch_up) {
+    if (reply->used > 0) {
+      log_reply_flush(reply, FRAME_FLAG_MORE);
+    }
+    if (reply->failed) {
+      log_unfollow(conn, NULL);
+    } else {
+      // A file that cannot be read was searched up to its start
+      log_follow_caught_up(reply, matched < 0 ? 0 : searched);
+    }
+  }
+  free(reply);
+}
+
+/**
+ * @brief Answer a LOGS command on a worker (worker pool task)
+ *
+ * Reading the file and sending it may wait on a slow admin client for as
+ * long as a job reply would. Reading the connection resumes once it is
+ * done.
+ *
+ * @param job LOGS task queued by queue_logs()
+ */
+static void serve_logs(job_t *job) {
+  send_log_query(job->conn, job->job_id, job->logs);
+  conn_resume(job->conn);
+  conn_release(job->conn);
+  free(job->logs);
+  free(job);
+}
+
+/**
+ * @brief Hand a LOGS command to the worker pool
+ *
+ * The connection is paused until serve_logs() is done, so the commands
+ * after it are answered after it.
+ *
+ * @param conn Admin connection (reactor thread)
+ * @param job_id Request identifier to echo
+ * @param args Text after "LOGS"
+ */
+static void queue_logs(connection_t *conn, uint32_t job_id, const char *args) {
+  const char *busy = "Server busy, try LOGS again\n";
+  job_t *job = calloc(1, sizeof(*job));
+
+  if (job) {
+    job->logs = strdup(args);
+  }
+  if (!job || !job->logs) {
+    free(job);
+    send_reply(conn, job_id, busy, strlen(busy));
+    return;
+  }
+  job->conn = conn;
+  job->job_id = job_id;
+  conn_retain(conn);
+  if (worker_pool_submit(job_pool, job, WORKER_CLASS_INTERACTIVE,
+                         conn->peer_addr, 1) != 0) {
+    conn_release(conn);
+    free(job->logs);
+    free(job);
+    send_reply(conn, job_id, busy, strlen(busy));
+    return;
+  }
+  conn_pause(conn);
+}
+
+/**
+ * @brief Answer a LOGS command (reactor thread)
+ *
+ * "LOGS STOP" is answered here; every other form goes to a worker, see
+ * send_log_query(). A following connection must stop first, so that only
+ * the logger thread writes to it.
+ *
+ * @param conn Admin connection
+ * @param job_id Request identifier to echo
+ * @param args Text after "LOGS"
+ */
+static void logs_command(connection_t *conn, uint32_t job_id,
+                         const char *args) {
+  uint32_t follow_id;
+
+  args += strspn(args, " ");
+  if (strcasecmp(args, "STOP") == 0) {
+    const char *stopped = "Stopped following the log\n";
+    const char *idle = "Not following the log\n";
+
+    if (log_unfollow(conn, &follow_id) == 0) {
+      send_reply(conn, follow_id, stopped, strlen(stopped));
+    } else {
+      send_reply(conn, job_id, idle, strlen(idle));
+    }
+    return;
+  }
+  if (log_following(conn)) {
+    const char *refusal = "Already following the log; send LOGS STOP first\n";
+
+    send_reply(conn, job_id, refusal, strlen(refusal));
+    return;
+  }
+  queue_logs(conn, job_id, args);
+}
+
+/**
+ * @brief Run the compiler of a profile on an executor
+ *
+ * The compiler runs from inside dir, so diagnostics name the job's files
+ * rather than a per-job path and can be served from the cache verbatim,
+ * under the same per-run limits as programs.
+ *
+ * @param profile Compiler and flags to use
+ * @param dir Working directory
+ * @param args Arguments after the profile's flags (files, -o, ...)
+ * @param arg_count Number of args (at most PROJECT_MAX_FILES + 4)
+ * @param output Receives an error message or the compiler diagnostics
+ * @param output_size Size of the output buffer
+ *
+ * @return 0 on success, 1 if the compiler rejected the source (output
+ *         holds its diagnostics, which may be cached), -1 on any other
+ *         failure
+ */
+static int run_compiler(const profile_t *profile, const char *dir,
+                        const char *const *args, size_t arg_count,
+                        char *output, size_t output_size) {
+  char flags[PROFILE_FLAGS_MAX];
+  char *argv[MAX_COMPILE_ARGS + PROJECT_MAX_FILES];
+  size_t argc = 0;
+  process_spec_t spec;
+  process_result_t result;
+  char *flag;
+  char *saved;
+
+  argv[argc++] = (char *)profile->compiler;
+  snprintf(flags, sizeof(flags), "%s", profile->flags);
+  for (flag = strtok_r(flags, " ", &saved); flag && argc < MAX_COMPILE_ARGS - 6;
+       flag = strtok_r(NULL, " ", &saved)) {
+    argv[argc++] = flag;
+  }
+  for (size_t i = 0; i < arg_count; i++) {
+    argv[argc++] = (char *)args[i];
+  }
+  argv[argc] = NULL;
+
+  memset(&spec, 0, sizeof(spec));
+  spec.argv = argv;
+  spec.search_path = 1;
+  spec.cwd = dir;
+  spec.timeout_ms = COMPILE_TIMEOUT_MS;
+  spec.output = output;
+  spec.output_size = output_size;
+
+  if (executor_run(&spec, &result) != 0) {
+    snprintf(output, output_size, "ERROR: Cannot start compiler: %s\n",
+             strerror(errno));
+    stats_add(STAT_SPAWN_FAILED, 1);
+    log_error("Compiler could not be started");
+    return -1;
+  }
+  stats_add(STAT_COMPILE_CPU_US, result.cpu_us);
+
+  if (!result.timed_out && WIFEXITED(result.status) &&
+      WEXITSTATUS(result.status) == 0) {
+    return 0;
+  }
+  log_activity("Compilation failed");
+  // Only diagnostics are worth caching, not limit hits
+  if (result.timed_out) {
+    snprintf(output, output_size, "ERROR: Compilation timed out\n");
+  } else if (result.memory_killed) {
+    stats_add(STAT_MEMORY_KILLED, 1);
+    snprintf(output, output_size,
+             "ERROR: Compiler exceeded the memory limit (%zu MB)\n",
+             config.limits.memory_bytes / (1024 * 1024));
+  } else if (result.output_len == 0) {
+    snprintf(output, output_size, "ERROR: Compilation failed\n");
+  } else {
+    return 1;
+  }
+  return -1;
+}
+
+/**
+ * @brief Compile a submission inside its workspace
+ *
+ * Writes the source to the workspace, runs the compiler and records the
+ * outcome (executable or diagnostics) in the compile cache. A submission
+ * that starts with eligible standard includes is compiled against the
+ * matching precompiled prelude.
+ *
+ * @param ws Job workspace
+ * @param profile Compiler and flags to use
+ * @param code Null-terminated C source code
+ * @param cache_key Compile cache key of this submission
+ * @param output Receives an error message or the compiler diagnostics
+ * @param output_size Size of the output buffer
+ *
+ * @return 0 if ws->program was produced, -1 otherwise
+ */
+static int compile_source(const workspace_t *ws, const profile_t *profile,
+                          const char *code,
+                          const uint8_t cache_key[SHA256_DIGEST_SIZE],
+                          char *output, size_t output_size) {
+  char prelude[PATH_MAX];
+  const char *args[5];
+  size_t argc = 0;
+  int rc;
+
+  // Write code to the job's source file
+  FILE *temp_file = fopen(ws->source, "w");
+  if (!temp_file) {
+    snprintf(output, output_size, "ERROR: Cannot create temporary file\n");
+    return -1;
+  }
+  fprintf(temp_file, "%s", code);
+  fclose(temp_file);
+
+  if (profile->prelude && prelude_lookup(code, prelude, sizeof(prelude))) {
+    args[argc++] = "-include";
+    args[argc++] = prelude;
+  }
+  args[argc++] = "code.c";
+  args[argc++] = "-o";
+  args[argc++] = "program";
+
+  rc = run_compiler(profile, ws->dir, args, argc, output, output_size);
+  if (rc != 0) {
+    if (rc > 0) {
+      compile_cache_store_failure(cache_key, output);
+    }
+    return -1;
+  }
+  compile_cache_store_binary(cache_key, ws->program);
+  return 0;
+}
+
+/**
+ * @brief Drop a reference to a build, freeing it with the last one
+ *
+ * @param build Build to release
+ */
+static void build_release(build_t *build) {
+  size_t refs;
+
+  pthread_mutex_lock(&build->lock);
+  refs = --build->refs;
+  pthread_mutex_unlock(&build->lock);
+  if (refs == 0) {
+    pthread_cond_destroy(&build->idle);
+    pthread_mutex_destroy(&build->lock);
+    free(build);
+  }
+}
+
+/**
+ * @brief Compile one translation unit of a project into its object file
+ *
+ * The object ("name.o" next to "name.c") is taken from the compile cache
+ * when the unit and the headers it includes are unchanged.
+ *
+ * @param build Running build
+ * @param unit Index of the unit in the job's files
+ * @param output Receives the diagnostics on failure
+ * @param output_size Size of output
+ *
+ * @return 0 on success, 1 if it did not compile, -1 on any other failure
+ */
+static int build_unit(build_t *build, size_t unit, char *output,
+                      size_t output_size) {
+  const job_t *job = build->job;
+  const project_file_t *file = &job->files[unit];
+  uint64_t started_us = stats_now_us();
+  uint8_t key[SHA256_DIGEST_SIZE];
+  char object[PROJECT_NAME_MAX];
+  char path[PATH_MAX];
+  char span[TRACE_NAME_MAX];
+  const char *args[4];
+  int rc;
+
+  snprintf(object, sizeof(object), "%s", file->name);
+  object[strlen(object) - 1] = 'o';
+  snprintf(path, sizeof(path), "%s/%s", build->ws->dir, object);
+  project_unit_key(job->profile->toolchain, job->profile->flags, job->code,
+                   job->files, job->file_count, unit, key);
+
+  switch (compile_cache_lookup(key, path, output, output_size)) {
+  case CACHE_HIT_BINARY:
+    snprintf(span, sizeof(span), "cached %s", file->name);
+    trace_span(job->trace, span, started_us, stats_now_us());
+    stats_add(STAT_UNITS_CACHED, 1);
+    pthread_mutex_lock(&build->lock);
+    build->cached++;
+    pthread_mutex_unlock(&build->lock);
+    return 0;
+  case CACHE_HIT_FAILED:
+    snprintf(span, sizeof(span), "cached failure %s", file->name);
+    trace_span(job->trace, span, started_us, stats_now_us());
+    return 1;
+  case CACHE_MISS:
+    break;
+  }
+
+  args[0] = "-c";
+  args[1] = file->name;
+  args[2] = "-o";
+  args[3] = object;
+  rc = run_compiler(job->profile, build->ws->dir, args, 4, output,
+                    output_size);
+  snprintf(span, sizeof(span), "compile %s", file->name);
+  trace_span(job->trace, span, started_us, stats_now_us());
+  if (rc > 0) {
+    compile_cache_store_failure(key, output);
+  } else if (rc == 0) {
+    compile_cache_store_binary(key, path);
+    stats_add(STAT_UNITS_COMPILED, 1);
+    pthread_mutex_lock(&build->lock);
+    build->compiled++;
+    pthread_mutex_unlock(&build->lock);
+  }
+  return rc;
+}
+
+/**
+ * @brief Compile project units until none is left to claim
+ *
+ * Called by the coordinating worker and by every helper task. Once a unit
+ * failed no further unit is started; its diagnostics become the job's
+ * output.
+ *
+ * @param build Running build
+ * @param output Diagnostics buffer of this thread (UNIT_OUTPUT_BYTES)
+ */
+static void build_work(build_t *build, char *output) {
+  for (;;) {
+    size_t unit;
+    int rc;
+
+    pthread_mutex_lock(&build->lock);
+    if (build->next == build->count || build->failed) {
+      pthread_mutex_unlock(&build->lock);
+      return;
+    }
+    unit = build->units[build->next++];
+    build->active++;
+    pthread_mutex_unlock(&build->lock);
+
+    output[0] = '\0';
+    rc = build_unit(build, unit, output, UNIT_OUTPUT_BYTES);
+
+    pthread_mutex_lock(&build->lock);
+    if (rc != 0 && !build->failed) {
+      build->failed = rc;
+      snprintf(build->output, build->output_size, "%s", output);
+    }
+    if (--build->active == 0) {
+      pthread_cond_broadcast(&build->idle);
+    }
+    pthread_mutex_unlock(&build->lock);
+  }
+}
+
+/**
+ * @brief Helper task of a build: compile units on this worker as well
+ *
+ * @param helper Task queued by build_project()
+ */
+static void build_help(job_t *helper) {
+  build_t *build = helper->building;
+  char *output = malloc(UNIT_OUTPUT_BYTES);
+
+  if (output) {
+    build_work(build, output);
+    free(output);
+  }
+  build_release(build);
+  free(helper);
+}
+
+/**
+ * @brief Compile the units of a project in parallel and link them
+ *
+ * Writes every file into the workspace, queues up to one helper task per
+ * other worker the job's class may use, compiles units on this worker
+ * too (see build_work()) and links the objects into ws->program. The
+ * program, or the diagnostics of a unit or of the link, is stored in the
+ * compile cache under the project's key.
+ *
+ * @param job Project submission
+ * @param cache_key Compile cache key of the whole project
+ * @param ws Job workspace
+ * @param output Receives an error message or the compiler diagnostics
+ * @param output_size Size of the output buffer
+ *
+ * @return 0 if ws->program was produced, -1 otherwise
+ */
+static int build_project(const job_t *job,
+                         const uint8_t cache_key[SHA256_DIGEST_SIZE],
+                         const workspace_t *ws, char *output,
+                         size_t output_size) {
+  const char *args[PROJECT_MAX_FILES + 2];
+  char objects[PROJECT_MAX_FILES][PROJECT_NAME_MAX];
+  char log_msg[128];
+  build_t *build = calloc(1, sizeof(*build));
+  char *unit_output = malloc(UNIT_OUTPUT_BYTES);
+  worker_class_stats_t limits;
+  uint64_t linking_us;
+  size_t helpers;
+  size_t argc = 0;
+  int failed;
+  int rc;
+
+  if (!build || !unit_output) {
+    snprintf(output, output_size, "ERROR: Out of memory\n");
+    free(unit_output);
+    free(build);
+    return -1;
+  }
+  if (project_write(ws->dir, job->code, job->files, job->file_count) != 0) {
+    snprintf(output, output_size,
+             errno == EEXIST ? "ERROR: Duplicate project file name\n"
+                             : "ERROR: Cannot write project files\n");
+    free(unit_output);
+    free(build);
+    return -1;
+  }
+  build->job = job;
+  build->ws = ws;
+  build->output = output;
+  build->output_size = output_size;
+  for (size_t i = 0; i < job->file_count; i++) {
+    if (project_is_unit(&job->files[i])) {
+      build->units[build->count++] = i;
+    }
+  }
+  if (build->count == 0) {
+    snprintf(output, output_size, "ERROR: Project has no .c file\n");
+    free(unit_output);
+    free(build);
+    return -1;
+  }
+  pthread_mutex_init(&build->lock, NULL);
+  pthread_cond_init(&build->idle, NULL);
+  build->refs = 1;
+
+  worker_pool_class_stats(job_pool, job->priority, &limits);
+  helpers = build->count - 1;
+  if (helpers > limits.max_running - 1) {
+    helpers = limits.max_running - 1;
+  }
+  for (size_t i = 0; i < helpers; i++) {
+    job_t *helper = calloc(1, sizeof(*helper));
+
+    if (!helper) {
+      break;
+    }
+    helper->building = build;
+    pthread_mutex_lock(&build->lock);
+    build->refs++;
+    pthread_mutex_unlock(&build->lock);
+    if (worker_pool_submit(job_pool, helper, job->priority, job->tenant,
+                           job->weight) != 0) {
+      free(helper);
+      build_release(build);
+      break;
+    }
+  }
+
+  build_work(build, unit_output);
+  free(unit_output);
+
+  // Helpers still compiling write into the workspace and output
+  pthread_mutex_lock(&build->lock);
+  while (build->active > 0) {
+    pthread_cond_wait(&build->idle, &build->lock);
+  }
+  failed = build->failed;
+  snprintf(log_msg, sizeof(log_msg),
+           "Project built: %zu units, %zu compiled, %zu cached", build->count,
+           build->compiled, build->cached);
+  pthread_mutex_unlock(&build->lock);
+
+  if (failed == 0) {
+    for (size_t i = 0; i < build->count; i++) {
+      snprintf(objects[i], sizeof(objects[i]), "%s",
+               job->files[build->units[i]].name);
+      objects[i][strlen(objects[i]) - 1] = 'o';
+      args[argc++] = objects[i];
+    }
+    args[argc++] = "-o";
+    args[argc++] = "program";
+    linking_us = stats_now_us();
+    failed = run_compiler(job->profile, ws->dir, args, argc, output,
+                          output_size);
+    trace_span(job->trace, "link", linking_us, stats_now_us());
+  }
+  build_release(build);
+
+  rc = failed == 0 ? 0 : -1;
+  if (failed > 0) {
+    compile_cache_store_failure(cache_key, output);
+  } else if (failed == 0) {
+    compile_cache_store_binary(cache_key, ws->program);
+    log_activity(log_msg);
+  }
+  return rc;
+}
+
+/**
+ * @brief Forward program output to the client while the program runs
+ *
+ * Installed as the process_run() output callback for JOB_STREAM jobs.
+ * conn_send() blocks while the client's socket buffer is full, which
+ * leaves the program blocked on its pipe: a chatty program is throttled to
+ * the client's pace instead of filling server memory.
+ *
+ * @param context The job_t being run
+ * @param data Output just read from the program
+ * @param len Number of bytes
+ *
+ * @return 0 to keep going, -1 (kill the program) if the client is gone
+ */
+static int stream_output(void *context, const char *data, size_t len) {
+  const job_t *job = (const job_t *)context;
+
+  return send_output(job->conn, job->job_id, data, len);
+}
+
+/**
+ * @brief Forward program output from its pipe to the client without
+ * copying it
+ *
+ * Installed next to stream_output() when the output need not be kept
+ * (see run_program()): every OUTPUT frame header is followed by bytes
+ * spliced from the program's pipe into the socket, so they never enter
+ * the server's address space.
+ *
+ * @param context The job_t being run
+ * @param fd Read end of the program's output pipe
+ * @param len Bytes waiting in the pipe to forward
+ *
+ * @return 0 to keep going, -1 (kill the program) if the client is gone
+ */
+static int splice_output(void *context, int fd, size_t len) {
+  const job_t *job = (const job_t *)context;
+  uint8_t header[FRAME_HEADER_SIZE];
+
+  while (len > 0) {
+    size_t chunk = len < FRAME_MAX_PAYLOAD ? len : FRAME_MAX_PAYLOAD;
+
+    frame_encode_header(header, FRAME_OUTPUT, 0, job->job_id,
+                        (uint32_t)chunk);
+    if (conn_sendfd(job->conn, header, sizeof(header), fd, NULL, chunk) !=
+        0) {
+      return -1;
+    }
+    stats_add(STAT_SPLICED_BYTES, chunk);
+    len -= chunk;
+  }
+  return 0;
+}
+
+/**
+ * @brief Answer a run from the result cache
+ *
+ * @param result_key Result cache key of the run
+ * @param output Receives the memoized output
+ * @param output_size Size of the output buffer
+ * @param outcome Receives RESULT_CACHED and the output length on a hit
+ * @param status Receives the memoized wait status on a hit
+ *
+ * @return 1 on a hit, 0 if the program has to run
+ */
+static int lookup_result(const uint8_t result_key[SHA256_DIGEST_SIZE],
+                         char *output, size_t output_size,
+                         job_outcome_t *outcome, int *status) {
+  if (!result_cache_lookup(result_key, output, output_size,
+                           &outcome->output_len, status)) {
+    return 0;
+  }
+  outcome->flags |= RESULT_CACHED;
+  log_activity("Code executed (cached result)");
+  return 1;
+}
+
+/**
+ * @brief Compute the compile cache key of a submission
+ *
+ * @param job Single source or project submission
+ * @param key Receives the key
+ */
+static void submission_key(const job_t *job, uint8_t key[SHA256_DIGEST_SIZE]) {
+  if (job->file_count > 0) {
+    project_key(job->profile->toolchain, job->profile->flags, job->code,
+                job->files, job->file_count, key);
+  } else {
+    compile_cache_key(job->profile->toolchain, job->profile->flags,
+                      job->code, strlen(job->code), key);
+  }
+}
+
+/**
+ * @brief Provide the compiled program of a submission in a new workspace
+ *
+ * Creates the workspace, then takes the executable from the compile
+ * cache or builds it with compile_source() or, for a project,
+ * build_project(). On failure the workspace is removed again and output
+ * holds the reason or the diagnostics.
+ *
+ * @param job Submission (source or project files, and profile)
+ * @param cache_key Compile cache key of the submission
+ * @param ws Receives the workspace
+ * @param output Receives an error message or the compiler diagnostics
+ * @param output_size Size of the output buffer
+ * @param outcome Receives RESULT_FAILED or RESULT_COMPILE_ERROR
+ *
+ * @return 0 if ws->program is ready, -1 otherwise
+ */
+static int prepare_program(const job_t *job,
+                           const uint8_t cache_key[SHA256_DIGEST_SIZE],
+                           workspace_t *ws, char *output, size_t output_size,
+                           job_outcome_t *outcome) {
+  uint64_t started_us;
+  int rc;
+
+  if (workspace_create(ws) != 0) {
+    snprintf(output, output_size, "ERROR: Cannot create job workspace\n");
+    outcome->flags |= RESULT_FAILED;
+    return -1;
+  }
+
+  started_us = stats_now_us();
+  switch (compile_cache_lookup(cache_key, ws->program, output, output_size)) {
+  case CACHE_HIT_FAILED:
+    trace_span(job->trace, "compile cached failure", started_us,
+               stats_now_us());
+    outcome->flags |= RESULT_COMPILE_ERROR;
+    workspace_destroy(ws);
+    log_activity("Compilation failed (cached)");
+    return -1;
+  case CACHE_HIT_BINARY:
+    trace_span(job->trace, "compile cached", started_us, stats_now_us());
+    break;
+  case CACHE_MISS:
+    started_us = stats_now_us();
+    rc = job->file_count > 0
+             ? build_project(job, cache_key, ws, output, output_size)
+             : compile_source(ws, job->profile, job->code, cache_key, output,
+                              output_size);
+    trace_span(job->trace, job->file_count > 0 ? "build" : "compile",
+               started_us, stats_now_us());
+    if (rc != 0) {
+      stats_record_since(PHASE_COMPILE, started_us);
+      outcome->flags |= RESULT_COMPILE_ERROR;
+      workspace_destroy(ws);
+      return -1;
+    }
+    stats_record_since(PHASE_COMPILE, started_us);
+    break;
+  }
+  return 0;
+}
+
+/**
+ * @brief Record a program run in the job's trace
+ *
+ * @param job Submission
+ * @param run Case that was run; batch spans are named after it
+ * @param name "exec", "jit" or "jit rejected"
+ * @param started_us When the run started
+ */
+static void trace_run(const job_t *job, const job_case_t *run,
+                      const char *name, uint64_t started_us) {
+  char span[TRACE_NAME_MAX];
+
+  if (!job->trace) {
+    return;
+  }
+  if (job->batch) {
+    snprintf(span, sizeof(span), "%s case %zu", name,
+             (size_t)(run - job->cases));
+  } else {
+    snprintf(span, sizeof(span), "%s", name);
+  }
+  trace_span(job->trace, span, started_us, stats_now_us());
+}
+
+/**
+ * @brief Run a compiled program once
+ *
+ * Feeds it the case's input on an executor, kills it after
+ * EXEC_TIMEOUT_MS, appends a message when a limit stopped it and
+ * memoizes complete runs.
+ *
+ * @param job Submission (output is streamed for single JOB_STREAM runs,
+ *        spliced from the pipe when it is not kept)
+ * @param argv Program and arguments
+ * @param cwd Working directory of the program
+ * @param source Source to compile in memory and run (see jit.h), or NULL
+ *        to execute argv[0]
+ * @param run Input of this run
+ * @param result_key Result cache key to memoize under, or NULL
+ * @param output Receives stdout and stderr
+ * @param output_size Size of the output buffer
+ * @param outcome Receives the flags and resources of the run
+ *
+ * @return The wait status of the program, -1 if it could not be started,
+ *         or JIT_REJECTED if source did not compile in memory (nothing
+ *         was run or written to output)
+ */
+static int run_program(const job_t *job, char *const *argv, const char *cwd,
+                       const char *source, const job_case_t *run,
+                       const uint8_t *result_key, char *output,
+                       size_t output_size, job_outcome_t *outcome) {
+  process_spec_t spec;
+  process_result_t result;
+  uint64_t started_us;
+  size_t used;
+  int newline;
+  int exec_result;
+  int rc;
+
+  memset(&spec, 0, sizeof(spec));
+  spec.argv = argv;
+  spec.cwd = cwd;
+  spec.input = run->input_len > 0 ? run->input : NULL;
+  spec.input_len = run->input_len;
+  spec.timeout_ms = EXEC_TIMEOUT_MS;
+  spec.output = output;
+  spec.output_size = output_size;
+  if ((job->flags & JOB_STREAM) && !job->batch) {
+    spec.on_output = stream_output;
+    spec.context = (void *)job;
+    // Output that is neither memoized nor compared only passes through
+    if (!result_key && !run->has_expected) {
+      spec.on_splice = splice_output;
+    }
+  }
+
+  started_us = stats_now_us();
+  if (source) {
+    rc = executor_jit(&spec, source, strlen(source), &result);
+    if (rc != 0 && (errno == ENOEXEC || errno == ENOSYS)) {
+      stats_add(STAT_JIT_REJECTED, 1);
+      trace_run(job, run, "jit rejected", started_us);
+      return JIT_REJECTED;
+    }
+    stats_add(STAT_JIT_RUNS, rc == 0);
+  } else {
+    rc = executor_run(&spec, &result);
+  }
+  trace_run(job, run, source ? "jit" : "exec", started_us);
+  if (rc != 0) {
+    snprintf(output, output_size, "ERROR: Cannot execute program: %s\n",
+             strerror(errno));
+    outcome->output_len = strlen(output);
+    stats_add(STAT_SPAWN_FAILED, 1);
+    log_error("Program could not be started");
+    outcome->flags |= RESULT_FAILED;
+    return -1;
+  }
+  stats_record_since(PHASE_EXECUTE, started_us);
+  exec_result = result.status;
+  if (spec.on_output) {
+    outcome->streamed = result.output_len;
+  }
+  outcome->cpu_us = result.cpu_us;
+  outcome->wall_us = result.wall_us;
+  outcome->peak_bytes = result.peak_bytes;
+  stats_add(STAT_EXECUTE_CPU_US, result.cpu_us);
+  stats_add(STAT_EXECUTE_PEAK_KB, result.peak_bytes / 1024);
+
+  if (result.truncated) {
+    outcome->flags |= RESULT_TRUNCATED;
+  }
+  if (result.pids_limited) {
+    outcome->flags |= RESULT_PROCESS_LIMIT;
+    stats_add(STAT_PIDS_LIMITED, 1);
+  }
+
+  // Limit messages start on a line of their own; spliced output was never
+  // seen, so it may not have ended one
+  used = result.output_len;
+  newline = result.spliced > 0 || (used > 0 && output[used - 1] != '\n');
+
+  // Only complete runs are memoized; a timeout says nothing about output
+  if (result.timed_out) {
+    outcome->flags |= RESULT_TIMED_OUT;
+    snprintf(output + used, output_size - used,
+             "%sERROR: Time limit exceeded (%d ms)\n", newline ? "\n" : "",
+             EXEC_TIMEOUT_MS);
+  } else if (result.memory_killed) {
+    outcome->flags |= RESULT_MEMORY_LIMIT;
+    stats_add(STAT_MEMORY_KILLED, 1);
+    snprintf(output + used, output_size - used,
+             "%sERROR: Memory limit exceeded (%zu MB)\n", newline ? "\n" : "",
+             config.limits.memory_bytes / (1024 * 1024));
+  } else if (result_key && !result.truncated && !result.cancelled &&
+             !result.pids_limited) {
+    result_cache_store(result_key, output, used, exec_result);
+  }
+  // The program's own output may hold NUL bytes; a limit message cannot
+  outcome->output_len = used + strlen(output + used);
+  return exec_result;
+}
+
+/**
+ * @brief Compare a run's output with the expected output of its case
+ *
+ * Trailing whitespace is ignored on both sides, so a missing or extra
+ * final newline does not fail a case. Sets RESULT_PASSED or
+ * RESULT_WRONG_OUTPUT; cases without FIELD_EXPECTED are left alone.
+ *
+ * @param run Case that was run
+ * @param output Output of the run
+ * @param outcome Output length; receives the verdict
+ */
+static void check_expected(const job_case_t *run, const char *output,
+                           job_outcome_t *outcome) {
+  size_t output_len = outcome->output_len;
+  size_t expected_len = run->expected_len;
+
+  if (!run->has_expected) {
+    return;
+  }
+  while (output_len > 0 && isspace((unsigned char)output[output_len - 1])) {
+    output_len--;
+  }
+  while (expected_len > 0 &&
+         isspace((unsigned char)run->expected[expected_len - 1])) {
+    expected_len--;
+  }
+  if (output_len == expected_len &&
+      memcmp(output, run->expected, output_len) == 0) {
+    outcome->flags |= RESULT_PASSED;
+  } else {
+    outcome->flags |= RESULT_WRONG_OUTPUT;
+  }
+}
+
+/**
+ * @brief Whether a single run may try the in-memory compiler first
+ *
+ * Only single sources of the "fast" profile qualify: the other profiles
+ * ask for a particular compiler or optimization level.
+ *
+ * @param job Submission
+ * @return 1 to try jit.h, 0 to compile with the profile's compiler
+ */
+static int jit_eligible(const job_t *job) {
+  return config.jit_max > 0 && config.executors > 0 && jit_available() &&
+         job->profile == &profiles[0] && job->file_count == 0 &&
+         strlen(job->code) <= config.jit_max;
+}
+
+/**
+ * @brief Compile and execute C source code
+ *
+ * This function takes C source code, writes it to a temporary file,
+ * compiles it using GCC, and executes the resulting program on the
+ * submission's input.
+ *
+ * @param job Submission (source code, its single case, JOB_* flags and,
+ *        for JOB_STREAM, the connection output is forwarded to)
+ * @param output Buffer to store compilation/execution output
+ * @param output_size Size of the output buffer
+ * @param outcome Receives how the job ended and how much output was
+ *        already streamed
+ *
+ * @return 0 on successful execution, -1 on compilation failure,
+ *         or the wait status of the executed program
+ *
+ * @details The function performs the following steps:
+ * 1. Answers from the result cache if memoization is enabled and the
+ *    request did not set JOB_NO_CACHE (no workspace, no fork); the input
+ *    is part of the key
+ * 2. Creates a private job workspace and, for a small source of the
+ *    "fast" profile, has an executor compile it in memory with libtcc
+ *    and run it (see jit.h); if tcc rejects it or is not built in,
+ *    compiles the submission or takes it from the compile cache (see
+ *    prepare_program())
+ * 3. Runs it on a pre-forked executor (see executor.h) from inside the
+ *    workspace with the input on stdin, under the per-run limits of
+ *    quota.h, killing it after EXEC_TIMEOUT_MS (see run_program())
+ * 4. Captures both stdout and stderr (forwarding them as they arrive for
+ *    JOB_STREAM), memoizes them if enabled and compares them with the
+ *    expected output if one was given
+ * 5. Updates the job counters, the resource totals and the
+ *    compile/execute latency histograms
+ * 6. Removes the workspace
+ *
+ * @note Submitted programs run with the server's privileges. For
+ * educational purposes only.
+ *
+ * Every job owns its workspace, so any number of handler threads may
+ * call this function concurrently.
+ */
+int compile_and_execute(const job_t *job, char *output, size_t output_size,
+                        job_outcome_t *outcome) {
+  char log_msg[256];
+  char *argv[] = {"./program", NULL};
+  uint8_t cache_key[SHA256_DIGEST_SIZE];
+  uint8_t result_key[SHA256_DIGEST_SIZE];
+  const job_case_t *run = &job->cases[0];
+  int memoize = result_cache_enabled() && !(job->flags & JOB_NO_CACHE);
+  uint64_t lookup_us = stats_now_us();
+  int exec_result;
+  workspace_t ws;
+
+  memset(outcome, 0, sizeof(*outcome));
+  stats_add(STAT_COMPILATIONS, 1);
+
+  submission_key(job, cache_key);
+  result_cache_key(cache_key, "", run->input, run->input_len, result_key);
+
+  // A memoized result implies the program compiled: no workspace needed
+  if (memoize &&
+      lookup_result(result_key, output, output_size, outcome, &exec_result)) {
+    trace_span(job->trace, "result cached", lookup_us, stats_now_us());
+    if (exec_result == 0) {
+      stats_add(STAT_SUCCESSFUL, 1);
+    }
+    check_expected(run, output, outcome);
+    return exec_result;
+  }
+
+  // The workspace of an in-memory compile only holds what the program
+  // writes
+  exec_result = JIT_REJECTED;
+  if (jit_eligible(job) && workspace_create(&ws) == 0) {
+    exec_result =
+        run_program(job, argv, ws.dir, job->code, run,
+                    memoize ? result_key : NULL, output, output_size, outcome);
+    if (exec_result == JIT_REJECTED) {
+      workspace_destroy(&ws);
+    }
+  }
+
+  if (exec_result == JIT_REJECTED) {
+    if (prepare_program(job, cache_key, &ws, output, output_size,
+                        outcome) != 0) {
+      outcome->output_len = strlen(output);
+      return -1;
+    }
+
+    // Execute the program with its workspace as working directory
+    exec_result =
+        run_program(job, argv, ws.dir, NULL, run, memoize ? result_key : NULL,
+                    output, output_size, outcome);
+  }
+  if (exec_result != -1) {
+    check_expected(run, output, outcome);
+  }
+  if (exec_result == 0) {
+    stats_add(STAT_SUCCESSFUL, 1);
+  }
+
+  // Clean up
+  workspace_destroy(&ws);
+
+  snprintf(log_msg, sizeof(log_msg), "Code executed, result: %d", exec_result);
+  log_activity(log_msg);
+
+  return exec_result;
+}
+
+/**
+ * @brief Reject a malformed request and drop the connection
+ *
+ * After a framing error the byte stream cannot be trusted any more, so
+ * the client gets an ERROR frame with the reason and is disconnected.
+ *
+ * @param conn Offending connection (reactor thread)
+ * @param job_id Request identifier to echo, if known
+ * @param message Human-readable reason
+ */
+static void protocol_error(connection_t *conn, uint32_t job_id,
+                           const char *message) {
+  char log_msg[256];
+
+  send_frame(conn, FRAME_ERROR, 0, job_id, message, strlen(message));
+  snprintf(log_msg, sizeof(log_msg), "Protocol error: %s", message);
+  log_msg[strcspn(log_msg, "\n")] = '\0';
+  log_warning(log_msg);
+  conn_close(conn);
+}
+
+/**
+ * @brief Check for a complete frame in a connection's input
+ *
+ * @param conn Connection whose input buffer is inspected
+ * @param offset Position of the frame in conn->in
+ * @param header Receives the decoded header
+ *
+ * @return 1 if the whole frame is buffered, 0 if more input is needed,
+ *         -1 if the header is invalid
+ */
+static int frame_at(const connection_t *conn, size_t offset,
+                    frame_header_t *header) {
+  if (conn->in_len - offset < FRAME_HEADER_SIZE) {
+    return 0;
+  }
+  if (frame_decode_header((const uint8_t *)conn->in + offset, header) != 0) {
+    return -1;
+  }
+  return conn->in_len - offset - FRAME_HEADER_SIZE >= header->length;
+}
+
+/**
+ * @brief Add the fields of one SUBMIT payload to the sequence's sizes
+ *
+ * @param payload Payload bytes
+ * @param length Payload size
+ * @param size Sizes so far, updated
+ *
+ * @return 0 on success, -1 if the payload is malformed
+ */
+static int submit_measure(const uint8_t *payload, size_t length,
+                          submit_size_t *size) {
+  const uint8_t *value;
+  uint32_t value_length;
+  uint16_t tag;
+  size_t offset = 0;
+  int rc;
+
+  while ((rc = field_next(payload, length, &offset, &tag, &value,
+                          &value_length)) == 1) {
+    switch (tag) {
+    case FIELD_SOURCE:
+      size->source += value_length;
+      if (size->files == 0) {
+        size->loose_source += value_length;
+      }
+      break;
+    case FIELD_FILE:
+      size->files++;
+      size->bad_name |= !project_name_valid((const char *)value, value_length);
+      break;
+    case FIELD_INPUT:
+    case FIELD_EXPECTED:
+      size->data += value_length;
+      size->loose |= size->cases == 0;
+      break;
+    case FIELD_CASE:
+      size->cases++;
+      break;
+    }
+  }
+  return rc < 0 ? -1 : 0;
+}
+
+/**
+ * @brief Look up a selectable compiler profile by name
+ *
+ * @param name Profile name (not NUL-terminated)
+ * @param length Length of name
+ *
+ * @return The profile, or NULL if it is unknown, not installed or not
+ *         allowed by -o
+ */
+static const profile_t *profile_find(const char *name, size_t length) {
+  for (size_t i = 0; i < PROFILE_COUNT; i++) {
+    if (profiles[i].enabled && strlen(profiles[i].name) == length &&
+        memcmp(profiles[i].name, name, length) == 0) {
+      return &profiles[i];
+    }
+  }
+  return NULL;
+}
+
+/**
+ * @brief List the selectable compiler profiles
+ *
+ * @param buffer Receives the names, comma-separated, the default first
+ * @param size Size of buffer
+ */
+static void list_profiles(char *buffer, size_t size) {
+  size_t used = snprintf(buffer, size, "%s", default_profile->name);
+
+  for (size_t i = 0; i < PROFILE_COUNT && used < size; i++) {
+    if (profiles[i].enabled && &profiles[i] != default_profile) {
+      used += snprintf(buffer + used, size - used, ", %s", profiles[i].name);
+    }
+  }
+}
+
+/**
+ * @brief Distribute the fields of a buffered SUBMIT sequence over a job
+ *
+ * Called twice: first with copy = 0 to size the input and expected
+ * output of every case, then, once job->data has been laid out, with
+ * copy = 1 to fill in the source, the project files, the cases and the
+ * profile (NULL if the requested one is not available).
+ *
+ * @param conn Connection holding the sequence at the start of its input
+ * @param end Size of the sequence
+ * @param job Job with code, cases, case_count and files allocated and
+ *        profile set to the default
+ * @param copy Whether to copy (1) or only count (0)
+ */
+static void submit_collect(const connection_t *conn, size_t end, job_t *job,
+                           int copy) {
+  job_case_t *current = job->batch ? NULL : job->cases;
+  project_file_t *file = NULL;
+  frame_header_t header;
+  size_t source_len = 0;
+
+  for (size_t pos = 0; pos < end;) {
+    const uint8_t *payload = (const uint8_t *)conn->in + pos;
+    const uint8_t *value;
+    uint32_t value_length;
+    uint16_t tag;
+    size_t field = 0;
+
+    frame_decode_header(payload, &header);
+    payload += FRAME_HEADER_SIZE;
+    while (field_next(payload, header.length, &field, &tag, &value,
+                      &value_length) == 1) {
+      switch (tag) {
+      case FIELD_SOURCE:
+        if (copy) {
+          memcpy(job->code + source_len, value, value_length);
+          if (file) {
+            file->len += value_length;
+          }
+        }
+        source_len += value_length;
+        break;
+      case FIELD_FILE:
+        if (copy) {
+          file = file ? file + 1 : job->files;
+          memcpy(file->name, value, value_length);
+          file->name[value_length] = '\0';
+          file->offset = source_len;
+        }
+        break;
+      case FIELD_INPUT:
+        if (copy) {
+          memcpy((char *)current->input + current->input_len, value,
+                 value_length);
+        }
+        current->input_len += value_length;
+        break;
+      case FIELD_EXPECTED:
+        if (copy) {
+          memcpy((char *)current->expected + current->expected_len, value,
+                 value_length);
+        }
+        current->expected_len += value_length;
+        current->has_expected = 1;
+        break;
+      case FIELD_CASE:
+        current = current ? current + 1 : job->cases;
+        break;
+      case FIELD_PROFILE:
+        if (copy) {
+          job->profile = profile_find((const char *)value, value_length);
+        }
+        break;
+      }
+    }
+    pos += FRAME_HEADER_SIZE + header.length;
+  }
+  if (copy) {
+    job->code[source_len] = '\0';
+  }
+}
+
+/**
+ * @brief Convert a wait status into the RESULT exit code
+ *
+ * @param status Return value of compile_and_execute()
+ * @return Exit status, 128 + signal number, or -1 if nothing ran
+ */
+static int32_t result_exit_code(int status) {
+  if (status < 0) {
+    return -1;
+  }
+  if (WIFEXITED(status)) {
+    return WEXITSTATUS(status);
+  }
+  if (WIFSIGNALED(status)) {
+    return 128 + WTERMSIG(status);
+  }
+  return -1;
+}
+
+/**
+ * @brief Narrow a measurement to a 32-bit RESULT field
+ *
+ * @param value Value to store
+ * @return value, saturated at UINT32_MAX
+ */
+static uint32_t clamp_u32(uint64_t value) {
+  return value > UINT32_MAX ? UINT32_MAX : (uint32_t)value;
+}
+
+/**
+ * @brief Fill in a RESULT payload from the outcome of a run
+ *
+ * @param exit_code RESULT exit code
+ * @param outcome Flags and resources of the run
+ * @param result Receives the payload
+ */
+static void result_from_outcome(int32_t exit_code,
+                                const job_outcome_t *outcome,
+                                result_payload_t *result) {
+  result->exit_code = exit_code;
+  result->flags = outcome->flags;
+  result->cpu_us = clamp_u32(outcome->cpu_us);
+  result->wall_us = clamp_u32(outcome->wall_us);
+  result->peak_kb = clamp_u32(outcome->peak_bytes / 1024);
+}
+
+/**
+ * @brief Send the result and output of one batch case as CASE frames
+ *
+ * Every frame repeats the case header, so frames of different cases may
+ * interleave; all but the last frame of the case carry FRAME_FLAG_MORE.
+ *
+ * @param conn Destination connection
+ * @param job_id Request identifier to echo
+ * @param index Case number
+ * @param result Outcome of the case
+ * @param data Output of the case
+ * @param len Output size (may be 0: one frame without output is sent)
+ *
+ * @return 0 on success, -1 if the client is gone
+ */
+static int send_case(connection_t *conn, uint32_t job_id, uint32_t index,
+                     const result_payload_t *result, const char *data,
+                     size_t len) {
+  uint8_t header[FRAME_HEADER_SIZE];
+  uint8_t case_header[CASE_HEADER_SIZE];
+  struct iovec iov[3];
+
+  case_encode_header(case_header, index, result);
+  do {
+    size_t room = FRAME_MAX_PAYLOAD - CASE_HEADER_SIZE;
+    size_t chunk = len < room ? len : room;
+    uint16_t flags = chunk < len ? FRAME_FLAG_MORE : 0;
+
+    frame_encode_header(header, FRAME_CASE, flags, job_id,
+                        (uint32_t)(CASE_HEADER_SIZE + chunk));
+    iov[0].iov_base = header;
+    iov[0].iov_len = sizeof(header);
+    iov[1].iov_base = case_header;
+    iov[1].iov_len = sizeof(case_header);
+    iov[2].iov_base = (void *)data;
+    iov[2].iov_len = chunk;
+    if (conn_sendv(conn, iov, 3) != 0) {
+      return -1;
+    }
+    data += chunk;
+    len -= chunk;
+  } while (len > 0);
+  return 0;
+}
+
+/**
+ * @brief Drop a reference to a batch, freeing it with the last one
+ *
+ * @param batch Batch to release
+ */
+static void batch_release(batch_t *batch) {
+  size_t refs;
+
+  pthread_mutex_lock(&batch->lock);
+  refs = --batch->refs;
+  pthread_mutex_unlock(&batch->lock);
+  if (refs == 0) {
+    pthread_cond_destroy(&batch->idle);
+    pthread_mutex_destroy(&batch->lock);
+    free(batch);
+  }
+}
+
+/**
+ * @brief Run batch cases until none is left to claim
+ *
+ * Called by the coordinating worker and by every helper task. Each case
+ * runs in a directory of its own inside the batch workspace and is
+ * reported with CASE frames as soon as it ends. The coordinator outlives
+ * every claimed case, so batch->job stays valid while one runs.
+ *
+ * @param batch Running batch
+ * @param output Output buffer of this thread (BATCH_OUTPUT_BYTES)
+ */
+static void batch_work(batch_t *batch, char *output) {
+  char *argv[] = {batch->ws.program, NULL};
+
+  for (;;) {
+    char cwd[PATH_MAX];
+    uint8_t result_key[SHA256_DIGEST_SIZE];
+    job_outcome_t outcome;
+    result_payload_t result;
+    const job_t *job;
+    const job_case_t *run;
+    size_t index;
+    int memoize;
+    int status;
+
+    pthread_mutex_lock(&batch->lock);
+    if (batch->next == batch->count) {
+      pthread_mutex_unlock(&batch->lock);
+      return;
+    }
+    index = batch->next++;
+    batch->active++;
+    pthread_mutex_unlock(&batch->lock);
+
+    job = batch->job;
+    run = &job->cases[index];
+    memoize = result_cache_enabled() && !(job->flags & JOB_NO_CACHE);
+    memset(&outcome, 0, sizeof(outcome));
+    result_cache_key(batch->cache_key, "", run->input, run->input_len,
+                     result_key);
+
+    if (!memoize || !lookup_result(result_key, output, BATCH_OUTPUT_BYTES,
+                                   &outcome, &status)) {
+      snprintf(cwd, sizeof(cwd), "%s/case-%zu", batch->ws.dir, index);
+      if (mkdir(cwd, 0700) != 0) {
+        snprintf(output, BATCH_OUTPUT_BYTES,
+                 "ERROR: Cannot create case directory\n");
+        outcome.output_len = strlen(output);
+        outcome.flags |= RESULT_FAILED;
+        status = -1;
+      } else {
+        status = run_program(job, argv, cwd, NULL, run,
+                             memoize ? result_key : NULL, output,
+                             BATCH_OUTPUT_BYTES, &outcome);
+        remove_directory(cwd);
+      }
+    }
+    if (status != -1) {
+      check_expected(run, output, &outcome);
+    }
+
+    result_from_outcome(result_exit_code(status), &outcome, &result);
+    send_case(job->conn, job->job_id, (uint32_t)index, &result, output,
+              outcome.output_len);
+
+    pthread_mutex_lock(&batch->lock);
+    if (status != 0 || (outcome.flags & RESULT_WRONG_OUTPUT)) {
+      batch->failed++;
+    }
+    batch->flags |= outcome.flags &
+                    (RESULT_TIMED_OUT | RESULT_TRUNCATED | RESULT_MEMORY_LIMIT |
+                     RESULT_PROCESS_LIMIT | RESULT_WRONG_OUTPUT);
+    batch->cpu_us += outcome.cpu_us;
+    if (outcome.peak_bytes > batch->peak_bytes) {
+      batch->peak_bytes = outcome.peak_bytes;
+    }
+    if (--batch->active == 0) {
+      pthread_cond_broadcast(&batch->idle);
+    }
+    pthread_mutex_unlock(&batch->lock);
+  }
+}
+
+/**
+ * @brief Helper task of a batch: run cases on this worker as well
+ *
+ * A helper that only gets a worker after every case was claimed simply
+ * drops its reference.
+ *
+ * @param helper Task queued by run_batch()
+ */
+static void batch_help(job_t *helper) {
+  batch_t *batch = helper->helping;
+  char *output = malloc(BATCH_OUTPUT_BYTES);
+
+  if (output) {
+    batch_work(batch, output);
+    free(output);
+  }
+  batch_release(batch);
+  free(helper);
+}
+
+/**
+ * @brief Compile a batch once and run its cases on every idle worker
+ *
+ * After compiling, up to one helper task per other worker is queued
+ * (fewer if the queue is full); this worker and the helpers then claim
+ * cases until all have run. Each case is answered on its own with CASE
+ * frames, see batch_work().
+ *
+ * @param job Batch submission
+ * @param output Receives the compiler diagnostics or an error message
+ * @param output_size Size of the output buffer
+ * @param outcome Receives the combined flags and resources of the cases
+ *
+ * @return Number of failed cases, or -1 if the program could not be built
+ */
+static int run_batch(const job_t *job, char *output, size_t output_size,
+                     job_outcome_t *outcome) {
+  char log_msg[256];
+  batch_t *batch = calloc(1, sizeof(*batch));
+  char *case_output = malloc(BATCH_OUTPUT_BYTES);
+  worker_class_stats_t limits;
+  uint64_t started_us;
+  size_t helpers;
+  int failed;
+
+  memset(outcome, 0, sizeof(*outcome));
+  if (!batch || !case_output) {
+    snprintf(output, output_size, "ERROR: Out of memory\n");
+    outcome->flags |= RESULT_FAILED;
+    free(case_output);
+    free(batch);
+    return -1;
+  }
+  stats_add(STAT_COMPILATIONS, 1);
+
+  batch->job = job;
+  batch->count = job->case_count;
+  submission_key(job, batch->cache_key);
+  if (prepare_program(job, batch->cache_key, &batch->ws, output, output_size,
+                      outcome) != 0) {
+    free(case_output);
+    free(batch);
+    return -1;
+  }
+  output[0] = '\0';
+  pthread_mutex_init(&batch->lock, NULL);
+  pthread_cond_init(&batch->idle, NULL);
+  batch->refs = 1;
+  started_us = stats_now_us();
+
+  // Spread the cases over the other workers the class may use; a full
+  // queue means fewer
+  worker_pool_class_stats(job_pool, job->priority, &limits);
+  helpers = batch->count - 1;
+  if (helpers > limits.max_running - 1) {
+    helpers = limits.max_running - 1;
+  }
+  for (size_t i = 0; i < helpers; i++) {
+    job_t *helper = calloc(1, sizeof(*helper));
+
+    if (!helper) {
+      break;
+    }
+    helper->helping = batch;
+    pthread_mutex_lock(&batch->lock);
+    batch->refs++;
+    pthread_mutex_unlock(&batch->lock);
+    if (worker_pool_submit(job_pool, helper, job->priority, job->tenant,
+                           job->weight) != 0) {
+      free(helper);
+      batch_release(batch);
+      break;
+    }
+  }
+
+  batch_work(batch, case_output);
+
+  // Helpers still running a case use the workspace and the connection
+  pthread_mutex_lock(&batch->lock);
+  while (batch->active > 0) {
+    pthread_cond_wait(&batch->idle, &batch->lock);
+  }
+  failed = (int)batch->failed;
+  outcome->flags = batch->flags;
+  outcome->cpu_us = batch->cpu_us;
+  outcome->peak_bytes = batch->peak_bytes;
+  pthread_mutex_unlock(&batch->lock);
+  outcome->wall_us = stats_now_us() - started_us;
+
+  workspace_destroy(&batch->ws);
+  batch_release(batch);
+  free(case_output);
+  if (failed == 0) {
+    stats_add(STAT_SUCCESSFUL, 1);
+  }
+
+  snprintf(log_msg, sizeof(log_msg), "Batch executed: %zu cases, %d failed",
+           job->case_count, failed);
+  log_activity(log_msg);
+  return failed;
+}
+
+/**
+ * @brief Turn away a request because the job queue is full
+ *
+ * Sends a BUSY frame with a retry hint. The connection stays open so the
+ * client can resubmit once the server has caught up.
+ *
+ * @param conn Client whose request could not be queued
+ * @param job_id Request identifier to echo
+ */
+static void reject_busy(connection_t *conn, uint32_t job_id) {
+  uint8_t payload[4];
+
+  protocol_put_u32(payload, config.retry_after_ms);
+  send_frame(conn, FRAME_BUSY, 0, job_id, payload, sizeof(payload));
+  stats_add(STAT_REJECTED, 1);
+  log_warning("Regular client request rejected: job queue full");
+}
+
+/**
+ * @brief Free a job and everything it owns
+ *
+ * @param job Job built by handle_client()
+ */
+static void job_free(job_t *job) {
+  trace_finish(job->trace);
+  free(job->request);
+  free(job->files);
+  free(job->cases);
+  free(job->data);
+  free(job->code);
+  free(job->logs);
+  free(job);
+}
+
+/**
+ * @brief Whether the server is draining
+ *
+ * @return 1 once a graceful shutdown or a handover started
+ */
+static int server_draining(void) {
+  return __atomic_load_n(&drain.draining, __ATOMIC_SEQ_CST);
+}
+
+/**
+ * @brief Wind a connection down for a drain (reactor thread)
+ *
+ * A client with jobs in flight stops being read and is closed by
+ * job_done() once they are answered; an idle one is closed now, so it
+ * reconnects to whichever server took the port. Admin and node
+ * connections are served until the end.
+ *
+ * @param conn Connection to wind down
+ */
+static void drain_connection(connection_t *conn) {
+  switch (conn->kind) {
+  case CONN_REGULAR:
+    if (__atomic_load_n(&conn->in_flight, __ATOMIC_SEQ_CST) == 0) {
+      conn_close(conn);
+    } else {
+      conn_pause(conn);
+    }
+    break;
+  case CONN_METRICS:
+    conn_close(conn);
+    break;
+  default:
+    break;
+  }
+}
+
+/**
+ * @brief Drain thread: wait for the queued and running jobs, then stop
+ * the reactor
+ *
+ * @param arg Unused
+ * @return NULL
+ */
+static void *drain_wait(void *arg) {
+  char message[128];
+  size_t left;
+
+  (void)arg;
+  // A coordinator sends no more jobs to a node that said goodbye
+  cluster_leave();
+
+  while ((left = worker_pool_queued(job_pool) + worker_pool_active(job_pool)) >
+             0 &&
+         stats_now_us() < drain.deadline_us) {
+    usleep(DRAIN_POLL_MS * 1000);
+  }
+  if (left > 0) {
+    snprintf(message, sizeof(message),
+             "Drain deadline passed with %zu jobs unfinished", left);
+    log_warning(message);
+  } else {
+    snprintf(message, sizeof(message), "Drained in %.1f s",
+             (double)(stats_now_us() - drain.started_us) / 1e6);
+    log_activity(message);
+  }
+  server_running = 0;
+  reactor_stop(reactor);
+  return NULL;
+}
+
+/**
+ * @brief Start a graceful shutdown (drain.lock held, not yet draining)
+ *
+ * New connections are left to the listen queues, which are closed, or to
+ * the server that took them over; connections are wound down by
+ * drain_connection().
+ *
+ * @param seconds How long unfinished jobs are waited for
+ * @param reason Logged cause
+ */
+static void drain_start(unsigned seconds, const char *reason) {
+  char message[160];
+
+  drain.started_us = stats_now_us();
+  drain.deadline_us = drain.started_us + (uint64_t)seconds * 1000000;
+  __atomic_store_n(&drain.draining, 1, __ATOMIC_SEQ_CST);
+  reactor_stop_accepting(reactor, drain_connection);
+
+  snprintf(message, sizeof(message),
+           "Draining (%s): %zu jobs queued or running, deadline %u s",
+           reason,
+           worker_pool_queued(job_pool) + worker_pool_active(job_pool),
+           seconds);
+  log_activity(message);
+  printf("%s\n", message);
+  fflush(stdout);
+
+  if (pthread_create(&drain.thread, NULL, drain_wait, NULL) == 0) {
+    drain.started = 1;
+  } else {
+    reactor_stop(reactor);
+  }
+}
+
+/**
+ * @brief Start a graceful shutdown unless one is already running; safe
+ * from any thread
+ *
+ * @param seconds How long unfinished jobs are waited for
+ * @param reason Logged cause
+ * @return 1 if this call started it, 0 if the server was draining already
+ */
+static int drain_begin(unsigned seconds, const char *reason) {
+  int begun = 0;
+
+  pthread_mutex_lock(&drain.lock);
+  if (!server_draining()) {
+    drain_start(seconds, reason);
+    begun = 1;
+  }
+  pthread_mutex_unlock(&drain.lock);
+  return begun;
+}
+
+/**
+ * @brief Finish a job whose reply was sent
+ *
+ * The job no longer counts against the connection's pipeline depth, and
+ * reading is resumed if it was paused at the limit. While draining, the
+ * connection is closed instead once its last job is answered.
+ *
+ * @param job Job to release
+ */
+static void job_done(job_t *job) {
+  int left = __atomic_sub_fetch(&job->conn->in_flight, 1, __ATOMIC_SEQ_CST);
+
+  if (server_draining()) {
+    if (left == 0) {
+      conn_hangup(job->conn);
+    }
+  } else if (left == (int)config.pipeline_depth - 1) {
+    conn_resume(job->conn);
+  }
+  conn_release(job->conn);
+  job_free(job);
+}
+
+/**
+ * @brief Relay a submission to a worker node (coordinator)
+ *
+ * The node is picked by the hash of the profile and source, so that
+ * resubmissions of a program meet its executable in that node's compile
+ * cache.
+ *
+ * @param job Submission with its raw frames
+ * @return 1 if the job was answered (by a node, or with BUSY because every
+ *         node is full), 0 to run it locally because no node is alive
+ */
+static int forward_job(const job_t *job) {
+  uint64_t started_us = stats_now_us();
+  uint8_t key[SHA256_DIGEST_SIZE];
+
+  compile_cache_key(job->profile->name, job->profile->flags, job->code,
+                    strlen(job->code), key);
+  switch (cluster_forward(job->conn, key, job->request, job->request_len)) {
+  case CLUSTER_FORWARDED:
+    trace_span(job->trace, "forward", started_us, stats_now_us());
+    return 1;
+  case CLUSTER_BUSY:
+    reject_busy(job->conn, job->job_id);
+    return 1;
+  default:
+    cluster_count_local();
+    return 0;
+  }
+}
+
+/**
+ * @brief Send the timeline of a job in a TRACE frame
+ *
+ * @param job Job submitted with FRAME_FLAG_TRACE
+ */
+static void send_trace(const job_t *job) {
+  char text[TRACE_TEXT_BYTES];
+  size_t len = trace_format(job->trace, text, sizeof(text));
+
+  send_frame(job->conn, FRAME_TRACE, 0, job->job_id, text, len);
+}
+
+/**
+ * @brief Worker pool job handler: compile, run and reply
+ *
+ * Runs on a worker thread. Whatever output was not already streamed is
+ * sent as OUTPUT frames, followed by a RESULT frame; a batch sends its
+ * CASE frames while it runs; a traced job that asked for it gets its
+ * TRACE frame before the RESULT. On a coordinator the job is relayed to a
+ * worker node instead, unless none is alive. Once the reply is sent the
+ * job is finished with job_done(). Helper tasks of a batch only run cases
+ * (see run_batch()). A job still queued when the server stopped is
+ * dropped unanswered, so that main() can join the workers quickly.
+ *
+ * @param arg Pointer to the job_t built by handle_client() or run_batch()
+ */
+static void run_job(void *arg) {
+  job_t *job = (job_t *)arg;
+  uint8_t payload[RESULT_PAYLOAD_SIZE];
+  result_payload_t result;
+  job_outcome_t outcome = {RESULT_FAILED, 0, 0, 0, 0, 0};
+  char *output;
+  uint64_t sending_us = 0;
+  int status = -1;
+
+  if (job->helping) {
+    batch_help(job);
+    return;
+  }
+  if (job->building) {
+    build_help(job);
+    return;
+  }
+  if (job->logs) {
+    serve_logs(job);
+    return;
+  }
+  if (!__atomic_load_n(&server_running, __ATOMIC_SEQ_CST)) {
+    // Still queued when the server stopped: the client is disconnected
+    job_done(job);
+    return;
+  }
+  stats_record_since(PHASE_QUEUE, job->queued_us);
+  trace_span(job->trace, "queue", job->queued_us, stats_now_us());
+  if (job->request && forward_job(job)) {
+    job_done(job);
+    return;
+  }
+
+  // Compile and execute the received code
+  output = malloc(MAX_OUTPUT_BYTES);
+  if (output) {
+    if (job->batch) {
+      status = run_batch(job, output, MAX_OUTPUT_BYTES, &outcome);
+      outcome.output_len = strlen(output);
+    } else {
+      status = compile_and_execute(job, output, MAX_OUTPUT_BYTES, &outcome);
+    }
+    sending_us = stats_now_us();
+    send_output(job->conn, job->job_id, output + outcome.streamed,
+                outcome.output_len - outcome.streamed);
+    trace_span(job->trace, "send", sending_us, stats_now_us());
+  }
+  if ((job->flags & JOB_TRACE) && job->trace) {
+    send_trace(job);
+  }
+
+  // Send result back to client; a batch reports its failed cases
+  result_from_outcome(job->batch ? status : result_exit_code(status),
+                      &outcome, &result);
+  result_encode(payload, &result);
+  send_frame(job->conn, FRAME_RESULT, 0, job->job_id, payload,
+             sizeof(payload));
+  if (output) {
+    stats_record_since(PHASE_SEND, sending_us);
+  }
+  free(output);
+  job_done(job);
+}
+
+/**
+ * @brief Answer a submission that selected an unavailable profile
+ *
+ * The reply names the profiles that can be used. Like BUSY, this is not
+ * a protocol error: the connection stays open.
+ *
+ * @param conn Client whose request is refused
+ * @param job_id Request identifier to echo
+ */
+static void reject_profile(connection_t *conn, uint32_t job_id) {
+  uint8_t payload[RESULT_PAYLOAD_SIZE];
+  result_payload_t result = {-1, RESULT_FAILED, 0, 0, 0};
+  char available[256];
+  char message[320];
+
+  list_profiles(available, sizeof(available));
+  snprintf(message, sizeof(message),
+           "ERROR: Unknown compiler profile (available: %s)\n", available);
+  send_output(conn, job_id, message, strlen(message));
+  result_encode(payload, &result);
+  send_frame(conn, FRAME_RESULT, 0, job_id, payload, sizeof(payload));
+  log_warning("Regular client request rejected: unknown compiler profile");
+}
+
+/**
+ * @brief Fair queuing weight of a client (reactor thread)
+ *
+ * @param addr Client IPv4 address, host byte order
+ * @return Its WEIGHT, or 1
+ */
+static unsigned tenant_weight(uint32_t addr) {
+  for (size_t i = 0; i < tenant_weight_count; i++) {
+    if (tenant_weights[i].addr == addr) {
+      return tenant_weights[i].weight;
+    }
+  }
+  return 1;
+}
+
+/**
+ * @brief Set the fair queuing weight of a client (reactor thread)
+ *
+ * Jobs already queued keep the weight they were submitted with until the
+ * client's next submission.
+ *
+ * @param addr Client IPv4 address, host byte order
+ * @param weight New weight; 1 drops the entry
+ *
+ * @return 0 on success, -1 if the table is full
+ */
+static int set_tenant_weight(uint32_t addr, unsigned weight) {
+  size_t i;
+
+  for (i = 0; i < tenant_weight_count; i++) {
+    if (tenant_weights[i].addr == addr) {
+      break;
+    }
+  }
+  if (weight == 1) {
+    if (i < tenant_weight_count) {
+      tenant_weights[i] = tenant_weights[--tenant_weight_count];
+    }
+    return 0;
+  }
+  if (i == tenant_weight_count) {
+    if (tenant_weight_count == MAX_TENANT_WEIGHTS) {
+      return -1;
+    }
+    tenant_weights[tenant_weight_count++].addr = addr;
+  }
+  tenant_weights[i].weight = weight;
+  return 0;
+}
+
+/**
+ * @brief Queue the first complete SUBMIT sequence of a connection's input
+ *
+ * @param conn Connection with buffered input
+ *
+ * @return 1 if a submission was consumed (queued, or refused with BUSY or
+ *         for its profile), 0 if more input is needed or the connection
+ *         was closed
+ */
+static int take_submission(connection_t *conn) {
+  frame_header_t header;
+  submit_size_t size = {0, 0, 0, 0, 0, 0, 0};
+  uint64_t accepted_us = conn->accepted_us;
+  uint64_t input_us = conn->input_us;
+  uint64_t read_us = conn->read_us;
+  size_t offset = 0;
+  uint32_t job_id = 0;
+  unsigned flags = 0;
+  int bulk = 0;
+  int in_flight;
+  int rc;
+
+  // Walk the buffered frames up to the end of the first SUBMIT sequence
+  while ((rc = frame_at(conn, offset, &header)) == 1) {
+    const uint8_t *payload =
+        (const uint8_t *)conn->in + offset + FRAME_HEADER_SIZE;
+
+    if (header.type == FRAME_QUIT && offset == 0) {
+      log_activity("Regular client disconnected");
+      conn_close(conn);
+      return 0;
+    }
+    if (header.type != FRAME_SUBMIT) {
+      protocol_error(conn, header.job_id, "ERROR: Unexpected frame type\n");
+      return 0;
+    }
+    if (offset == 0) {
+      job_id = header.job_id;
+      flags = (header.flags & FRAME_FLAG_NOCACHE) ? JOB_NO_CACHE : 0;
+      flags |= (header.flags & FRAME_FLAG_STREAM) ? JOB_STREAM : 0;
+      flags |= (header.flags & FRAME_FLAG_TRACE) ? JOB_TRACE : 0;
+      bulk = (header.flags & FRAME_FLAG_BULK) != 0;
+    } else if (header.job_id != job_id) {
+      protocol_error(conn, header.job_id, "ERROR: Unfinished submission\n");
+      return 0;
+    }
+
+    if (submit_measure(payload, header.length, &size) != 0) {
+      protocol_error(conn, job_id, "ERROR: Malformed submission\n");
+      return 0;
+    }
+    if (size.source > MAX_SOURCE_BYTES) {
+      protocol_error(conn, job_id, "ERROR: Source too large\n");
+      return 0;
+    }
+    if (size.data > MAX_INPUT_BYTES) {
+      protocol_error(conn, job_id, "ERROR: Input too large\n");
+      return 0;
+    }
+    if (size.cases > BATCH_MAX_CASES) {
+      protocol_error(conn, job_id, "ERROR: Too many test cases\n");
+      return 0;
+    }
+    if (size.files > PROJECT_MAX_FILES) {
+      protocol_error(conn, job_id, "ERROR: Too many project files\n");
+      return 0;
+    }
+    if (size.bad_name) {
+      protocol_error(conn, job_id, "ERROR: Bad project file name\n");
+      return 0;
+    }
+
+    offset += FRAME_HEADER_SIZE + header.length;
+    if (!(header.flags & FRAME_FLAG_MORE)) {
+      break;
+    }
+  }
+  if (rc < 0) {
+    protocol_error(conn, 0, "ERROR: Malformed frame\n");
+    return 0;
+  }
+  if (rc == 0) {
+    return 0; /* wait for the rest of the submission */
+  }
+
+  if (size.cases > 0 && size.loose) {
+    protocol_error(conn, job_id, "ERROR: Input outside a test case\n");
+    return 0;
+  }
+  if (size.files > 0 && size.loose_source > 0) {
+    protocol_error(conn, job_id, "ERROR: Source outside a project file\n");
+    return 0;
+  }
+
+  job_t *job = calloc(1, sizeof(*job));
+  if (job) {
+    job->batch = size.cases > 0;
+    job->case_count = job->batch ? size.cases : 1;
+    job->code = malloc(size.source + 1);
+    job->data = malloc(size.data + 1);
+    job->cases = calloc(job->case_count, sizeof(*job->cases));
+    job->file_count = size.files;
+    if (size.files > 0) {
+      job->files = calloc(size.files, sizeof(*job->files));
+    }
+  }
+  if (!job || !job->code || !job->data || !job->cases ||
+      (size.files > 0 && !job->files)) {
+    if (job) {
+      job_free(job);
+    }
+    conn_close(conn);
+    return 0;
+  }
+
+  // Size every case, lay them out in job->data, then copy the fields of
+  // every frame in the sequence
+  job->profile = default_profile;
+  submit_collect(conn, offset, job, 0);
+  size.data = 0;
+  for (size_t i = 0; i < job->case_count; i++) {
+    job_case_t *run = &job->cases[i];
+
+    run->input = job->data + size.data;
+    size.data += run->input_len;
+    run->expected = job->data + size.data;
+    size.data += run->expected_len;
+    run->input_len = 0;
+    run->expected_len = 0;
+  }
+  submit_collect(conn, offset, job, 1);
+  if (config.node_port != 0 && job->profile) {
+    job->request = malloc(offset);
+    if (job->request) {
+      memcpy(job->request, conn->in, offset);
+      job->request_len = offset;
+    }
+  }
+  conn_consume(conn, offset);
+  conn->accepted_us = 0;
+  if (!job->profile) {
+    reject_profile(conn, job_id);
+    job_free(job);
+    return 1;
+  }
+
+  job->conn = conn;
+  job->job_id = job_id;
+  job->flags = flags;
+  job->queued_us = stats_now_us();
+  if ((flags & JOB_TRACE) || trace_enabled()) {
+    job->trace = trace_begin(job_id);
+    if (accepted_us != 0) {
+      trace_span(job->trace, "accept", accepted_us, input_us);
+    }
+    trace_span(job->trace, "recv", input_us, read_us);
+    trace_span(job->trace, "parse", read_us, job->queued_us);
+  }
+  job->priority =
+      job->batch || bulk ? WORKER_CLASS_BATCH : WORKER_CLASS_INTERACTIVE;
+  job->tenant = conn->peer_addr;
+  job->weight = tenant_weight(conn->peer_addr);
+  conn_retain(conn);
+
+  // Count the job before a worker can finish it (see run_job())
+  in_flight = __atomic_add_fetch(&conn->in_flight, 1, __ATOMIC_ACQ_REL);
+  if (worker_pool_submit(job_pool, job, job->priority, job->tenant,
+                         job->weight) != 0) {
+    __atomic_sub_fetch(&conn->in_flight, 1, __ATOMIC_ACQ_REL);
+    reject_busy(conn, job_id);
+    conn_release(conn);
+    job_free(job);
+  } else if (in_flight >= (int)config.pipeline_depth) {
+    conn_pause(conn);
+  }
+  return 1;
+}
+
+/**
+ * @brief Handle input from a regular client connection
+ *
+ * Called on the reactor thread whenever a regular client has sent data.
+ * Every complete SUBMIT sequence that is buffered has its source
+ * assembled into a job for the worker pool; the results are sent back by
+ * run_job() as the jobs finish.
+ *
+ * @param conn Connection with buffered input
+ *
+ * @details Protocol (see protocol.h):
+ * - SUBMIT frames carry the source in FIELD_SOURCE fields; a sequence of
+ *   frames with FRAME_FLAG_MORE is concatenated up to MAX_SOURCE_BYTES
+ * - FRAME_FLAG_NOCACHE on the first frame forces the program to run even
+ *   if its result is memoized
+ * - FRAME_FLAG_STREAM on the first frame streams the program's output
+ *   while it runs (single runs only)
+ * - FIELD_INPUT and FIELD_EXPECTED give the program's stdin and its
+ *   expected output, up to MAX_INPUT_BYTES in total
+ * - FIELD_CASE makes the submission a batch of up to BATCH_MAX_CASES
+ *   runs, each with the INPUT and EXPECTED fields that follow it
+ * - FIELD_PROFILE selects one of the enabled compiler profiles
+ * - FIELD_FILE makes the submission a project of up to PROJECT_MAX_FILES
+ *   files, each with the SOURCE fields that follow it
+ * - A QUIT frame disconnects the client once its jobs have been answered
+ * - Anything else is a protocol error and closes the connection
+ *
+ * @note Submissions are pipelined: a client may send the next one before
+ * the previous ones are answered, and replies arrive in completion order,
+ * told apart by their job ids. Reading is paused while
+ * config.pipeline_depth jobs of the connection are queued or running, so
+ * one client cannot buffer unbounded work. A draining server reads no new
+ * submissions (see drain_connection()).
+ */
+static void handle_client(connection_t *conn) {
+  if (server_draining()) {
+    drain_connection(conn);
+    return;
+  }
+  while (!conn->paused && !conn->closing && take_submission(conn)) {
+  }
+}
+
+/**
+ * @brief Describe the per-run limits actually enforced
+ *
+ * @param buffer Receives one line of text
+ * @param size Size of buffer
+ */
+static void describe_limits(char *buffer, size_t size) {
+  size_t mb = config.limits.memory_bytes / (1024 * 1024);
+
+  switch (quota_mode) {
+  case QUOTA_CGROUP:
+    snprintf(buffer, size,
+             "Resource limits: cgroup v2, %u%% CPU, %zu MB, %u tasks per run "
+             "(0 = unlimited)\n",
+             config.limits.cpu_percent, mb, config.limits.pids);
+    break;
+  case QUOTA_RLIMIT:
+    snprintf(buffer, size,
+             "Resource limits: rlimit, %zu MB address space per run (0 = "
+             "unlimited); CPU share and task limits need cgroup v2\n",
+             mb);
+    break;
+  default:
+    snprintf(buffer, size, "Resource limits: none\n");
+    break;
+  }
+}
+
+/**
+ * @brief Send the worker nodes of a coordinator and their totals as the
+ * end of a STATUS reply
+ *
+ * Each line goes in its own REPLY frame, so the reply holds every node
+ * however many there are. The totals add the jobs the coordinator ran
+ * itself to those of the nodes alive.
+ *
+ * @param conn Admin connection
+ * @param job_id Request identifier to echo
+ */
+static void send_cluster(connection_t *conn, uint32_t job_id) {
+  cluster_node_t nodes[CLUSTER_MAX_NODES];
+  cluster_load_t total;
+  cluster_stats_t cluster;
+  size_t count = cluster_nodes(nodes, CLUSTER_MAX_NODES);
+  char line[BUFFER_SIZE];
+  int len;
+
+  cluster_stats(&cluster);
+  memset(&total, 0, sizeof(total));
+  total.jobs = stats_counter(STAT_COMPILATIONS);
+  total.successful = stats_counter(STAT_SUCCESSFUL);
+  total.rejected = stats_counter(STAT_REJECTED);
+
+  len = snprintf(line, sizeof(line),
+                 "Cluster: %zu/%zu nodes alive, %llu jobs relayed (%llu to "
+                 "their preferred node), %llu failovers, %llu run locally\n",
+                 cluster.alive, cluster.nodes,
+                 (unsigned long long)cluster.forwarded,
+                 (unsigned long long)cluster.affinity,
+                 (unsigned long long)cluster.failovers,
+                 (unsigned long long)cluster.local);
+  if (send_reply_part(conn, job_id, line, (size_t)len, 1) != 0) {
+    return;
+  }
+  for (size_t i = 0; i < count; i++) {
+    const cluster_load_t *load = &nodes[i].load;
+
+    len = snprintf(line, sizeof(line),
+                   "  %-21s %-5s busy %u/%u, queued %u/%u, %u in flight, "
+                   "%llu relayed, %llu jobs, %llu successful, cache "
+                   "%llu/%llu hits\n",
+                   nodes[i].address, nodes[i].alive ? "up" : "down",
+                   load->active, load->workers, load->queued,
+                   load->queue_capacity, nodes[i].in_flight,
+                   (unsigned long long)nodes[i].forwarded,
+                   (unsigned long long)load->jobs,
+                   (unsigned long long)load->successful,
+                   (unsigned long long)load->cache_hits,
+                   (unsigned long long)(load->cache_hits +
+                                        load->cache_misses));
+    if (send_reply_part(conn, job_id, line, (size_t)len, 1) != 0) {
+      return;
+    }
+    if (nodes[i].alive) {
+      total.workers += load->workers;
+      total.active += load->active;
+      total.queued += load->queued;
+      total.queue_capacity += load->queue_capacity;
+      total.jobs += load->jobs;
+      total.successful += load->successful;
+      total.rejected += load->rejected;
+      total.cache_hits += load->cache_hits;
+      total.cache_misses += load->cache_misses;
+    }
+  }
+  len = snprintf(line, sizeof(line),
+                 "Cluster total: %llu jobs, %llu successful, %llu rejected, "
+                 "workers busy %u/%u, queued %u/%u, cache %llu/%llu hits\n",
+                 (unsigned long long)total.jobs,
+                 (unsigned long long)total.successful,
+                 (unsigned long long)total.rejected, total.active,
+                 total.workers, total.queued, total.queue_capacity,
+                 (unsigned long long)total.cache_hits,
+                 (unsigned long long)(total.cache_hits + total.cache_misses));
+  send_reply_part(conn, job_id, line, (size_t)len, 0);
+}
+
+/**
+ * @brief Describe the worker pool's priority classes, for STATUS and
+ * CLASSES
+ *
+ * @param buffer Receives one line per class
+ * @param size Size of buffer
+ */
+static void describe_classes(char *buffer, size_t size) {
+  worker_class_stats_t stats;
+  size_t used = 0;
+
+  buffer[0] = '\0';
+  for (int i = 0; i < WORKER_CLASS_COUNT && used < size; i++) {
+    worker_pool_class_stats(job_pool, (worker_class_t)i, &stats);
+    snprintf(buffer + used, size - used,
+             "Class %-11s %zu/%zu queued, %zu/%zu running, %zu tenants "
+             "waiting, %llu started, %llu rejected\n",
+             worker_pool_class_name((worker_class_t)i), stats.queued,
+             stats.capacity, stats.running, stats.max_running, stats.tenants,
+             (unsigned long long)stats.started,
+             (unsigned long long)stats.rejected);
+    used += strlen(buffer + used);
+  }
+}
+
+/**
+ * @brief Look up a priority class by its admin name
+ *
+ * @param name "interactive" or "batch"
+ * @param cls Receives the class
+ *
+ * @return 0 on success, -1 if there is no such class
+ */
+static int parse_class(const char *name, worker_class_t *cls) {
+  for (int i = 0; i < WORKER_CLASS_COUNT; i++) {
+    if (strcmp(name, worker_pool_class_name((worker_class_t)i)) == 0) {
+      *cls = (worker_class_t)i;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+/**
+ * @brief Execute one admin command and send the reply
+ *
+ * @param conn Admin connection (reactor thread)
+ * @param job_id Request identifier to echo
+ * @param buffer Null-terminated command text
+ *
+ * @details Supported commands:
+ * - "STATUS": Returns server statistics (job counters, caches and
+ *   per-phase latency percentiles); a coordinator adds every worker
+ *   node's load and counters and their totals
+ * - "LOGS [offset]": Returns server.log from byte offset on (a negative
+ *   offset counts back from the end), sent with sendfile()
+ * - "LOGS [TAIL n] [LEVEL l] [SINCE t] [UNTIL t] [FOLLOW] [GREP text]":
+ *   Returns the matching lines; with FOLLOW new matching lines are sent
+ *   as they are written until "LOGS STOP"
+ * - "CLASSES": Returns the priority classes and the tenant weights
+ * - "CLASS <name> <queue> <running>": Sets the queue capacity and running
+ *   limit of a priority class
+ * - "WEIGHT <address> <weight>": Sets the fair queuing weight of a client
+ *   address (1 restores the default)
+ * - "SHUTDOWN [seconds|NOW]": Drains the server: it stops accepting,
+ *   answers the jobs already queued or running for up to seconds
+ *   (default config.drain_s) and exits; NOW exits at once
+ * - "QUIT": Disconnects the admin client
+ *
+ * @return 0 if the connection stays open, -1 if it was closed
+ *
+ * @note SHUTDOWN NOW, or the end of a drain, sets server_running to 0 and
+ * stops the reactor, causing server termination.
+ */
+static int admin_command(connection_t *conn, uint32_t job_id,
+                         const char *buffer) {
+  char response[BUFFER_SIZE];
+
+  if (strncmp(buffer, "STATUS", 6) == 0) {
+    cache_stats_t cache;
+    result_cache_stats_t results;
+    logger_stats_t log;
+    prelude_stats_t preludes;
+    executor_stats_t executors;
+    trace_stats_t traces;
+    stats_summary_t latency;
+    size_t used;
+    int phase;
+    compile_cache_stats(&cache);
+    result_cache_stats(&results);
+
+    // A job is counted as started before it can count as successful
+    unsigned long long successful = stats_counter(STAT_SUCCESSFUL);
+    unsigned long long total = stats_counter(STAT_COMPILATIONS);
+
+    snprintf(response, sizeof(response),
+             "Server Status:\nTotal compilations: %llu\nSuccessful: "
+             "%llu\nFailed: %llu\nWorkers busy: %zu/%zu\nQueued jobs: "
+             "%zu/%zu\nOpen connections: %zu\nCompile cache: %llu hits, "
+             "%llu misses, %llu evictions\nCache usage: %zu entries, "
+             "%zu/%zu KB\n",
+             total, successful, total - successful,
+             worker_pool_active(job_pool), worker_pool_size(job_pool),
+             worker_pool_queued(job_pool), worker_pool_capacity(job_pool),
+             reactor_connections(reactor), (unsigned long long)cache.hits,
+             (unsigned long long)cache.misses,
+             (unsigned long long)cache.evictions, cache.entries,
+             cache.bytes / 1024, cache.max_bytes / 1024);
+
+    used = strlen(response);
+    describe_classes(response + used, sizeof(response) - used);
+
+    used = strlen(response);
+    if (results.ttl > 0) {
+      snprintf(response + used, sizeof(response) - used,
+               "Result cache: %llu hits, %llu misses, %llu expired, "
+               "%zu entries, TTL %us\n",
+               (unsigned long long)results.hits,
+               (unsigned long long)results.misses,
+               (unsigned long long)results.expired, results.entries,
+               results.ttl);
+    } else {
+      snprintf(response + used, sizeof(response) - used,
+               "Result cache: disabled\n");
+    }
+
+    used = strlen(response);
+    snprintf(response + used, sizeof(response) - used,
+             "Compiler profiles: ");
+    used = strlen(response);
+    list_profiles(response + used, sizeof(response) - used);
+    used = strlen(response);
+    snprintf(response + used, sizeof(response) - used, "\n");
+
+    used = strlen(response);
+    logger_stats(&log);
+    snprintf(response + used, sizeof(response) - used,
+             "Log: %llu lines, %llu dropped, %llu batches, %llu rotations\n",
+             (unsigned long long)log.lines, (unsigned long long)log.dropped,
+             (unsigned long long)log.batches,
+             (unsigned long long)log.rotations);
+
+    used = strlen(response);
+    snprintf(response + used, sizeof(response) - used,
+             "Zero-copy: %llu KB output spliced, %llu KB log sent\n",
+             (unsigned long long)stats_counter(STAT_SPLICED_BYTES) / 1024,
+             (unsigned long long)stats_counter(STAT_SENDFILE_BYTES) / 1024);
+
+    used = strlen(response);
+    snprintf(response + used, sizeof(response) - used,
+             "Project units: %llu compiled, %llu objects cached\n",
+             (unsigned long long)stats_counter(STAT_UNITS_COMPILED),
+             (unsigned long long)stats_counter(STAT_UNITS_CACHED));
+
+    used = strlen(response);
+    if (server_draining()) {
+      uint64_t now_us = stats_now_us();
+
+      snprintf(response + used, sizeof(response) - used,
+               "Draining: for %.1f s, %.1f s left before unfinished jobs "
+               "are abandoned\n",
+               (double)(now_us - drain.started_us) / 1e6,
+               now_us < drain.deadline_us
+                   ? (double)(drain.deadline_us - now_us) / 1e6
+                   : 0.0);
+      used = strlen(response);
+    }
+    trace_stats(&traces);
+    if (trace_enabled()) {
+      snprintf(response + used, sizeof(response) - used,
+               "Tracing: %llu traces, %llu written to %s, %llu spans "
+               "dropped\n",
+               (unsigned long long)traces.traces,
+               (unsigned long long)traces.written, config.trace_file,
+               (unsigned long long)traces.dropped);
+    } else {
+      snprintf(response + used, sizeof(response) - used,
+               "Tracing: %llu traces on request, no trace file\n",
+               (unsigned long long)traces.traces);
+    }
+
+    used = strlen(response);
+    prelude_stats(&preludes);
+    snprintf(response + used, sizeof(response) - used,
+             "Precompiled headers: %llu hits, %llu misses, %zu preludes, "
+             "%llu failed\n",
+             (unsigned long long)preludes.hits,
+             (unsigned long long)preludes.misses, preludes.preludes,
+             (unsigned long long)preludes.failures);
+
+    used = strlen(response);
+    if (jit_available() && config.jit_max > 0) {
+      snprintf(response + used, sizeof(response) - used,
+               "In-memory compiles: %llu runs, %llu left to gcc\n",
+               (unsigned long long)stats_counter(STAT_JIT_RUNS),
+               (unsigned long long)stats_counter(STAT_JIT_REJECTED));
+    } else {
+      snprintf(response + used, sizeof(response) - used,
+               "In-memory compiles: %s\n",
+               jit_available() ? "disabled" : "not built in");
+    }
+
+    used = strlen(response);
+    executor_stats(&executors);
+    snprintf(response + used, sizeof(response) - used,
+             "Executors: %zu/%zu alive, %llu jobs, %llu direct spawns%s%s%s\n",
+             executors.alive, executors.processes,
+             (unsigned long long)executors.jobs,
+             (unsigned long long)executors.fallbacks,
+             executors.isolation & EXECUTOR_ISOLATE_NET ? ", private network"
+                                                        : "",
+             executors.isolation & EXECUTOR_ISOLATE_IPC ? ", private IPC" : "",
+             executors.isolation & EXECUTOR_ISOLATE_USER ? " (user namespace)"
+                                                         : "");
+
+    used = strlen(response);
+    stats_summary(PHASE_EXECUTE, &latency);
+    describe_limits(response + used, sizeof(response) - used);
+    used = strlen(response);
+    snprintf(response + used, sizeof(response) - used,
+             "Resource use: %.3f s compiler CPU, %.3f s program CPU, "
+             "%llu KB mean program peak, %llu memory kills, %llu task "
+             "limit hits\n",
+             (double)stats_counter(STAT_COMPILE_CPU_US) / 1e6,
+             (double)stats_counter(STAT_EXECUTE_CPU_US) / 1e6,
+             (unsigned long long)(latency.count > 0
+                                      ? stats_counter(STAT_EXECUTE_PEAK_KB) /
+                                            latency.count
+                                      : 0),
+             (unsigned long long)stats_counter(STAT_MEMORY_KILLED),
+             (unsigned long long)stats_counter(STAT_PIDS_LIMITED));
+
+    used = strlen(response);
+    snprintf(response + used, sizeof(response) - used,
+             "Latency (us)      count       p50       p99      p999       "
+             "max\n");
+    for (phase = 0; phase < STAT_PHASE_COUNT; phase++) {
+      used = strlen(response);
+      stats_summary((stat_phase_t)phase, &latency);
+      snprintf(response + used, sizeof(response) - used,
+               "  %-10s %10llu %9llu %9llu %9llu %9llu\n",
+               stats_phase_name((stat_phase_t)phase),
+               (unsigned long long)latency.count,
+               (unsigned long long)latency.p50,
+               (unsigned long long)latency.p99,
+               (unsigned long long)latency.p999,
+               (unsigned long long)latency.max);
+    }
+    if (config.node_port != 0) {
+      if (send_reply_part(conn, job_id, response, strlen(response), 1) ==
+          0) {
+        send_cluster(conn, job_id);
+      }
+      return 0;
+    }
+  } else if (strncmp(buffer, "SHUTDOWN", 8) == 0) {
+    const char *arg = buffer + 8 + strspn(buffer + 8, " ");
+    unsigned seconds = config.drain_s;
+    int now = strcasecmp(arg, "NOW") == 0;
+    char *end;
+
+    if (*arg != '\0' && !now) {
+      unsigned long value = strtoul(arg, &end, 10);
+
+      if (*end != '\0' || value > UINT_MAX) {
+        snprintf(response, sizeof(response),
+                 "Usage: SHUTDOWN [seconds|NOW]\n");
+        send_reply(conn, job_id, response, strlen(response));
+        return 0;
+      }
+      seconds = (unsigned)value;
+    }
+    if (now) {
+      snprintf(response, sizeof(response), "Server shutting down...\n");
+    } else if (drain_begin(seconds, "admin SHUTDOWN")) {
+      snprintf(response, sizeof(response),
+               "Server draining: %zu jobs queued or running, exiting when "
+               "they finish or in %u s\n",
+               worker_pool_queued(job_pool) + worker_pool_active(job_pool),
+               seconds);
+    } else {
+      snprintf(response, sizeof(response), "Server already draining\n");
+    }
+    send_reply(conn, job_id, response, strlen(response));
+    log_activity("Admin client disconnected");
+    conn_close(conn);
+    if (now) {
+      server_running = 0;
+      reactor_stop(reactor);
+    }
+    return -1;
+  } else if (strncmp(buffer, "LOGS", 4) == 0) {
+    logs_command(conn, job_id, buffer + 4);
+    return 0;
+  } else if (strncmp(buffer, "CLASSES", 7) == 0) {
+    char address[INET_ADDRSTRLEN];
+    size_t used;
+
+    describe_classes(response, sizeof(response));
+    used = strlen(response);
+    snprintf(response + used, sizeof(response) - used, "Tenant weights:%s\n",
+             tenant_weight_count == 0 ? " none, every client has 1" : "");
+    for (size_t i = 0; i < tenant_weight_count; i++) {
+      struct in_addr addr = {htonl(tenant_weights[i].addr)};
+
+      inet_ntop(AF_INET, &addr, address, sizeof(address));
+      used = strlen(response);
+      snprintf(response + used, sizeof(response) - used, "  %-15s %u\n",
+               address, tenant_weights[i].weight);
+    }
+  } else if (strncmp(buffer, "CLASS ", 6) == 0) {
+    char name[32];
+    char log_msg[128];
+    size_t capacity;
+    size_t running;
+    worker_class_t cls;
+
+    if (sscanf(buffer + 6, "%31s %zu %zu", name, &capacity, &running) != 3 ||
+        parse_class(name, &cls) != 0) {
+      snprintf(response, sizeof(response),
+               "Usage: CLASS interactive|batch <queue> <running>\n");
+    } else if (worker_pool_set_limits(job_pool, cls, capacity, running) !=
+               0) {
+      snprintf(response, sizeof(response),
+               "Queue must be at least 1 and running 1 to %zu\n",
+               worker_pool_size(job_pool));
+    } else {
+      snprintf(log_msg, sizeof(log_msg),
+               "Class %s set to %zu queued, %zu running", name, capacity,
+               running);
+      log_activity(log_msg);
+      snprintf(response, sizeof(response), "%s\n", log_msg);
+    }
+  } else if (strncmp(buffer, "WEIGHT ", 7) == 0) {
+    char address[INET_ADDRSTRLEN];
+    char log_msg[128];
+    struct in_addr addr;
+    unsigned weight;
+
+    if (sscanf(buffer + 7, "%15s %u", address, &weight) != 2 ||
+        inet_pton(AF_INET, address, &addr) != 1 || weight == 0 ||
+        weight > TENANT_WEIGHT_MAX) {
+      snprintf(response, sizeof(response),
+               "Usage: WEIGHT <IPv4 address> <1-%d>\n", TENANT_WEIGHT_MAX);
+    } else if (set_tenant_weight(ntohl(addr.s_addr), weight) != 0) {
+      snprintf(response, sizeof(response),
+               "Too many weighted clients (at most %d)\n",
+               MAX_TENANT_WEIGHTS);
+    } else {
+      snprintf(log_msg, sizeof(log_msg), "Tenant %s weight set to %u",
+               address, weight);
+      log_activity(log_msg);
+      snprintf(response, sizeof(response), "%s\n", log_msg);
+    }
+  } else if (strncmp(buffer, "QUIT", 4) == 0) {
+    log_activity("Admin client disconnected");
+    log_unfollow(conn, NULL);
+    conn_close(conn);
+    return -1;
+  } else {
+    snprintf(response, sizeof(response),
+             "Unknown command. Available: STATUS, LOGS [offset], LOGS "
+             "[TAIL n] [LEVEL l] [SINCE t] [UNTIL t] [FOLLOW] [GREP text], "
+             "LOGS STOP, CLASSES, CLASS, WEIGHT, SHUTDOWN [seconds|NOW], "
+             "QUIT\n");
+  }
+
+  send_reply(conn, job_id, response, strlen(response));
+  return 0;
+}
+
+/**
+ * @brief Handle admin client connections
+ *
+ * Called on the reactor thread whenever an admin client has sent data.
+ * Every complete COMMAND frame is executed by admin_command(). Admin
+ * commands are cheap, so they are answered inline instead of occupying a
+ * worker; only LOGS, which may send a large file, goes to one, and the
+ * connection is not read until it is done.
+ *
+ * @param conn Connection with buffered input
+ */
+static void handle_admin(connection_t *conn) {
+  char buffer[BUFFER_SIZE];
+  frame_header_t header;
+  int rc = 0;
+
+  while (!conn->paused && (rc = frame_at(conn, 0, &header)) == 1) {
+    size_t len = header.length < BUFFER_SIZE - 1 ? header.length
+                                                 : BUFFER_SIZE - 1;
+
+    if (header.type == FRAME_QUIT) {
+      log_activity("Admin client disconnected");
+      log_unfollow(conn, NULL);
+      conn_close(conn);
+      return;
+    }
+    if (header.type != FRAME_COMMAND) {
+      protocol_error(conn, header.job_id, "ERROR: Unexpected frame type\n");
+      return;
+    }
+
+    memcpy(buffer, conn->in + FRAME_HEADER_SIZE, len);
+    buffer[len] = '\0';
+    conn_consume(conn, FRAME_HEADER_SIZE + header.length);
+
+    if (admin_command(conn, header.job_id, buffer) != 0) {
+      return;
+    }
+  }
+  if (rc < 0) {
+    protocol_error(conn, 0, "ERROR: Malformed frame\n");
+  }
+}
+
+/**
+ * @brief Handle heartbeats from worker nodes (coordinator)
+ *
+ * Called on the reactor thread. Every COMMAND frame is a heartbeat for
+ * cluster_heartbeat(), which identifies the node by the address it
+ * connected from and the port it announces.
+ *
+ * @param conn Node connection with buffered input
+ */
+static void handle_node(connection_t *conn) {
+  char buffer[BUFFER_SIZE];
+  char host[INET_ADDRSTRLEN];
+  struct sockaddr_in peer;
+  socklen_t peer_len = sizeof(peer);
+  frame_header_t header;
+  int rc;
+
+  if (getpeername(conn->fd, (struct sockaddr *)&peer, &peer_len) != 0 ||
+      peer.sin_family != AF_INET ||
+      !inet_ntop(AF_INET, &peer.sin_addr, host, sizeof(host))) {
+    conn_close(conn);
+    return;
+  }
+
+  while ((rc = frame_at(conn, 0, &header)) == 1) {
+    size_t len = header.length < BUFFER_SIZE - 1 ? header.length
+                                                 : BUFFER_SIZE - 1;
+
+    if (header.type != FRAME_COMMAND) {
+      protocol_error(conn, header.job_id, "ERROR: Unexpected frame type\n");
+      return;
+    }
+    memcpy(buffer, conn->in + FRAME_HEADER_SIZE, len);
+    buffer[len] = '\0';
+    conn_consume(conn, FRAME_HEADER_SIZE + header.length);
+
+    if (cluster_heartbeat(host, buffer) != 0) {
+      protocol_error(conn, 0, "ERROR: Malformed heartbeat\n");
+      return;
+    }
+  }
+  if (rc < 0) {
+    protocol_error(conn, 0, "ERROR: Malformed frame\n");
+  }
+}
 
-/** @def MAX_CLIENTS
- * @brief Maximum number of concurrent client connections
+/**
+ * @brief Append a family with one sample per priority class
+ *
+ * @param text Exposition
+ * @param name Metric name
+ * @param type "counter" or "gauge"
+ * @param help One-line description
+ * @param values Sample of every class
  */
-#define MAX_CLIENTS 10
+static void metrics_classes(metrics_text_t *text, const char *name,
+                            const char *type, const char *help,
+                            const double values[WORKER_CLASS_COUNT]) {
+  char labels[64];
+
+  metrics_family(text, name, type, help);
+  for (int i = 0; i < WORKER_CLASS_COUNT; i++) {
+    snprintf(labels, sizeof(labels), "class=\"%s\"",
+             worker_pool_class_name((worker_class_t)i));
+    metrics_sample(text, name, labels, values[i]);
+  }
+}
 
 /**
- * @struct client_info_t
- * @brief Structure to hold client connection information
+ * @brief Render the Prometheus exposition of the server's state
  *
- * @var client_info_t::socket
- * Client socket file descriptor
- * @var client_info_t::type
- * Client type ("regular" or "admin")
+ * @param text Receives the metrics
  */
-typedef struct {
-  int socket;    /**< Client socket file descriptor */
-  char type[20]; /**< Client type identifier */
-} client_info_t;
+static void render_metrics(metrics_text_t *text) {
+  cache_stats_t cache;
+  result_cache_stats_t results;
+  prelude_stats_t preludes;
+  executor_stats_t executors;
+  logger_stats_t log;
+  trace_stats_t traces;
+  worker_class_stats_t classes[WORKER_CLASS_COUNT];
+  double queued[WORKER_CLASS_COUNT];
+  double running[WORKER_CLASS_COUNT];
+  double started[WORKER_CLASS_COUNT];
+  double rejected[WORKER_CLASS_COUNT];
 
-/** @brief Global flag to control server running state */
-int server_running = 1;
+  compile_cache_stats(&cache);
+  result_cache_stats(&results);
+  prelude_stats(&preludes);
+  logger_stats(&log);
+  for (int i = 0; i < WORKER_CLASS_COUNT; i++) {
+    worker_pool_class_stats(job_pool, (worker_class_t)i, &classes[i]);
+    queued[i] = (double)classes[i].queued;
+    running[i] = (double)classes[i].running;
+    started[i] = (double)classes[i].started;
+    rejected[i] = (double)classes[i].rejected;
+  }
+
+  metrics_single(text, "cce_jobs_total", "counter", "Jobs started",
+                 (double)stats_counter(STAT_COMPILATIONS));
+  metrics_single(text, "cce_jobs_successful_total", "counter",
+                 "Jobs whose program exited with status 0",
+                 (double)stats_counter(STAT_SUCCESSFUL));
+  metrics_single(text, "cce_jobs_rejected_total", "counter",
+                 "Submissions rejected with BUSY because the queue was full",
+                 (double)stats_counter(STAT_REJECTED));
+  metrics_single(text, "cce_spawn_failures_total", "counter",
+                 "Compiler or program processes that could not be started",
+                 (double)stats_counter(STAT_SPAWN_FAILED));
+  metrics_single(text, "cce_compiler_cpu_seconds_total", "counter",
+                 "CPU time used by compiler runs",
+                 (double)stats_counter(STAT_COMPILE_CPU_US) / 1e6);
+  metrics_single(text, "cce_program_cpu_seconds_total", "counter",
+                 "CPU time used by program runs",
+                 (double)stats_counter(STAT_EXECUTE_CPU_US) / 1e6);
+  metrics_single(text, "cce_program_peak_memory_bytes_total", "counter",
+                 "Sum of the peak memory of every program run",
+                 (double)stats_counter(STAT_EXECUTE_PEAK_KB) * 1024);
+  metrics_single(text, "cce_memory_limit_kills_total", "counter",
+                 "Compiler or program runs killed at the memory limit",
+                 (double)stats_counter(STAT_MEMORY_KILLED));
+  metrics_single(text, "cce_task_limit_hits_total", "counter",
+                 "Program runs that hit the task limit",
+                 (double)stats_counter(STAT_PIDS_LIMITED));
+  metrics_single(text, "cce_jit_runs_total", "counter",
+                 "Programs compiled in memory with libtcc",
+                 (double)stats_counter(STAT_JIT_RUNS));
+  metrics_single(text, "cce_jit_rejected_total", "counter",
+                 "Sources libtcc rejected, compiled with gcc instead",
+                 (double)stats_counter(STAT_JIT_REJECTED));
+  metrics_single(text, "cce_queue_depth", "gauge",
+                 "Jobs waiting for a worker",
+                 (double)worker_pool_queued(job_pool));
+  metrics_single(text, "cce_queue_capacity", "gauge",
+                 "Jobs that may wait before submissions are rejected",
+                 (double)worker_pool_capacity(job_pool));
+  metrics_single(text, "cce_workers_busy", "gauge",
+                 "Workers currently running a job",
+                 (double)worker_pool_active(job_pool));
+  metrics_single(text, "cce_workers", "gauge", "Worker threads",
+                 (double)worker_pool_size(job_pool));
+  metrics_classes(text, "cce_class_queue_depth", "gauge",
+                  "Jobs of a priority class waiting for a worker", queued);
+  metrics_classes(text, "cce_class_workers_busy", "gauge",
+                  "Workers running a job of a priority class", running);
+  metrics_classes(text, "cce_class_jobs_started_total", "counter",
+                  "Jobs of a priority class handed to a worker", started);
+  metrics_classes(text, "cce_class_jobs_rejected_total", "counter",
+                  "Submissions refused because their class's queue was full",
+                  rejected);
+  metrics_single(text, "cce_connections", "gauge", "Open client connections",
+                 (double)reactor_connections(reactor));
+  executor_stats(&executors);
+  metrics_single(text, "cce_executors_alive", "gauge",
+                 "Pre-forked executor processes still usable",
+                 (double)executors.alive);
+  metrics_single(text, "cce_executor_fallbacks_total", "counter",
+                 "Programs spawned directly because no executor was alive",
+                 (double)executors.fallbacks);
+
+  metrics_single(text, "cce_compile_cache_hits_total", "counter",
+                 "Compile cache lookups answered from the cache",
+                 (double)cache.hits);
+  metrics_single(text, "cce_compile_cache_misses_total", "counter",
+                 "Compile cache lookups that required a compile",
+                 (double)cache.misses);
+  metrics_single(text, "cce_compile_cache_evictions_total", "counter",
+                 "Compile cache entries evicted to respect the size limit",
+                 (double)cache.evictions);
+  metrics_single(text, "cce_compile_cache_bytes", "gauge",
+                 "Bytes held by the compile cache", (double)cache.bytes);
+  metrics_single(text, "cce_result_cache_hits_total", "counter",
+                 "Runs answered from the result cache", (double)results.hits);
+  metrics_single(text, "cce_result_cache_misses_total", "counter",
+                 "Result cache lookups that had to run the program",
+                 (double)results.misses);
+  metrics_single(text, "cce_precompiled_header_hits_total", "counter",
+                 "Compiles that used a precompiled prelude",
+                 (double)preludes.hits);
+  metrics_single(text, "cce_precompiled_header_misses_total", "counter",
+                 "Compiles that parsed their headers", (double)preludes.misses);
+  metrics_single(text, "cce_log_lines_total", "counter",
+                 "Lines written to the activity log", (double)log.lines);
+  metrics_single(text, "cce_log_dropped_total", "counter",
+                 "Log lines dropped because the logger fell behind",
+                 (double)log.dropped);
+  metrics_single(text, "cce_output_spliced_bytes_total", "counter",
+                 "Program output spliced from its pipe to the client",
+                 (double)stats_counter(STAT_SPLICED_BYTES));
+  metrics_single(text, "cce_log_sendfile_bytes_total", "counter",
+                 "Log bytes sent to admin clients with sendfile()",
+                 (double)stats_counter(STAT_SENDFILE_BYTES));
+  metrics_single(text, "cce_project_units_compiled_total", "counter",
+                 "Project translation units compiled",
+                 (double)stats_counter(STAT_UNITS_COMPILED));
+  metrics_single(text, "cce_project_units_cached_total", "counter",
+                 "Project translation units whose object was cached",
+                 (double)stats_counter(STAT_UNITS_CACHED));
 
-/** @brief Total number of compilation attempts */
-int total_compilations = 0;
+  trace_stats(&traces);
+  metrics_single(text, "cce_traces_total", "counter", "Jobs traced",
+                 (double)traces.traces);
+  metrics_single(text, "cce_trace_spans_dropped_total", "counter",
+                 "Spans that did not fit their trace",
+                 (double)traces.dropped);
 
-/** @brief Number of successful compilations */
-int successful_compilations = 0;
+  if (config.node_port != 0) {
+    cluster_stats_t cluster;
 
-/** @brief Mutex for protecting statistics variables */
-pthread_mutex_t stats_mutex = PTHREAD_MUTEX_INITIALIZER;
+    cluster_stats(&cluster);
+    metrics_single(text, "cce_cluster_nodes_alive", "gauge",
+                   "Worker nodes receiving jobs", (double)cluster.alive);
+    metrics_single(text, "cce_cluster_relayed_total", "counter",
+                   "Jobs answered by a worker node",
+                   (double)cluster.forwarded);
+    metrics_single(text, "cce_cluster_affinity_total", "counter",
+                   "Relayed jobs answered by their preferred node",
+                   (double)cluster.affinity);
+    metrics_single(text, "cce_cluster_failovers_total", "counter",
+                   "Jobs moved on after a node was busy or unreachable",
+                   (double)cluster.failovers);
+    metrics_single(text, "cce_cluster_local_total", "counter",
+                   "Jobs the coordinator ran because no node was alive",
+                   (double)cluster.local);
+  }
+
+  metrics_phase_histograms(text, "cce_job_phase_duration_seconds");
+  metrics_process(text);
+}
 
 /**
- * @brief Log activities to server log file
+ * @brief Send an HTTP response and close the connection
  *
- * This function writes timestamped log messages to server.log file.
- * It automatically adds timestamps and handles file operations.
+ * Called on the reactor thread: a response the scraper does not read at
+ * once is queued and the connection closed once it is sent.
  *
- * @param message The message to log
+ * @param conn Scraper connection
+ * @param status Status line after "HTTP/1.1 ", e.g. "200 OK"
+ * @param type Content-Type
+ * @param body Response body
+ * @param len Body size
+ */
+static void send_http(connection_t *conn, const char *status, const char *type,
+                      const char *body, size_t len) {
+  char head[256];
+  struct iovec iov[2];
+  int head_len = snprintf(head, sizeof(head),
+                          "HTTP/1.1 %s\r\nContent-Type: %s\r\n"
+                          "Content-Length: %zu\r\nConnection: close\r\n\r\n",
+                          status, type, len);
+
+  iov[0].iov_base = head;
+  iov[0].iov_len = (size_t)head_len;
+  iov[1].iov_base = (void *)body;
+  iov[1].iov_len = len;
+  conn_postv(conn, iov, 2);
+  conn_close(conn);
+}
+
+/**
+ * @brief Handle input from a metrics scraper
  *
- * @note The function is thread-safe but doesn't use explicit locking.
- * Multiple threads may write simultaneously, which could interleave output.
+ * Answers one `GET /metrics` per connection with the Prometheus
+ * text format; anything else gets a 404 or 405. The exposition is
+ * rendered on the reactor thread, which only reads counters and takes the
+ * caches' locks briefly.
  *
- * @warning If the log file cannot be opened, the message is silently discarded.
+ * @param conn Connection with buffered input
  */
-void log_activity(const char *message) {
-  FILE *log_file = fopen("server.log", "a");
-  if (log_file) {
-    time_t now = time(NULL);
-    char *time_str = ctime(&now);
-    time_str[strlen(time_str) - 1] = '\0'; // Remove newline
-    fprintf(log_file, "[%s] %s\n", time_str, message);
-    fclose(log_file);
+static void handle_metrics(connection_t *conn) {
+  char method[16];
+  char path[256];
+  metrics_text_t text;
+  long head = metrics_parse_request(conn->in, conn->in_len, method,
+                                    sizeof(method), path, sizeof(path));
+
+  if (head == 0) {
+    return;
   }
+  if (head < 0) {
+    send_http(conn, "400 Bad Request", "text/plain", "Bad request\n", 12);
+    return;
+  }
+  conn_consume(conn, (size_t)head);
+
+  if (strcmp(path, "/metrics") != 0) {
+    send_http(conn, "404 Not Found", "text/plain", "Not found\n", 10);
+    return;
+  }
+  if (strcmp(method, "GET") != 0) {
+    send_http(conn, "405 Method Not Allowed", "text/plain",
+              "Method not allowed\n", 19);
+    return;
+  }
+
+  metrics_init(&text);
+  render_metrics(&text);
+  if (text.failed) {
+    send_http(conn, "500 Internal Server Error", "text/plain",
+              "Out of memory\n", 14);
+  } else {
+    send_http(conn, "200 OK", METRICS_CONTENT_TYPE, text.data, text.len);
+  }
+  metrics_free(&text);
 }
 
 /**
- * @brief Compile and execute C source code
- *
- * This function takes C source code, writes it to a temporary file,
- * compiles it using GCC, and executes the resulting program.
+ * @brief Reactor input callback: route input by listener kind
  *
- * @param code Pointer to null-terminated C source code string
- * @param output Buffer to store compilation/execution output
- * @param output_size Size of the output buffer
+ * @param conn Connection with buffered input
+ */
+static void dispatch_input(connection_t *conn) {
+  if (conn->kind == CONN_ADMIN) {
+    handle_admin(conn);
+  } else if (conn->kind == CONN_METRICS) {
+    handle_metrics(conn);
+  } else if (conn->kind == CONN_NODE) {
+    handle_node(conn);
+  } else {
+    handle_client(conn);
+  }
+}
+
+/**
+ * @brief Fill in the heartbeat of a worker node (cluster_load_fn)
  *
- * @return 0 on successful execution, -1 on compilation failure,
- *         or the exit code of the executed program
+ * @param load Receives the worker pool load and job counters
+ */
+static void report_load(cluster_load_t *load) {
+  cache_stats_t cache;
+
+  compile_cache_stats(&cache);
+  load->workers = (uint32_t)worker_pool_size(job_pool);
+  load->active = (uint32_t)worker_pool_active(job_pool);
+  load->queued = (uint32_t)worker_pool_queued(job_pool);
+  load->queue_capacity = (uint32_t)worker_pool_capacity(job_pool);
+  load->jobs = stats_counter(STAT_COMPILATIONS);
+  load->successful = stats_counter(STAT_SUCCESSFUL);
+  load->rejected = stats_counter(STAT_REJECTED);
+  load->cache_hits = cache.hits;
+  load->cache_misses = cache.misses;
+}
+
+/**
+ * @brief Allow as many open sockets as the hard limit permits
  *
- * @details The function performs the following steps:
- * 1. Writes source code to "temp_code.c"
- * 2. Compiles using "gcc temp_code.c -o temp_program"
- * 3. Executes with 5-second timeout using "timeout 5 ./temp_program"
- * 4. Captures both stdout and stderr
- * 5. Updates compilation statistics
- * 6. Cleans up temporary files
+ * Idle clients only cost a file descriptor each, so the soft
+ * RLIMIT_NOFILE is the practical cap on concurrent connections.
+ */
+static void raise_fd_limit(void) {
+  struct rlimit limit;
+
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+  }
+}
+
+/**
+ * @brief Record the exact compiler version of one profile
  *
- * @note The function uses system() calls which could be a security risk
- * in production environments. For educational purposes only.
+ * A compiler upgrade changes the key of every submission, so binaries built
+ * by the old compiler are never served after the upgrade.
  *
- * @warning Temporary files are created in the current directory.
- * Ensure proper permissions and disk space.
+ * @param profile Profile whose toolchain is filled in ("" if the compiler
+ *        cannot be run)
  */
-int compile_and_execute(const char *code, char *output, size_t output_size) {
-  char log_msg[256];
+static void detect_toolchain(profile_t *profile) {
+  char *argv[] = {(char *)profile->compiler, (char *)profile->version_flag,
+                  NULL};
+  process_spec_t spec;
+  process_result_t result;
 
-  // Write code to temporary file
-  FILE *temp_file = fopen("temp_code.c", "w");
-  if (!temp_file) {
-    snprintf(output, output_size, "ERROR: Cannot create temporary file\n");
-    return -1;
+  // Profiles sharing a compiler share its version
+  for (profile_t *other = profiles; other < profile; other++) {
+    if (strcmp(other->compiler, profile->compiler) == 0) {
+      memcpy(profile->toolchain, other->toolchain, sizeof(profile->toolchain));
+      return;
+    }
   }
-  fprintf(temp_file, "%s", code);
-  fclose(temp_file);
 
-  pthread_mutex_lock(&stats_mutex);
-  total_compilations++;
-  pthread_mutex_unlock(&stats_mutex);
+  memset(&spec, 0, sizeof(spec));
+  spec.argv = argv;
+  spec.search_path = 1;
+  spec.timeout_ms = COMPILE_TIMEOUT_MS;
+  spec.output = profile->toolchain;
+  spec.output_size = sizeof(profile->toolchain);
 
-  // Compile the code
-  int compile_result =
-      system("gcc temp_code.c -o temp_program 2> compile_error.log");
+  if (process_run(&spec, &result) != 0 || !WIFEXITED(result.status) ||
+      WEXITSTATUS(result.status) != 0) {
+    profile->toolchain[0] = '\0';
+    return;
+  }
+  profile->toolchain[strcspn(profile->toolchain, "\n")] = '\0';
+  if (profile->toolchain[0] == '\0') {
+    snprintf(profile->toolchain, sizeof(profile->toolchain), "%s",
+             profile->compiler);
+  }
+}
 
-  if (compile_result != 0) {
-    // Compilation failed
-    FILE *error_file = fopen("compile_error.log", "r");
-    if (error_file) {
-      fread(output, 1, output_size - 1, error_file);
-      fclose(error_file);
-    } else {
-      snprintf(output, output_size, "ERROR: Compilation failed\n");
+/**
+ * @brief Detect the installed compilers and apply the -o whitelist
+ *
+ * @return 0 on success, -1 if -o names an unknown profile or no profile
+ *         it names is installed
+ */
+static int setup_profiles(void) {
+  char list[256];
+  char *name;
+  char *saved;
+
+  for (size_t i = 0; i < PROFILE_COUNT; i++) {
+    detect_toolchain(&profiles[i]);
+  }
+  if (!config.profiles) {
+    // The built-in profile stays usable even if gcc --version misbehaves
+    if (profiles[0].toolchain[0] == '\0') {
+      snprintf(profiles[0].toolchain, sizeof(profiles[0].toolchain), "%s",
+               COMPILER);
+    }
+    for (size_t i = 0; i < PROFILE_COUNT; i++) {
+      profiles[i].enabled = profiles[i].toolchain[0] != '\0';
+    }
+  } else {
+    default_profile = NULL;
+    snprintf(list, sizeof(list), "%s", config.profiles);
+    for (name = strtok_r(list, ",", &saved); name;
+         name = strtok_r(NULL, ",", &saved)) {
+      profile_t *profile = NULL;
+      for (size_t i = 0; i < PROFILE_COUNT; i++) {
+        if (strcmp(profiles[i].name, name) == 0) {
+          profile = &profiles[i];
+        }
+      }
+      if (!profile) {
+        fprintf(stderr, "Unknown compiler profile: %s\n", name);
+        return -1;
+      }
+      if (profile->toolchain[0] == '\0') {
+        printf("Compiler profile %s: %s not installed\n", name,
+               profile->compiler);
+        continue;
+      }
+      profile->enabled = 1;
+      if (!default_profile) {
+        default_profile = profile;
+      }
+    }
+    if (!default_profile) {
+      fprintf(stderr, "None of the compiler profiles is installed\n");
+      return -1;
     }
-    snprintf(log_msg, sizeof(log_msg), "Compilation failed");
-    log_activity(log_msg);
-    return -1;
   }
 
-  // Execute the program
-  FILE *exec_pipe = popen("timeout 5 ./temp_program 2>&1", "r");
-  if (!exec_pipe) {
-    snprintf(output, output_size, "ERROR: Cannot execute program\n");
-    return -1;
+  list_profiles(list, sizeof(list));
+  printf("Compiler profiles: %s (%s)\n", list, default_profile->toolchain);
+  for (size_t i = 0; i < PROFILE_COUNT; i++) {
+    if (!config.profiles && profiles[i].toolchain[0] == '\0') {
+      printf("Compiler profile %s: %s not installed\n", profiles[i].name,
+             profiles[i].compiler);
+    }
   }
+  return 0;
+}
 
-  size_t bytes_read = fread(output, 1, output_size - 1, exec_pipe);
-  output[bytes_read] = '\0';
-
-  int exec_result = pclose(exec_pipe);
+/**
+ * @brief Create the compile cache directory and enable the cache
+ */
+static void setup_compile_cache(void) {
+  char dir[PATH_MAX / 2];
+  cache_stats_t cache;
 
-  pthread_mutex_lock(&stats_mutex);
-  if (exec_result == 0) {
-    successful_compilations++;
+  if (config.cache_mb == 0) {
+    printf("Compile cache: disabled\n");
+    return;
   }
-  pthread_mutex_unlock(&stats_mutex);
-
-  // Clean up
-  unlink("temp_code.c");
-  unlink("temp_program");
-  unlink("compile_error.log");
+  if (config.cache_dir) {
+    if ((mkdir(config.cache_dir, 0700) != 0 && errno != EEXIST) ||
+        compile_cache_init(config.cache_dir, config.cache_mb * 1024 * 1024,
+                           1) != 0) {
+      perror("compile cache directory");
+      printf("Compile cache: unavailable, continuing without it\n");
+      return;
+    }
+    compile_cache_stats(&cache);
+    printf("Compile cache: %zu MB in %s, %zu entries kept\n",
+           config.cache_mb, config.cache_dir, cache.entries);
+    return;
+  }
+  if (workspace_mkdtemp(dir, sizeof(dir), CACHE_DIR_TEMPLATE) != 0 ||
+      compile_cache_init(dir, config.cache_mb * 1024 * 1024, 0) != 0) {
+    printf("Compile cache: unavailable, continuing without it\n");
+    return;
+  }
+  printf("Compile cache: %zu MB in %s\n", config.cache_mb, dir);
+}
 
-  snprintf(log_msg, sizeof(log_msg), "Code executed, result: %d", exec_result);
-  log_activity(log_msg);
+/**
+ * @brief Create the prelude directory and enable precompiled headers
+ */
+static void setup_prelude(void) {
+  char dir[PATH_MAX / 2];
 
-  return exec_result;
+  if (config.prelude_headers[0] == '\0') {
+    printf("Precompiled headers: disabled\n");
+    return;
+  }
+  if (workspace_mkdtemp(dir, sizeof(dir), PRELUDE_DIR_TEMPLATE) != 0 ||
+      prelude_init(dir, COMPILER, COMPILER_FLAGS, config.prelude_headers) !=
+          0) {
+    printf("Precompiled headers: unavailable, continuing without them\n");
+    return;
+  }
+  printf("Precompiled headers: %s in %s\n", config.prelude_headers, dir);
 }
 
 /**
- * @brief Handle regular client connections
- *
- * This function runs in a separate thread for each regular client connection.
- * It receives C source code from clients, compiles and executes it,
- * then sends the results back.
+ * @brief Print command line usage
  *
- * @param arg Pointer to client_info_t structure containing client details
- * @return NULL when client disconnects
- *
- * @details Protocol:
- * - Receives C source code in text format
- * - Special command "QUIT" disconnects the client
- * - All other input is treated as C source code
- * - Sends compilation/execution results back to client
- *
- * @note This function is designed to be called as a pthread function.
- * The client_info_t structure is freed when the client disconnects.
+ * @param prog Program name (argv[0])
  */
-void *handle_client(void *arg) {
-  client_info_t *client = (client_info_t *)arg;
-  char buffer[BUFFER_SIZE];
-  char output[BUFFER_SIZE];
+static void print_usage(const char *prog) {
+  printf("Usage: %s [-w workers] [-q queue] [-p depth] [-r retry_ms] "
+         "[-c cache_mb] [-R ttl] [-l log_mb]\n"
+         "       [-H headers] [-m port] [-e executors] [-C cpu_percent] "
+         "[-M memory_mb] [-P tasks]\n"
+         "       [-o profiles] [-J bytes] [-L port] [-A port] [-N port] "
+         "[-j host[:port]]\n"
+         "       [-T file] [-D seconds] [-U path] [-K dir]\n",
+         prog);
+  printf("  -w workers   Worker threads (default: online CPUs)\n");
+  printf("  -q queue     Queued jobs of each priority class before BUSY\n"
+         "               (default: %d x workers)\n",
+         QUEUE_PER_WORKER);
+  printf("  -p depth     Jobs in flight per connection (default: %d)\n",
+         DEFAULT_PIPELINE_DEPTH);
+  printf("  -r retry_ms  Retry hint sent with BUSY (default: %d)\n",
+         DEFAULT_RETRY_AFTER_MS);
+  printf("  -c cache_mb  Compile cache size, 0 disables (default: %d)\n",
+         DEFAULT_CACHE_MB);
+  printf("  -R ttl       Memoize program output for ttl seconds; only for\n"
+         "               deterministic workloads (default: 0, disabled)\n");
+  printf("  -l log_mb    Rotate %s at this size, 0 never (default: %d)\n",
+         LOG_FILE, DEFAULT_LOG_MB);
+  printf("  -H headers   Comma-separated headers to precompile, \"\" disables\n"
+         "               (default: %s)\n",
+         PRELUDE_HEADERS);
+  printf("  -m port      HTTP port of /metrics, 0 disables (default: %d)\n",
+         METRICS_PORT);
+  printf("  -e executors Pre-forked processes that run programs, 0 spawns\n"
+         "               them directly (default: one per worker)\n");
+  printf("  -C percent   CPU bandwidth per compiler or program run, 100 is\n"
+         "               one core, 0 unlimited (default: %d)\n",
+         DEFAULT_CPU_PERCENT);
+  printf("  -M memory_mb Memory limit per run, 0 unlimited (default: %d)\n",
+         DEFAULT_MEMORY_MB);
+  printf("  -P tasks     Process and thread limit per run, 0 unlimited\n"
+         "               (default: %d)\n",
+         DEFAULT_PIDS);
+  printf("  -o profiles  Comma-separated compiler profiles clients may\n"
+         "               select, the first being the default (default:\n"
+         "               every installed one of fast, O2, native, clang,\n"
+         "               tcc)\n");
+  printf("  -J bytes     Compile \"fast\" sources up to this size in memory\n"
+         "               with libtcc, 0 disables it (default: %d)%s\n",
+         DEFAULT_JIT_MAX, jit_available() ? "" : " [not built in]");
+  printf("  -L port      Port of regular clients (default: %d)\n", PORT);
+  printf("  -A port      Port of admin clients (default: %d)\n", ADMIN_PORT);
+  printf("  -N port      Coordinate a cluster: accept worker nodes on this\n"
+         "               port (conventionally %d) and relay jobs to them\n",
+         CLUSTER_NODE_PORT);
+  printf("  -j host[:port]\n"
+         "               Work for the coordinator at host (node port\n"
+         "               default: %d)\n",
+         CLUSTER_NODE_PORT);
+  printf("  -T file      Trace every job into this Chrome trace file\n"
+         "               (default: only jobs whose client asks)\n");
+  printf("  -D seconds   How long SHUTDOWN and SIGTERM wait for unfinished\n"
+         "               jobs (default: %d)\n",
+         DEFAULT_DRAIN_S);
+  printf("  -U path      Take the listening sockets over from the server\n"
+         "               on this Unix socket, and hand them to the next\n"
+         "               one started with it (default: no handover)\n");
+  printf("  -K dir       Keep the compile cache in this directory across\n"
+         "               restarts, shared with other servers using it\n"
+         "               (default: a private one, deleted at exit)\n");
+}
 
-  log_activity("Regular client connected");
+/**
+ * @brief Parse command line options into the global configuration
+ *
+ * @param argc Argument count
+ * @param argv Argument vector
+ * @return 0 on success, -1 on invalid usage
+ */
+static int parse_options(int argc, char **argv) {
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  int opt;
 
-  while (1) {
-    memset(buffer, 0, BUFFER_SIZE);
-    int bytes_received = recv(client->socket, buffer, BUFFER_SIZE - 1, 0);
+  config.workers = cpus > 0 ? (size_t)cpus : 1;
+  config.queue_capacity = 0;
+  config.pipeline_depth = DEFAULT_PIPELINE_DEPTH;
+  config.retry_after_ms = DEFAULT_RETRY_AFTER_MS;
+  config.cache_mb = DEFAULT_CACHE_MB;
+  config.cache_dir = NULL;
+  config.result_ttl = 0;
+  config.log_mb = DEFAULT_LOG_MB;
+  config.prelude_headers = PRELUDE_HEADERS;
+  config.metrics_port = METRICS_PORT;
+  config.executors = (size_t)-1;
+  config.limits.cpu_percent = DEFAULT_CPU_PERCENT;
+  config.limits.memory_bytes = (size_t)DEFAULT_MEMORY_MB * 1024 * 1024;
+  config.limits.pids = DEFAULT_PIDS;
+  config.profiles = NULL;
+  config.jit_max = DEFAULT_JIT_MAX;
+  config.port = PORT;
+  config.admin_port = ADMIN_PORT;
+  config.node_port = 0;
+  config.coordinator = NULL;
+  config.trace_file = NULL;
+  config.drain_s = DEFAULT_DRAIN_S;
+  config.handover_path = NULL;
 
-    if (bytes_received <= 0) {
+  while ((opt = getopt(argc, argv,
+                       "w:q:p:r:c:R:l:H:m:e:C:M:P:o:J:L:A:N:j:T:D:U:K:h")) !=
+         -1) {
+    switch (opt) {
+    case 'w':
+      config.workers = strtoul(optarg, NULL, 10);
       break;
-    }
-
-    if (strncmp(buffer, "QUIT", 4) == 0) {
+    case 'q':
+      config.queue_capacity = strtoul(optarg, NULL, 10);
+      break;
+    case 'p':
+      config.pipeline_depth = (unsigned)strtoul(optarg, NULL, 10);
+      break;
+    case 'r':
+      config.retry_after_ms = (unsigned)strtoul(optarg, NULL, 10);
+      break;
+    case 'c':
+      config.cache_mb = strtoul(optarg, NULL, 10);
+      break;
+    case 'R':
+      config.result_ttl = (unsigned)strtoul(optarg, NULL, 10);
+      break;
+    case 'l':
+      config.log_mb = strtoul(optarg, NULL, 10);
+      break;
+    case 'H':
+      config.prelude_headers = optarg;
+      break;
+    case 'm':
+      config.metrics_port = (unsigned)strtoul(optarg, NULL, 10);
+      break;
+    case 'e':
+      config.executors = strtoul(optarg, NULL, 10);
+      break;
+    case 'C':
+      config.limits.cpu_percent = (unsigned)strtoul(optarg, NULL, 10);
+      break;
+    case 'M':
+      config.limits.memory_bytes = strtoul(optarg, NULL, 10) * 1024 * 1024;
       break;
+    case 'P':
+      config.limits.pids = (unsigned)strtoul(optarg, NULL, 10);
+      break;
+    case 'o':
+      config.profiles = optarg;
+      break;
+    case 'J':
+      config.jit_max = strtoul(optarg, NULL, 10);
+      break;
+    case 'L':
+      config.port = (unsigned)strtoul(optarg, NULL, 10);
+      break;
+    case 'A':
+      config.admin_port = (unsigned)strtoul(optarg, NULL, 10);
+      break;
+    case 'N':
+      config.node_port = (unsigned)strtoul(optarg, NULL, 10);
+      break;
+    case 'j':
+      config.coordinator = optarg;
+      break;
+    case 'T':
+      config.trace_file = optarg;
+      break;
+    case 'D':
+      config.drain_s = (unsigned)strtoul(optarg, NULL, 10);
+      break;
+    case 'U':
+      config.handover_path = optarg;
+      break;
+    case 'K':
+      config.cache_dir = optarg;
+      break;
+    case 'h':
+      print_usage(argv[0]);
+      exit(EXIT_SUCCESS);
+    default:
+      return -1;
     }
-
-    // Compile and execute the received code
-    compile_and_execute(buffer, output, sizeof(output));
-
-    // Send result back to client
-    send(client->socket, output, strlen(output), 0);
   }
 
-  log_activity("Regular client disconnected");
-  close(client->socket);
-  free(client);
-  return NULL;
+  if (config.workers == 0) {
+    fprintf(stderr, "Worker count must be at least 1\n");
+    return -1;
+  }
+  if (config.pipeline_depth == 0) {
+    fprintf(stderr, "Pipeline depth must be at least 1\n");
+    return -1;
+  }
+  if (config.port == 0 || config.port > 65535 || config.admin_port == 0 ||
+      config.admin_port > 65535 || config.node_port > 65535) {
+    fprintf(stderr, "Ports must be between 1 and 65535\n");
+    return -1;
+  }
+  if (config.queue_capacity == 0) {
+    config.queue_capacity = config.workers * QUEUE_PER_WORKER;
+  }
+  if (config.executors == (size_t)-1) {
+    config.executors = config.workers;
+  }
+  return 0;
 }
 
 /**
- * @brief Handle admin client connections
+ * @brief Start reporting to the coordinator given with -j
  *
- * This function runs in a separate thread for each admin client connection.
- * It processes administrative commands and provides server management
- * capabilities.
- *
- * @param arg Pointer to client_info_t structure containing client details
- * @return NULL when client disconnects
- *
- * @details Supported commands:
- * - "STATUS": Returns server statistics (total/successful compilations)
- * - "LOGS": Returns contents of server.log file
- * - "SHUTDOWN": Gracefully shuts down the server
- * - "QUIT": Disconnects the admin client
- *
- * @note This function is designed to be called as a pthread function.
- * The SHUTDOWN command sets server_running to 0, causing server termination.
+ * @return 0 on success, -1 if the address is invalid or the heartbeat
+ *         thread could not start
  */
-void *handle_admin(void *arg) {
-  client_info_t *client = (client_info_t *)arg;
-  char buffer[BUFFER_SIZE];
-  char response[BUFFER_SIZE];
+static int join_coordinator(void) {
+  char host[256];
+  unsigned long port = CLUSTER_NODE_PORT;
+  char *colon;
 
-  log_activity("Admin client connected");
+  snprintf(host, sizeof(host), "%s", config.coordinator);
+  colon = strrchr(host, ':');
+  if (colon) {
+    *colon = '\0';
+    port = strtoul(colon + 1, NULL, 10);
+  }
+  if (host[0] == '\0' || port == 0 || port > 65535) {
+    fprintf(stderr, "Invalid coordinator address: %s\n", config.coordinator);
+    return -1;
+  }
+  if (cluster_join(host, (uint16_t)port, (uint16_t)config.port,
+                   report_load) != 0) {
+    fprintf(stderr, "Cannot start the coordinator heartbeat\n");
+    return -1;
+  }
+  printf("Worker node of coordinator %s:%lu\n", host, port);
+  log_activity("Joining coordinator");
+  return 0;
+}
 
-  while (1) {
-    memset(buffer, 0, BUFFER_SIZE);
-    int bytes_received = recv(client->socket, buffer, BUFFER_SIZE - 1, 0);
+/**
+ * @brief Signal thread: the first SIGTERM or SIGINT drains the server,
+ * the next one stops it at once
+ *
+ * Returns once the server has stopped running; main() then wakes it with
+ * a SIGTERM of its own to join it.
+ *
+ * @param arg The blocked signals (sigset_t)
+ * @return NULL
+ */
+static void *watch_signals(void *arg) {
+  const sigset_t *signals = arg;
+  int sig;
 
-    if (bytes_received <= 0) {
+  while (sigwait(signals, &sig) == 0) {
+    if (!__atomic_load_n(&server_running, __ATOMIC_SEQ_CST)) {
       break;
     }
-
-    if (strncmp(buffer, "STATUS", 6) == 0) {
-      pthread_mutex_lock(&stats_mutex);
-      snprintf(response, sizeof(response),
-               "Server Status:\nTotal compilations: %d\nSuccessful: "
-               "%d\nFailed: %d\n",
-               total_compilations, successful_compilations,
-               total_compilations - successful_compilations);
-      pthread_mutex_unlock(&stats_mutex);
-    } else if (strncmp(buffer, "SHUTDOWN", 8) == 0) {
-      snprintf(response, sizeof(response), "Server shutting down...\n");
-      send(client->socket, response, strlen(response), 0);
+    if (!drain_begin(config.drain_s, sig == SIGTERM ? "SIGTERM" : "SIGINT")) {
+      log_warning("Second signal: exiting without waiting for jobs");
       server_running = 0;
+      reactor_stop(reactor);
       break;
-    } else if (strncmp(buffer, "LOGS", 4) == 0) {
-      FILE *log_file = fopen("server.log", "r");
-      if (log_file) {
-        size_t bytes_read = fread(response, 1, sizeof(response) - 1, log_file);
-        response[bytes_read] = '\0';
-        fclose(log_file);
-      } else {
-        snprintf(response, sizeof(response), "No logs available\n");
-      }
-    } else if (strncmp(buffer, "QUIT", 4) == 0) {
-      break;
-    } else {
-      snprintf(response, sizeof(response),
-               "Unknown command. Available: STATUS, LOGS, SHUTDOWN, QUIT\n");
     }
-
-    send(client->socket, response, strlen(response), 0);
   }
-
-  log_activity("Admin client disconnected");
-  close(client->socket);
-  free(client);
   return NULL;
 }
 
 /**
- * @brief Regular client server thread
- *
- * This thread manages the server socket for regular client connections.
- * It listens on PORT (8080) and creates new threads for each client.
+ * @brief Listen on a port, reusing a socket of the previous server if it
+ * handed one over for it
  *
- * @param arg Unused parameter (required for pthread interface)
- * @return NULL when server shuts down
+ * @param port Port
+ * @param backlog Listen queue length of a new socket
+ * @param kind Kind of connections accepted on it
  *
- * @details This function:
- * 1. Creates and configures server socket
- * 2. Binds to PORT and listens for connections
- * 3. Accepts client connections in a loop
- * 4. Creates detached threads for each client using handle_client()
- * 5. Continues until server_running becomes 0
- *
- * @note Each client connection gets its own thread for concurrent handling.
- * Threads are detached to avoid resource leaks.
+ * @return 0 on success, -1 on failure (errno is set)
  */
-void *regular_server_thread(void *arg) {
-  int server_fd, client_socket;
-  struct sockaddr_in address;
-  int opt = 1;
-  int addrlen = sizeof(address);
-
-  if ((server_fd = socket(AF_INET, SOCK_STREAM, 0)) == 0) {
-    perror("socket failed");
-    exit(EXIT_FAILURE);
-  }
+static int serve_port(unsigned port, int backlog, conn_kind_t kind) {
+  for (size_t i = 0; i < handover.inherited_count; i++) {
+    reactor_listener_t *listener = &handover.inherited[i];
+    struct sockaddr_in address;
+    socklen_t len = sizeof(address);
 
-  if (setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR | SO_REUSEPORT, &opt,
-                 sizeof(opt))) {
-    perror("setsockopt");
-    exit(EXIT_FAILURE);
+    if (listener->fd >= 0 && listener->kind == kind &&
+        getsockname(listener->fd, (struct sockaddr *)&address, &len) == 0 &&
+        address.sin_family == AF_INET && ntohs(address.sin_port) == port &&
+        reactor_adopt(reactor, listener->fd, kind) == 0) {
+      listener->fd = -1;
+      return 0;
+    }
   }
+  return reactor_listen(reactor, (uint16_t)port, backlog, kind);
+}
 
-  address.sin_family = AF_INET;
-  address.sin_addr.s_addr = INADDR_ANY;
-  address.sin_port = htons(PORT);
+/**
+ * @brief Take the listening sockets over from the server on the handover
+ * socket, if one runs (-U)
+ *
+ * @return Connection to confirm on once they are served, -1 if none
+ */
+static int take_over_sockets(void) {
+  int peer = -1;
+  int count = handover_receive(config.handover_path, handover.inherited,
+                               HANDOVER_MAX, &peer);
 
-  if (bind(server_fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
-    perror("bind failed");
-    exit(EXIT_FAILURE);
+  if (count < 0) {
+    fprintf(stderr, "Socket handover on %s failed (%s): binding the ports\n",
+            config.handover_path, strerror(errno));
+    return -1;
   }
-
-  if (listen(server_fd, MAX_CLIENTS) < 0) {
-    perror("listen");
-    exit(EXIT_FAILURE);
+  handover.inherited_count = (size_t)count;
+  if (count > 0) {
+    printf("Taking over %d listening sockets from the running server\n",
+           count);
   }
+  return peer;
+}
 
-  printf("Regular client server listening on port %d\n", PORT);
-  log_activity("Regular client server started");
+/**
+ * @brief Handover thread: give the listening sockets to the next server
+ * that connects, then drain
+ *
+ * @param arg Unused
+ * @return NULL
+ */
+static void *await_successor(void *arg) {
+  reactor_listener_t listeners[HANDOVER_MAX];
+
+  (void)arg;
+  while (1) {
+    int peer = accept4(handover.fd, NULL, NULL, SOCK_CLOEXEC);
+    size_t count;
+    int sent;
 
-  while (server_running) {
-    if ((client_socket = accept(server_fd, (struct sockaddr *)&address,
-                                (socklen_t *)&addrlen)) < 0) {
-      if (server_running) {
-        perror("accept");
+    if (peer < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) {
+        continue;
       }
-      continue;
+      return NULL; /* shut down by finish_handover() */
+    }
+    count = server_draining()
+                ? 0
+                : reactor_listeners(reactor, listeners, HANDOVER_MAX);
+    sent = handover_send(peer, listeners, count);
+    close(peer);
+    if (sent == 0) {
+      log_activity("Listening sockets handed over to a new server");
+      drain_begin(config.drain_s, "handed over to a new server");
+      return NULL;
     }
+    log_warning("Socket handover failed: still serving");
+    if (count == 0) {
+      return NULL;
+    }
+  }
+}
 
-    client_info_t *client = malloc(sizeof(client_info_t));
-    client->socket = client_socket;
-    strcpy(client->type, "regular");
+/**
+ * @brief Finish taking the sockets over and offer them to the next server
+ *
+ * @param peer Connection returned by take_over_sockets(), or -1
+ * @return 0 on success, -1 if the handover socket cannot be created
+ */
+static int start_handover(int peer) {
+  struct stat info;
 
-    pthread_t thread;
-    pthread_create(&thread, NULL, handle_client, client);
-    pthread_detach(thread);
+  // Sockets the previous server had for ports no longer configured
+  for (size_t i = 0; i < handover.inherited_count; i++) {
+    if (handover.inherited[i].fd >= 0) {
+      close(handover.inherited[i].fd);
+      handover.inherited[i].fd = -1;
+    }
+  }
+  if (peer >= 0) {
+    handover_done(peer);
+    log_activity("Took over the listening sockets of the previous server");
   }
 
-  close(server_fd);
-  return NULL;
+  handover.fd = handover_listen(config.handover_path);
+  if (handover.fd < 0) {
+    perror("listen on handover socket");
+    return -1;
+  }
+  if (stat(config.handover_path, &info) == 0) {
+    handover.dev = info.st_dev;
+    handover.ino = info.st_ino;
+  }
+  if (pthread_create(&handover.thread, NULL, await_successor, NULL) != 0) {
+    fprintf(stderr, "Cannot start the handover thread\n");
+    return -1;
+  }
+  handover.started = 1;
+  printf("Handover socket: %s\n", config.handover_path);
+  return 0;
 }
 
 /**
- * @brief Admin server thread
- *
- * This thread manages the server socket for admin client connections.
- * It listens on ADMIN_PORT (8081) and creates new threads for each admin.
- *
- * @param arg Unused parameter (required for pthread interface)
- * @return NULL when server shuts down
- *
- * @details This function:
- * 1. Creates and configures server socket
- * 2. Binds to ADMIN_PORT and listens for connections
- * 3. Accepts admin connections in a loop
- * 4. Creates detached threads for each admin using handle_admin()
- * 5. Continues until server_running becomes 0
- *
- * @note Admin connections are limited (usually fewer than regular clients).
- * Each admin connection gets its own thread for concurrent administration.
+ * @brief Stop offering the listening sockets; the socket file is removed
+ * unless a successor already replaced it with its own
  */
-void *admin_server_thread(void *arg) {
-  int server_fd, client_socket;
-  struct sockaddr_in address;
-  int opt = 1;
-  int addrlen = sizeof(address);
+static void finish_handover(void) {
+  struct stat info;
 
-  if ((server_fd = socket(AF_INET, SOCK_STREAM, 0)) == 0) {
-    perror("socket failed");
-    exit(EXIT_FAILURE);
+  if (handover.fd < 0) {
+    return;
+  }
+  shutdown(handover.fd, SHUT_RDWR); /* wakes accept4() */
+  if (handover.started) {
+    pthread_join(handover.thread, NULL);
   }
+  close(handover.fd);
+  handover.fd = -1;
+  if (stat(config.handover_path, &info) == 0 && info.st_dev == handover.dev &&
+      info.st_ino == handover.ino) {
+    unlink(config.handover_path);
+  }
+}
 
-  if (setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR | SO_REUSEPORT, &opt,
-                 sizeof(opt))) {
-    perror("setsockopt");
-    exit(EXIT_FAILURE);
+int main(int argc, char **argv) {
+  static sigset_t signals;
+  pthread_t signal_thread;
+  int signal_started = 0;
+  int handover_peer = -1;
+
+  if (parse_options(argc, argv) != 0) {
+    print_usage(argv[0]);
+    return EXIT_FAILURE;
   }
 
-  address.sin_family = AF_INET;
-  address.sin_addr.s_addr = INADDR_ANY;
-  address.sin_port = htons(ADMIN_PORT);
+  printf("Starting Code Compiler & Executor Server...\n");
+  fflush(stdout);
 
-  if (bind(server_fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
-    perror("bind failed");
-    exit(EXIT_FAILURE);
+  // Set up the job cgroups and fork the executors while this is the only
+  // thread; the limits are applied by the executors
+  if (config.executors > 0) {
+    char limits[256];
+    size_t started;
+    quota_mode = quota_init(&config.limits);
+    started = executor_start(config.executors);
+    printf("Executors: %zu of %zu pre-forked\n", started, config.executors);
+    describe_limits(limits, sizeof(limits));
+    printf("%s", limits);
+  } else {
+    printf("No executors: programs run unconfined, without isolation or "
+           "resource limits\n");
   }
 
-  if (listen(server_fd, 3) < 0) {
-    perror("listen");
-    exit(EXIT_FAILURE);
+  // Every thread started from here on inherits the mask, so SIGTERM and
+  // SIGINT reach only watch_signals(); executors and programs unblock them
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGTERM);
+  sigaddset(&signals, SIGINT);
+  pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+  if (logger_init(LOG_FILE, config.log_mb * 1024 * 1024, LOG_KEEP) != 0) {
+    perror("open " LOG_FILE);
   }
+  atexit(logger_shutdown);
+  log_activity("Server starting");
 
-  printf("Admin server listening on port %d\n", ADMIN_PORT);
-  log_activity("Admin server started");
+  // Create directories if they don't exist
+  mkdir("processing", 0755);
+  mkdir("outgoing", 0755);
 
-  while (server_running) {
-    if ((client_socket = accept(server_fd, (struct sockaddr *)&address,
-                                (socklen_t *)&addrlen)) < 0) {
-      if (server_running) {
-        perror("accept");
-      }
-      continue;
+  // Writes to a pipe whose reader died must fail with EPIPE, not kill us
+  signal(SIGPIPE, SIG_IGN);
+  raise_fd_limit();
+  if (setup_profiles() != 0) {
+    return EXIT_FAILURE;
+  }
+  setup_compile_cache();
+  setup_prelude();
+  if (config.trace_file) {
+    if (trace_open(config.trace_file) != 0) {
+      perror("open trace file");
+      return EXIT_FAILURE;
     }
+    printf("Tracing every job into %s\n", config.trace_file);
+  }
+  if (jit_available() && config.jit_max > 0 && config.executors > 0) {
+    printf("In-memory compiles: libtcc for sources up to %zu bytes\n",
+           config.jit_max);
+  }
+  result_cache_init(config.result_ttl, (size_t)RESULT_CACHE_MB * 1024 * 1024);
+  if (config.result_ttl > 0) {
+    printf("Result cache: %u s TTL, %d MB\n", config.result_ttl,
+           RESULT_CACHE_MB);
+  }
 
-    client_info_t *client = malloc(sizeof(client_info_t));
-    client->socket = client_socket;
-    strcpy(client->type, "admin");
-
-    pthread_t thread;
-    pthread_create(&thread, NULL, handle_admin, client);
-    pthread_detach(thread);
+  job_pool =
+      worker_pool_create(config.workers, config.queue_capacity, run_job);
+  if (!job_pool) {
+    fprintf(stderr, "Cannot start worker pool\n");
+    return EXIT_FAILURE;
   }
+  printf("Worker pool: %zu workers, %zu queue slots per class, %u jobs in "
+         "flight per connection\n",
+         worker_pool_size(job_pool), config.queue_capacity,
+         config.pipeline_depth);
 
-  close(server_fd);
-  return NULL;
-}
+  reactor = reactor_create(dispatch_input, MAX_REQUEST_BYTES);
+  if (!reactor) {
+    fprintf(stderr, "Cannot start event loop\n");
+    return EXIT_FAILURE;
+  }
 
-int main(void) {
-  pthread_t regular_thread, admin_thread;
+  if (config.handover_path) {
+    handover_peer = take_over_sockets();
+  }
 
-  printf("Starting Code Compiler & Executor Server...\n");
-  log_activity("Server starting");
+  if (serve_port(config.port, MAX_CLIENTS, CONN_REGULAR) != 0) {
+    perror("listen on regular port");
+    return EXIT_FAILURE;
+  }
+  printf("Regular client server listening on port %u\n", config.port);
+  log_activity("Regular client server started");
 
-  // Create directories if they don't exist
-  system("mkdir -p processing outgoing");
+  if (serve_port(config.admin_port, 3, CONN_ADMIN) != 0) {
+    perror("listen on admin port");
+    return EXIT_FAILURE;
+  }
+  printf("Admin server listening on port %u\n", config.admin_port);
+  log_activity("Admin server started");
 
-  // Start both server threads
-  pthread_create(&regular_thread, NULL, regular_server_thread, NULL);
-  pthread_create(&admin_thread, NULL, admin_server_thread, NULL);
+  if (config.metrics_port != 0) {
+    if (serve_port(config.metrics_port, MAX_CLIENTS, CONN_METRICS) != 0) {
+      perror("listen on metrics port");
+      return EXIT_FAILURE;
+    }
+    printf("Metrics endpoint: http://0.0.0.0:%u/metrics\n",
+           config.metrics_port);
+  }
 
-  // Wait for shutdown signal
-  while (server_running) {
-    sleep(1);
+  if (config.node_port != 0) {
+    if (serve_port(config.node_port, MAX_CLIENTS, CONN_NODE) != 0) {
+      perror("listen on node port");
+      return EXIT_FAILURE;
+    }
+    printf("Coordinator: worker nodes register on port %u\n",
+           config.node_port);
   }
+  if (config.handover_path && start_handover(handover_peer) != 0) {
+    return EXIT_FAILURE;
+  }
+  if (config.coordinator && join_coordinator() != 0) {
+    return EXIT_FAILURE;
+  }
+  if (pthread_create(&signal_thread, NULL, watch_signals, &signals) == 0) {
+    signal_started = 1;
+  }
+
+  // Serve clients until SHUTDOWN NOW or the end of a drain
+  reactor_run(reactor);
 
   printf("Server shutting down...\n");
   log_activity("Server shutting down");
+  if (drain.started) {
+    pthread_join(drain.thread, NULL);
+  }
+  finish_handover();
+  log_unfollow_all();
+
+  // From here on no drain can start and signals are ignored
+  pthread_mutex_lock(&drain.lock);
+  __atomic_store_n(&drain.draining, 1, __ATOMIC_SEQ_CST);
+  pthread_mutex_unlock(&drain.lock);
+  __atomic_store_n(&server_running, 0, __ATOMIC_SEQ_CST);
+  if (signal_started) {
+    pthread_kill(signal_thread, SIGTERM);
+    pthread_join(signal_thread, NULL);
+  }
 
-  pthread_cancel(regular_thread);
-  pthread_cancel(admin_thread);
+  // Queued jobs are dropped (see run_job()) and running ones finish before
+  // the modules they use go; the heartbeat reads the pool, so it stops
+  // first
+  cluster_leave();
+  worker_pool_destroy(job_pool);
+  job_pool = NULL;
+  reactor_destroy(reactor);
+  reactor = NULL;
+  cluster_shutdown();
 
+  compile_cache_shutdown();
+  prelude_shutdown();
+  trace_close();
+  executor_shutdown();
+  quota_shutdown();
   return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,76 @@
+/**
+ * @file sha256.h
+ * @brief Minimal SHA-256 implementation used for content addressing
+ * @author Rares-Nicholas Popa & Adrian-Petru Enache
+ * @version 1.0.0
+ *
+ * @details Compile cache keys are SHA-256 digests of the source text and
+ * everything else that influences the produced binary. A cryptographic
+ * hash keeps accidental collisions (which would run the wrong program)
+ * out of the question.
+ *
+ * @copyright This project is for educational purposes as part of the PCD
+ * course.
+ */
+
+#ifndef SHA256_H
+#define SHA256_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** @def SHA256_DIGEST_SIZE
+ * @brief Size of a SHA-256 digest in bytes
+ */
+#define SHA256_DIGEST_SIZE 32
+
+/** @def SHA256_HEX_SIZE
+ * @brief Size of a hex-encoded digest including the terminating NUL
+ */
+#define SHA256_HEX_SIZE (2 * SHA256_DIGEST_SIZE + 1)
+
+/**
+ * @struct sha256_ctx_t
+ * @brief Incremental hashing state
+ */
+typedef struct {
+  uint32_t state[8];  /**< Intermediate hash value */
+  uint64_t length;    /**< Total bytes hashed so far */
+  uint8_t block[64];  /**< Partially filled input block */
+  size_t block_len;   /**< Bytes used in block */
+} sha256_ctx_t;
+
+/**
+ * @brief Start a new digest
+ *
+ * @param ctx Context to initialise
+ */
+void sha256_init(sha256_ctx_t *ctx);
+
+/**
+ * @brief Feed bytes into a digest
+ *
+ * @param ctx Context started with sha256_init()
+ * @param data Input bytes
+ * @param len Number of bytes
+ */
+void sha256_update(sha256_ctx_t *ctx, const void *data, size_t len);
+
+/**
+ * @brief Finish a digest
+ *
+ * @param ctx Context to finish (must be re-initialised before reuse)
+ * @param digest Receives SHA256_DIGEST_SIZE bytes
+ */
+void sha256_final(sha256_ctx_t *ctx, uint8_t digest[SHA256_DIGEST_SIZE]);
+
+/**
+ * @brief Hex-encode a digest
+ *
+ * @param digest SHA256_DIGEST_SIZE bytes
+ * @param hex Receives SHA256_HEX_SIZE characters including the NUL
+ */
+void sha256_hex(const uint8_t digest[SHA256_DIGEST_SIZE],
+                char hex[SHA256_HEX_SIZE]);
+
+#endif /* SHA256_H */
@@ -0,0 +1,224 @@
+/**
+ * @file stats.c
+ * @brief Sharded job counters and per-phase latency histograms
+ * @author Rares-Nicholas Popa & Adrian-Petru Enache
+ * @version 1.0.0
+ *
+ * @details Threads are assigned shards round robin on their first update.
+ * With more threads than shards two threads may share one; the atomic
+ * additions keep the counts exact, only the cache line is shared.
+ *
+ * @copyright This project is for educational purposes as part of the PCD
+ * course.
+ */
+
+#include "stats.h"
+
+#include <time.h>
+
+/** @def STATS_SHARDS
+ * @brief Number of per-thread shards
+ */
+#define STATS_SHARDS 16
+
+/** @def STATS_SUB_BITS
+ * @brief log2 of the linear steps per power of two
+ */
+#define STATS_SUB_BITS 4
+
+/** @def STATS_SUB_BUCKETS
+ * @brief Linear steps per power of two (precision about 6%)
+ */
+#define STATS_SUB_BUCKETS (1 << STATS_SUB_BITS)
+
+/** @def STATS_MAX_BITS
+ * @brief Values are clamped below 2^STATS_MAX_BITS us (about 71 minutes)
+ */
+#define STATS_MAX_BITS 32
+
+/** @def STATS_BUCKETS
+ * @brief Buckets per histogram
+ */
+#define STATS_BUCKETS                                                          \
+  ((STATS_MAX_BITS - STATS_SUB_BITS + 1) * STATS_SUB_BUCKETS)
+
+/**
+ * @struct stats_shard_t
+ * @brief Counters and histograms updated by one thread
+ */
+typedef struct {
+  uint64_t counters[STAT_COUNTER_COUNT];             /**< Event counts */
+  uint64_t sums[STAT_PHASE_COUNT];                   /**< Sum of samples */
+  uint64_t buckets[STAT_PHASE_COUNT][STATS_BUCKETS]; /**< Histograms */
+} __attribute__((aligned(64))) stats_shard_t;
+
+/** @brief All shards */
+static stats_shard_t shards[STATS_SHARDS];
+
+/** @brief Next shard handed to a new thread */
+static unsigned next_shard = 0;
+
+/** @brief Shard of the calling thread, or -1 before its first update */
+static __thread int thread_shard = -1;
+
+/** @brief Phase names, indexed by stat_phase_t */
+static const char *const phase_names[STAT_PHASE_COUNT] = {
+    "queue", "compile", "execute", "send"};
+
+/**
+ * @brief Shard of the calling thread
+ *
+ * @return Shard to update
+ */
+static stats_shard_t *my_shard(void) {
+  if (thread_shard < 0) {
+    thread_shard = (int)(__atomic_fetch_add(&next_shard, 1, __ATOMIC_RELAXED) %
+                         STATS_SHARDS);
+  }
+  return &shards[thread_shard];
+}
+
+/**
+ * @brief Histogram bucket of a value
+ *
+ * @param value Microseconds
+ * @return Bucket index
+ */
+static unsigned bucket_of(uint64_t value) {
+  unsigned msb;
+
+  if (value < STATS_SUB_BUCKETS) {
+    return (unsigned)value;
+  }
+  if (value >> STATS_MAX_BITS) {
+    return STATS_BUCKETS - 1;
+  }
+  msb = 63u - (unsigned)__builtin_clzll(value);
+  return (msb - STATS_SUB_BITS + 1) * STATS_SUB_BUCKETS +
+         (unsigned)((value >> (msb - STATS_SUB_BITS)) - STATS_SUB_BUCKETS);
+}
+
+/**
+ * @brief Largest value that falls into a bucket
+ *
+ * @param bucket Bucket index
+ * @return Microseconds
+ */
+static uint64_t bucket_high(unsigned bucket) {
+  unsigned shift, sub;
+
+  if (bucket < STATS_SUB_BUCKETS) {
+    return bucket;
+  }
+  shift = bucket / STATS_SUB_BUCKETS - 1;
+  sub = bucket % STATS_SUB_BUCKETS;
+  return (((uint64_t)(STATS_SUB_BUCKETS + sub + 1)) << shift) - 1;
+}
+
+uint64_t stats_now_us(void) {
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000u + (uint64_t)now.tv_nsec / 1000u;
+}
+
+void stats_add(stat_counter_t counter, uint64_t value) {
+  __atomic_fetch_add(&my_shard()->counters[counter], value, __ATOMIC_RELAXED);
+}
+
+void stats_record_since(stat_phase_t phase, uint64_t start_us) {
+  uint64_t now = stats_now_us();
+  uint64_t elapsed = now > start_us ? now - start_us : 0;
+  stats_shard_t *shard = my_shard();
+
+  __atomic_fetch_add(&shard->buckets[phase][bucket_of(elapsed)], 1,
+                     __ATOMIC_RELAXED);
+  __atomic_fetch_add(&shard->sums[phase], elapsed, __ATOMIC_RELAXED);
+}
+
+uint64_t stats_counter(stat_counter_t counter) {
+  uint64_t total = 0;
+  size_t i;
+
+  for (i = 0; i < STATS_SHARDS; i++) {
+    total += __atomic_load_n(&shards[i].counters[counter], __ATOMIC_RELAXED);
+  }
+  return total;
+}
+
+/**
+ * @brief Sum the histogram of a phase over all shards
+ *
+ * @param phase Phase to read
+ * @param merged Receives STATS_BUCKETS counts
+ * @return Total number of samples
+ */
+static uint64_t merge_buckets(stat_phase_t phase, uint64_t *merged) {
+  uint64_t count = 0;
+  unsigned b;
+  size_t i;
+
+  for (b = 0; b < STATS_BUCKETS; b++) {
+    merged[b] = 0;
+    for (i = 0; i < STATS_SHARDS; i++) {
+      merged[b] += __atomic_load_n(&shards[i].buckets[phase][b],
+                                   __ATOMIC_RELAXED);
+    }
+    count += merged[b];
+  }
+  return count;
+}
+
+void stats_summary(stat_phase_t phase, stats_summary_t *summary) {
+  static const unsigned permille[3] = {500, 990, 999};
+  uint64_t *targets[3];
+  uint64_t merged[STATS_BUCKETS];
+  uint64_t count, seen = 0;
+  unsigned b, q = 0;
+
+  targets[0] = &summary->p50;
+  targets[1] = &summary->p99;
+  targets[2] = &summary->p999;
+  summary->p50 = summary->p99 = summary->p999 = summary->max = 0;
+
+  count = merge_buckets(phase, merged);
+  summary->count = count;
+
+  // Walk up the buckets until each percentile's rank is covered
+  for (b = 0; b < STATS_BUCKETS && count > 0; b++) {
+    if (merged[b] == 0) {
+      continue;
+    }
+    seen += merged[b];
+    while (q < 3 && seen * 1000 >= count * permille[q]) {
+      *targets[q++] = bucket_high(b);
+    }
+    summary->max = bucket_high(b);
+  }
+}
+
+void stats_cumulative(stat_phase_t phase, const uint64_t *bounds_us,
+                      size_t count, uint64_t *cumulative, uint64_t *total,
+                      uint64_t *sum_us) {
+  uint64_t merged[STATS_BUCKETS];
+  uint64_t seen = 0;
+  unsigned b = 0;
+  size_t i;
+
+  *total = merge_buckets(phase, merged);
+  *sum_us = 0;
+  for (i = 0; i < STATS_SHARDS; i++) {
+    *sum_us += __atomic_load_n(&shards[i].sums[phase], __ATOMIC_RELAXED);
+  }
+
+  for (i = 0; i < count; i++) {
+    while (b < STATS_BUCKETS && bucket_high(b) <= bounds_us[i]) {
+      seen += merged[b++];
+    }
+    cumulative[i] = seen;
+  }
+}
+
+const char *stats_phase_name(stat_phase_t phase) {
+  return phase_names[phase];
+}
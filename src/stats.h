@@ -0,0 +1,137 @@
+/**
+ * @file stats.h
+ * @brief Sharded job counters and per-phase latency histograms
+ * @author Rares-Nicholas Popa & Adrian-Petru Enache
+ * @version 1.0.0
+ *
+ * @details Every thread updates its own cache-line aligned shard with
+ * relaxed atomic additions, so recording a sample never takes a lock or
+ * bounces a cache line between workers. Readers (the STATUS command) sum
+ * the shards. Latencies go into HDR-style log-linear histograms: values
+ * are bucketed by power of two, each power split into STATS_SUB_BUCKETS
+ * linear steps, which bounds the relative error of a reported percentile
+ * at 1 / STATS_SUB_BUCKETS over the whole range.
+ *
+ * @copyright This project is for educational purposes as part of the PCD
+ * course.
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @enum stat_counter_t
+ * @brief Event counters
+ */
+typedef enum {
+  STAT_COMPILATIONS,    /**< Jobs started */
+  STAT_SUCCESSFUL,      /**< Jobs whose program exited with status 0 */
+  STAT_REJECTED,        /**< Submissions refused with BUSY */
+  STAT_SPAWN_FAILED,    /**< Compiler or program could not be started */
+  STAT_COMPILE_CPU_US,  /**< CPU time used by the compiler */
+  STAT_EXECUTE_CPU_US,  /**< CPU time used by programs */
+  STAT_EXECUTE_PEAK_KB, /**< Sum of program peak memory, in KiB */
+  STAT_MEMORY_KILLED,   /**< Runs killed at the memory limit */
+  STAT_PIDS_LIMITED,    /**< Runs that hit the task limit */
+  STAT_JIT_RUNS,        /**< Programs compiled in memory (see jit.h) */
+  STAT_JIT_REJECTED,    /**< Sources tcc rejected, compiled by gcc instead */
+  STAT_SPLICED_BYTES,   /**< Program output spliced from pipe to socket */
+  STAT_SENDFILE_BYTES,  /**< Log bytes sent with sendfile() */
+  STAT_UNITS_COMPILED,  /**< Project translation units compiled */
+  STAT_UNITS_CACHED,    /**< Project units whose object was cached */
+  STAT_COUNTER_COUNT    /**< Number of counters */
+} stat_counter_t;
+
+/**
+ * @enum stat_phase_t
+ * @brief Job phases with a latency histogram
+ */
+typedef enum {
+  PHASE_QUEUE,     /**< Submitted until a worker picked the job up */
+  PHASE_COMPILE,   /**< Compiler run (compile cache misses only) */
+  PHASE_EXECUTE,   /**< Program run, including streamed output */
+  PHASE_SEND,      /**< Remaining output and RESULT frame */
+  STAT_PHASE_COUNT /**< Number of phases */
+} stat_phase_t;
+
+/**
+ * @struct stats_summary_t
+ * @brief Percentiles of one histogram, in microseconds
+ */
+typedef struct {
+  uint64_t count; /**< Samples recorded */
+  uint64_t p50;   /**< Median */
+  uint64_t p99;   /**< 99th percentile */
+  uint64_t p999;  /**< 99.9th percentile */
+  uint64_t max;   /**< Largest sample (bucket resolution) */
+} stats_summary_t;
+
+/**
+ * @brief Current monotonic time for latency measurements
+ *
+ * @return Microseconds since an arbitrary epoch
+ */
+uint64_t stats_now_us(void);
+
+/**
+ * @brief Add to a counter
+ *
+ * @param counter Counter to update
+ * @param value Amount added
+ */
+void stats_add(stat_counter_t counter, uint64_t value);
+
+/**
+ * @brief Record a phase duration
+ *
+ * @param phase Phase measured
+ * @param start_us stats_now_us() at the start of the phase
+ */
+void stats_record_since(stat_phase_t phase, uint64_t start_us);
+
+/**
+ * @brief Sum a counter over all shards
+ *
+ * @param counter Counter to read
+ * @return Current total
+ */
+uint64_t stats_counter(stat_counter_t counter);
+
+/**
+ * @brief Compute the percentiles of a phase histogram
+ *
+ * @param phase Phase to summarise
+ * @param summary Receives the percentiles (all zero without samples)
+ */
+void stats_summary(stat_phase_t phase, stats_summary_t *summary);
+
+/**
+ * @brief Cumulative histogram of a phase at caller-chosen bounds
+ *
+ * Meant for exporters with fixed bucket boundaries (Prometheus `le`). A
+ * sample counts towards a bound if its whole bucket lies at or below it,
+ * so counts are exact at bucket edges and slightly low in between.
+ *
+ * @param phase Phase to export
+ * @param bounds_us Ascending upper bounds in microseconds
+ * @param count Number of bounds
+ * @param cumulative Receives, per bound, the samples at or below it
+ * @param total Receives the number of samples
+ * @param sum_us Receives the sum of all samples
+ */
+void stats_cumulative(stat_phase_t phase, const uint64_t *bounds_us,
+                      size_t count, uint64_t *cumulative, uint64_t *total,
+                      uint64_t *sum_us);
+
+/**
+ * @brief Name of a phase for reports
+ *
+ * @param phase Phase
+ * @return Static lower-case name, e.g. "compile"
+ */
+const char *stats_phase_name(stat_phase_t phase);
+
+#endif /* STATS_H */
@@ -0,0 +1,298 @@
+/**
+ * @file trace.c
+ * @brief Per-request timelines of the phases a submission goes through
+ * @author Rares-Nicholas Popa & Adrian-Petru Enache
+ * @version 1.0.0
+ *
+ * @details Spans are stamped on the monotonic clock, which cannot jump;
+ * the offset to the wall clock is taken once, when the first trace
+ * starts, and added when events are written. A trace is written with a
+ * single write() to a file opened with O_APPEND, so the events of traces
+ * finished concurrently never interleave.
+ *
+ * @copyright This project is for educational purposes as part of the PCD
+ * course.
+ */
+
+#include "trace.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/random.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+/** @def EVENT_MAX
+ * @brief Longest trace file event of one span
+ */
+#define EVENT_MAX 384
+
+/**
+ * @struct trace_span_t
+ * @brief One recorded phase
+ */
+typedef struct {
+  char name[TRACE_NAME_MAX]; /**< Phase name */
+  uint64_t start_us;         /**< Start, monotonic */
+  uint64_t end_us;           /**< End, monotonic */
+  pid_t tid;                 /**< Thread that recorded it */
+} trace_span_t;
+
+/**
+ * @struct trace
+ * @brief Spans of one request
+ */
+struct trace {
+  pthread_mutex_t lock;                /**< Guards the spans */
+  uint64_t id;                         /**< Trace id */
+  uint32_t job_id;                     /**< Client job id */
+  size_t count;                        /**< Spans recorded */
+  size_t dropped;                      /**< Spans that did not fit */
+  trace_span_t spans[TRACE_MAX_SPANS]; /**< Recorded spans */
+};
+
+/** @brief Global tracing state */
+static struct {
+  pthread_mutex_t lock;  /**< Serialises writes to fd */
+  pthread_once_t once;   /**< Runs trace_setup() */
+  int fd;                /**< Trace file, -1 if none */
+  uint64_t seed;         /**< Base of the trace ids */
+  uint64_t next;         /**< Traces started (atomic) */
+  int64_t epoch_us;      /**< Wall clock minus monotonic clock */
+  trace_stats_t stats;   /**< Counters (atomic) */
+} tracer = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_ONCE_INIT, -1, 0, 0, 0,
+            {0, 0, 0}};
+
+/**
+ * @brief Read a clock in microseconds
+ *
+ * @param clock CLOCK_MONOTONIC or CLOCK_REALTIME
+ * @return Microseconds since the clock's epoch
+ */
+static int64_t clock_us(clockid_t clock) {
+  struct timespec ts;
+
+  clock_gettime(clock, &ts);
+  return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/**
+ * @brief Seed the trace ids and take the wall clock offset (once)
+ */
+static void trace_setup(void) {
+  if (getrandom(&tracer.seed, sizeof(tracer.seed), GRND_NONBLOCK) !=
+      (ssize_t)sizeof(tracer.seed)) {
+    tracer.seed = (uint64_t)clock_us(CLOCK_REALTIME) ^ (uint64_t)getpid();
+  }
+  tracer.epoch_us = clock_us(CLOCK_REALTIME) - clock_us(CLOCK_MONOTONIC);
+}
+
+/**
+ * @brief Scramble a counter into an id (splitmix64 finalizer)
+ *
+ * @param x Value to mix
+ * @return Mixed value; distinct inputs give distinct outputs
+ */
+static uint64_t mix64(uint64_t x) {
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+  return x ^ (x >> 31);
+}
+
+int trace_open(const char *path) {
+  struct stat st;
+  int fd;
+
+  pthread_once(&tracer.once, trace_setup);
+  fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    return -1;
+  }
+  if (fstat(fd, &st) == 0 && st.st_size == 0 && write(fd, "[\n", 2) != 2) {
+    int saved = errno;
+
+    close(fd);
+    errno = saved;
+    return -1;
+  }
+  tracer.fd = fd;
+  return 0;
+}
+
+int trace_enabled(void) { return tracer.fd >= 0; }
+
+trace_t *trace_begin(uint32_t job_id) {
+  trace_t *trace = malloc(sizeof(*trace));
+  uint64_t n;
+
+  if (!trace) {
+    return NULL;
+  }
+  pthread_once(&tracer.once, trace_setup);
+  n = __atomic_add_fetch(&tracer.next, 1, __ATOMIC_RELAXED);
+  pthread_mutex_init(&trace->lock, NULL);
+  trace->id = mix64(tracer.seed + n * 0x9e3779b97f4a7c15ull);
+  trace->job_id = job_id;
+  trace->count = 0;
+  trace->dropped = 0;
+  return trace;
+}
+
+void trace_span(trace_t *trace, const char *name, uint64_t start_us,
+                uint64_t end_us) {
+  trace_span_t *span;
+
+  if (!trace) {
+    return;
+  }
+  pthread_mutex_lock(&trace->lock);
+  if (trace->count == TRACE_MAX_SPANS) {
+    trace->dropped++;
+    pthread_mutex_unlock(&trace->lock);
+    return;
+  }
+  span = &trace->spans[trace->count++];
+  snprintf(span->name, sizeof(span->name), "%s", name);
+  span->start_us = start_us;
+  span->end_us = end_us < start_us ? start_us : end_us;
+  span->tid = (pid_t)syscall(SYS_gettid);
+  pthread_mutex_unlock(&trace->lock);
+}
+
+/**
+ * @brief Order the spans of a trace by start, keeping the recording order
+ * of spans that start together (a stable insertion sort: there are few)
+ *
+ * @param trace Trace, locked
+ */
+static void sort_spans(trace_t *trace) {
+  for (size_t i = 1; i < trace->count; i++) {
+    trace_span_t span = trace->spans[i];
+    size_t j = i;
+
+    while (j > 0 && trace->spans[j - 1].start_us > span.start_us) {
+      trace->spans[j] = trace->spans[j - 1];
+      j--;
+    }
+    trace->spans[j] = span;
+  }
+}
+
+size_t trace_format(trace_t *trace, char *buffer, size_t size) {
+  size_t used;
+
+  pthread_mutex_lock(&trace->lock);
+  sort_spans(trace);
+  used = (size_t)snprintf(buffer, size, "Trace %016llx, %zu spans",
+                          (unsigned long long)trace->id, trace->count);
+  if (used < size && trace->dropped > 0) {
+    used += (size_t)snprintf(buffer + used, size - used, " (%zu dropped)",
+                             trace->dropped);
+  }
+  if (used < size) {
+    used += (size_t)snprintf(buffer + used, size - used, "\n");
+  }
+  for (size_t i = 0; i < trace->count && used < size; i++) {
+    const trace_span_t *span = &trace->spans[i];
+
+    used += (size_t)snprintf(
+        buffer + used, size - used, "  %-24s +%9.3f ms %9.3f ms\n",
+        span->name, (double)(span->start_us - trace->spans[0].start_us) / 1e3,
+        (double)(span->end_us - span->start_us) / 1e3);
+  }
+  pthread_mutex_unlock(&trace->lock);
+  return used < size ? used : size - 1;
+}
+
+/**
+ * @brief Format one span as a Chrome trace event
+ *
+ * @param trace Trace the span belongs to
+ * @param span Span
+ * @param out Receives the event and its separator (EVENT_MAX bytes)
+ *
+ * @return Length of the event
+ */
+static size_t format_event(const trace_t *trace, const trace_span_t *span,
+                           char *out) {
+  char name[TRACE_NAME_MAX];
+  long long ts = (long long)span->start_us + tracer.epoch_us;
+  int len;
+
+  // Names come from the server, but keep the JSON valid whatever they hold
+  for (size_t i = 0; (name[i] = span->name[i]) != '\0'; i++) {
+    if (name[i] == '"' || name[i] == '\\' || (unsigned char)name[i] < 0x20) {
+      name[i] = '_';
+    }
+  }
+  if (span->end_us == span->start_us) {
+    len = snprintf(out, EVENT_MAX,
+                   "{\"name\":\"%s\",\"cat\":\"cce\",\"ph\":\"i\",\"s\":\"t\","
+                   "\"ts\":%lld,\"pid\":%d,\"tid\":%d,\"args\":{\"trace_id\":"
+                   "\"%016llx\",\"job_id\":%u}},\n",
+                   name, ts, (int)getpid(), (int)span->tid,
+                   (unsigned long long)trace->id, trace->job_id);
+  } else {
+    len = snprintf(out, EVENT_MAX,
+                   "{\"name\":\"%s\",\"cat\":\"cce\",\"ph\":\"X\",\"ts\":%lld,"
+                   "\"dur\":%llu,\"pid\":%d,\"tid\":%d,\"args\":{\"trace_id\":"
+                   "\"%016llx\",\"job_id\":%u}},\n",
+                   name, ts,
+                   (unsigned long long)(span->end_us - span->start_us),
+                   (int)getpid(), (int)span->tid,
+                   (unsigned long long)trace->id, trace->job_id);
+  }
+  return len < EVENT_MAX ? (size_t)len : EVENT_MAX - 1;
+}
+
+void trace_finish(trace_t *trace) {
+  char *events;
+
+  if (!trace) {
+    return;
+  }
+  __atomic_add_fetch(&tracer.stats.traces, 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&tracer.stats.dropped, trace->dropped, __ATOMIC_RELAXED);
+
+  events = tracer.fd >= 0 && trace->count > 0
+               ? malloc(trace->count * EVENT_MAX)
+               : NULL;
+  if (events) {
+    size_t len = 0;
+
+    for (size_t i = 0; i < trace->count; i++) {
+      len += format_event(trace, &trace->spans[i], events + len);
+    }
+    pthread_mutex_lock(&tracer.lock);
+    if (tracer.fd >= 0 && write(tracer.fd, events, len) == (ssize_t)len) {
+      tracer.stats.written++;
+    }
+    pthread_mutex_unlock(&tracer.lock);
+    free(events);
+  }
+  pthread_mutex_destroy(&trace->lock);
+  free(trace);
+}
+
+void trace_stats(trace_stats_t *stats) {
+  stats->traces = __atomic_load_n(&tracer.stats.traces, __ATOMIC_RELAXED);
+  stats->dropped = __atomic_load_n(&tracer.stats.dropped, __ATOMIC_RELAXED);
+  pthread_mutex_lock(&tracer.lock);
+  stats->written = tracer.stats.written;
+  pthread_mutex_unlock(&tracer.lock);
+}
+
+void trace_close(void) {
+  pthread_mutex_lock(&tracer.lock);
+  if (tracer.fd >= 0) {
+    close(tracer.fd);
+    tracer.fd = -1;
+  }
+  pthread_mutex_unlock(&tracer.lock);
+}
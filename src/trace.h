@@ -0,0 +1,121 @@
+/**
+ * @file trace.h
+ * @brief Per-request timelines of the phases a submission goes through
+ * @author Rares-Nicholas Popa & Adrian-Petru Enache
+ * @version 1.0.0
+ *
+ * @details A trace collects named spans (start and end on the
+ * CLOCK_MONOTONIC clock of stats_now_us()) under a random 64-bit id:
+ * accept, recv, queue, compile or link, exec and send. Any thread may add
+ * spans to a trace, so the cases of a batch and the units of a project
+ * record their own. A finished trace can be formatted as text for the
+ * client and is appended to the trace file, when one is open, as events
+ * of the Chrome trace event format ("JSON array" variant, loadable in
+ * Perfetto or chrome://tracing): one complete ("X") event per span, with
+ * wall clock timestamps, the thread that recorded it and the trace and
+ * job ids as arguments.
+ *
+ * @copyright This project is for educational purposes as part of the PCD
+ * course.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** @def TRACE_MAX_SPANS
+ * @brief Spans kept per trace; later ones are counted as dropped
+ */
+#define TRACE_MAX_SPANS 64
+
+/** @def TRACE_NAME_MAX
+ * @brief Size of a span name, including the terminating NUL
+ */
+#define TRACE_NAME_MAX 80
+
+/** @brief Opaque trace of one request */
+typedef struct trace trace_t;
+
+/**
+ * @struct trace_stats_t
+ * @brief Tracing counters
+ */
+typedef struct {
+  uint64_t traces;  /**< Traces finished */
+  uint64_t written; /**< Traces appended to the trace file */
+  uint64_t dropped; /**< Spans that did not fit their trace */
+} trace_stats_t;
+
+/**
+ * @brief Open the trace file every finished trace is appended to
+ *
+ * A new or empty file gets the opening "[" of the JSON array; the array
+ * is never closed, which both viewers accept.
+ *
+ * @param path Trace file
+ * @return 0 on success, -1 if it cannot be opened (errno is set)
+ */
+int trace_open(const char *path);
+
+/**
+ * @brief Whether a trace file is open, so every request is traced
+ *
+ * @return 1 if trace_open() succeeded, 0 otherwise
+ */
+int trace_enabled(void);
+
+/**
+ * @brief Start the trace of a request
+ *
+ * @param job_id Client job id, recorded with every span
+ * @return The trace, or NULL if out of memory
+ */
+trace_t *trace_begin(uint32_t job_id);
+
+/**
+ * @brief Add a span recorded by the calling thread
+ *
+ * @param trace Trace, or NULL for none (nothing is recorded)
+ * @param name Phase name, cut to TRACE_NAME_MAX - 1 bytes
+ * @param start_us Start, stats_now_us() clock
+ * @param end_us End, same clock; equal to start_us for an instant
+ */
+void trace_span(trace_t *trace, const char *name, uint64_t start_us,
+                uint64_t end_us);
+
+/**
+ * @brief Describe a trace for the client
+ *
+ * One line with the id, then one line per span with its start relative to
+ * the first span and its duration, in milliseconds.
+ *
+ * @param trace Trace
+ * @param buffer Receives the null-terminated text
+ * @param size Size of buffer
+ *
+ * @return Length of the text
+ */
+size_t trace_format(trace_t *trace, char *buffer, size_t size);
+
+/**
+ * @brief Append a trace to the trace file, if one is open, and free it
+ *
+ * @param trace Trace, or NULL
+ */
+void trace_finish(trace_t *trace);
+
+/**
+ * @brief Read the tracing counters
+ *
+ * @param stats Receives the counters
+ */
+void trace_stats(trace_stats_t *stats);
+
+/**
+ * @brief Close the trace file
+ */
+void trace_close(void);
+
+#endif /* TRACE_H */
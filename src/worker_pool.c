@@ -0,0 +1,383 @@
+/**
+ * @file worker_pool.c
+ * @brief Fixed-size worker thread pool fed by bounded, fairly shared queues
+ * @author Rares-Nicholas Popa & Adrian-Petru Enache
+ * @version 1.0.0
+ *
+ * @details Each class keeps one FIFO per tenant with queued jobs (a flow)
+ * and a ring of those flows; a small hash table finds the flow of a
+ * submission. A worker takes the next job of the current flow of the
+ * highest class that has jobs and is below its running limit, and moves
+ * the ring on once the flow used its weight or ran dry. Everything is
+ * protected by one mutex, held only to push or pop a job, never while a
+ * job runs; workers sleep on a condition variable while nothing can start.
+ *
+ * @copyright This project is for educational purposes as part of the PCD
+ * course.
+ */
+
+#include "worker_pool.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+
+/** @def FLOW_BUCKETS
+ * @brief Hash table buckets per class (power of two)
+ */
+#define FLOW_BUCKETS 64
+
+/**
+ * @struct pool_task_t
+ * @brief A queued job
+ */
+typedef struct pool_task {
+  void *job;              /**< Opaque job pointer */
+  struct pool_task *next; /**< Next job of the same flow */
+} pool_task_t;
+
+/**
+ * @struct pool_flow_t
+ * @brief Queued jobs of one tenant in one class
+ */
+typedef struct pool_flow {
+  uint64_t tenant;         /**< Tenant identifier */
+  unsigned weight;         /**< Jobs started per round */
+  unsigned served;         /**< Jobs started in the current round */
+  pool_task_t *head;       /**< Oldest job */
+  pool_task_t *tail;       /**< Newest job */
+  struct pool_flow *next;  /**< Next flow in the class's ring */
+  struct pool_flow *prev;  /**< Previous flow in the class's ring */
+  struct pool_flow *chain; /**< Next flow in the same bucket */
+} pool_flow_t;
+
+/**
+ * @struct pool_class_t
+ * @brief Queue and limits of one priority class
+ */
+typedef struct {
+  pool_flow_t *current;               /**< Flow served next, NULL if idle */
+  pool_flow_t *buckets[FLOW_BUCKETS]; /**< Flows by tenant */
+  worker_class_stats_t stats;         /**< Counters and limits */
+} pool_class_t;
+
+/**
+ * @struct worker_pool
+ * @brief Internal state of a worker pool
+ */
+struct worker_pool {
+  pthread_mutex_t lock;                     /**< Protects every field below */
+  pthread_cond_t ready;                     /**< Signalled when a job can
+                                                 start or on stop */
+  pool_class_t classes[WORKER_CLASS_COUNT]; /**< Highest priority first */
+  size_t queued;                            /**< Jobs queued in all classes */
+  size_t active;                            /**< Workers running a job */
+  size_t workers;                           /**< Started worker threads */
+  int stopping;                             /**< Set by worker_pool_destroy() */
+  worker_fn_t handler;                      /**< Job handler */
+  pthread_t *threads;                       /**< Worker thread handles */
+};
+
+/**
+ * @brief Bucket of a tenant
+ *
+ * @param tenant Tenant identifier
+ * @return Index into pool_class_t::buckets
+ */
+static size_t flow_bucket(uint64_t tenant) {
+  tenant ^= tenant >> 33;
+  tenant *= 0xff51afd7ed558ccdULL;
+  tenant ^= tenant >> 33;
+  return (size_t)tenant & (FLOW_BUCKETS - 1);
+}
+
+/**
+ * @brief Unlink an empty flow from its class and free it (lock held)
+ *
+ * @param cls Class of the flow
+ * @param flow Flow without jobs
+ */
+static void flow_remove(pool_class_t *cls, pool_flow_t *flow) {
+  pool_flow_t **link = &cls->buckets[flow_bucket(flow->tenant)];
+
+  while (*link != flow) {
+    link = &(*link)->chain;
+  }
+  *link = flow->chain;
+
+  if (flow->next == flow) {
+    cls->current = NULL;
+  } else {
+    flow->prev->next = flow->next;
+    flow->next->prev = flow->prev;
+    if (cls->current == flow) {
+      cls->current = flow->next;
+    }
+  }
+  cls->stats.tenants--;
+  free(flow);
+}
+
+/**
+ * @brief Take the next job that may start (lock held)
+ *
+ * @param pool Pool
+ * @param class_index Receives the class of the job
+ * @return The task, or NULL if every class is empty or at its limit
+ */
+static pool_task_t *pool_take(worker_pool_t *pool, size_t *class_index) {
+  for (size_t i = 0; i < WORKER_CLASS_COUNT; i++) {
+    pool_class_t *cls = &pool->classes[i];
+    pool_flow_t *flow = cls->current;
+    pool_task_t *task;
+
+    if (!flow || cls->stats.running >= cls->stats.max_running) {
+      continue;
+    }
+    task = flow->head;
+    flow->head = task->next;
+    if (!flow->head) {
+      flow->tail = NULL;
+    }
+    cls->stats.queued--;
+    cls->stats.running++;
+    cls->stats.started++;
+    pool->queued--;
+
+    // Weighted round robin: move on once the flow used its share
+    if (!flow->head) {
+      flow_remove(cls, flow);
+    } else if (++flow->served >= flow->weight) {
+      flow->served = 0;
+      cls->current = flow->next;
+    }
+    *class_index = i;
+    return task;
+  }
+  return NULL;
+}
+
+/**
+ * @brief Worker thread body
+ *
+ * Runs jobs until the pool is stopping and the queues have been drained.
+ *
+ * @param arg The owning worker_pool_t
+ * @return NULL
+ */
+static void *worker_main(void *arg) {
+  worker_pool_t *pool = (worker_pool_t *)arg;
+
+  pthread_mutex_lock(&pool->lock);
+  while (1) {
+    pool_task_t *task;
+    size_t class_index = 0;
+
+    // A class at its running limit is picked up again by the worker that
+    // finishes one of its jobs
+    while (!(task = pool_take(pool, &class_index)) &&
+           !(pool->stopping && pool->queued == 0)) {
+      pthread_cond_wait(&pool->ready, &pool->lock);
+    }
+    if (!task) {
+      break;
+    }
+    pool->active++;
+    pthread_mutex_unlock(&pool->lock);
+
+    void *job = task->job;
+    free(task);
+    pool->handler(job);
+
+    pthread_mutex_lock(&pool->lock);
+    pool->active--;
+    pool->classes[class_index].stats.running--;
+  }
+  pthread_mutex_unlock(&pool->lock);
+  return NULL;
+}
+
+worker_pool_t *worker_pool_create(size_t workers, size_t capacity,
+                                  worker_fn_t handler) {
+  worker_pool_t *pool = calloc(1, sizeof(*pool));
+  if (!pool) {
+    return NULL;
+  }
+
+  if (workers == 0) {
+    workers = 1;
+  }
+  if (capacity == 0) {
+    capacity = 1;
+  }
+
+  pool->threads = calloc(workers, sizeof(*pool->threads));
+  if (!pool->threads) {
+    free(pool);
+    return NULL;
+  }
+
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->ready, NULL);
+  pool->handler = handler;
+  for (size_t i = 0; i < WORKER_CLASS_COUNT; i++) {
+    pool->classes[i].stats.capacity = capacity;
+    pool->classes[i].stats.max_running = workers;
+  }
+  // Keep a quarter of the workers for interactive jobs
+  if (workers > 1) {
+    size_t reserved = workers / 4 > 0 ? workers / 4 : 1;
+    pool->classes[WORKER_CLASS_BATCH].stats.max_running = workers - reserved;
+  }
+
+  for (pool->workers = 0; pool->workers < workers; pool->workers++) {
+    if (pthread_create(&pool->threads[pool->workers], NULL, worker_main,
+                       pool) != 0) {
+      break;
+    }
+  }
+
+  if (pool->workers == 0) {
+    worker_pool_destroy(pool);
+    return NULL;
+  }
+  return pool;
+}
+
+int worker_pool_submit(worker_pool_t *pool, void *job, worker_class_t cls,
+                       uint64_t tenant, unsigned weight) {
+  pool_class_t *queue = &pool->classes[cls];
+  pool_task_t *task = malloc(sizeof(*task));
+  pool_flow_t *flow;
+  size_t bucket = flow_bucket(tenant);
+
+  if (!task) {
+    return -1;
+  }
+  task->job = job;
+  task->next = NULL;
+
+  pthread_mutex_lock(&pool->lock);
+  if (pool->stopping || queue->stats.queued >= queue->stats.capacity) {
+    queue->stats.rejected += !pool->stopping;
+    pthread_mutex_unlock(&pool->lock);
+    free(task);
+    return -1;
+  }
+
+  for (flow = queue->buckets[bucket]; flow && flow->tenant != tenant;
+       flow = flow->chain) {
+  }
+  if (!flow) {
+    flow = calloc(1, sizeof(*flow));
+    if (!flow) {
+      pthread_mutex_unlock(&pool->lock);
+      free(task);
+      return -1;
+    }
+    flow->tenant = tenant;
+    flow->chain = queue->buckets[bucket];
+    queue->buckets[bucket] = flow;
+
+    // A new flow joins at the end of the round
+    if (!queue->current) {
+      flow->next = flow->prev = flow;
+      queue->current = flow;
+    } else {
+      flow->next = queue->current;
+      flow->prev = queue->current->prev;
+      flow->prev->next = flow;
+      queue->current->prev = flow;
+    }
+    queue->stats.tenants++;
+  }
+  flow->weight = weight > 0 ? weight : 1;
+  if (flow->tail) {
+    flow->tail->next = task;
+  } else {
+    flow->head = task;
+  }
+  flow->tail = task;
+  queue->stats.queued++;
+  pool->queued++;
+  pthread_cond_signal(&pool->ready);
+  pthread_mutex_unlock(&pool->lock);
+
+  return 0;
+}
+
+int worker_pool_set_limits(worker_pool_t *pool, worker_class_t cls,
+                           size_t capacity, size_t max_running) {
+  if (capacity == 0 || max_running == 0 || max_running > pool->workers) {
+    return -1;
+  }
+  pthread_mutex_lock(&pool->lock);
+  pool->classes[cls].stats.capacity = capacity;
+  pool->classes[cls].stats.max_running = max_running;
+  pthread_cond_broadcast(&pool->ready);
+  pthread_mutex_unlock(&pool->lock);
+  return 0;
+}
+
+void worker_pool_class_stats(worker_pool_t *pool, worker_class_t cls,
+                             worker_class_stats_t *stats) {
+  pthread_mutex_lock(&pool->lock);
+  *stats = pool->classes[cls].stats;
+  pthread_mutex_unlock(&pool->lock);
+}
+
+const char *worker_pool_class_name(worker_class_t cls) {
+  return cls == WORKER_CLASS_BATCH ? "batch" : "interactive";
+}
+
+size_t worker_pool_queued(worker_pool_t *pool) {
+  size_t count;
+
+  pthread_mutex_lock(&pool->lock);
+  count = pool->queued;
+  pthread_mutex_unlock(&pool->lock);
+  return count;
+}
+
+size_t worker_pool_capacity(worker_pool_t *pool) {
+  size_t capacity = 0;
+
+  pthread_mutex_lock(&pool->lock);
+  for (size_t i = 0; i < WORKER_CLASS_COUNT; i++) {
+    capacity += pool->classes[i].stats.capacity;
+  }
+  pthread_mutex_unlock(&pool->lock);
+  return capacity;
+}
+
+size_t worker_pool_active(worker_pool_t *pool) {
+  size_t active;
+
+  pthread_mutex_lock(&pool->lock);
+  active = pool->active;
+  pthread_mutex_unlock(&pool->lock);
+  return active;
+}
+
+size_t worker_pool_size(worker_pool_t *pool) { return pool->workers; }
+
+void worker_pool_destroy(worker_pool_t *pool) {
+  size_t i;
+
+  if (!pool) {
+    return;
+  }
+
+  pthread_mutex_lock(&pool->lock);
+  pool->stopping = 1;
+  pthread_cond_broadcast(&pool->ready);
+  pthread_mutex_unlock(&pool->lock);
+
+  for (i = 0; i < pool->workers; i++) {
+    pthread_join(pool->threads[i], NULL);
+  }
+
+  pthread_cond_destroy(&pool->ready);
+  pthread_mutex_destroy(&pool->lock);
+  free(pool->threads);
+  free(pool);
+}
@@ -0,0 +1,166 @@
+/**
+ * @file worker_pool.h
+ * @brief Fixed-size worker thread pool fed by bounded, fairly shared queues
+ * @author Rares-Nicholas Popa & Adrian-Petru Enache
+ * @version 1.0.0
+ *
+ * @details The pool owns a fixed number of threads that pop opaque job
+ * pointers and pass them to a single handler function. Submission never
+ * blocks: when the queue is full the caller is told so and is expected to
+ * push back on the client instead of spawning more work.
+ *
+ * Every job belongs to a priority class and to a tenant. Classes have
+ * strict priority: a worker always takes an interactive job before a batch
+ * job. Each class has its own queue capacity and a limit on the workers
+ * running its jobs at once; by default batch jobs may not occupy the last
+ * quarter of the workers, which stay free for interactive jobs. Within a
+ * class the tenants are served by weighted round robin: a tenant with
+ * weight w gets w jobs started per round for every job of a weight 1
+ * tenant, so one tenant flooding its class only queues behind itself.
+ *
+ * @copyright This project is for educational purposes as part of the PCD
+ * course.
+ */
+
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Function executed by a worker thread for every dequeued job
+ *
+ * @param job The pointer that was passed to worker_pool_submit()
+ */
+typedef void (*worker_fn_t)(void *job);
+
+/**
+ * @enum worker_class_t
+ * @brief Priority classes, highest first
+ */
+typedef enum {
+  WORKER_CLASS_INTERACTIVE, /**< Short jobs a user is waiting for */
+  WORKER_CLASS_BATCH,       /**< Bulk work that soaks up spare capacity */
+  WORKER_CLASS_COUNT        /**< Number of classes */
+} worker_class_t;
+
+/**
+ * @struct worker_class_stats_t
+ * @brief Snapshot of one class, for STATUS and CLASSES
+ */
+typedef struct {
+  size_t queued;      /**< Jobs waiting */
+  size_t capacity;    /**< Jobs that may wait before submissions fail */
+  size_t running;     /**< Workers running a job of the class */
+  size_t max_running; /**< Limit on running */
+  size_t tenants;     /**< Tenants with jobs waiting */
+  uint64_t started;   /**< Jobs handed to a worker */
+  uint64_t rejected;  /**< Submissions refused because the queue was full */
+} worker_class_stats_t;
+
+/** @brief Opaque worker pool handle */
+typedef struct worker_pool worker_pool_t;
+
+/**
+ * @brief Create a pool and start its worker threads
+ *
+ * @param workers Number of worker threads (at least 1)
+ * @param capacity Maximum number of queued, not yet running jobs of each
+ *        class
+ * @param handler Function invoked for each job
+ *
+ * @return The new pool, or NULL if memory or threads could not be allocated
+ */
+worker_pool_t *worker_pool_create(size_t workers, size_t capacity,
+                                  worker_fn_t handler);
+
+/**
+ * @brief Queue a job without blocking
+ *
+ * @param pool Pool to submit to
+ * @param job Opaque job pointer handed to the handler
+ * @param cls Priority class
+ * @param tenant Identifier of the client the job is shared fairly for
+ * @param weight Share of the tenant within the class (at least 1)
+ *
+ * @return 0 if the job was queued, -1 if the class's queue is full or the
+ *         pool is shutting down (ownership of @p job stays with the caller)
+ */
+int worker_pool_submit(worker_pool_t *pool, void *job, worker_class_t cls,
+                       uint64_t tenant, unsigned weight);
+
+/**
+ * @brief Change the queue capacity and running limit of a class
+ *
+ * Lowering a limit affects new submissions and starts only: queued and
+ * running jobs are left alone.
+ *
+ * @param pool Pool to adjust
+ * @param cls Class to adjust
+ * @param capacity New queue capacity (at least 1)
+ * @param max_running New limit on its running jobs (1 to the pool size)
+ *
+ * @return 0 on success, -1 if a value is out of range
+ */
+int worker_pool_set_limits(worker_pool_t *pool, worker_class_t cls,
+                           size_t capacity, size_t max_running);
+
+/**
+ * @brief Read the state of a class
+ *
+ * @param pool Pool to inspect
+ * @param cls Class to inspect
+ * @param stats Receives the snapshot
+ */
+void worker_pool_class_stats(worker_pool_t *pool, worker_class_t cls,
+                             worker_class_stats_t *stats);
+
+/**
+ * @brief Name of a class, as used by the admin commands
+ *
+ * @param cls Class
+ * @return "interactive" or "batch"
+ */
+const char *worker_pool_class_name(worker_class_t cls);
+
+/**
+ * @brief Number of jobs currently waiting in the queues
+ *
+ * @param pool Pool to inspect
+ * @return Queue depth of all classes
+ */
+size_t worker_pool_queued(worker_pool_t *pool);
+
+/**
+ * @brief Total queue capacity
+ *
+ * @param pool Pool to inspect
+ * @return Sum of the classes' capacities
+ */
+size_t worker_pool_capacity(worker_pool_t *pool);
+
+/**
+ * @brief Number of workers currently executing a job
+ *
+ * @param pool Pool to inspect
+ * @return Busy worker count
+ */
+size_t worker_pool_active(worker_pool_t *pool);
+
+/**
+ * @brief Number of worker threads in the pool
+ *
+ * @param pool Pool to inspect
+ * @return Worker count
+ */
+size_t worker_pool_size(worker_pool_t *pool);
+
+/**
+ * @brief Stop accepting jobs, finish the queued ones and join all workers
+ *
+ * @param pool Pool to destroy (may be NULL)
+ */
+void worker_pool_destroy(worker_pool_t *pool);
+
+#endif /* WORKER_POOL_H */